@@ -0,0 +1,68 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * avs_bench -- benchmark harness
+ *
+ * A case allocates its state once in setup, and run executes
+ * n iterations on it. The state is released with mem_deref, so a
+ * case that needs cleanup gives its state a destructor. A case
+ * without setup gets its arg as state. The harness
+ * picks n so that each repetition runs for a fixed time.
+ */
+
+typedef int (bench_setup_h)(void **statep, const void *arg);
+typedef int (bench_run_h)(void *state, uint64_t n);
+
+struct bench_case {
+	const char *name;
+	const void *arg;
+	size_t bytes;           /* processed per iteration, 0 if n/a */
+	bench_setup_h *setup;   /* optional */
+	bench_run_h *run;
+};
+
+struct bench_suite {
+	const char *name;
+	const struct bench_case *casev;
+	size_t casec;
+};
+
+
+extern const struct bench_suite bench_suite_aueffect;
+extern const struct bench_suite bench_suite_aufanout;
+extern const struct bench_suite bench_suite_audio_file;
+extern const struct bench_suite bench_suite_bundle;
+extern const struct bench_suite bench_suite_conv_lookup;
+extern const struct bench_suite bench_suite_decbudget;
+extern const struct bench_suite bench_suite_econn;
+extern const struct bench_suite bench_suite_evq;
+extern const struct bench_suite bench_suite_frame_crypto;
+extern const struct bench_suite bench_suite_frame_hdr;
+extern const struct bench_suite bench_suite_jzon;
+extern const struct bench_suite bench_suite_keystore;
+extern const struct bench_suite bench_suite_membdelta;
+extern const struct bench_suite bench_suite_packet_queue;
+extern const struct bench_suite bench_suite_sdp;
+
+
+/* Keep the compiler from optimizing away a result */
+extern volatile uint64_t bench_sink;
+
+/* Shared test vectors */
+extern const char bench_sdp_offer[];
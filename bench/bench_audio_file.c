@@ -0,0 +1,208 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+/*
+ * Throughput of the offline effect file I/O on an hour long,
+ * 16 kHz mono recording. Most cases move one second of audio per
+ * iteration. The reverse case runs the whole converter per iteration.
+ */
+
+#define FS_HZ     16000
+#define SECONDS   3600
+#define SEC_SAMPS FS_HZ
+
+
+struct af_state {
+	char in[64];
+	char out[64];
+	struct audio_reader *ar;
+	struct audio_writer *aw;
+	enum audio_file_fmt fmt;
+	int16_t sec[SEC_SAMPS];
+	unsigned pos;      /* [seconds] */
+};
+
+
+static const enum audio_file_fmt wav = AUDIO_FILE_WAV;
+static const enum audio_file_fmt wav_float = AUDIO_FILE_WAV_FLOAT;
+
+
+static void destructor(void *arg)
+{
+	struct af_state *st = arg;
+
+	mem_deref(st->aw);
+	mem_deref(st->ar);
+
+	(void)unlink(st->in);
+	(void)unlink(st->out);
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	const enum audio_file_fmt *fmt = arg;
+	struct audio_writer *aw = NULL;
+	struct af_state *st;
+	unsigned i;
+	int err;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->fmt = fmt ? *fmt : AUDIO_FILE_WAV;
+
+	re_snprintf(st->in, sizeof(st->in), "/tmp/avs_bench_%d_in.wav",
+		    (int)getpid());
+	re_snprintf(st->out, sizeof(st->out), "/tmp/avs_bench_%d_out.wav",
+		    (int)getpid());
+
+	for (i = 0; i < SEC_SAMPS; i++)
+		st->sec[i] = (int16_t)(((i * 7919) & 0x3fff) - 0x2000);
+
+	err = audio_writer_open(&aw, st->in, AUDIO_FILE_WAV, FS_HZ, 1);
+	if (err)
+		goto out;
+
+	for (i = 0; i < SECONDS && !err; i++)
+		err = audio_writer_write(aw, st->sec, SEC_SAMPS);
+
+	if (!err)
+		err = audio_writer_close(aw);
+	if (err)
+		goto out;
+
+	err = audio_reader_open(&st->ar, st->in, AUDIO_FILE_WAV, 0);
+
+ out:
+	mem_deref(aw);
+
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+static int run_read(void *arg, uint64_t n, bool reverse)
+{
+	struct af_state *st = arg;
+	const int16_t *sampv;
+	uint64_t i, sum = 0;
+	size_t sampc;
+
+	sampv = audio_reader_samples(st->ar, &sampc);
+	if (sampc < SECONDS * SEC_SAMPS)
+		return EIO;
+
+	for (i = 0; i < n; i++) {
+		const unsigned sec = reverse ? SECONDS - 1 - st->pos : st->pos;
+		const int16_t *p = &sampv[sec * SEC_SAMPS];
+		size_t j;
+
+		for (j = 0; j < SEC_SAMPS; j++)
+			sum += (uint16_t)p[reverse ? SEC_SAMPS - 1 - j : j];
+
+		st->pos = (st->pos + 1) % SECONDS;
+	}
+
+	bench_sink += sum;
+
+	return 0;
+}
+
+
+static int run_read_fwd(void *arg, uint64_t n)
+{
+	return run_read(arg, n, false);
+}
+
+
+static int run_read_rev(void *arg, uint64_t n)
+{
+	return run_read(arg, n, true);
+}
+
+
+/* Start a new file once an hour has been written */
+static int run_write(void *arg, uint64_t n)
+{
+	struct af_state *st = arg;
+	uint64_t i;
+	int err = 0;
+
+	for (i = 0; i < n && !err; i++) {
+
+		if (!st->aw || st->pos == SECONDS) {
+			st->aw = mem_deref(st->aw);
+			st->pos = 0;
+
+			err = audio_writer_open(&st->aw, st->out, st->fmt,
+						FS_HZ, 1);
+			if (err)
+				break;
+		}
+
+		err = audio_writer_write(st->aw, st->sec, SEC_SAMPS);
+		++st->pos;
+	}
+
+	return err;
+}
+
+
+static int run_reverse(void *arg, uint64_t n)
+{
+	struct af_state *st = arg;
+	uint64_t i;
+	int err = 0;
+
+	for (i = 0; i < n && !err; i++) {
+		err = apply_effect_to_wav(st->in, st->out,
+					  AUDIO_EFFECT_REVERSE, false,
+					  NULL, NULL);
+	}
+
+	return err;
+}
+
+
+#define SEC_BYTES  (SEC_SAMPS * sizeof(int16_t))
+#define HOUR_BYTES (SECONDS * SEC_BYTES)
+
+static const struct bench_case casev[] = {
+	{"read_fwd_1h",    NULL,       SEC_BYTES,  setup, run_read_fwd},
+	{"read_rev_1h",    NULL,       SEC_BYTES,  setup, run_read_rev},
+	{"write_1h",       &wav,       SEC_BYTES,  setup, run_write},
+	{"write_float_1h", &wav_float, SEC_BYTES,  setup, run_write},
+	{"reverse_1h",     NULL,       HOUR_BYTES, setup, run_reverse},
+};
+
+const struct bench_suite bench_suite_audio_file = {
+	"audio_file", casev, ARRAY_SIZE(casev)
+};
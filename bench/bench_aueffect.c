@@ -0,0 +1,288 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+#define FS_HZ      32000  /* rate the effects are run at */
+#define FRAME_LEN  (FS_HZ / 100)
+#define NUM_FRAMES 50
+
+
+struct aue_state {
+	struct aueffect *aue;
+	int16_t *in;
+	int16_t out[4 * FRAME_LEN];
+	unsigned pos;
+};
+
+
+static const enum audio_effect chorus     = AUDIO_EFFECT_CHORUS_MED;
+static const enum audio_effect reverb     = AUDIO_EFFECT_REVERB_MID;
+static const enum audio_effect pitch_up   = AUDIO_EFFECT_PITCH_UP_SHIFT_MED;
+static const enum audio_effect pitch_down = AUDIO_EFFECT_PITCH_DOWN_SHIFT_MED;
+static const enum audio_effect pace_down  = AUDIO_EFFECT_PACE_DOWN_SHIFT_MED;
+static const enum audio_effect vocoder    = AUDIO_EFFECT_VOCODER_MED;
+static const enum audio_effect auto_tune  = AUDIO_EFFECT_AUTO_TUNE_MED;
+static const enum audio_effect harmonizer = AUDIO_EFFECT_HARMONIZER_MED;
+static const enum audio_effect normalizer = AUDIO_EFFECT_NORMALIZER;
+
+
+static void destructor(void *arg)
+{
+	struct aue_state *st = arg;
+
+	mem_deref(st->aue);
+	mem_deref(st->in);
+}
+
+
+/* A voiced, slowly gliding signal, so the pitch based effects work */
+static void signal_fill(int16_t *sampv, size_t sampc)
+{
+	double phase = 0;
+	size_t i;
+
+	for (i = 0; i < sampc; i++) {
+		const double f0 = 140.0 + 40.0 * i / sampc;
+
+		phase += 2 * M_PI * f0 / FS_HZ;
+
+		sampv[i] = (int16_t)(6000 * sin(phase)
+				     + 3000 * sin(2 * phase)
+				     + 1500 * sin(3 * phase));
+	}
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	const enum audio_effect *effect = arg;
+	struct aue_state *st;
+	int err;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->in = mem_alloc(NUM_FRAMES * FRAME_LEN * sizeof(*st->in), NULL);
+	if (!st->in) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	signal_fill(st->in, NUM_FRAMES * FRAME_LEN);
+
+	err = aueffect_alloc(&st->aue, *effect, FS_HZ);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+/* One iteration is one 10ms frame */
+static int run_process(void *arg, uint64_t n)
+{
+	struct aue_state *st = arg;
+	uint64_t i;
+	size_t outc = 0;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		const int16_t *in = &st->in[st->pos * FRAME_LEN];
+
+		err = aueffect_process(st->aue, in, st->out,
+				       FRAME_LEN, &outc);
+		if (err)
+			return EIO;
+
+		st->pos = (st->pos + 1) % NUM_FRAMES;
+	}
+
+	bench_sink += outc;
+
+	return 0;
+}
+
+
+/*
+ * Combined effects, run one after the other with each doing its own
+ * pitch analysis, or as an aueffect_chain where they share one.
+ */
+struct combo {
+	enum audio_effect effectv[AUEFFECT_CHAIN_MAX];
+	size_t effectc;
+	bool chain;
+};
+
+struct combo_state {
+	struct aueffect *auev[AUEFFECT_CHAIN_MAX];
+	size_t auec;
+	struct aueffect_chain *chain;
+	int16_t *in;
+	int16_t bufv[2][FRAME_LEN];
+	unsigned pos;
+};
+
+
+static const struct combo tune_harm = {
+	{AUDIO_EFFECT_AUTO_TUNE_MED, AUDIO_EFFECT_HARMONIZER_MED}, 2, false
+};
+static const struct combo tune_harm_chain = {
+	{AUDIO_EFFECT_AUTO_TUNE_MED, AUDIO_EFFECT_HARMONIZER_MED}, 2, true
+};
+static const struct combo tune_voc = {
+	{AUDIO_EFFECT_AUTO_TUNE_MED, AUDIO_EFFECT_VOCODER_MED}, 2, false
+};
+static const struct combo tune_voc_chain = {
+	{AUDIO_EFFECT_AUTO_TUNE_MED, AUDIO_EFFECT_VOCODER_MED}, 2, true
+};
+
+
+static void combo_destructor(void *arg)
+{
+	struct combo_state *st = arg;
+	size_t i;
+
+	for (i = 0; i < st->auec; i++)
+		mem_deref(st->auev[i]);
+	mem_deref(st->chain);
+	mem_deref(st->in);
+}
+
+
+static int combo_setup(void **statep, const void *arg)
+{
+	const struct combo *combo = arg;
+	struct combo_state *st;
+	int err = 0;
+
+	st = mem_zalloc(sizeof(*st), combo_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->in = mem_alloc(NUM_FRAMES * FRAME_LEN * sizeof(*st->in), NULL);
+	if (!st->in) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	signal_fill(st->in, NUM_FRAMES * FRAME_LEN);
+
+	if (combo->chain) {
+		/* a budget that never bypasses */
+		err = aueffect_chain_alloc(&st->chain, FS_HZ, 1000000);
+		if (err)
+			goto out;
+
+		err = aueffect_chain_set(st->chain, combo->effectv,
+					 combo->effectc);
+		goto out;
+	}
+
+	for (st->auec = 0; st->auec < combo->effectc; st->auec++) {
+		err = aueffect_alloc(&st->auev[st->auec],
+				     combo->effectv[st->auec], FS_HZ);
+		if (err)
+			goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+/* One iteration is one 10ms frame through all the effects */
+static int run_combo(void *arg, uint64_t n)
+{
+	struct combo_state *st = arg;
+	uint64_t i;
+	size_t j, outc = 0;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		const int16_t *in = &st->in[st->pos * FRAME_LEN];
+
+		if (st->chain) {
+			memcpy(st->bufv[0], in, sizeof(st->bufv[0]));
+
+			err = aueffect_chain_process(st->chain, st->bufv[0],
+						     FRAME_LEN);
+			if (err)
+				return EIO;
+		}
+
+		for (j = 0; j < st->auec; j++) {
+			err = aueffect_process(st->auev[j], in,
+					       st->bufv[j & 1], FRAME_LEN,
+					       &outc);
+			if (err)
+				return EIO;
+
+			in = st->bufv[j & 1];
+		}
+
+		st->pos = (st->pos + 1) % NUM_FRAMES;
+	}
+
+	bench_sink += outc + st->bufv[0][0];
+
+	return 0;
+}
+
+
+#define FRAME_BYTES (FRAME_LEN * sizeof(int16_t))
+
+static const struct bench_case casev[] = {
+	{"chorus",     &chorus,     FRAME_BYTES, setup, run_process},
+	{"reverb",     &reverb,     FRAME_BYTES, setup, run_process},
+	{"pitch_up",   &pitch_up,   FRAME_BYTES, setup, run_process},
+	{"pitch_down", &pitch_down, FRAME_BYTES, setup, run_process},
+	{"pace_down",  &pace_down,  FRAME_BYTES, setup, run_process},
+	{"vocoder",    &vocoder,    FRAME_BYTES, setup, run_process},
+	{"auto_tune",  &auto_tune,  FRAME_BYTES, setup, run_process},
+	{"harmonizer", &harmonizer, FRAME_BYTES, setup, run_process},
+	{"normalizer", &normalizer, FRAME_BYTES, setup, run_process},
+
+	{"tune>harm",       &tune_harm,       FRAME_BYTES,
+	 combo_setup, run_combo},
+	{"tune>harm_chain", &tune_harm_chain, FRAME_BYTES,
+	 combo_setup, run_combo},
+	{"tune>voc",        &tune_voc,        FRAME_BYTES,
+	 combo_setup, run_combo},
+	{"tune>voc_chain",  &tune_voc_chain,  FRAME_BYTES,
+	 combo_setup, run_combo},
+};
+
+const struct bench_suite bench_suite_aueffect = {
+	"aueffect", casev, ARRAY_SIZE(casev)
+};
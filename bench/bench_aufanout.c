@@ -0,0 +1,263 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <avs.h>
+#include <opus.h>
+#include "bench.h"
+
+
+/*
+ * Mesh call send path with the real Opus encoder, as configured for
+ * group calls: one encoder per peer versus one shared via aufanout.
+ * One iteration is one 10ms chunk sent to all peers.
+ */
+
+#define FS_HZ        48000
+#define SAMPC        (FS_HZ / 100)
+#define PTIME_CHUNKS 4         /* 40ms packets, GROUP_PTIME */
+#define BITRATE      32000
+#define MAX_PACKET   1500
+#define MAX_PEERS    8
+#define NUM_CHUNKS   100
+
+
+struct opus_enc {
+	OpusEncoder *enc;
+	int16_t buf[SAMPC * PTIME_CHUNKS];
+	unsigned nchunks;
+};
+
+struct mesh {
+	unsigned npeers;
+	bool shared;
+};
+
+struct mesh_state {
+	struct opus_enc encv[MAX_PEERS];
+	struct aufanout *af;
+	struct aufanout_sink *sinkv[MAX_PEERS];
+	unsigned npeers;
+	int16_t *in;
+	unsigned pos;
+};
+
+
+static const struct mesh private_1 = {1, false};
+static const struct mesh private_2 = {2, false};
+static const struct mesh private_4 = {4, false};
+static const struct mesh private_8 = {8, false};
+static const struct mesh shared_1  = {1, true};
+static const struct mesh shared_2  = {2, true};
+static const struct mesh shared_4  = {4, true};
+static const struct mesh shared_8  = {8, true};
+
+
+static int opus_encode_handler(uint8_t *dst, size_t *lenp,
+			       struct aufanout_meta *meta,
+			       const int16_t *sampv, size_t sampc,
+			       void *arg)
+{
+	struct opus_enc *oe = arg;
+	opus_int32 n;
+	(void)meta;
+
+	memcpy(&oe->buf[oe->nchunks * SAMPC], sampv,
+	       sampc * sizeof(*sampv));
+	if (++oe->nchunks < PTIME_CHUNKS) {
+		*lenp = 0;
+		return 0;
+	}
+
+	oe->nchunks = 0;
+
+	n = opus_encode(oe->enc, oe->buf, SAMPC * PTIME_CHUNKS,
+			dst, (opus_int32)*lenp);
+	if (n < 0)
+		return EPROTO;
+
+	*lenp = n;
+
+	return 0;
+}
+
+
+static void destructor(void *arg)
+{
+	struct mesh_state *st = arg;
+	unsigned i;
+
+	for (i = 0; i < MAX_PEERS; i++) {
+		mem_deref(st->sinkv[i]);
+		if (st->encv[i].enc)
+			opus_encoder_destroy(st->encv[i].enc);
+	}
+
+	mem_deref(st->af);
+	mem_deref(st->in);
+}
+
+
+/* Speech-like input, so Opus does not fall back to DTX */
+static void signal_fill(int16_t *sampv, size_t sampc)
+{
+	double phase = 0;
+	size_t i;
+
+	for (i = 0; i < sampc; i++) {
+		const double f0 = 120.0 + 60.0 * sin(2 * M_PI * i / FS_HZ);
+
+		phase += 2 * M_PI * f0 / FS_HZ;
+
+		sampv[i] = (int16_t)(5000 * sin(phase)
+				     + 2500 * sin(3 * phase)
+				     + (rand_u16() & 0x3ff) - 0x200);
+	}
+}
+
+
+static int enc_alloc(struct opus_enc *oe)
+{
+	int err;
+
+	oe->enc = opus_encoder_create(FS_HZ, 1, OPUS_APPLICATION_VOIP, &err);
+	if (!oe->enc)
+		return ENOMEM;
+
+	opus_encoder_ctl(oe->enc, OPUS_SET_BITRATE(BITRATE));
+	opus_encoder_ctl(oe->enc, OPUS_SET_INBAND_FEC(1));
+	opus_encoder_ctl(oe->enc, OPUS_SET_PACKET_LOSS_PERC(10));
+
+	return 0;
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	const struct mesh *mesh = arg;
+	struct mesh_state *st;
+	unsigned p;
+	int err = 0;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->npeers = mesh->npeers;
+
+	st->in = mem_alloc(NUM_CHUNKS * SAMPC * sizeof(*st->in), NULL);
+	if (!st->in) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	signal_fill(st->in, NUM_CHUNKS * SAMPC);
+
+	/* before: one encoder per peer, called directly */
+	if (!mesh->shared) {
+		for (p = 0; p < st->npeers; p++) {
+			err = enc_alloc(&st->encv[p]);
+			if (err)
+				goto out;
+		}
+		goto out;
+	}
+
+	/* after: one encoder, one aufanout sink per peer */
+	err = enc_alloc(&st->encv[0]);
+	if (err)
+		goto out;
+
+	err = aufanout_alloc(&st->af, SAMPC, MAX_PACKET,
+			     opus_encode_handler, &st->encv[0]);
+	if (err)
+		goto out;
+
+	for (p = 0; p < st->npeers; p++) {
+		err = aufanout_sink_alloc(&st->sinkv[p], st->af);
+		if (err)
+			goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+static int run(void *arg, uint64_t n)
+{
+	struct mesh_state *st = arg;
+	uint8_t pkt[MAX_PACKET];
+	size_t len = 0;
+	uint64_t i;
+	unsigned p;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		const int16_t *sampv = &st->in[st->pos * SAMPC];
+
+		for (p = 0; p < st->npeers; p++) {
+			struct aufanout_meta meta;
+
+			len = sizeof(pkt);
+
+			if (st->af) {
+				err = aufanout_encode(st->sinkv[p], pkt, &len,
+						      &meta, sampv, SAMPC);
+			}
+			else {
+				err = opus_encode_handler(pkt, &len, &meta,
+							  sampv, SAMPC,
+							  &st->encv[p]);
+			}
+			if (err)
+				return err;
+		}
+
+		st->pos = (st->pos + 1) % NUM_CHUNKS;
+	}
+
+	bench_sink += len;
+
+	return 0;
+}
+
+
+#define CHUNK_BYTES (SAMPC * sizeof(int16_t))
+
+static const struct bench_case casev[] = {
+	{"private_1", &private_1, CHUNK_BYTES, setup, run},
+	{"private_2", &private_2, CHUNK_BYTES, setup, run},
+	{"private_4", &private_4, CHUNK_BYTES, setup, run},
+	{"private_8", &private_8, CHUNK_BYTES, setup, run},
+	{"shared_1",  &shared_1,  CHUNK_BYTES, setup, run},
+	{"shared_2",  &shared_2,  CHUNK_BYTES, setup, run},
+	{"shared_4",  &shared_4,  CHUNK_BYTES, setup, run},
+	{"shared_8",  &shared_8,  CHUNK_BYTES, setup, run},
+};
+
+const struct bench_suite bench_suite_aufanout = {
+	"aufanout", casev, ARRAY_SIZE(casev)
+};
@@ -0,0 +1,142 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+struct bundle_state {
+	struct list membl;
+	struct bundle_cache *bc;
+};
+
+struct roster {
+	uint32_t memberc;
+	bool cached;
+};
+
+
+static void state_destructor(void *arg)
+{
+	struct bundle_state *st = arg;
+
+	mem_deref(st->bc);
+	list_flush(&st->membl);
+}
+
+
+/* An SFU roster, every other member sends video */
+static int setup(void **statep, const void *arg)
+{
+	const struct roster *roster = arg;
+	struct bundle_state *st;
+	char *sdp = NULL;
+	uint32_t i;
+	int err = 0;
+
+	st = mem_zalloc(sizeof(*st), state_destructor);
+	if (!st)
+		return ENOMEM;
+
+	for (i = 0; i < roster->memberc; i++) {
+		struct conf_member *cm;
+		char userid[32], label[32];
+
+		re_snprintf(userid, sizeof(userid), "user-%u", i);
+		re_snprintf(label, sizeof(label), "label-%u", i);
+
+		err = conf_member_alloc(&cm, &st->membl, NULL, userid,
+					"client", "hash",
+					0x10000 + i, i % 2 ? 0x20000 + i : 0,
+					label);
+		if (err)
+			goto out;
+	}
+
+	if (roster->cached) {
+		err = bundle_cache_alloc(&st->bc);
+		if (err)
+			goto out;
+
+		/* warm up the cache with the full roster */
+		err = bundle_generate(st->bc, &sdp, ICALL_CONV_TYPE_CONFERENCE,
+				      true, bench_sdp_offer, &st->membl);
+		mem_deref(sdp);
+	}
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+/*
+ * One roster change per update, as when a participant mutes or
+ * drops out of a large call.
+ */
+static int run_update(void *arg, uint64_t n)
+{
+	struct bundle_state *st = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		struct conf_member *cm;
+		char *sdp = NULL;
+
+		cm = list_ledata(list_head(&st->membl));
+		cm->active = !cm->active;
+
+		err = bundle_generate(st->bc, &sdp,
+				      ICALL_CONV_TYPE_CONFERENCE,
+				      true, bench_sdp_offer, &st->membl);
+		if (err)
+			return err;
+
+		bench_sink += str_len(sdp);
+		mem_deref(sdp);
+	}
+
+	return 0;
+}
+
+
+static const struct roster full_100 = {100, false};
+static const struct roster full_300 = {300, false};
+static const struct roster full_500 = {500, false};
+static const struct roster incr_100 = {100, true};
+static const struct roster incr_300 = {300, true};
+static const struct roster incr_500 = {500, true};
+
+static const struct bench_case casev[] = {
+	{"full_100", &full_100, 0, setup, run_update},
+	{"full_300", &full_300, 0, setup, run_update},
+	{"full_500", &full_500, 0, setup, run_update},
+	{"incr_100", &incr_100, 0, setup, run_update},
+	{"incr_300", &incr_300, 0, setup, run_update},
+	{"incr_500", &incr_500, 0, setup, run_update},
+};
+
+const struct bench_suite bench_suite_bundle = {
+	"bundle", casev, ARRAY_SIZE(casev)
+};
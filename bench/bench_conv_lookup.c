@@ -0,0 +1,201 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <pthread.h>
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+/*
+ * Many app threads looking up conversations of one calling instance
+ * at the same time, as a bot or gateway does through the wcall API.
+ * The locked case is the lock and list walk that wcall_lookup used
+ * before the lookups went through a cdict.
+ */
+
+#define NUM_CONVS   16
+#define MAX_THREADS 16
+
+
+struct conv {
+	struct le le;
+	char convid[40];
+};
+
+struct lookup_param {
+	unsigned threads;
+	bool locked;
+};
+
+struct lookup_state {
+	const struct lookup_param *prm;
+	struct cdict *cd;
+	struct lock *lock;
+	struct list convl;
+	struct conv convv[NUM_CONVS];
+};
+
+struct worker {
+	struct lookup_state *st;
+	uint64_t n;
+	unsigned seed;
+	uint64_t found;
+};
+
+
+static void destructor(void *arg)
+{
+	struct lookup_state *st = arg;
+
+	mem_deref(st->cd);
+	mem_deref(st->lock);
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	struct lookup_state *st;
+	int i, err;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->prm = arg;
+
+	err  = cdict_alloc(&st->cd);
+	err |= lock_alloc(&st->lock);
+	if (err)
+		goto out;
+
+	for (i = 0; i < NUM_CONVS; i++) {
+		struct conv *conv = &st->convv[i];
+
+		re_snprintf(conv->convid, sizeof(conv->convid),
+			    "a7f2c1d0-5b3e-4c9a-8e6f-%012d", i);
+
+		list_append(&st->convl, &conv->le, conv);
+		err = cdict_add(st->cd, conv->convid, conv);
+		if (err)
+			goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+static struct conv *locked_lookup(struct lookup_state *st,
+				  const char *convid)
+{
+	struct conv *conv = NULL;
+	struct le *le;
+
+	lock_write_get(st->lock);
+	for (le = st->convl.head; le; le = le->next) {
+		if (streq(convid, ((struct conv *)le->data)->convid)) {
+			conv = le->data;
+			break;
+		}
+	}
+	lock_rel(st->lock);
+
+	return conv;
+}
+
+
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	struct lookup_state *st = w->st;
+	uint64_t i;
+
+	for (i = 0; i < w->n; i++) {
+		const char *convid;
+		struct conv *conv;
+
+		w->seed = w->seed * 1103515245 + 12345;
+		convid = st->convv[(w->seed >> 16) % NUM_CONVS].convid;
+
+		if (st->prm->locked)
+			conv = locked_lookup(st, convid);
+		else
+			conv = cdict_lookup(st->cd, convid);
+
+		w->found += conv != NULL;
+	}
+
+	return NULL;
+}
+
+
+/* n lookups in total, spread over the threads */
+static int run_lookup(void *arg, uint64_t n)
+{
+	struct lookup_state *st = arg;
+	const unsigned threads = st->prm->threads;
+	struct worker workerv[MAX_THREADS];
+	pthread_t tidv[MAX_THREADS];
+	unsigned i;
+	int err = 0;
+
+	for (i = 0; i < threads; i++) {
+		workerv[i].st = st;
+		workerv[i].n = n / threads + (i < n % threads);
+		workerv[i].seed = i;
+		workerv[i].found = 0;
+
+		err = pthread_create(&tidv[i], NULL, worker_thread,
+				     &workerv[i]);
+		if (err)
+			break;
+	}
+
+	while (i--) {
+		pthread_join(tidv[i], NULL);
+		bench_sink += workerv[i].found;
+	}
+
+	return err;
+}
+
+
+static const struct lookup_param locked_1  = {1,  true};
+static const struct lookup_param locked_4  = {4,  true};
+static const struct lookup_param locked_16 = {16, true};
+static const struct lookup_param cdict_1   = {1,  false};
+static const struct lookup_param cdict_4   = {4,  false};
+static const struct lookup_param cdict_16  = {16, false};
+
+static const struct bench_case casev[] = {
+	{"locked_1t",  &locked_1,  0, setup, run_lookup},
+	{"locked_4t",  &locked_4,  0, setup, run_lookup},
+	{"locked_16t", &locked_16, 0, setup, run_lookup},
+	{"cdict_1t",   &cdict_1,   0, setup, run_lookup},
+	{"cdict_4t",   &cdict_4,   0, setup, run_lookup},
+	{"cdict_16t",  &cdict_16,  0, setup, run_lookup},
+};
+
+const struct bench_suite bench_suite_conv_lookup = {
+	"conv_lookup", casev, ARRAY_SIZE(casev)
+};
@@ -0,0 +1,259 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <re.h>
+#include <avs.h>
+#include <opus.h>
+#include "bench.h"
+
+
+/*
+ * Receive side of a group call with the real Opus decoder: every
+ * stream decoded, versus the decode budget. A stream outside the
+ * budget is not free -- its decoder gets the level frame and runs
+ * loss concealment. One iteration is one 20ms frame of all streams.
+ */
+
+#define FS_HZ        48000
+#define SAMPC        (FS_HZ / 50)
+#define BITRATE      32000
+#define MAX_PACKET   1500
+#define MAX_STREAMS  100
+#define NUM_PACKETS  50
+#define TALKERS      3
+#define TURN_FRAMES  150       /* 3s turns */
+#define LEVEL_FRAMES 10        /* levels are polled every 200ms */
+
+
+struct call {
+	unsigned nstreams;
+	uint32_t budget;       /* 0 decodes all */
+};
+
+struct call_state {
+	OpusDecoder *decv[MAX_STREAMS];
+	struct decbudget *db;
+	struct decbudget_ent *entv[MAX_STREAMS];
+	unsigned nstreams;
+
+	uint8_t pktv[NUM_PACKETS][MAX_PACKET];
+	size_t lenv[NUM_PACKETS];
+
+	uint64_t now;
+	unsigned frame;
+};
+
+
+static const struct call all_5    = {  5, 0};
+static const struct call all_25   = { 25, 0};
+static const struct call all_100  = {100, 0};
+static const struct call top4_5   = {  5, 4};
+static const struct call top4_25  = { 25, 4};
+static const struct call top4_100 = {100, 4};
+
+
+static void destructor(void *arg)
+{
+	struct call_state *st = arg;
+	unsigned i;
+
+	for (i = 0; i < MAX_STREAMS; i++) {
+		mem_deref(st->entv[i]);
+		if (st->decv[i])
+			opus_decoder_destroy(st->decv[i]);
+	}
+
+	mem_deref(st->db);
+}
+
+
+/* Speech-like input, so Opus does not fall back to DTX */
+static void signal_fill(int16_t *sampv, size_t sampc, size_t offset,
+			double *phase)
+{
+	size_t i;
+
+	for (i = 0; i < sampc; i++) {
+		const double t = (double)(offset + i) / FS_HZ;
+		const double f0 = 120.0 + 60.0 * sin(2 * M_PI * t);
+
+		*phase += 2 * M_PI * f0 / FS_HZ;
+
+		sampv[i] = (int16_t)(5000 * sin(*phase)
+				     + 2500 * sin(3 * *phase)
+				     + (rand_u16() & 0x3ff) - 0x200);
+	}
+}
+
+
+/* The same packets are sent by every stream */
+static int packets_encode(struct call_state *st)
+{
+	OpusEncoder *enc;
+	int16_t sampv[SAMPC];
+	double phase = 0;
+	unsigned i;
+	int err = 0;
+
+	enc = opus_encoder_create(FS_HZ, 1, OPUS_APPLICATION_VOIP, &err);
+	if (!enc)
+		return ENOMEM;
+
+	opus_encoder_ctl(enc, OPUS_SET_BITRATE(BITRATE));
+
+	for (i = 0; i < NUM_PACKETS; i++) {
+		opus_int32 n;
+
+		signal_fill(sampv, SAMPC, i * SAMPC, &phase);
+
+		n = opus_encode(enc, sampv, SAMPC,
+				st->pktv[i], sizeof(st->pktv[i]));
+		if (n <= 0) {
+			err = EPROTO;
+			break;
+		}
+
+		st->lenv[i] = n;
+	}
+
+	opus_encoder_destroy(enc);
+
+	return err;
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	const struct call *call = arg;
+	struct call_state *st;
+	unsigned i;
+	int err;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->nstreams = call->nstreams;
+	st->now = 10000;
+
+	err = packets_encode(st);
+	if (err)
+		goto out;
+
+	err = decbudget_alloc(&st->db, call->budget);
+	if (err)
+		goto out;
+
+	for (i = 0; i < st->nstreams; i++) {
+
+		st->decv[i] = opus_decoder_create(FS_HZ, 1, &err);
+		if (!st->decv[i]) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		err = decbudget_ent_alloc(&st->entv[i], st->db, NULL);
+		if (err)
+			goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+static int run(void *arg, uint64_t n)
+{
+	struct call_state *st = arg;
+	opus_int16 pcm[SAMPC];
+	uint8_t lvl[2];
+	uint64_t i;
+	unsigned s;
+	int r = 0;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		const unsigned f = st->frame++;
+		const unsigned p = f % NUM_PACKETS;
+		const unsigned talker = (f / TURN_FRAMES) % TALKERS;
+
+		st->now += 20;
+
+		for (s = 0; s < st->nstreams; s++) {
+			const uint8_t *pkt = st->pktv[p];
+			size_t len = st->lenv[p];
+
+			if (f % LEVEL_FRAMES == 0) {
+				uint8_t level;
+
+				if (s < TALKERS)
+					level = s == talker ? 120 : 20;
+				else
+					level = (uint8_t)(s % 3);
+
+				decbudget_ent_set_level(st->entv[s], level);
+			}
+
+			/* what the receive path hands a pruned stream */
+			if (!decbudget_ent_decoding(st->entv[s])) {
+				size_t lvlc = sizeof(lvl);
+
+				err = decbudget_level_frame(lvl, &lvlc,
+							    pkt, len);
+				if (err)
+					return err;
+
+				pkt = lvl;
+				len = lvlc;
+			}
+
+			r = opus_decode(st->decv[s], pkt, (opus_int32)len,
+					pcm, SAMPC, 0);
+			if (r < 0)
+				return EPROTO;
+		}
+
+		if (f % LEVEL_FRAMES == 0)
+			decbudget_update(st->db, st->now);
+	}
+
+	bench_sink += (uint64_t)r;
+
+	return 0;
+}
+
+
+static const struct bench_case casev[] = {
+	{"all_5",    &all_5,    0, setup, run},
+	{"all_25",   &all_25,   0, setup, run},
+	{"all_100",  &all_100,  0, setup, run},
+	{"top4_5",   &top4_5,   0, setup, run},
+	{"top4_25",  &top4_25,  0, setup, run},
+	{"top4_100", &top4_100, 0, setup, run},
+};
+
+const struct bench_suite bench_suite_decbudget = {
+	"decbudget", casev, ARRAY_SIZE(casev)
+};
@@ -0,0 +1,192 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+struct msg_state {
+	struct econn_message *msg;
+	char *str;
+	size_t len;
+};
+
+
+static void destructor(void *arg)
+{
+	struct msg_state *st = arg;
+
+	mem_deref(st->str);
+	mem_deref(st->msg);
+}
+
+
+static struct econn_message *msg_new(enum econn_msg type)
+{
+	struct econn_message *msg;
+
+	msg = econn_message_alloc();
+	if (!msg)
+		return NULL;
+
+	econn_message_init(msg, type, "sess-A");
+	str_ncpy(msg->src_userid, "9a7b2f4e-user", sizeof(msg->src_userid));
+	str_ncpy(msg->src_clientid, "c1a2b3", sizeof(msg->src_clientid));
+
+	return msg;
+}
+
+
+static struct econn_message *msg_setup(void)
+{
+	struct econn_message *msg = msg_new(ECONN_SETUP);
+
+	if (!msg)
+		return NULL;
+
+	str_dup(&msg->u.setup.sdp_msg, bench_sdp_offer);
+	str_dup(&msg->u.setup.url, "https://sft.example.com/sft/");
+	econn_props_alloc(&msg->u.setup.props, NULL);
+	econn_props_add(msg->u.setup.props, "videosend", "true");
+	econn_props_add(msg->u.setup.props, "screensend", "false");
+
+	return msg;
+}
+
+
+static struct econn_message *msg_confconn(void)
+{
+	struct econn_message *msg = msg_new(ECONN_CONF_CONN);
+	struct zapi_ice_server *turnv;
+
+	if (!msg)
+		return NULL;
+
+	turnv = mem_zalloc(2 * sizeof(*turnv), NULL);
+	if (!turnv) {
+		mem_deref(msg);
+		return NULL;
+	}
+
+	str_ncpy(turnv[0].url, "turn:1.2.3.4:3478", sizeof(turnv[0].url));
+	str_ncpy(turnv[0].username, "user", sizeof(turnv[0].username));
+	str_ncpy(turnv[0].credential, "secret",
+		 sizeof(turnv[0].credential));
+	str_ncpy(turnv[1].url, "turns:turn.example.com:443?transport=tcp",
+		 sizeof(turnv[1].url));
+
+	msg->u.confconn.turnv = turnv;
+	msg->u.confconn.turnc = 2;
+	msg->u.confconn.update = true;
+	str_dup(&msg->u.confconn.tool, "avs");
+	str_dup(&msg->u.confconn.toolver, "7.1.local");
+	msg->u.confconn.status = ECONN_CONFCONN_OK;
+	msg->u.confconn.selective_audio = true;
+	msg->u.confconn.vstreams = 9;
+
+	return msg;
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	const enum econn_msg *type = arg;
+	struct msg_state *st;
+	int err;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->msg = (*type == ECONN_SETUP) ? msg_setup() : msg_confconn();
+	if (!st->msg) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = econn_message_encode(&st->str, st->msg);
+	if (err)
+		goto out;
+
+	st->len = str_len(st->str);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+static int run_encode(void *arg, uint64_t n)
+{
+	struct msg_state *st = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		char *str;
+
+		err = econn_message_encode(&str, st->msg);
+		if (err)
+			return err;
+
+		bench_sink += str_len(str);
+		mem_deref(str);
+	}
+
+	return 0;
+}
+
+
+static int run_decode(void *arg, uint64_t n)
+{
+	struct msg_state *st = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		struct econn_message *msg;
+
+		err = econn_message_decode(&msg, 0, 0, st->str, st->len);
+		if (err)
+			return err;
+
+		mem_deref(msg);
+	}
+
+	return 0;
+}
+
+
+static const enum econn_msg type_setup = ECONN_SETUP;
+static const enum econn_msg type_confconn = ECONN_CONF_CONN;
+
+static const struct bench_case casev[] = {
+	{"encode_setup",    &type_setup,    0, setup, run_encode},
+	{"decode_setup",    &type_setup,    0, setup, run_decode},
+	{"encode_confconn", &type_confconn, 0, setup, run_encode},
+	{"decode_confconn", &type_confconn, 0, setup, run_decode},
+};
+
+const struct bench_suite bench_suite_econn = {
+	"econn", casev, ARRAY_SIZE(casev)
+};
@@ -0,0 +1,219 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+/*
+ * Event throughput of the sharded runtime: flow events pushed from
+ * one WebRTC-like thread to the instances, spread over 1 to 4 AVS
+ * threads. Each event does some work on its owner, as handling a
+ * flow event does. One iteration is one event handled.
+ */
+
+#define MAX_OWNERS 4
+#define WORK_BYTES 4096
+
+enum {
+	EV_WORK = 1,
+	EV_STOP,
+};
+
+struct owner {
+	pthread_t tid;
+	struct avs_evq *evq;
+	uint8_t buf[WORK_BYTES];
+	uint64_t sum;
+	uint64_t handled;
+	int ready;
+};
+
+struct evq_state {
+	struct owner ownerv[MAX_OWNERS];
+	unsigned ownerc;
+};
+
+
+static const unsigned owners_1 = 1;
+static const unsigned owners_2 = 2;
+static const unsigned owners_4 = 4;
+
+
+static void evq_handler(int id, void *data, void *arg)
+{
+	struct owner *ow = data;
+
+	(void)arg;
+
+	switch (id) {
+
+	case EV_WORK:
+		ow->sum += hash_fast((char *)ow->buf, sizeof(ow->buf));
+		__atomic_add_fetch(&ow->handled, 1, __ATOMIC_RELEASE);
+		break;
+
+	case EV_STOP:
+		re_cancel();
+		break;
+	}
+}
+
+
+static void *owner_thread(void *arg)
+{
+	struct owner *ow = arg;
+	int err;
+
+	err = re_thread_init();
+	if (err)
+		goto out;
+
+	err = avs_evq_get(&ow->evq, evq_handler);
+	if (err) {
+		re_thread_close();
+		goto out;
+	}
+
+	__atomic_store_n(&ow->ready, 1, __ATOMIC_RELEASE);
+
+	re_main(NULL);
+
+	ow->evq = mem_deref(ow->evq);
+	re_thread_close();
+
+ out:
+	if (err)
+		__atomic_store_n(&ow->ready, -1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+
+static void destructor(void *arg)
+{
+	struct evq_state *st = arg;
+	unsigned i;
+
+	for (i = 0; i < st->ownerc; i++) {
+		struct owner *ow = &st->ownerv[i];
+
+		if (__atomic_load_n(&ow->ready, __ATOMIC_ACQUIRE) > 0)
+			avs_evq_push(ow->evq, EV_STOP, ow);
+
+		pthread_join(ow->tid, NULL);
+	}
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	const unsigned *ownerc = arg;
+	struct evq_state *st;
+	unsigned i;
+	int err = 0;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	for (i = 0; i < *ownerc; i++) {
+		struct owner *ow = &st->ownerv[i];
+		int ready;
+
+		rand_bytes(ow->buf, sizeof(ow->buf));
+
+		err = pthread_create(&ow->tid, NULL, owner_thread, ow);
+		if (err)
+			goto out;
+
+		++st->ownerc;
+
+		while (!(ready = __atomic_load_n(&ow->ready,
+						 __ATOMIC_ACQUIRE))) {
+			usleep(1000);
+		}
+		if (ready < 0) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+static uint64_t handled(const struct evq_state *st)
+{
+	uint64_t n = 0;
+	unsigned i;
+
+	for (i = 0; i < st->ownerc; i++)
+		n += __atomic_load_n(&st->ownerv[i].handled, __ATOMIC_ACQUIRE);
+
+	return n;
+}
+
+
+/* Push n events round-robin, and wait until all are handled */
+static int run(void *arg, uint64_t n)
+{
+	struct evq_state *st = arg;
+	const uint64_t target = handled(st) + n;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		struct owner *ow = &st->ownerv[i % st->ownerc];
+
+		/* the queue is full, let the owners catch up */
+		while ((err = avs_evq_push(ow->evq, EV_WORK, ow)) == EAGAIN)
+			sched_yield();
+		if (err)
+			return err;
+	}
+
+	while (handled(st) < target)
+		sched_yield();
+
+	for (i = 0; i < st->ownerc; i++)
+		bench_sink += st->ownerv[i].sum;
+
+	return 0;
+}
+
+
+static const struct bench_case casev[] = {
+	{"owners_1", &owners_1, 0, setup, run},
+	{"owners_2", &owners_2, 0, setup, run},
+	{"owners_4", &owners_4, 0, setup, run},
+};
+
+const struct bench_suite bench_suite_evq = {
+	"evq", casev, ARRAY_SIZE(casev)
+};
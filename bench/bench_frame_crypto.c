@@ -0,0 +1,175 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+#define KEYSZ 32
+#define USERID_HASH "4f2a63c5e1b27a9d"
+
+struct crypto_arg {
+	enum frame_media_type mtype;
+	size_t size;
+};
+
+struct crypto_state {
+	struct keystore *ks;
+	struct frame_encryptor *enc;
+	struct frame_decryptor *dec;
+	uint8_t *frame;
+	uint8_t *cipher;
+	uint8_t *plain;
+	size_t size;
+	size_t csize;
+};
+
+
+static const struct crypto_arg audio_frame = {FRAME_MEDIA_AUDIO, 100};
+static const struct crypto_arg video_frame = {FRAME_MEDIA_VIDEO, 1200};
+
+
+static void destructor(void *arg)
+{
+	struct crypto_state *st = arg;
+
+	mem_deref(st->dec);
+	mem_deref(st->enc);
+	mem_deref(st->ks);
+	mem_deref(st->plain);
+	mem_deref(st->cipher);
+	mem_deref(st->frame);
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	const struct crypto_arg *ca = arg;
+	const uint8_t salt[] = "BENCH_CALL_ID";
+	struct crypto_state *st;
+	uint8_t key[KEYSZ];
+	size_t maxsz, i;
+	int err;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	memset(key, 0xa5, sizeof(key));
+
+	err = keystore_alloc(&st->ks);
+	err |= keystore_set_salt(st->ks, salt, sizeof(salt) - 1);
+	err |= keystore_set_session_key(st->ks, 0, key, sizeof(key));
+	if (err)
+		goto out;
+
+	err = frame_encryptor_alloc(&st->enc, USERID_HASH, ca->mtype);
+	if (err)
+		goto out;
+	err = frame_encryptor_set_keystore(st->enc, st->ks);
+	if (err)
+		goto out;
+
+	err = frame_decryptor_alloc(&st->dec, ca->mtype);
+	if (err)
+		goto out;
+	err  = frame_decryptor_set_keystore(st->dec, st->ks);
+	err |= frame_decryptor_set_uid(st->dec, USERID_HASH);
+	if (err)
+		goto out;
+
+	st->size = ca->size;
+	maxsz = frame_encryptor_max_size(st->enc, st->size);
+
+	st->frame = mem_alloc(st->size, NULL);
+	st->cipher = mem_alloc(maxsz, NULL);
+	st->plain = mem_alloc(maxsz, NULL);
+	if (!st->frame || !st->cipher || !st->plain) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < st->size; i++)
+		st->frame[i] = (uint8_t)i;
+
+	/* one frame for the decrypt cases */
+	err = frame_encryptor_encrypt(st->enc, 0, st->frame, st->size,
+				      st->cipher, &st->csize);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+static int run_encrypt(void *arg, uint64_t n)
+{
+	struct crypto_state *st = arg;
+	uint64_t i;
+	size_t csize = 0;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		err = frame_encryptor_encrypt(st->enc, 0, st->frame, st->size,
+					      st->cipher, &csize);
+		if (err)
+			return err;
+	}
+
+	bench_sink += csize;
+
+	return 0;
+}
+
+
+static int run_decrypt(void *arg, uint64_t n)
+{
+	struct crypto_state *st = arg;
+	uint64_t i;
+	size_t psize = 0;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		err = frame_decryptor_decrypt(st->dec, 0,
+					      st->cipher, st->csize,
+					      st->plain, &psize);
+		if (err)
+			return err;
+	}
+
+	bench_sink += psize;
+
+	return 0;
+}
+
+
+static const struct bench_case casev[] = {
+	{"encrypt_audio", &audio_frame,  100, setup, run_encrypt},
+	{"decrypt_audio", &audio_frame,  100, setup, run_decrypt},
+	{"encrypt_video", &video_frame, 1200, setup, run_encrypt},
+	{"decrypt_video", &video_frame, 1200, setup, run_decrypt},
+};
+
+const struct bench_suite bench_suite_frame_crypto = {
+	"frame_crypto", casev, ARRAY_SIZE(casev)
+};
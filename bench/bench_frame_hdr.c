@@ -0,0 +1,158 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+struct hdr_vals {
+	uint64_t frame;
+	uint64_t key;
+	uint32_t csrc;
+};
+
+struct hdr_state {
+	const struct hdr_vals *vals;
+	uint8_t buf[128];
+	size_t len;
+};
+
+
+static const struct hdr_vals vals_small = {
+	.frame = 42,
+	.key = 1,
+	.csrc = 0,
+};
+
+static const struct hdr_vals vals_large = {
+	.frame = 0x0123456789abcdefULL,
+	.key = 0xfedcba98ULL,
+	.csrc = 0xdeadbeef,
+};
+
+
+/* A header followed by a chain of extensions, csrc last */
+static const struct hdr_buf {
+	uint8_t buf[40];
+	size_t len;
+} exts_buf = {
+	{0x10, 0x1b, 0x22, 0x44, 0x66, 0x88, 0x11, 0x33,
+	 0x80, 0x00,
+	 0x92, 0x00, 0x00, 0x00,
+	 0xb3, 0x00, 0x00, 0x00, 0x00, 0x00,
+	 0x31, 0xde, 0xad, 0xbe, 0xef,
+	 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+	33
+};
+
+
+static int setup(void **statep, const void *arg)
+{
+	const struct hdr_vals *vals = arg;
+	struct hdr_state *st;
+
+	st = mem_zalloc(sizeof(*st), NULL);
+	if (!st)
+		return ENOMEM;
+
+	st->vals = vals;
+	st->len = frame_hdr_write(st->buf, sizeof(st->buf),
+				  vals->frame, vals->key, vals->csrc);
+	if (!st->len) {
+		mem_deref(st);
+		return EINVAL;
+	}
+
+	*statep = st;
+
+	return 0;
+}
+
+
+static int run_write(void *arg, uint64_t n)
+{
+	struct hdr_state *st = arg;
+	uint64_t i;
+	size_t sum = 0;
+
+	for (i = 0; i < n; i++) {
+		sum += frame_hdr_write(st->buf, sizeof(st->buf),
+				       st->vals->frame + i, st->vals->key,
+				       st->vals->csrc);
+	}
+
+	bench_sink += sum;
+
+	return 0;
+}
+
+
+static int run_read(void *arg, uint64_t n)
+{
+	struct hdr_state *st = arg;
+	uint64_t frame, key, sum = 0;
+	uint32_t csrc;
+	uint64_t i;
+
+	for (i = 0; i < n; i++) {
+		/* the header is followed by the payload */
+		if (!frame_hdr_read(st->buf, sizeof(st->buf),
+				    &frame, &key, &csrc))
+			return EBADMSG;
+
+		sum += frame;
+	}
+
+	bench_sink += sum;
+
+	return 0;
+}
+
+
+static int run_read_exts(void *arg, uint64_t n)
+{
+	const struct hdr_buf *hb = arg;
+	uint64_t frame, key, sum = 0;
+	uint32_t csrc = 0;
+	uint64_t i;
+
+	for (i = 0; i < n; i++) {
+		if (!frame_hdr_read(hb->buf, hb->len, &frame, &key, &csrc))
+			return EBADMSG;
+
+		sum += csrc;
+	}
+
+	bench_sink += sum;
+
+	return 0;
+}
+
+
+static const struct bench_case casev[] = {
+	{"write_small", &vals_small, 0, setup, run_write},
+	{"write_large", &vals_large, 0, setup, run_write},
+	{"read_small",  &vals_small, 0, setup, run_read},
+	{"read_large",  &vals_large, 0, setup, run_read},
+	{"read_exts",   &exts_buf,   0, NULL,  run_read_exts},
+};
+
+const struct bench_suite bench_suite_frame_hdr = {
+	"frame_hdr", casev, ARRAY_SIZE(casev)
+};
@@ -0,0 +1,234 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+#define NUM_MEMBERS 32
+
+struct jzon_state {
+	char *doc;
+	size_t len;
+	struct json_object *jobj;
+};
+
+
+static void destructor(void *arg)
+{
+	struct jzon_state *st = arg;
+
+	mem_deref(st->jobj);
+	mem_deref(st->doc);
+}
+
+
+/* A conference message with a member list, as sent by the SFT */
+static int doc_print(struct re_printf *pf, void *arg)
+{
+	unsigned i;
+	int err;
+
+	(void)arg;
+
+	err = re_hprintf(pf, "{\"version\":\"3.0\",\"type\":\"CONFPART\","
+			 "\"sessid\":\"f0e1d2c3\",\"resp\":false,"
+			 "\"props\":{\"videosend\":\"true\","
+			 "\"screensend\":\"false\",\"audiocbr\":\"true\"},"
+			 "\"should_start\":true,\"timestamp\":1602763412,"
+			 "\"seqno\":4711,\"entropy\":\"6f8a2c01d9e4b357\","
+			 "\"partlist\":[");
+
+	for (i = 0; i < NUM_MEMBERS; i++) {
+		err |= re_hprintf(pf, "%s{\"userid\":"
+				  "\"9a7b2f4e-%04x-4c1d-8e2a-0123456789ab\","
+				  "\"clientid\":\"c1a2b3%04x\","
+				  "\"ssrc_audio\":%u,\"ssrc_video\":%u,"
+				  "\"authorized\":%s,\"muted\":false}",
+				  i ? "," : "", i, i,
+				  0x10000000 + i, 0x20000000 + i,
+				  i % 2 ? "true" : "false");
+	}
+
+	err |= re_hprintf(pf, "]}");
+
+	return err;
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	struct jzon_state *st;
+	int err;
+
+	(void)arg;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	err = re_sdprintf(&st->doc, "%H", doc_print, NULL);
+	if (err)
+		goto out;
+
+	st->len = str_len(st->doc);
+
+	err = jzon_decode(&st->jobj, st->doc, st->len);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+static int run_decode(void *arg, uint64_t n)
+{
+	struct jzon_state *st = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		struct json_object *jobj;
+
+		err = jzon_decode(&jobj, st->doc, st->len);
+		if (err)
+			return err;
+
+		mem_deref(jobj);
+	}
+
+	return 0;
+}
+
+
+static int run_encode(void *arg, uint64_t n)
+{
+	struct jzon_state *st = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		char *str;
+
+		err = jzon_encode(&str, st->jobj);
+		if (err)
+			return err;
+
+		bench_sink += str_len(str);
+		mem_deref(str);
+	}
+
+	return 0;
+}
+
+
+/* Walk the whole document without building a tree */
+static int run_pull(void *arg, uint64_t n)
+{
+	struct jzon_state *st = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		struct jzon_pull jp;
+
+		jzon_pull_init(&jp, st->doc, st->len);
+
+		err = jzon_pull_skip(&jp);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+static int run_array_build(void *arg, uint64_t n)
+{
+	uint64_t i;
+	unsigned k;
+
+	(void)arg;
+
+	for (i = 0; i < n; i++) {
+		struct json_object *jarr = jzon_alloc_array();
+
+		if (!jarr)
+			return ENOMEM;
+
+		for (k = 0; k < NUM_MEMBERS; k++)
+			json_object_array_add(jarr, json_object_new_int(k));
+
+		bench_sink += json_object_array_length(jarr);
+		mem_deref(jarr);
+	}
+
+	return 0;
+}
+
+
+/* Append n elements, then read them back by index */
+static int run_array_index(void *arg, uint64_t n)
+{
+	const unsigned *count = arg;
+	uint64_t i;
+	unsigned k;
+
+	for (i = 0; i < n; i++) {
+		struct json_object *jarr = jzon_alloc_array();
+
+		if (!jarr)
+			return ENOMEM;
+
+		for (k = 0; k < *count; k++)
+			json_object_array_add(jarr, json_object_new_int(k));
+
+		for (k = 0; k < *count; k++) {
+			bench_sink += json_object_get_int(
+				json_object_array_get_idx(jarr, k));
+		}
+
+		mem_deref(jarr);
+	}
+
+	return 0;
+}
+
+
+static const unsigned count_10   = 10;
+static const unsigned count_100  = 100;
+static const unsigned count_1000 = 1000;
+
+static const struct bench_case casev[] = {
+	{"decode",      NULL, 0, setup, run_decode},
+	{"encode",      NULL, 0, setup, run_encode},
+	{"pull_skip",   NULL, 0, setup, run_pull},
+	{"array_build", NULL, 0, NULL,  run_array_build},
+	{"array_index_10",   &count_10,   0, NULL, run_array_index},
+	{"array_index_100",  &count_100,  0, NULL, run_array_index},
+	{"array_index_1000", &count_1000, 0, NULL, run_array_index},
+};
+
+const struct bench_suite bench_suite_jzon = {
+	"jzon", casev, ARRAY_SIZE(casev)
+};
@@ -0,0 +1,142 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+#define KEYSZ 32
+
+
+struct ks_state {
+	struct keystore *ks;
+	uint32_t index;
+};
+
+
+static void destructor(void *arg)
+{
+	struct ks_state *st = arg;
+
+	mem_deref(st->ks);
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	const uint8_t salt[] = "BENCH_CALL_ID";
+	struct ks_state *st;
+	uint8_t key[KEYSZ];
+	int err;
+
+	(void)arg;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	memset(key, 0x5a, sizeof(key));
+
+	err  = keystore_alloc(&st->ks);
+	err |= keystore_set_salt(st->ks, salt, sizeof(salt) - 1);
+	err |= keystore_set_session_key(st->ks, 0, key, sizeof(key));
+	if (err) {
+		mem_deref(st);
+		return err;
+	}
+
+	*statep = st;
+
+	return 0;
+}
+
+
+/* A new session key, including the media key derivation */
+static int run_set_session_key(void *arg, uint64_t n)
+{
+	struct ks_state *st = arg;
+	uint8_t key[KEYSZ];
+	uint64_t i;
+	int err;
+
+	memset(key, 0x5a, sizeof(key));
+
+	for (i = 0; i < n; i++) {
+		++st->index;
+		memcpy(key, &st->index, sizeof(st->index));
+
+		err = keystore_set_session_key(st->ks, st->index,
+					       key, sizeof(key));
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+static int run_get_media_key(void *arg, uint64_t n)
+{
+	struct ks_state *st = arg;
+	uint8_t key[KEYSZ];
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		err = keystore_get_media_key(st->ks, st->index,
+					     key, sizeof(key));
+		if (err)
+			return err;
+	}
+
+	bench_sink += key[0];
+
+	return 0;
+}
+
+
+static int run_generate_iv(void *arg, uint64_t n)
+{
+	struct ks_state *st = arg;
+	uint8_t iv[12];
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		err = keystore_generate_iv(st->ks, "4f2a63c5e1b27a9d",
+					   "video_iv", iv, sizeof(iv));
+		if (err)
+			return err;
+	}
+
+	bench_sink += iv[0];
+
+	return 0;
+}
+
+
+static const struct bench_case casev[] = {
+	{"set_session_key", NULL, 0, setup, run_set_session_key},
+	{"get_media_key",   NULL, 0, setup, run_get_media_key},
+	{"generate_iv",     NULL, 0, setup, run_generate_iv},
+};
+
+const struct bench_suite bench_suite_keystore = {
+	"keystore", casev, ARRAY_SIZE(casev)
+};
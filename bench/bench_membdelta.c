@@ -0,0 +1,152 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <avs_wcall.h>
+#include "bench.h"
+
+
+/*
+ * One mute toggle in a group call, notified to the app as a full
+ * roster (as before) or as a member delta. The size of the
+ * notifications is added to bench_sink.
+ */
+
+#define MAX_MEMBERS 200
+
+struct roster {
+	unsigned membc;
+	bool delta;
+};
+
+struct roster_state {
+	struct membdelta *md;
+	struct wcall_members membs;
+	struct wcall_member membv[MAX_MEMBERS];
+	char userv[MAX_MEMBERS][16];
+	char clientv[MAX_MEMBERS][16];
+	bool delta;
+	unsigned pos;
+};
+
+
+static const struct roster full_10   = {10,  false};
+static const struct roster full_50   = {50,  false};
+static const struct roster full_100  = {100, false};
+static const struct roster full_200  = {200, false};
+static const struct roster delta_10  = {10,  true};
+static const struct roster delta_50  = {50,  true};
+static const struct roster delta_100 = {100, true};
+static const struct roster delta_200 = {200, true};
+
+
+static void destructor(void *arg)
+{
+	struct roster_state *st = arg;
+
+	mem_deref(st->md);
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	const struct roster *roster = arg;
+	struct roster_state *st;
+	char *json = NULL;
+	unsigned i;
+	int err;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	for (i = 0; i < roster->membc; i++) {
+		re_snprintf(st->userv[i], sizeof(st->userv[i]),
+			    "user-%04u", i);
+		re_snprintf(st->clientv[i], sizeof(st->clientv[i]),
+			    "client-%u", i % 3);
+
+		st->membv[i].userid = st->userv[i];
+		st->membv[i].clientid = st->clientv[i];
+		st->membv[i].audio_state = 1;
+	}
+
+	st->membs.membv = st->membv;
+	st->membs.membc = roster->membc;
+	st->delta = roster->delta;
+
+	err = membdelta_alloc(&st->md, 0);
+	if (err)
+		goto out;
+
+	/* the first notification is always a full roster */
+	err = membdelta_update(st->md, "conv", &st->membs, &json);
+	mem_deref(json);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*statep = st;
+
+	return err;
+}
+
+
+static int run(void *arg, uint64_t n)
+{
+	struct roster_state *st = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		char *json;
+
+		st->membv[st->pos].muted ^= 1;
+		st->pos = (st->pos + 1) % st->membs.membc;
+
+		if (!st->delta)
+			membdelta_resync(st->md);
+
+		err = membdelta_update(st->md, "conv", &st->membs, &json);
+		if (err)
+			return err;
+
+		bench_sink += str_len(json);
+		mem_deref(json);
+	}
+
+	return 0;
+}
+
+
+static const struct bench_case casev[] = {
+	{"full_10",   &full_10,   0, setup, run},
+	{"full_50",   &full_50,   0, setup, run},
+	{"full_100",  &full_100,  0, setup, run},
+	{"full_200",  &full_200,  0, setup, run},
+	{"delta_10",  &delta_10,  0, setup, run},
+	{"delta_50",  &delta_50,  0, setup, run},
+	{"delta_100", &delta_100, 0, setup, run},
+	{"delta_200", &delta_200, 0, setup, run},
+};
+
+const struct bench_suite bench_suite_membdelta = {
+	"membdelta", casev, ARRAY_SIZE(casev)
+};
@@ -0,0 +1,142 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+#define PACKET_SIZE 1200
+#define BURST       64
+
+
+struct pq_state {
+	packet_queue_t *pq;
+	uint8_t pkt[PACKET_SIZE];
+};
+
+
+static void destructor(void *arg)
+{
+	struct pq_state *st = arg;
+
+	mem_deref(st->pq);
+}
+
+
+static int setup(void **statep, const void *arg)
+{
+	struct pq_state *st;
+	int err;
+
+	(void)arg;
+
+	st = mem_zalloc(sizeof(*st), destructor);
+	if (!st)
+		return ENOMEM;
+
+	err = packet_queue_alloc(&st->pq, false);
+	if (err) {
+		mem_deref(st);
+		return err;
+	}
+
+	memset(st->pkt, 0x80, sizeof(st->pkt));
+
+	*statep = st;
+
+	return 0;
+}
+
+
+static int pop_one(struct pq_state *st)
+{
+	packet_type_t type;
+	uint8_t *data;
+	size_t size;
+	int err;
+
+	err = packet_queue_pop(st->pq, &type, &data, &size);
+	if (err)
+		return err;
+
+	bench_sink += size;
+	mem_deref(data);
+
+	return 0;
+}
+
+
+static int run_push_pop(void *arg, uint64_t n)
+{
+	struct pq_state *st = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		err = packet_queue_push(st->pq, PACKET_TYPE_RTP,
+					st->pkt, sizeof(st->pkt));
+		if (err)
+			return err;
+
+		err = pop_one(st);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+/* One iteration is one packet, queued up in bursts */
+static int run_burst(void *arg, uint64_t n)
+{
+	struct pq_state *st = arg;
+	uint64_t i, k, burst;
+	int err;
+
+	for (i = 0; i < n; i += burst) {
+
+		burst = min(n - i, BURST);
+
+		for (k = 0; k < burst; k++) {
+			err = packet_queue_push(st->pq, PACKET_TYPE_RTP,
+						st->pkt, sizeof(st->pkt));
+			if (err)
+				return err;
+		}
+
+		for (k = 0; k < burst; k++) {
+			err = pop_one(st);
+			if (err)
+				return err;
+		}
+	}
+
+	return 0;
+}
+
+
+static const struct bench_case casev[] = {
+	{"push_pop", NULL, PACKET_SIZE, setup, run_push_pop},
+	{"burst_64", NULL, PACKET_SIZE, setup, run_burst},
+};
+
+const struct bench_suite bench_suite_packet_queue = {
+	"packet_queue", casev, ARRAY_SIZE(casev)
+};
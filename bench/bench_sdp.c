@@ -0,0 +1,220 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+/* A bundled audio/video/data offer, as created by the browser */
+const char bench_sdp_offer[] =
+	"v=0\r\n"
+	"o=- 4611731400430051336 2 IN IP4 127.0.0.1\r\n"
+	"s=-\r\n"
+	"t=0 0\r\n"
+	"a=group:BUNDLE 0 1 2\r\n"
+	"a=msid-semantic: WMS\r\n"
+	"a=tool:avs 7.1.local (x86_64/linux)\r\n"
+	"m=audio 9 UDP/TLS/RTP/SAVPF 111 103 9 0 8 110 126\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"b=AS:50\r\n"
+	"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=candidate:1467250027 1 udp 2122260223 192.168.0.196 46243"
+	" typ host generation 0\r\n"
+	"a=candidate:435653019 1 tcp 1845501695 192.168.0.196 0"
+	" typ host tcptype active generation 0\r\n"
+	"a=candidate:3289912957 1 udp 41885695 203.0.113.7 61822"
+	" typ relay raddr 198.51.100.1 rport 50234 generation 0\r\n"
+	"a=ice-ufrag:4ZcD\r\n"
+	"a=ice-pwd:2/1muCWoOi3uLifh0NuRHlHb\r\n"
+	"a=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 7B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:"
+	"1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n"
+	"a=setup:actpass\r\n"
+	"a=mid:0\r\n"
+	"a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n"
+	"a=extmap:2 http://www.webrtc.org/experiments/rtp-hdrext/"
+	"abs-send-time\r\n"
+	"a=extmap:3 http://www.ietf.org/id/"
+	"draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n"
+	"a=sendrecv\r\n"
+	"a=rtcp-mux\r\n"
+	"a=rtpmap:111 opus/48000/2\r\n"
+	"a=rtcp-fb:111 transport-cc\r\n"
+	"a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+	"a=rtpmap:103 ISAC/16000\r\n"
+	"a=rtpmap:9 G722/8000\r\n"
+	"a=rtpmap:0 PCMU/8000\r\n"
+	"a=rtpmap:8 PCMA/8000\r\n"
+	"a=rtpmap:110 telephone-event/48000\r\n"
+	"a=rtpmap:126 telephone-event/8000\r\n"
+	"a=ssrc:1698222018 cname:Ao3Zt2ee5yxNLy4x\r\n"
+	"a=ssrc:1698222018 msid:- 8d8e2d07-5b61-4e26-b1de-0c1b8a47e8ba\r\n"
+	"m=video 9 UDP/TLS/RTP/SAVPF 100 101 96 97\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"b=AS:800\r\n"
+	"a=rtcp:9 IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:4ZcD\r\n"
+	"a=ice-pwd:2/1muCWoOi3uLifh0NuRHlHb\r\n"
+	"a=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 7B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:"
+	"1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n"
+	"a=setup:actpass\r\n"
+	"a=mid:1\r\n"
+	"a=extmap:14 urn:ietf:params:rtp-hdrext:toffset\r\n"
+	"a=extmap:2 http://www.webrtc.org/experiments/rtp-hdrext/"
+	"abs-send-time\r\n"
+	"a=extmap:13 urn:3gpp:video-orientation\r\n"
+	"a=extmap:3 http://www.ietf.org/id/"
+	"draft-holmer-rmcat-transport-wide-cc-extensions-01\r\n"
+	"a=sendrecv\r\n"
+	"a=rtcp-mux\r\n"
+	"a=rtcp-rsize\r\n"
+	"a=rtpmap:100 VP8/90000\r\n"
+	"a=rtcp-fb:100 goog-remb\r\n"
+	"a=rtcp-fb:100 transport-cc\r\n"
+	"a=rtcp-fb:100 ccm fir\r\n"
+	"a=rtcp-fb:100 nack\r\n"
+	"a=rtcp-fb:100 nack pli\r\n"
+	"a=rtpmap:101 rtx/90000\r\n"
+	"a=fmtp:101 apt=100\r\n"
+	"a=rtpmap:96 VP9/90000\r\n"
+	"a=rtcp-fb:96 nack\r\n"
+	"a=rtpmap:97 rtx/90000\r\n"
+	"a=fmtp:97 apt=96\r\n"
+	"a=ssrc-group:FID 2231627014 632943048\r\n"
+	"a=ssrc:2231627014 cname:Ao3Zt2ee5yxNLy4x\r\n"
+	"a=ssrc:632943048 cname:Ao3Zt2ee5yxNLy4x\r\n"
+	"m=application 9 DTLS/SCTP 5000\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:4ZcD\r\n"
+	"a=ice-pwd:2/1muCWoOi3uLifh0NuRHlHb\r\n"
+	"a=ice-options:trickle\r\n"
+	"a=fingerprint:sha-256 7B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:"
+	"1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n"
+	"a=setup:actpass\r\n"
+	"a=mid:2\r\n"
+	"a=sctpmap:5000 webrtc-datachannel 1024\r\n";
+
+
+static int run_dup(void *arg, uint64_t n)
+{
+	const enum icall_conv_type *conv_type = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		struct sdp_session *sess;
+
+		err = sdp_dup(&sess, *conv_type, bench_sdp_offer, true);
+		if (err)
+			return err;
+
+		mem_deref(sess);
+	}
+
+	return 0;
+}
+
+
+/* The local offer path: dup, then rewrite bandwidth and ptime */
+static int run_modify_offer(void *arg, uint64_t n)
+{
+	const enum icall_conv_type *conv_type = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		struct sdp_session *sess;
+		const char *sdp;
+
+		err = sdp_dup(&sess, *conv_type, bench_sdp_offer, true);
+		if (err)
+			return err;
+
+		sdp = sdp_modify_offer(sess, *conv_type, true);
+		mem_deref(sess);
+		if (!sdp)
+			return ENOMEM;
+
+		bench_sink += str_len(sdp);
+		mem_deref((void *)sdp);
+	}
+
+	return 0;
+}
+
+
+static int run_strip_video(void *arg, uint64_t n)
+{
+	const enum icall_conv_type *conv_type = arg;
+	uint64_t i;
+	int err;
+
+	for (i = 0; i < n; i++) {
+		char *sdp = NULL;
+
+		err = sdp_strip_video(&sdp, *conv_type, bench_sdp_offer);
+		if (err)
+			return err;
+
+		bench_sink += str_len(sdp);
+		mem_deref(sdp);
+	}
+
+	return 0;
+}
+
+
+static void acbr_handler(bool enabled, bool offer, void *arg)
+{
+	(void)offer;
+	(void)arg;
+
+	bench_sink += enabled;
+}
+
+
+static int run_check(void *arg, uint64_t n)
+{
+	uint64_t i;
+
+	(void)arg;
+
+	for (i = 0; i < n; i++)
+		sdp_check(bench_sdp_offer, false, true,
+			  acbr_handler, NULL, NULL, NULL);
+
+	return 0;
+}
+
+
+static const enum icall_conv_type oneonone = ICALL_CONV_TYPE_ONEONONE;
+static const enum icall_conv_type conference = ICALL_CONV_TYPE_CONFERENCE;
+
+static const struct bench_case casev[] = {
+	{"dup",               &oneonone,   0, NULL, run_dup},
+	{"modify_offer",      &oneonone,   0, NULL, run_modify_offer},
+	{"modify_offer_conf", &conference, 0, NULL, run_modify_offer},
+	{"strip_video",       &oneonone,   0, NULL, run_strip_video},
+	{"check",             NULL,        0, NULL, run_check},
+};
+
+const struct bench_suite bench_suite_sdp = {
+	"sdp", casev, ARRAY_SIZE(casev)
+};
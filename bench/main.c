@@ -0,0 +1,377 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/* avs_bench -- micro benchmarks for the AVS core primitives
+ *
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <avs.h>
+#include "bench.h"
+
+
+enum {
+	DEFAULT_TIME = 200,   /* [ms] per repetition */
+	DEFAULT_REPS = 5,
+	MAX_REPS     = 100,
+};
+
+struct bench_result {
+	const char *suite;
+	const char *name;
+	uint64_t n;
+	size_t bytes;
+	double ns_min;
+	double ns_median;
+	double ns_mean;
+};
+
+
+static const struct bench_suite *suitev[] = {
+#if HAVE_WEBRTC
+	&bench_suite_aueffect,
+	&bench_suite_aufanout,
+	&bench_suite_audio_file,
+	&bench_suite_decbudget,
+#endif
+	&bench_suite_bundle,
+	&bench_suite_conv_lookup,
+	&bench_suite_econn,
+	&bench_suite_evq,
+	&bench_suite_frame_crypto,
+	&bench_suite_frame_hdr,
+	&bench_suite_jzon,
+	&bench_suite_keystore,
+	&bench_suite_membdelta,
+	&bench_suite_packet_queue,
+	&bench_suite_sdp,
+};
+
+static struct bench_result *resultv;
+static size_t resultc;
+
+volatile uint64_t bench_sink;
+
+
+static void usage(void)
+{
+	(void)re_fprintf(stderr,
+			 "usage: avs_bench [-hl] [-f <filter>] [-j <file>]"
+			 " [-r <reps>] [-t <ms>]\n");
+	(void)re_fprintf(stderr, "\t-f <filter>    Only run cases whose"
+			 " suite/name contains <filter>\n");
+	(void)re_fprintf(stderr, "\t-j <file>      Write results as JSON,"
+			 " '-' for stdout\n");
+	(void)re_fprintf(stderr, "\t-l             List cases\n");
+	(void)re_fprintf(stderr, "\t-r <reps>      Repetitions per case"
+			 " (default %d)\n", DEFAULT_REPS);
+	(void)re_fprintf(stderr, "\t-t <ms>        Time per repetition"
+			 " (default %d)\n", DEFAULT_TIME);
+	(void)re_fprintf(stderr, "\t-h             Show options\n");
+}
+
+
+static bool case_match(const struct bench_suite *suite,
+		       const struct bench_case *bc, const char *filter)
+{
+	char name[128];
+
+	if (!filter)
+		return true;
+
+	re_snprintf(name, sizeof(name), "%s/%s", suite->name, bc->name);
+
+	return strstr(name, filter) != NULL;
+}
+
+
+static int run_timed(const struct bench_case *bc, void *state, uint64_t n,
+		     uint64_t *usecp)
+{
+	uint64_t t0;
+	int err;
+
+	t0 = tmr_jiffies_usec();
+	err = bc->run(state, n);
+	*usecp = tmr_jiffies_usec() - t0;
+
+	return err;
+}
+
+
+static int double_cmp(const void *a, const void *b)
+{
+	const double da = *(const double *)a;
+	const double db = *(const double *)b;
+
+	return (da > db) - (da < db);
+}
+
+
+/*
+ * Double the iteration count until one run takes the target time,
+ * then time the repetitions with that count.
+ */
+static int run_case(const struct bench_suite *suite,
+		    const struct bench_case *bc,
+		    uint64_t target_usec, unsigned reps,
+		    struct bench_result *res)
+{
+	double nsv[MAX_REPS];
+	void *state = NULL, *arg;
+	uint64_t n = 1, usec;
+	double sum = 0;
+	unsigned i;
+	int err;
+
+	if (bc->setup) {
+		err = bc->setup(&state, bc->arg);
+		if (err)
+			return err;
+	}
+
+	arg = bc->setup ? state : (void *)bc->arg;
+
+	for (;;) {
+		err = run_timed(bc, arg, n, &usec);
+		if (err)
+			goto out;
+
+		if (usec >= target_usec || n >= (1ULL << 40))
+			break;
+
+		/* jump close to the target once the timer resolves */
+		if (usec > 1000)
+			n = n * target_usec / usec + 1;
+		else
+			n *= 2;
+	}
+
+	for (i = 0; i < reps; i++) {
+		err = run_timed(bc, arg, n, &usec);
+		if (err)
+			goto out;
+
+		nsv[i] = usec * 1000.0 / n;
+		sum += nsv[i];
+	}
+
+	qsort(nsv, reps, sizeof(nsv[0]), double_cmp);
+
+	res->suite = suite->name;
+	res->name = bc->name;
+	res->n = n;
+	res->bytes = bc->bytes;
+	res->ns_min = nsv[0];
+	res->ns_median = (reps % 2) ? nsv[reps / 2]
+		: (nsv[reps / 2 - 1] + nsv[reps / 2]) / 2;
+	res->ns_mean = sum / reps;
+
+ out:
+	mem_deref(state);
+
+	return err;
+}
+
+
+static double mb_per_sec(const struct bench_result *res)
+{
+	if (!res->bytes || res->ns_median <= 0)
+		return 0;
+
+	return res->bytes * 1000.0 / res->ns_median;
+}
+
+
+static void print_text(const struct bench_result *res)
+{
+	re_printf("%-14s %-24s %12llu %12.1f %12.1f %12.1f",
+		  res->suite, res->name, res->n,
+		  res->ns_min, res->ns_median, res->ns_mean);
+
+	if (res->bytes)
+		re_printf(" %10.1f MB/s", mb_per_sec(res));
+
+	re_printf("\n");
+}
+
+
+static int print_json(FILE *f)
+{
+	size_t i;
+
+	re_fprintf(f, "{\"tool\":\"avs_bench\",\"version\":\"%s\","
+		   "\"results\":[", avs_version_str());
+
+	for (i = 0; i < resultc; i++) {
+		const struct bench_result *res = &resultv[i];
+
+		re_fprintf(f, "%s\n{\"suite\":\"%s\",\"name\":\"%s\","
+			   "\"iterations\":%llu,"
+			   "\"ns_per_op\":{\"min\":%.1f,\"median\":%.1f,"
+			   "\"mean\":%.1f},"
+			   "\"bytes_per_op\":%zu,\"mb_per_s\":%.1f}",
+			   i ? "," : "",
+			   res->suite, res->name, res->n,
+			   res->ns_min, res->ns_median, res->ns_mean,
+			   res->bytes, mb_per_sec(res));
+	}
+
+	re_fprintf(f, "\n]}\n");
+
+	return ferror(f) ? EIO : 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char *filter = NULL;
+	const char *json = NULL;
+	uint64_t target_usec = DEFAULT_TIME * 1000;
+	unsigned reps = DEFAULT_REPS;
+	bool list = false;
+	size_t i, j, casec = 0;
+	int err = 0;
+
+	for (;;) {
+		const int c = getopt(argc, argv, "f:hj:lr:t:");
+		if (c < 0)
+			break;
+
+		switch (c) {
+
+		case 'f':
+			filter = optarg;
+			break;
+
+		case 'j':
+			json = optarg;
+			break;
+
+		case 'l':
+			list = true;
+			break;
+
+		case 'r':
+			reps = atoi(optarg);
+			break;
+
+		case 't':
+			target_usec = atoi(optarg) * 1000ULL;
+			break;
+
+		case 'h':
+		default:
+			usage();
+			return 2;
+		}
+	}
+
+	if (reps < 1 || reps > MAX_REPS || !target_usec) {
+		usage();
+		return 2;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(suitev); i++)
+		casec += suitev[i]->casec;
+
+	if (list) {
+		for (i = 0; i < ARRAY_SIZE(suitev); i++) {
+			for (j = 0; j < suitev[i]->casec; j++) {
+				re_printf("%s/%s\n", suitev[i]->name,
+					  suitev[i]->casev[j].name);
+			}
+		}
+		return 0;
+	}
+
+	err = libre_init();
+	if (err)
+		return 1;
+
+	err = avs_init(0);
+	if (err)
+		goto out;
+
+	log_set_min_level(LOG_LEVEL_WARN);
+
+	resultv = mem_zalloc(casec * sizeof(*resultv), NULL);
+	if (!resultv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	/* with JSON on stdout, skip the table */
+	if (!json || !streq(json, "-")) {
+		re_printf("%-14s %-24s %12s %12s %12s %12s\n",
+			  "suite", "case", "iterations",
+			  "min ns/op", "median ns/op", "mean ns/op");
+	}
+
+	for (i = 0; i < ARRAY_SIZE(suitev); i++) {
+		const struct bench_suite *suite = suitev[i];
+
+		for (j = 0; j < suite->casec; j++) {
+			const struct bench_case *bc = &suite->casev[j];
+			struct bench_result *res = &resultv[resultc];
+
+			if (!case_match(suite, bc, filter))
+				continue;
+
+			err = run_case(suite, bc, target_usec, reps, res);
+			if (err) {
+				re_fprintf(stderr, "avs_bench: %s/%s failed"
+					   " (%m)\n", suite->name, bc->name,
+					   err);
+				goto out;
+			}
+
+			++resultc;
+
+			if (!json || !streq(json, "-"))
+				print_text(res);
+		}
+	}
+
+	if (json) {
+		FILE *f = streq(json, "-") ? stdout : fopen(json, "w");
+
+		if (!f) {
+			err = errno;
+			re_fprintf(stderr, "avs_bench: %s: %m\n", json, err);
+			goto out;
+		}
+
+		err = print_json(f);
+
+		if (f != stdout)
+			fclose(f);
+	}
+
+ out:
+	mem_deref(resultv);
+
+	avs_close();
+	libre_close();
+
+	return err ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+#
+# srcs.mk All benchmark source files.
+#
+
+BENCH_SRCS	+= main.c
+
+# Suites in alphabetical order
+BENCH_SRCS	+= bench_bundle.c
+BENCH_SRCS	+= bench_conv_lookup.c
+BENCH_SRCS	+= bench_econn.c
+BENCH_SRCS	+= bench_evq.c
+BENCH_SRCS	+= bench_frame_crypto.c
+BENCH_SRCS	+= bench_frame_hdr.c
+BENCH_SRCS	+= bench_jzon.c
+BENCH_SRCS	+= bench_keystore.c
+BENCH_SRCS	+= bench_membdelta.c
+BENCH_SRCS	+= bench_packetqueue.c
+BENCH_SRCS	+= bench_sdp.c
+
+# Conditional suites
+ifeq ($(HAVE_WEBRTC),1)
+BENCH_SRCS	+= bench_aueffect.c
+BENCH_SRCS	+= bench_aufanout.c
+BENCH_SRCS	+= bench_audio_file.c
+BENCH_SRCS	+= bench_decbudget.c
+endif
+
+BENCH_CPPFLAGS	+= -Ibench
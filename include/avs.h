@@ -37,11 +37,14 @@ extern "C" {
 #endif
 
 
+#include "avs_aufanout.h"
 #include "avs_base.h"
 #include "avs_cert.h"
 #include "avs_conf_pos.h"
 #include "avs_conf_member.h"
+#include "avs_decbudget.h"
 #include "avs_dict.h"
+#include "avs_cdict.h"
 #include "avs_jzon.h"
 #include "avs_kase.h"
 #include "avs_log.h"
@@ -50,6 +53,7 @@ extern "C" {
 #include "avs_frame_hdr.h"	
 #include "avs_frame_encryptor.h"	
 #include "avs_frame_decryptor.h"	
+#include "avs_frame_stats.h"
 #include "avs_zapi.h"
 #include "avs_icall.h"	
 #include "avs_iflow.h"	
@@ -73,6 +77,7 @@ extern "C" {
 #include "avs_config.h"
 #include "avs_engine.h"
 #include "avs_netprobe.h"
+#include "avs_relayrank.h"
 #include "avs_network.h"
 #include "avs_econn.h"
 #include "avs_econn_fmt.h"
@@ -81,6 +86,7 @@ extern "C" {
 #include "avs_ccall.h"
 
 #include "avs_mediamgr.h"
+#include "avs_membdelta.h"
 
 #include "avs_version.h"
     
@@ -28,6 +28,9 @@ typedef void (reset_effect_h)(void *st, int fs_hz);
 typedef void (free_effect_h)(void *st);
 typedef void (effect_process_h)(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
 typedef void (effect_length_h)(void *st, int *length_mod_Q10);
+
+struct pitch_estimator;
+typedef void (effect_share_pitch_h)(void *st, const struct pitch_estimator *src);
     
 enum audio_effect{
     AUDIO_EFFECT_CHORUS = 0,
@@ -77,12 +80,16 @@ struct aueffect {
     free_effect_h *e_free_h;
     effect_process_h *e_proc_h;
     effect_length_h *e_length_h;
+    effect_share_pitch_h *e_share_h;
+    bool alters_pitch;
 };
     
 int aueffect_alloc(struct aueffect **auep, enum audio_effect effect_type, int fs_hz);
 int aueffect_reset(struct aueffect *aue, int fs_hz);
 int aueffect_process(struct aueffect *aue, const int16_t *sampin, int16_t *sampout, size_t n_sampin, size_t *n_sampout);
 int aueffect_length_modification(struct aueffect *aue, int *length_modification_q10);
+int aueffect_share_pitch(struct aueffect *aue, const struct pitch_estimator *src);
+bool aueffect_alters_pitch(const struct aueffect *aue);
     
 void* create_chorus(int fs_hz, int strength);
 void free_chorus(void *st);
@@ -96,24 +103,29 @@ void* create_pitch_up_shift(int fs_hz, int strength);
 void* create_pitch_down_shift(int fs_hz, int strength);
 void free_pitch_shift(void *st);
 void pitch_shift_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void pitch_shift_share_pitch(void *st, const struct pitch_estimator *src);
     
 void* create_pace_up_shift(int fs_hz, int strength);
 void* create_pace_down_shift(int fs_hz, int strength);
 void free_pace_shift(void *st);
 void pace_shift_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
 void pace_shift_length_factor(void *st, int *length_mod_Q10);
+void pace_shift_share_pitch(void *st, const struct pitch_estimator *src);
     
 void* create_vocoder(int fs_hz, int strength);
 void free_vocoder(void *st);
 void vocoder_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void vocoder_share_pitch(void *st, const struct pitch_estimator *src);
 
 void* create_auto_tune(int fs_hz, int strength);
 void free_auto_tune(void *st);
 void auto_tune_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void auto_tune_share_pitch(void *st, const struct pitch_estimator *src);
 
 void* create_harmonizer(int fs_hz, int strength);
 void free_harmonizer(void *st);
 void harmonizer_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void harmonizer_share_pitch(void *st, const struct pitch_estimator *src);
 
 void* create_normalizer(int fs_hz, int strength);
 void reset_normalizer(void *st, int fs_hz);
@@ -123,6 +135,7 @@ void normalizer_process(void *st, int16_t in[], int16_t out[], size_t L_in, size
 void* create_pitch_cycler(int fs_hz, int strength);
 void free_pitch_cycler(void *st);
 void pitch_cycler_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t *L_out);
+void pitch_cycler_share_pitch(void *st, const struct pitch_estimator *src);
     
 void* create_pass_through(int fs_hz, int strength);
 void free_pass_through(void *st);
@@ -131,6 +144,68 @@ void pass_through_process(void *st, int16_t in[], int16_t out[], size_t L_in, si
 typedef void (effect_progress_h)(int progress, void *arg);
 int apply_effect_to_wav(const char* wavIn, const char* wavOut, enum audio_effect effect_type, bool reduce_noise, effect_progress_h* progress_h, void *arg);
 int apply_effect_to_pcm(const char* pcmIn, const char* pcmOut, int fs_hz, enum audio_effect effect_type, bool reduce_noise, effect_progress_h* progress_h, void *arg);
+
+/* Offline audio file I/O, shared by the converters */
+enum audio_file_fmt {
+    AUDIO_FILE_PCM = 0,      /* raw 16-bit samples, no header      */
+    AUDIO_FILE_WAV,          /* 16-bit PCM WAV                     */
+    AUDIO_FILE_WAV_FLOAT,    /* 32-bit float WAV, for output only  */
+};
+
+struct audio_reader;
+struct audio_writer;
+
+int apply_effect_to_file(const char *fileIn, enum audio_file_fmt fmt_in, int fs_hz,
+                         const char *fileOut, enum audio_file_fmt fmt_out,
+                         enum audio_effect effect_type, bool reduce_noise,
+                         effect_progress_h *progress_h, void *arg);
+
+int audio_reader_open(struct audio_reader **arp, const char *path,
+                      enum audio_file_fmt fmt, int fs_hz);
+const int16_t *audio_reader_samples(const struct audio_reader *ar, size_t *sampc);
+int audio_reader_srate(const struct audio_reader *ar);
+int audio_reader_channels(const struct audio_reader *ar);
+
+int audio_writer_open(struct audio_writer **awp, const char *path,
+                      enum audio_file_fmt fmt, int fs_hz, int channels);
+int audio_writer_write(struct audio_writer *aw, const int16_t *sampv, size_t sampc);
+int audio_writer_silence(struct audio_writer *aw, size_t sampc);
+uint64_t audio_writer_samples(const struct audio_writer *aw);
+int audio_writer_close(struct audio_writer *aw);
+
+/* Real-time effect chain, for the capture path of a call */
+#define AUEFFECT_CHAIN_MAX     4
+/* [us] of processing per 10 ms frame, checked between effects */
+#define AUEFFECT_CHAIN_BUDGET  3000
+
+struct aueffect_chain;
+
+struct aueffect_chain_stats {
+    uint32_t frames;        /* frames seen with effects set       */
+    uint32_t bypassed;      /* of those, passed through dry       */
+    uint32_t overruns;      /* frames over the budget             */
+    uint32_t last_us;       /* processing time of the last frame  */
+    uint32_t max_us;        /* worst frame since the last set     */
+    uint32_t budget_us;
+    uint32_t pitch_shared;  /* effects sharing a pitch analysis  */
+    bool overloaded;        /* bypassed after repeated overruns   */
+};
+
+int aueffect_chain_alloc(struct aueffect_chain **chainp, int fs_hz,
+                         uint32_t budget_us);
+int aueffect_chain_set(struct aueffect_chain *chain,
+                       const enum audio_effect *effectv, size_t effectc);
+int aueffect_chain_set_srate(struct aueffect_chain *chain, int fs_hz);
+void aueffect_chain_set_budget(struct aueffect_chain *chain,
+                               uint32_t budget_us);
+void aueffect_chain_set_bypass(struct aueffect_chain *chain, bool bypass);
+int aueffect_chain_process(struct aueffect_chain *chain,
+                           int16_t *sampv, size_t sampc);
+void aueffect_chain_get_stats(const struct aueffect_chain *chain,
+                              struct aueffect_chain_stats *stats);
+
+/* A webrtc::CustomProcessing for capture post-processing, owned by the caller */
+void *aueffect_chain_capture_processing(struct aueffect_chain *chain);
     
 #ifdef __cplusplus
 }
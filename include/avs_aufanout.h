@@ -0,0 +1,74 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVS_AUFANOUT_H
+#define AVS_AUFANOUT_H
+
+/*
+ * Audio fan-out -- encode the local audio once and hand the same
+ * encoded frame to every send stream (one per mesh peer).
+ *
+ * Every sink feeds the same captured PCM chunks, possibly at slightly
+ * different times. The first sink to deliver a chunk runs the encoder,
+ * the others pick up the cached result. Chunks are matched on their
+ * full content, so sinks may join at any time. A sink whose audio
+ * does not follow the encoded sequence is cut off with EPROTO, so
+ * the encoder never sees a chunk that another sink did not send.
+ */
+
+struct aufanout;
+struct aufanout_sink;
+
+/* Number of encoded chunks kept for late sinks, must be a power of 2 */
+#define AUFANOUT_RING 16
+
+/* Describes an encoded packet */
+struct aufanout_meta {
+	uint32_t span;     /* number of chunks in the packet  */
+	bool speech;       /* set by the encoder              */
+	int codec;         /* set by the encoder, opaque      */
+};
+
+/*
+ * Encode one chunk of PCM. On input *lenp is the size of dst, on output
+ * the number of bytes written; 0 if the encoder is still buffering.
+ * The handler fills in speech and codec of the meta.
+ */
+typedef int (aufanout_encode_h)(uint8_t *dst, size_t *lenp,
+				struct aufanout_meta *meta,
+				const int16_t *sampv, size_t sampc,
+				void *arg);
+
+struct aufanout_stats {
+	uint64_t encoded;  /* chunks run through the encoder  */
+	uint64_t shared;   /* chunks served from the cache    */
+	uint64_t resync;   /* sinks that lost their alignment */
+	uint64_t diverged; /* sinks cut off with EPROTO       */
+};
+
+int  aufanout_alloc(struct aufanout **afp, size_t sampc, size_t maxsz,
+		    aufanout_encode_h *encodeh, void *arg);
+int  aufanout_sink_alloc(struct aufanout_sink **sinkp, struct aufanout *af);
+int  aufanout_encode(struct aufanout_sink *sink,
+		     uint8_t *dst, size_t *lenp, struct aufanout_meta *meta,
+		     const int16_t *sampv, size_t sampc);
+uint32_t aufanout_sink_count(const struct aufanout *af);
+void aufanout_get_stats(const struct aufanout *af,
+			struct aufanout_stats *stats);
+
+#endif
@@ -34,6 +34,17 @@ void avs_print_versions(void);
 void avs_print_network(void);
 
 
+/*
+ * Thread event queue -- an mqueue per thread and handler. Events
+ * pushed to it are handled on the thread that took the queue.
+ */
+struct avs_evq;
+
+int  avs_evq_get(struct avs_evq **evqp, mqueue_h *h);
+int  avs_evq_push(struct avs_evq *evq, int id, void *data);
+bool avs_evq_is_last(const struct avs_evq *evq);
+
+
 /* Special error codes for AVS */
 #define ETIMEDOUT_ECONN    (-1000)
 #define ETIMEDOUT_OTR      (-1001)
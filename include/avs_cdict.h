@@ -0,0 +1,37 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVS_CDICT_H
+#define AVS_CDICT_H
+
+/*
+ * Concurrent dictionary -- string keys to values, for tables that are
+ * read from many threads and changed rarely. Lookups take no lock,
+ * writers are serialized on an internal lock. Values are not
+ * referenced; the owner keeps them alive while they are in the table.
+ */
+
+struct cdict;
+
+int   cdict_alloc(struct cdict **cdp);
+int   cdict_add(struct cdict *cd, const char *key, void *val);
+void  cdict_remove(struct cdict *cd, const char *key);
+void *cdict_lookup(struct cdict *cd, const char *key);
+uint32_t cdict_count(const struct cdict *cd);
+
+#endif
@@ -21,6 +21,7 @@ extern "C" {
 #endif
 
 struct iflow;
+struct decbudget_ent;
 
 struct conf_member {
 	char *userid;
@@ -47,6 +48,8 @@ struct conf_member {
 	uint8_t audio_level;
 	uint8_t audio_level_smooth;
 	uint64_t last_ts;
+
+	struct decbudget_ent *budget;
 };
 
 int conf_member_alloc(struct conf_member **cmp,
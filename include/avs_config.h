@@ -42,6 +42,7 @@ struct config_update_elem {
 	/* Internal use */
 	struct config *cfg;
 	struct le le;
+	struct tmr tmr;
 };
 
 
@@ -52,6 +53,9 @@ int  config_update(struct config *cfg, int err,
 int  config_start(struct config *cfg);
 void config_stop(struct config *cfg);
 int  config_request(struct config *cfg);
+int  config_request_cached(struct config *cfg, struct config_update_elem *upe);
+int  config_prefetch(struct config *cfg);
+bool config_is_valid(const struct config *cfg);
 int  config_register_update_handler(struct config_update_elem *upe, struct config *cfg);
 int  config_unregister_update_handler(struct config_update_elem *upe);
 int  config_unregister_all_updates(struct config *cfg, void *arg);
@@ -23,8 +23,22 @@
 
 struct cryptobox;
 
+/* Sessions kept open, the rest are loaded from disk when needed */
+#define CRYPTOBOX_CACHE_SIZE 1024
+
+struct cryptobox_peer {
+	const char *userid;
+	const char *clientid;
+};
+
+/* Preloaded sessions are in the cache */
+typedef void (cryptobox_preload_h)(int err, size_t loaded, void *arg);
+
 int  cryptobox_alloc(struct cryptobox **cbp, const char *storedir);
 void cryptobox_dump(const struct cryptobox *cb);
+int  cryptobox_set_cache_size(struct cryptobox *cb, size_t maxsess);
+/* Save now -- before sending what was encrypted, and on app background */
+void cryptobox_flush(struct cryptobox *cb);
 
 int  cryptobox_generate_prekey(struct cryptobox *cb,
 			       uint8_t *key, size_t *sz, uint16_t id);
@@ -44,6 +58,11 @@ struct session *cryptobox_session_find(struct cryptobox *cb,
 				       const char *remote_userid,
 				       const char *remote_clientid,
 				       const char *local_clientid);
+int  cryptobox_session_preload(struct cryptobox *cb,
+			       const char *local_clientid,
+			       const struct cryptobox_peer *peerv,
+			       size_t peerc,
+			       cryptobox_preload_h *h, void *arg);
 int cryptobox_session_encrypt(struct cryptobox *cb, struct session *sess,
 			      uint8_t *cipher, size_t *cipher_len,
 			      const uint8_t *plain, size_t plain_len);
@@ -0,0 +1,55 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVS_DECBUDGET_H
+#define AVS_DECBUDGET_H
+
+/*
+ * Decode budget -- decode and mix only the K loudest incoming audio
+ * streams. The others stay on a level-only path: their packets, and
+ * with them the RTP audio level, still reach the receiver, but the
+ * payload is replaced by an empty frame (see decbudget_level_frame),
+ * so their decoder only runs loss concealment. That is cheaper than
+ * a decode, not free; bench/bench_decbudget.c measures both.
+ */
+
+struct decbudget;
+struct decbudget_ent;
+
+/* A decoded stream that went quiet is kept for this long [ms] */
+#define DECBUDGET_HOLD_MS  1500
+
+/* Level by which a new speaker must beat the weakest decoded stream */
+#define DECBUDGET_MARGIN     16
+
+int  decbudget_alloc(struct decbudget **dbp, uint32_t maxc);
+void decbudget_set_max(struct decbudget *db, uint32_t maxc);
+uint32_t decbudget_max(const struct decbudget *db);
+uint32_t decbudget_count(const struct decbudget *db);
+uint32_t decbudget_update(struct decbudget *db, uint64_t now);
+int  decbudget_debug(struct re_printf *pf, const struct decbudget *db);
+
+int  decbudget_ent_alloc(struct decbudget_ent **entp, struct decbudget *db,
+			 const char *name);
+void decbudget_ent_set_level(struct decbudget_ent *ent, uint8_t level);
+bool decbudget_ent_decoding(const struct decbudget_ent *ent);
+
+int  decbudget_level_frame(uint8_t *dst, size_t *lenp,
+			   const uint8_t *frame, size_t len);
+
+#endif
@@ -82,6 +82,49 @@ const char *ecall_props_get_remote(struct ecall *ecall, const char *key);
 void ecall_trace(struct ecall *ecall, const struct econn_message *msg,
 		 bool tx, enum econn_transport tp,
 		 const char *fmt, ...);
+
+/* Call trace export */
+
+#define ECALL_TRACE_MAGIC   0x41565354  /* "AVST" */
+#define ECALL_TRACE_VERSION 1
+
+enum ecall_trace_fmt {
+	ECALL_TRACE_FMT_BINARY = 0,
+	ECALL_TRACE_FMT_NDJSON = 1,
+};
+
+enum {
+	ECALL_TRACE_TX   = 1<<0,
+	ECALL_TRACE_RESP = 1<<1,
+};
+
+/*
+ * One traced econn message. The binary export writes the header and
+ * the records in network byte order, see ecall_trace_export().
+ */
+struct ecall_trace_rec {
+	uint32_t ts;        /* ms since the call was allocated    */
+	uint32_t age;       /* age of backend message in seconds  */
+	uint32_t sessid;    /* hash of the sender session-id      */
+	uint8_t msg_type;   /* enum econn_msg                     */
+	uint8_t tp;         /* enum econn_transport               */
+	uint8_t flags;      /* ECALL_TRACE_TX, ECALL_TRACE_RESP   */
+	uint8_t pad;
+};
+
+/* The header of a binary export, as read back */
+struct ecall_trace_hdr {
+	char userid[256];
+	char clientid[256];
+	uint64_t start;     /* wallclock when the call was allocated [ms] */
+	uint32_t dropped;   /* records overwritten in the ring        */
+	uint16_t count;     /* records that follow                    */
+};
+
+int ecall_trace_export(struct mbuf *mb, const struct ecall *ecall,
+		       enum ecall_trace_fmt fmt);
+int ecall_trace_decode_hdr(struct mbuf *mb, struct ecall_trace_hdr *hdr);
+int ecall_trace_decode_rec(struct mbuf *mb, struct ecall_trace_rec *rec);
 int  ecall_restart(struct ecall *ecall, enum icall_call_type call_type);
 
 struct conf_part *ecall_get_conf_part(struct ecall *ecall);
@@ -168,6 +211,7 @@ int ecall_sync_decoders(struct ecall *ecall);
 
 int ecall_set_keystore(struct ecall *ecall,
 		       struct keystore *keystore);
+void ecall_set_timeline(struct ecall *ecall, struct icall_timeline *tl);
 
 
 void ecall_activate(void);
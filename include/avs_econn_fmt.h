@@ -24,3 +24,6 @@ int econn_message_encode(char **strp, const struct econn_message *msg);
 int econn_message_decode(struct econn_message **msgp,
 			 uint64_t curr_time, uint64_t msg_time,
 			 const char *str, size_t len);
+int econn_message_decode_jzon(struct econn_message **msgp,
+			      uint64_t curr_time, uint64_t msg_time,
+			      const char *str, size_t len);
@@ -31,6 +31,11 @@ int frame_decryptor_set_keystore(struct frame_decryptor *dec,
 int frame_decryptor_set_uid(struct frame_decryptor *dec,
 			    const char *userid_hash);
 
+struct frame_stats_group;
+
+int frame_decryptor_set_stats(struct frame_decryptor *dec,
+			      struct frame_stats_group *grp);
+
 int frame_decryptor_decrypt(struct frame_decryptor *dec,
 			    uint32_t csrc,
 			    const uint8_t *src,
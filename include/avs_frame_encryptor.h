@@ -32,6 +32,11 @@ int frame_encryptor_alloc(struct frame_encryptor **penc,
 int frame_encryptor_set_keystore(struct frame_encryptor *enc,
 				 struct keystore *keystore);
 
+struct frame_stats_group;
+
+int frame_encryptor_set_stats(struct frame_encryptor *enc,
+			      struct frame_stats_group *grp);
+
 int frame_encryptor_encrypt(struct frame_encryptor *enc,
 			    uint32_t ssrc,
 			    const uint8_t *src,
@@ -22,6 +22,11 @@
 
 size_t frame_hdr_max_size(void);
 
+/*
+ * Returns the header size, or 0 if it does not fit in bsz. Up to
+ * 8 bytes of buf behind the header may be overwritten, they are
+ * meant for the payload.
+ */
 size_t frame_hdr_write(uint8_t  *buf,
 		       size_t   bsz,
 		       uint64_t frame,
@@ -0,0 +1,83 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVS_FRAME_STATS_H
+#define AVS_FRAME_STATS_H
+
+/*
+ * Frame crypto telemetry -- counters and a timing histogram for each
+ * frame encryptor and decryptor. A stream is only updated from the
+ * media thread that owns it, without locks; the streams of a
+ * peerflow are summed up in a group when queried.
+ */
+
+enum frame_stats_drop {
+	FRAME_DROP_NO_KEY = 0,  /* key not in the keystore (yet)   */
+	FRAME_DROP_NO_USER,     /* csrc not mapped to a user (yet) */
+	FRAME_DROP_NO_IV,       /* IV could not be derived         */
+	FRAME_DROP_SHORT,       /* shorter than header and tag     */
+	FRAME_DROP_AUTH,        /* authentication tag mismatch     */
+	FRAME_DROP_CRYPTO,      /* other cipher errors             */
+
+	FRAME_DROP_MAX
+};
+
+/* Bucket i counts frames that took less than 2^(i+8) [ns] */
+#define FRAME_STATS_BUCKETS 16
+
+struct frame_stats {
+	uint64_t frames;        /* processed successfully */
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t dropv[FRAME_DROP_MAX];
+	uint64_t key_switches;
+	uint64_t ns_total;
+	uint64_t histv[FRAME_STATS_BUCKETS];
+
+	/* frame_stats_now() of the first frame, 0 before */
+	uint64_t first_ns;      /* seen, processed or dropped */
+	uint64_t first_ok_ns;   /* processed successfully     */
+};
+
+struct frame_stats_group;
+struct frame_stats_stream;
+
+int  frame_stats_group_alloc(struct frame_stats_group **grpp);
+int  frame_stats_group_get(struct frame_stats_group *grp,
+			   enum frame_media_type mtype, bool tx,
+			   struct frame_stats *stats);
+int  frame_stats_group_debug(struct re_printf *pf,
+			     struct frame_stats_group *grp);
+
+int  frame_stats_stream_alloc(struct frame_stats_stream **fsp,
+			      struct frame_stats_group *grp,
+			      enum frame_media_type mtype, bool tx);
+uint64_t frame_stats_now(void);
+void frame_stats_frame(struct frame_stats_stream *fs,
+		       size_t bytes_in, size_t bytes_out, uint64_t t0);
+void frame_stats_drop(struct frame_stats_stream *fs,
+		      enum frame_stats_drop reason);
+void frame_stats_key_switch(struct frame_stats_stream *fs);
+
+void frame_stats_add(struct frame_stats *dst, const struct frame_stats *src);
+uint64_t frame_stats_drops(const struct frame_stats *stats);
+uint64_t frame_stats_percentile(const struct frame_stats *stats,
+				unsigned pct);
+const char *frame_stats_drop_name(enum frame_stats_drop reason);
+
+#endif
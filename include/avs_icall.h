@@ -77,6 +77,48 @@ struct icall_client {
 struct icall_client *icall_client_alloc(const char *userid,
 					const char *clientid);
 
+
+/*
+ * Call setup timeline -- the time at which a call first reached each
+ * phase of its setup, on the monotonic clock in [us]. Only the first
+ * time counts; a phase that was not reached is 0.
+ */
+enum icall_phase {
+	ICALL_PHASE_START = 0,        /* call started or answered      */
+	ICALL_PHASE_CONFIG_REQ,       /* call config requested         */
+	ICALL_PHASE_CONFIG_RESP,      /* call config received          */
+	ICALL_PHASE_SFT_REQ,          /* CONFCONN sent to the SFT      */
+	ICALL_PHASE_SFT_RESP,         /* SETUP received from the SFT   */
+	ICALL_PHASE_LOCAL_SDP,        /* local offer or answer created */
+	ICALL_PHASE_ICE_GATHERED,
+	ICALL_PHASE_DTLS_ESTAB,
+	ICALL_PHASE_DCE_ESTAB,
+	ICALL_PHASE_RTP_SENT,         /* first media frame sent        */
+	ICALL_PHASE_RTP_RECV,         /* first media frame received    */
+	ICALL_PHASE_FRAME_DECRYPTED,  /* first frame decrypted         */
+
+	ICALL_PHASE_MAX
+};
+
+struct icall_timeline {
+	uint64_t tsv[ICALL_PHASE_MAX];
+};
+
+uint64_t icall_timeline_now(void);
+void icall_timeline_reset(struct icall_timeline *tl);
+void icall_timeline_mark(struct icall_timeline *tl, enum icall_phase phase);
+void icall_timeline_mark_at(struct icall_timeline *tl,
+			    enum icall_phase phase, uint64_t ts);
+int64_t icall_timeline_elapsed(const struct icall_timeline *tl,
+			       enum icall_phase phase);
+const char *icall_phase_name(enum icall_phase phase);
+int icall_timeline_debug(struct re_printf *pf,
+			 const struct icall_timeline *tl);
+int icall_timeline_json(struct re_printf *pf,
+			const struct icall_timeline *tl);
+int icall_timeline_metrics(char **jsonp, const char *metrics_json,
+			   const struct icall_timeline *tl);
+
 /* Calls into icall */
 typedef int  (icall_add_turnserver)(struct icall *icall,
 				    struct zapi_ice_server *srv);
@@ -112,6 +154,8 @@ typedef int  (icall_update_mute_state)(const struct icall* icall);
 
 typedef int  (icall_debug)(struct re_printf *pf, const struct icall* icall);
 typedef int  (icall_stats)(struct re_printf *pf, const struct icall* icall);
+typedef int  (icall_trace_export)(struct mbuf *mb, const struct icall *icall,
+				  int fmt);
 
 /* Callbacks from icall */
 typedef int  (icall_sft_h)(struct icall *icall,
@@ -208,6 +252,7 @@ struct icall {
 	icall_update_mute_state		*update_mute_state;
 	icall_debug			*debug;
 	icall_stats			*stats;
+	icall_trace_export		*trace_export;  /* optional */
 
 	icall_send_h			*sendh;
 	icall_sft_h			*sfth;
@@ -230,6 +275,8 @@ struct icall {
 	icall_audio_level_h             *audio_levelh;
 
 	void				*arg;
+
+	struct icall_timeline		timeline;
 }__attribute__ ((aligned (8)));
 
 #define ICALL_CALL(icall, fn, ...) if(icall && (icall)->fn){icall->fn(icall, ##__VA_ARGS__);}
@@ -32,6 +32,10 @@ struct iflow_stats {
 	uint32_t vpkts_sent;
 	float dloss;
 	float rtt;
+
+	/* frame encryption, audio and video */
+	struct frame_stats fenc;
+	struct frame_stats fdec;
 };
 
 /* Calls into iflow */
@@ -107,6 +111,7 @@ typedef void (iflow_destroyf)(void);
 
 typedef void (iflow_set_mutef)(bool muted);
 typedef bool (iflow_get_mutef)(void);
+typedef int  (iflow_set_voice_effectsf)(const int *effectv, size_t effectc);
 
 /* Callbacks from iflow */
 typedef void (iflow_estab_h)(struct iflow *flow,
@@ -245,6 +250,7 @@ void iflow_set_alloc(iflow_allocf *allocf);
 void iflow_register_statics(iflow_destroyf *destroy,
 			    iflow_set_mutef *set_mute,
 			    iflow_get_mutef *get_mute);
+void iflow_register_voice_effects(iflow_set_voice_effectsf *set_voice_effects);
 
 int iflow_alloc(struct iflow		**flowp,
 		const char		*convid,
@@ -259,6 +265,7 @@ void iflow_destroy(void);
 
 void iflow_set_mute(bool mute);
 bool iflow_get_mute(void);
+int  iflow_set_voice_effects(const int *effectv, size_t effectc);
 
 void iflow_set_video_handlers(iflow_render_frame_h *render_frame_h,
 			      iflow_video_size_h *size_h,
@@ -75,6 +75,40 @@ void jzon_dump(struct json_object *jobj);
 struct odict *jzon_get_odict(struct json_object *jobj);
 
 
+/*
+ * Pull parser -- walks a JSON buffer without building a tree
+ */
+
+struct jzon_pull {
+	const char *p;
+	const char *end;
+	unsigned depth;
+};
+
+struct jzon_value {
+	enum odict_type type;
+	struct pl pl;      /* raw string contents or number text */
+	bool esc;          /* string contains escape sequences    */
+	bool b;            /* value of ODICT_BOOL                 */
+};
+
+void   jzon_pull_init(struct jzon_pull *jp, const char *buf, size_t len);
+int    jzon_pull_value(struct jzon_pull *jp, struct jzon_value *val);
+int    jzon_pull_skip(struct jzon_pull *jp);
+int    jzon_pull_object_begin(struct jzon_pull *jp);
+int    jzon_pull_object_next(struct jzon_pull *jp, struct pl *key,
+			     bool *first);
+int    jzon_pull_array_begin(struct jzon_pull *jp);
+int    jzon_pull_array_next(struct jzon_pull *jp, bool *first);
+int    jzon_pull_end(struct jzon_pull *jp);
+int    jzon_pull_odict(struct odict **op, struct jzon_pull *jp);
+
+size_t jzon_value_strcpy(char *dst, size_t sz, const struct jzon_value *val);
+int    jzon_value_strdup(char **dstp, const struct jzon_value *val);
+int64_t jzon_value_i64(const struct jzon_value *val);
+double jzon_value_double(const struct jzon_value *val);
+
+
 /*
  * emulation of JSON-C api
  */
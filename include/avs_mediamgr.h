@@ -96,6 +96,40 @@ void mediamgr_set_sound_mode(struct mediamgr *mm,
     
 void mediamgr_set_user_starts_audio(struct mediamgr *mediamgr, bool enable);
 
+/*
+ * Audio device pre-warming, off by default. Audio ready [ms] is when
+ * the call gets the device, not when the first audio frame is played.
+ */
+struct mediamgr_audio_stats {
+	uint32_t warm;           /* answered on a pre-warmed device     */
+	uint32_t cold;           /* opened the device on answer         */
+	uint32_t unused;         /* pre-warmed, released without a call */
+	uint32_t warm_ready_ms;  /* last answer to audio ready, warm    */
+	uint32_t cold_ready_ms;  /* last answer to audio ready, cold    */
+};
+
+void mediamgr_set_audio_prewarm(struct mediamgr *mediamgr, bool enable);
+int  mediamgr_get_audio_stats(const struct mediamgr *mediamgr,
+			      struct mediamgr_audio_stats *stats);
+
+/* Pre-warm bookkeeping, driven by the mediamgr thread, times in [ms] */
+#define MEDIAMGR_PREWARM_TIMEOUT  90000  /* longer than a call rings */
+
+struct mediamgr_prewarm {
+	bool warm;            /* device opened while ringing, not used yet */
+	uint64_t ts_warm;
+	uint64_t ts_answer;
+	struct mediamgr_audio_stats stats;
+};
+
+void mediamgr_prewarm_opened(struct mediamgr_prewarm *pw, uint64_t now);
+void mediamgr_prewarm_answered(struct mediamgr_prewarm *pw, uint64_t now);
+int64_t mediamgr_prewarm_handover(struct mediamgr_prewarm *pw, bool warm,
+				  uint64_t now);
+bool mediamgr_prewarm_expired(const struct mediamgr_prewarm *pw,
+			      uint64_t now);
+void mediamgr_prewarm_release(struct mediamgr_prewarm *pw);
+
 void mediamgr_enter_call(struct mediamgr *mediamgr);
 void mediamgr_exit_call(struct mediamgr *mediamgr);
 void mediamgr_audio_release(struct mediamgr *mediamgr);
@@ -0,0 +1,49 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVS_MEMBDELTA_H
+#define AVS_MEMBDELTA_H
+
+/*
+ * Member delta -- tracks the participant list of a call and encodes
+ * only what changed since the previous notification:
+ *
+ *   {"convid":"..","seq":7,"type":"delta",
+ *    "joined":[{"userid":..,"clientid":..,"aestab":..,"vrecv":..,
+ *               "muted":..}],
+ *    "changed":[...],
+ *    "left":[{"userid":..,"clientid":..}]}
+ *
+ * The first notification, and then every snapshot_interval ones, is
+ * a full roster with "type":"full" and a "members" array. A receiver
+ * that sees a gap in "seq" waits for the next full roster.
+ */
+
+struct wcall_members;
+struct membdelta;
+
+#define MEMBDELTA_SNAPSHOT_INTERVAL 50
+
+int  membdelta_alloc(struct membdelta **mdp, uint32_t snapshot_interval);
+int  membdelta_update(struct membdelta *md, const char *convid,
+		      const struct wcall_members *members, char **jsonp);
+void membdelta_resync(struct membdelta *md);
+uint32_t membdelta_seq(const struct membdelta *md);
+int  membdelta_debug(struct re_printf *pf, const struct membdelta *md);
+
+#endif
@@ -57,6 +57,7 @@ struct list *msystem_aucodecl(struct msystem *msys);
 struct list *msystem_vidcodecl(struct msystem *msys);
 bool msystem_get_loopback(struct msystem *msys);
 bool msystem_get_privacy(struct msystem *msys);
+uint32_t msystem_get_decode_budget(const struct msystem *msys);
 const char *msystem_get_interface(struct msystem *msys);
 void msystem_start(struct msystem *msys);
 void msystem_stop(struct msystem *msys);
@@ -65,6 +66,7 @@ int  msystem_push(struct msystem *msys, int op, void *arg);
 bool msystem_is_using_voe(struct msystem *msys);
 void msystem_enable_loopback(struct msystem *msys, bool enable);
 void msystem_enable_privacy(struct msystem *msys, bool enable);
+void msystem_set_decode_budget(struct msystem *msys, uint32_t maxc);
 void msystem_enable_kase(struct msystem *msys, bool enable);
 bool msystem_have_kase(const struct msystem *msys);
 void msystem_set_ifname(struct msystem *msys, const char *ifname);
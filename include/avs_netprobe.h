@@ -22,6 +22,35 @@ struct netprobe_result {
 
 	size_t n_pkt_sent;
 	size_t n_pkt_recv;
+
+	/* RTT distribution in [micro-seconds] */
+	uint32_t rtt_min;
+	uint32_t rtt_p50;
+	uint32_t rtt_p90;
+	uint32_t rtt_p99;
+	uint32_t rtt_max;
+
+	uint32_t jitter;          /* inter-arrival jitter, RFC 3550 [us] */
+
+	size_t n_lost;
+	size_t n_loss_bursts;     /* runs of consecutive lost packets   */
+	size_t loss_burst_max;    /* longest run of lost packets        */
+	size_t n_reordered;       /* arrived after a later packet       */
+	size_t n_dup;
+
+	uint32_t bw_kbps;         /* available bandwidth, 0 if not probed */
+};
+
+/*
+ * One probe packet. Packets of bandwidth trains have train > 0,
+ * the regular probe packets have train 0.
+ */
+struct netprobe_sample {
+	uint64_t ts_tx;    /* micro-seconds                 */
+	uint64_t ts_rx;    /* micro-seconds, 0 if lost      */
+	uint32_t size;     /* packet size in bytes          */
+	uint16_t train;
+	uint16_t dup;      /* number of duplicates received */
 };
 
 typedef void (netprobe_h)(int err, const struct netprobe_result *result,
@@ -35,3 +64,12 @@ int netprobe_alloc(struct netprobe **npb, const struct sa *turn_srv,
 		   const char *turn_username, const char *turn_password,
 		   size_t pkt_count, uint32_t pkt_interval_ms,
 		   netprobe_h *h, void *arg);
+int netprobe_set_bwprobe(struct netprobe *np, uint32_t trainc,
+			 uint32_t train_len, uint32_t max_size);
+const struct netprobe_sample *netprobe_samples(const struct netprobe *np,
+					       size_t *sampc);
+
+int netprobe_analyze(struct netprobe_result *result,
+		     const struct netprobe_sample *sampv, size_t sampc);
+int netprobe_result_debug(struct re_printf *pf,
+			  const struct netprobe_result *result);
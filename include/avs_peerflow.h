@@ -27,6 +27,10 @@ int peerflow_alloc(struct iflow		**flowp,
 
 void capture_source_handle_frame(struct avs_vidframe *frame);
 
+int peerflow_get_frame_stats(const struct iflow *flow,
+			     enum frame_media_type mtype, bool tx,
+			     struct frame_stats *stats);
+
 int peerflow_get_userid_for_ssrc(struct peerflow* pf,
 				 uint32_t csrc,
 				 bool video,
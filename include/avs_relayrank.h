@@ -0,0 +1,50 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AVS_RELAYRANK_H
+#define AVS_RELAYRANK_H
+
+/*
+ * Relay ranking -- probes all configured TURN servers in parallel and
+ * keeps an exponentially decayed RTT and loss score per server. The
+ * cost of a server is its RTT plus a penalty per permille of loss,
+ * in [micro-seconds]; lower is better.
+ */
+
+struct relayrank;
+struct zapi_ice_server;
+struct netprobe_result;
+
+/* The ranking changed */
+typedef void (relayrank_h)(void *arg);
+
+#define RELAYRANK_INTERVAL 300  /* seconds between probe rounds */
+
+int  relayrank_alloc(struct relayrank **rrp, relayrank_h *h, void *arg);
+int  relayrank_set_servers(struct relayrank *rr,
+			   const struct zapi_ice_server *srvv, size_t srvc);
+int  relayrank_start(struct relayrank *rr, uint32_t interval);
+void relayrank_stop(struct relayrank *rr);
+int  relayrank_update(struct relayrank *rr, const char *url, int err,
+		      const struct netprobe_result *result);
+uint32_t relayrank_cost(const struct relayrank *rr, const char *url);
+int  relayrank_sort(const struct relayrank *rr,
+		    struct zapi_ice_server *srvv, size_t srvc);
+int  relayrank_debug(struct re_printf *pf, const struct relayrank *rr);
+
+#endif
@@ -49,6 +49,22 @@ int chunk_encode(struct mbuf *mb, const uint8_t *p, size_t len);
 int chunk_decode(uint8_t **bufp, size_t *lenp, struct mbuf *mb_in);
 
 
+/*
+ * Incremental JSON, hands out the elements of one array as they arrive
+ */
+
+struct jstream;
+
+typedef void (jstream_item_h)(struct json_object *jobj, void *arg);
+
+int  jstream_alloc(struct jstream **jsp, const char *key,
+		   jstream_item_h *itemh, void *arg);
+int  jstream_write(struct jstream *js, const uint8_t *buf, size_t len);
+struct mbuf *jstream_envelope(const struct jstream *js);
+size_t jstream_count(const struct jstream *js);
+size_t jstream_buffered(const struct jstream *js);
+
+
 /*
  * Cookie jar
  */
@@ -92,6 +108,23 @@ struct login_token *login_get_token(const struct login *login);
 struct rest_cli;
 struct rest_req;
 
+/*
+ * Requests are scheduled per host, lowest prio value first and in
+ * order of arrival within the same prio. A queued request ages, it
+ * catches up one prio level for each prio_age [ms] it waits, so low
+ * prio requests are not starved. At most maxopen requests are in
+ * flight to each host.
+ */
+struct rest_stats {
+	uint32_t queued;         /* waiting for a free slot         */
+	uint32_t inflight;       /* sent, waiting for the response  */
+	uint32_t inflight_max;
+	uint64_t nreq;           /* sent since the client was created */
+	uint64_t wait_total_ms;  /* time spent queued, all requests */
+	uint32_t wait_max_ms;
+	size_t body_max;         /* largest response body buffered  */
+};
+
 
 int  rest_client_alloc(struct rest_cli **restp, struct http_cli *http,
 		       const char *server_uri, struct store *store,
@@ -99,6 +132,9 @@ int  rest_client_alloc(struct rest_cli **restp, struct http_cli *http,
 void rest_client_set_token(struct rest_cli *rest,
 			   const struct login_token *token);
 int  rest_client_debug(struct re_printf *pf, const struct rest_cli *cli);
+void rest_client_set_prio_age(struct rest_cli *cli, uint32_t ms);
+int  rest_client_get_stats(const struct rest_cli *cli,
+			   struct rest_stats *stats);
 
 int rest_req_alloc(struct rest_req **rrp,
 		   rest_resp_h *resph, void *arg, const char *method,
@@ -107,6 +143,8 @@ int rest_req_valloc(struct rest_req **rrp,
 		    rest_resp_h *resph, void *arg, const char *method,
 		    const char *path, va_list ap);
 int rest_req_set_raw(struct rest_req *rr, bool raw);
+int rest_req_set_items(struct rest_req *rr, const char *key,
+		       jstream_item_h *itemh);
 int rest_req_add_header(struct rest_req *rr, const char *fmt, ...);
 int rest_req_add_header_v(struct rest_req *rr, const char *fmt, va_list ap);
 int rest_req_add_body(struct rest_req *rr, const char *ctype,
@@ -51,7 +51,20 @@ void sdp_safe_media_set_lattr(struct sdp_media *sdpm, bool replace,
 
 typedef int (bundle_flow_update_h)(struct iflow *flow, const char *sdp);
 
-int bundle_update(struct iflow *flow,
+struct bundle_cache;
+
+int  bundle_cache_alloc(struct bundle_cache **bcp);
+void bundle_cache_flush(struct bundle_cache *bc);
+
+int bundle_generate(struct bundle_cache *bc,
+		    char **sdpp,
+		    enum icall_conv_type conv_type,
+		    bool include_audio,
+		    const char *remote_sdp,
+		    struct list *conf_membl);
+
+int bundle_update(struct bundle_cache *bc,
+		  struct iflow *flow,
 		  enum icall_conv_type conv_type,
 		  bool include_audio,
 		  const char *remote_sdp,
@@ -138,6 +138,21 @@ typedef void (wcall_group_changed_h)(const char *convid, void *arg);
 
 typedef void (wcall_participant_changed_h)(const char *convid,
 					   const char *mjson, void *arg);
+
+/**
+ * Opt-in alternative to wcall_participant_changed_h for large calls:
+ * only the members that joined, left or changed since the previous
+ * notification are reported. Every notification carries a sequence
+ * number, a full roster is sent first and then periodically, so
+ * that a receiver that missed one can resync.
+ *
+ * @param convid   Conversation id on which participant list has changed
+ * @param djson    Delta or full roster, see avs_membdelta.h
+ * @param arg      User context passed to
+ *                 wcall_set_participant_delta_handler
+ */
+typedef void (wcall_participant_delta_h)(const char *convid,
+					 const char *djson, void *arg);
 	
 /* Media has been established */
 typedef void (wcall_media_estab_h)(const char *convid,
@@ -183,7 +198,13 @@ typedef void (wcall_close_h)(int reason,
 			     const char *userid,
 			     const char *clientid,
 			     void *arg);
-/* Call metrics */
+/* Call metrics
+ *
+ * When a call ends, the metrics object always holds the call setup
+ * timeline next to the other metrics, the [ms] from start or answer
+ * to each setup phase that was reached:
+ * {...,"setup_timeline":{"config_req":0,"config_resp":85,...}}
+ */
 typedef void (wcall_metrics_h)(const char *convid,
     const char *metrics_json, void *arg);
 
@@ -396,6 +417,11 @@ void wcall_set_video_handlers(wcall_render_frame_h *render_frame_h,
 
 void wcall_network_changed(WUSER_HANDLE wuser);
 
+/* The app came to the foreground, refresh the call config if it is
+ * about to expire so that the next call does not wait for it.
+ */
+void wcall_app_foreground(WUSER_HANDLE wuser);
+
 void wcall_set_group_changed_handler(WUSER_HANDLE wuser,
 				     wcall_group_changed_h *chgh,
 				     void *arg);
@@ -403,6 +429,14 @@ void wcall_set_group_changed_handler(WUSER_HANDLE wuser,
 void wcall_set_participant_changed_handler(WUSER_HANDLE wuser,
 					   wcall_participant_changed_h *chgh,
 					   void *arg);
+
+/* snapshot_interval: send a full roster every this many notifications,
+ * 0 for the default
+ */
+void wcall_set_participant_delta_handler(WUSER_HANDLE wuser,
+					 wcall_participant_delta_h *deltah,
+					 int snapshot_interval,
+					 void *arg);
 	
 
 int wcall_set_network_quality_handler(WUSER_HANDLE wuser,
@@ -423,6 +457,20 @@ struct re_printf;
 int  wcall_debug(struct re_printf *pf, WUSER_HANDLE wuser);
 int  wcall_stats(struct re_printf *pf, WUSER_HANDLE wuser);
 
+#define WCALL_TRACE_FMT_BINARY 0 /* for the tracemerge tool */
+#define WCALL_TRACE_FMT_NDJSON 1
+
+typedef void (wcall_trace_h)(const uint8_t *buf, size_t len, void *arg);
+
+/*
+ * Export the econn message trace of a 1:1 call, anonymized, to attach
+ * to a bug report. The handler is called before this returns.
+ * Returns ENOENT if there is no such call, ENOTSUP if it keeps no
+ * trace.
+ */
+int  wcall_trace_export(WUSER_HANDLE wuser, const char *convid, int fmt,
+			wcall_trace_h *traceh, void *arg);
+
 
 #define WCALL_STATE_NONE         0 /* There is no call */
 #define WCALL_STATE_OUTGOING     1 /* Outgoing call is pending */
@@ -473,6 +521,11 @@ void wcall_free_members(struct wcall_members *members);
 
 void wcall_enable_privacy(WUSER_HANDLE wuser, int enabled);
 
+/* Decode and mix only the max_streams loudest participants,
+ * 0 (the default) decodes everybody.
+ */
+void wcall_set_decode_budget(WUSER_HANDLE wuser, int max_streams);
+
 struct mediamgr *wcall_mediamgr(WUSER_HANDLE wuser);
 
 void wcall_handle_frame(struct avs_vidframe *frame);
@@ -496,6 +549,11 @@ void wcall_set_active_speaker_handler(WUSER_HANDLE wuser,
 	
 int wcall_set_proxy(const char *host, int port);
 
+/* Run the captured audio through up to 4 effects (enum audio_effect),
+ * in this order, during calls. An empty list turns them off.
+ */
+int wcall_set_voice_effects(const int *effectv, size_t effectc);
+
 		     
 /*
  * Netprobe
@@ -512,9 +570,46 @@ int wcall_netprobe(WUSER_HANDLE wuser,
 		   size_t pkt_count, uint32_t pkt_interval_ms,
 		   wcall_netprobe_h *netprobeh, void *arg);
 
+/*
+ * Same probe as wcall_netprobe, also reporting the 99th percentile
+ * RTT, the inter-arrival jitter and the packet loss. Times are in
+ * micro-seconds, loss_burst_max is the longest run of lost packets.
+ */
+typedef void (wcall_netprobe_stats_h)(int err,
+				      uint32_t rtt_avg,
+				      uint32_t rtt_p99,
+				      uint32_t jitter,
+				      size_t n_pkt_sent,
+				      size_t n_pkt_recv,
+				      size_t n_lost,
+				      size_t loss_burst_max,
+				      void *arg);
+
+int wcall_netprobe_stats(WUSER_HANDLE wuser,
+			 size_t pkt_count, uint32_t pkt_interval_ms,
+			 wcall_netprobe_stats_h *statsh, void *arg);
+
+/*
+ * Probe all TURN servers of the call config in the background, every
+ * interval seconds, and order the ICE and SFT ICE servers handed to
+ * new calls by measured RTT and loss. An interval of 0 turns it off.
+ */
+int wcall_set_relay_ranking(WUSER_HANDLE wuser, int interval /* in s */);
+
 
 void wcall_thread_main(int *error, int *initialized);
 int wcall_run(void);
+
+/*
+ * Host the calling instances on n AVS threads, each with its own main
+ * loop, instead of funnelling them all through one. Instances are
+ * spread round-robin by wcall_create and stay on their thread; the
+ * handlers of an instance are called from it. Start the shards after
+ * wcall_init and before the first wcall_create, and stop them after
+ * the last wcall_destroy.
+ */
+int  wcall_run_shards(unsigned n);
+void wcall_stop_shards(void);
 void wcall_poll(void);
 int wcall_setup(void);
 
@@ -32,6 +32,7 @@
 
 #--- AVS Core Modules ---
 
+AVS_MODULES += aufanout
 AVS_MODULES += base
 AVS_MODULES += cert
 AVS_MODULES += conf_pos
@@ -41,6 +42,7 @@ ifneq ($(HAVE_CRYPTOBOX),)
 AVS_MODULES += cryptobox
 endif
 AVS_MODULES += dce
+AVS_MODULES += decbudget
 AVS_MODULES += dict
 AVS_MODULES += ecall
 AVS_MODULES += econn
@@ -56,7 +58,9 @@ endif
 AVS_MODULES += keystore
 AVS_MODULES += log
 AVS_MODULES += mediamgr
+AVS_MODULES += membdelta
 AVS_MODULES += msystem
+AVS_MODULES += netprobe_analyze
 AVS_MODULES += nevent
 ifeq ($(AVS_OS),wasm)
 AVS_MODULES += jsflow
@@ -69,6 +73,7 @@ ifneq ($(HAVE_PROTOBUF),)
 AVS_MODULES += protobuf
 endif
 AVS_MODULES += queue
+AVS_MODULES += relayrank
 AVS_MODULES += rest
 AVS_MODULES += sdp
 AVS_MODULES += sem
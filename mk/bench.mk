@@ -0,0 +1,51 @@
+#
+# Makefile snippet for building the benchmarks
+#
+
+BENCH_MK := bench/srcs.mk
+BENCH_BIN := avs_bench
+
+include $(BENCH_MK)
+
+BENCH_MKS := $(OUTER_MKS) mk/bench.mk $(BENCH_MK)
+BENCH_OBJ_PATH := $(BUILD_OBJ)/bench
+
+BENCH_OBJS := $(patsubst %.c,$(BENCH_OBJ_PATH)/%.o,\
+			$(filter %.c,$(BENCH_SRCS)))
+
+BENCH_DEPS += $(AVS_DEPS) $(MENG_DEPS)
+BENCH_LIBS += $(AVS_LIBS) $(MENG_LIBS)
+
+ifeq ($(AVS_OS),android)
+    LFLAGS += -fPIE -pie
+endif
+
+-include $(BENCH_OBJS:.o=.d)
+
+$(BENCH_OBJS): $(TOOLCHAIN_MASTER) $(BENCH_DEPS)
+
+ifeq ($(SKIP_MK_DEPS),)
+$(BENCH_OBJS): $(BENCH_MKS)
+endif
+
+$(BENCH_OBJS): $(BENCH_OBJ_PATH)/%.o: bench/%.c
+	@echo "  CC   $(AVS_OS)-$(AVS_ARCH) bench/$*.c"
+	@mkdir -p $(dir $@)
+	@$(CC)  $(CPPFLAGS) $(CFLAGS) \
+		$(AVS_CPPFLAGS) $(AVS_CFLAGS) \
+		$(BENCH_CPPFLAGS) $(BENCH_CFLAGS) \
+		-c $< -o $@ $(DFLAGS)
+
+$(BUILD_BIN)/$(BENCH_BIN)$(BIN_SUFFIX): $(BENCH_OBJS) $(AVS_STATIC) $(MENG_STATIC)
+	@echo "  LD      $@"
+	@mkdir -p $(BUILD_BIN)
+	@$(CXX) $(LFLAGS) $(BENCH_LFLAGS) \
+		$^ $(BENCH_LIBS) $(LIBS) -o $@
+
+
+#--- Phony Targets ---
+
+.PHONY: bench bench_clean
+bench: $(BUILD_BIN)/$(BENCH_BIN)$(BIN_SUFFIX)
+bench_clean:
+	@rm -f $(BUILD_BIN)/$(BENCH_BIN)$(BIN_SUFFIX)
@@ -3,6 +3,7 @@
 #
 
 TOOLS_ALL += zcall
+TOOLS_ALL += tracemerge
 
 TOOLS_MKS := $(patsubst %,tools/%/tool.mk,$(TOOLS_ALL))
 TOOLS_OBJ_PATH := $(BUILD_OBJ)/tools
@@ -0,0 +1,548 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/* Offline audio file I/O for the effect converters
+ *
+ * Input files are mapped into memory, so a converter can walk the
+ * samples in any direction without seeking. Output goes through a
+ * large buffer, and the WAV header is written up front and patched
+ * with the final sizes on close.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_audio_effect.h"
+
+
+enum {
+	WRITE_BUF_SIZE  = 256 * 1024,   /* [bytes] */
+
+	WAVE_FORMAT_PCM        = 0x0001,
+	WAVE_FORMAT_IEEE_FLOAT = 0x0003,
+	WAVE_FORMAT_EXTENSIBLE = 0xfffe,
+
+	/* offsets of the size fields in the header we write */
+	RIFF_SIZE_OFFSET = 4,
+	WAV_HDR_SIZE     = 44,
+	FLOAT_HDR_SIZE   = 58,
+};
+
+
+struct audio_reader {
+	uint8_t *map;
+	size_t map_len;
+
+	const int16_t *sampv;
+	size_t sampc;
+	int fs_hz;
+	int channels;
+};
+
+struct audio_writer {
+	int fd;
+	enum audio_file_fmt fmt;
+	int fs_hz;
+	int channels;
+
+	uint8_t *buf;
+	size_t buf_len;
+	uint64_t data_len;      /* [bytes] written after the header */
+	bool closed;
+};
+
+
+static uint16_t get_le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8
+		| (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static uint8_t *put_le16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = v >> 8;
+
+	return p + 2;
+}
+
+
+static uint8_t *put_le32(uint8_t *p, uint32_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = v >> 24;
+
+	return p + 4;
+}
+
+
+static uint8_t *put_tag(uint8_t *p, const char *tag)
+{
+	memcpy(p, tag, 4);
+
+	return p + 4;
+}
+
+
+static void reader_destructor(void *arg)
+{
+	struct audio_reader *ar = arg;
+
+	if (ar->map)
+		munmap(ar->map, ar->map_len);
+}
+
+
+/*
+ * Walk the RIFF chunks for "fmt " and "data". Only 16-bit PCM is
+ * accepted, the effects work on int16 samples. A data chunk that
+ * claims more than the file holds, as written by a recorder that
+ * did not get to finish its header, is cut at the end of the file.
+ */
+static int wav_parse(struct audio_reader *ar)
+{
+	const uint8_t *p = ar->map, *end = ar->map + ar->map_len;
+	bool have_fmt = false;
+
+	if (ar->map_len < 12 || memcmp(p, "RIFF", 4) ||
+	    memcmp(p + 8, "WAVE", 4)) {
+		warning("audio_file: not a RIFF/WAVE file\n");
+		return EPROTO;
+	}
+
+	p += 12;
+
+	while (end - p >= 8) {
+		const uint32_t size = get_le32(p + 4);
+		const uint8_t *body = p + 8;
+		size_t avail = end - body;
+
+		if (0 == memcmp(p, "fmt ", 4)) {
+			uint16_t format, bits;
+
+			if (size < 16 || avail < 16)
+				return EPROTO;
+
+			format = get_le16(body);
+			ar->channels = get_le16(body + 2);
+			ar->fs_hz = get_le32(body + 4);
+			bits = get_le16(body + 14);
+
+			if ((format != WAVE_FORMAT_PCM &&
+			     format != WAVE_FORMAT_EXTENSIBLE) || bits != 16) {
+				warning("audio_file: unsupported format 0x%04x"
+					" with %u bits\n", format, bits);
+				return ENOTSUP;
+			}
+
+			have_fmt = true;
+		}
+		else if (0 == memcmp(p, "data", 4)) {
+
+			if (!have_fmt)
+				return EPROTO;
+
+			ar->sampv = (const int16_t *)(void *)body;
+			ar->sampc = min((size_t)size, avail) / sizeof(int16_t);
+
+			return 0;
+		}
+
+		/* chunks are padded to an even size */
+		if ((size_t)size + (size & 1) >= avail)
+			break;
+
+		p = body + size + (size & 1);
+	}
+
+	warning("audio_file: no %s chunk\n", have_fmt ? "data" : "fmt");
+
+	return EPROTO;
+}
+
+
+int audio_reader_open(struct audio_reader **arp, const char *path,
+		      enum audio_file_fmt fmt, int fs_hz)
+{
+	struct audio_reader *ar;
+	struct stat st;
+	int fd, err = 0;
+
+	if (!arp || !path || fmt == AUDIO_FILE_WAV_FLOAT)
+		return EINVAL;
+
+	if (fmt == AUDIO_FILE_PCM && fs_hz <= 0)
+		return EINVAL;
+
+	ar = mem_zalloc(sizeof(*ar), reader_destructor);
+	if (!ar)
+		return ENOMEM;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		err = errno;
+		warning("audio_file: %s: open failed (%m)\n", path, err);
+		goto out;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		err = errno;
+		goto out;
+	}
+
+	ar->map_len = st.st_size;
+	if (ar->map_len) {
+		void *map;
+
+		map = mmap(NULL, ar->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			err = errno;
+			warning("audio_file: %s: mmap failed (%m)\n",
+				path, err);
+			goto out;
+		}
+
+		ar->map = map;
+	}
+
+	if (fmt == AUDIO_FILE_WAV) {
+		err = wav_parse(ar);
+		if (err)
+			goto out;
+	}
+	else {
+		ar->sampv = (const int16_t *)(void *)ar->map;
+		ar->sampc = ar->map_len / sizeof(int16_t);
+		ar->fs_hz = fs_hz;
+		ar->channels = 1;
+	}
+
+	if (ar->fs_hz < 8000 || ar->fs_hz > 192000 || !ar->channels) {
+		warning("audio_file: %s: bad sample rate %d\n",
+			path, ar->fs_hz);
+		err = EPROTO;
+		goto out;
+	}
+
+ out:
+	if (fd >= 0)
+		close(fd);
+
+	if (err)
+		mem_deref(ar);
+	else
+		*arp = ar;
+
+	return err;
+}
+
+
+/* All samples, valid for the lifetime of the reader */
+const int16_t *audio_reader_samples(const struct audio_reader *ar,
+				    size_t *sampc)
+{
+	if (!ar)
+		return NULL;
+
+	if (sampc)
+		*sampc = ar->sampc;
+
+	return ar->sampv;
+}
+
+
+int audio_reader_srate(const struct audio_reader *ar)
+{
+	return ar ? ar->fs_hz : 0;
+}
+
+
+int audio_reader_channels(const struct audio_reader *ar)
+{
+	return ar ? ar->channels : 0;
+}
+
+
+static int write_all(int fd, const uint8_t *p, size_t len)
+{
+	while (len) {
+		ssize_t n = write(fd, p, len);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno;
+		}
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+
+static int writer_flush(struct audio_writer *aw)
+{
+	int err;
+
+	if (!aw->buf_len)
+		return 0;
+
+	err = write_all(aw->fd, aw->buf, aw->buf_len);
+	aw->buf_len = 0;
+
+	return err;
+}
+
+
+static size_t header_size(enum audio_file_fmt fmt)
+{
+	switch (fmt) {
+
+	case AUDIO_FILE_WAV:       return WAV_HDR_SIZE;
+	case AUDIO_FILE_WAV_FLOAT: return FLOAT_HDR_SIZE;
+	default:                   return 0;
+	}
+}
+
+
+/*
+ * The canonical header, fmt and data chunks only. Float files also
+ * carry the fact chunk that non-PCM formats are required to have.
+ */
+static void header_encode(uint8_t *hdr, const struct audio_writer *aw)
+{
+	const bool flt = aw->fmt == AUDIO_FILE_WAV_FLOAT;
+	const uint16_t bytes = flt ? sizeof(float) : sizeof(int16_t);
+	const uint32_t data_len = (uint32_t)min(aw->data_len,
+						(uint64_t)UINT32_MAX - 64);
+	uint8_t *p = hdr;
+
+	p = put_tag(p, "RIFF");
+	p = put_le32(p, header_size(aw->fmt) - 8 + data_len);
+	p = put_tag(p, "WAVE");
+
+	p = put_tag(p, "fmt ");
+	p = put_le32(p, flt ? 18 : 16);
+	p = put_le16(p, flt ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM);
+	p = put_le16(p, aw->channels);
+	p = put_le32(p, aw->fs_hz);
+	p = put_le32(p, aw->fs_hz * aw->channels * bytes);
+	p = put_le16(p, aw->channels * bytes);
+	p = put_le16(p, bytes * 8);
+
+	if (flt) {
+		p = put_le16(p, 0);
+		p = put_tag(p, "fact");
+		p = put_le32(p, 4);
+		p = put_le32(p, data_len / (aw->channels * bytes));
+	}
+
+	p = put_tag(p, "data");
+	p = put_le32(p, data_len);
+}
+
+
+static void writer_destructor(void *arg)
+{
+	struct audio_writer *aw = arg;
+
+	if (!aw->closed)
+		(void)audio_writer_close(aw);
+
+	mem_deref(aw->buf);
+}
+
+
+int audio_writer_open(struct audio_writer **awp, const char *path,
+		      enum audio_file_fmt fmt, int fs_hz, int channels)
+{
+	struct audio_writer *aw;
+	int err = 0;
+
+	if (!awp || !path || fs_hz <= 0 || channels <= 0)
+		return EINVAL;
+
+	aw = mem_zalloc(sizeof(*aw), writer_destructor);
+	if (!aw)
+		return ENOMEM;
+
+	aw->fd = -1;
+	aw->closed = true;
+	aw->fmt = fmt;
+	aw->fs_hz = fs_hz;
+	aw->channels = channels;
+
+	aw->buf = mem_alloc(WRITE_BUF_SIZE, NULL);
+	if (!aw->buf) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	aw->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (aw->fd < 0) {
+		err = errno;
+		warning("audio_file: %s: open failed (%m)\n", path, err);
+		goto out;
+	}
+
+	aw->closed = false;
+
+	/* a placeholder until the sizes are known */
+	aw->buf_len = header_size(fmt);
+	if (aw->buf_len)
+		header_encode(aw->buf, aw);
+
+ out:
+	if (err)
+		mem_deref(aw);
+	else
+		*awp = aw;
+
+	return err;
+}
+
+
+int audio_writer_write(struct audio_writer *aw,
+		       const int16_t *sampv, size_t sampc)
+{
+	const size_t ssz = aw && aw->fmt == AUDIO_FILE_WAV_FLOAT
+		? sizeof(float) : sizeof(int16_t);
+	int err;
+
+	if (!aw || (!sampv && sampc))
+		return EINVAL;
+
+	if (aw->closed)
+		return EBADF;
+
+	while (sampc) {
+		size_t n = min(sampc, (WRITE_BUF_SIZE - aw->buf_len) / ssz);
+
+		if (!n) {
+			err = writer_flush(aw);
+			if (err)
+				return err;
+			continue;
+		}
+
+		if (ssz == sizeof(float)) {
+			uint8_t *dst = &aw->buf[aw->buf_len];
+			size_t i;
+
+			/* the float header leaves dst unaligned */
+			for (i = 0; i < n; i++) {
+				const float f = sampv[i] * (1.0f / 32768.0f);
+
+				memcpy(dst + i * ssz, &f, ssz);
+			}
+		}
+		else {
+			memcpy(&aw->buf[aw->buf_len], sampv, n * ssz);
+		}
+
+		aw->buf_len += n * ssz;
+		aw->data_len += n * ssz;
+		sampv += n;
+		sampc -= n;
+	}
+
+	return 0;
+}
+
+
+/* Append sampc zero samples */
+int audio_writer_silence(struct audio_writer *aw, size_t sampc)
+{
+	int16_t zero[256];
+	int err = 0;
+
+	memset(zero, 0, sizeof(zero));
+
+	while (sampc && !err) {
+		size_t n = min(sampc, ARRAY_SIZE(zero));
+
+		err = audio_writer_write(aw, zero, n);
+		sampc -= n;
+	}
+
+	return err;
+}
+
+
+uint64_t audio_writer_samples(const struct audio_writer *aw)
+{
+	if (!aw)
+		return 0;
+
+	return aw->data_len / (aw->fmt == AUDIO_FILE_WAV_FLOAT
+			       ? sizeof(float) : sizeof(int16_t));
+}
+
+
+/*
+ * Flush the buffer and write the final sizes into the header.
+ * Releasing an open writer closes it too, but the error is lost.
+ */
+int audio_writer_close(struct audio_writer *aw)
+{
+	uint8_t hdr[FLOAT_HDR_SIZE];
+	size_t hdr_len;
+	int err;
+
+	if (!aw)
+		return EINVAL;
+
+	if (aw->closed)
+		return 0;
+
+	aw->closed = true;
+
+	err = writer_flush(aw);
+
+	hdr_len = header_size(aw->fmt);
+	if (!err && hdr_len) {
+		header_encode(hdr, aw);
+
+		if (pwrite(aw->fd, hdr, hdr_len, 0) != (ssize_t)hdr_len)
+			err = errno ? errno : EIO;
+	}
+
+	if (close(aw->fd) < 0 && !err)
+		err = errno;
+
+	aw->fd = -1;
+
+	if (err)
+		warning("audio_file: write failed (%m)\n", err);
+
+	return err;
+}
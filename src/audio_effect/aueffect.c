@@ -91,6 +91,8 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_pitch_shift;
             aue->e_proc_h = pitch_shift_process;
+            aue->e_share_h = pitch_shift_share_pitch;
+            aue->alters_pitch = true;
             break;
         case AUDIO_EFFECT_PITCH_DOWN_SHIFT_INSANE:
             strength++;
@@ -104,6 +106,8 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_pitch_shift;
             aue->e_proc_h = pitch_shift_process;
+            aue->e_share_h = pitch_shift_share_pitch;
+            aue->alters_pitch = true;
             break;
         case AUDIO_EFFECT_PACE_DOWN_SHIFT_MAX:
             strength++;
@@ -115,6 +119,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_free_h = free_pace_shift;
             aue->e_proc_h = pace_shift_process;
             aue->e_length_h = pace_shift_length_factor;
+            aue->e_share_h = pace_shift_share_pitch;
             break;
         case AUDIO_EFFECT_PACE_UP_SHIFT_MAX:
             strength++;
@@ -126,6 +131,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_free_h = free_pace_shift;
             aue->e_proc_h = pace_shift_process;
             aue->e_length_h = pace_shift_length_factor;
+            aue->e_share_h = pace_shift_share_pitch;
             break;
         case AUDIO_EFFECT_VOCODER_MED:
             strength++;            
@@ -134,6 +140,8 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_vocoder;
             aue->e_proc_h = vocoder_process;
+            aue->e_share_h = vocoder_share_pitch;
+            aue->alters_pitch = true;
             break;
         case AUDIO_EFFECT_AUTO_TUNE_MAX:
             strength++;
@@ -144,6 +152,7 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_auto_tune;
             aue->e_proc_h = auto_tune_process;
+            aue->e_share_h = auto_tune_share_pitch;
             break;
         case AUDIO_EFFECT_HARMONIZER_MAX:
             strength++;
@@ -154,6 +163,8 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_harmonizer;
             aue->e_proc_h = harmonizer_process;
+            aue->e_share_h = harmonizer_share_pitch;
+            aue->alters_pitch = true;
             break;
         case AUDIO_EFFECT_NORMALIZER:
             aue->e_create_h = create_normalizer;
@@ -170,6 +181,8 @@ int aueffect_alloc(struct aueffect **auep,
             aue->e_reset_h = NULL;
             aue->e_free_h = free_pitch_cycler;
             aue->e_proc_h = pitch_cycler_process;
+            aue->e_share_h = pitch_cycler_share_pitch;
+            aue->alters_pitch = true;
             break;
         case AUDIO_EFFECT_NONE:
             aue->e_create_h = create_pass_through;
@@ -232,3 +245,33 @@ int aueffect_length_modification(struct aueffect *aue, int *length_modification_
  
     return 0;
 }
+
+/*
+ * Let the effect use the pitch analysis of src, instead of running its
+ * own, or run its own again with src NULL. src must be analysed on
+ * the effect input, frame by frame, before the effect processes it.
+ */
+int aueffect_share_pitch(struct aueffect *aue, const struct pitch_estimator *src)
+{
+    if(!aue || !aue->effect){
+        return EINVAL;
+    }
+    if(!aue->e_share_h){
+        return ENOTSUP;
+    }
+
+    aue->e_share_h(aue->effect, src);
+
+    return 0;
+}
+
+/*
+ * Whether the output has another pitch than the input. The vocoder
+ * does, it excites its filter with a pulse train of its own period.
+ * Auto-tune moves the pitch by less than a semitone, which the pitch
+ * lags of the input still cover.
+ */
+bool aueffect_alters_pitch(const struct aueffect *aue)
+{
+    return aue ? aue->alters_pitch : false;
+}
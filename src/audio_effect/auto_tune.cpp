@@ -259,3 +259,10 @@ void auto_tune_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_
     
     *L_out = L_in;
 }
+
+void auto_tune_share_pitch(void *st, const struct pitch_estimator *src)
+{
+    struct auto_tune_effect *ate = (struct auto_tune_effect*)st;
+
+    ate->pest.shared = src;
+}
@@ -0,0 +1,621 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Real-time effect chain -- runs a few effects in series on the 10 ms
+ * frames of the capture path.
+ *
+ * The chain is configured from the app thread and processed on the
+ * audio thread. A configuration, with its effects, resamplers and
+ * buffers, is built entirely on the app side and handed over through
+ * one pointer. The audio thread swaps it in at the start of a frame
+ * and puts the old one on a retire list, which the app side frees on
+ * its next update. The audio thread never allocates, frees or locks.
+ * A configuration has resamplers for every rate the APM runs at, so
+ * a change of the stream rate only selects another pair of them.
+ *
+ * When several effects in a row read the pitch of the chain input,
+ * the chain analyses it once per frame and they all share the result.
+ */
+
+#include <string.h>
+#include <re.h>
+#include "avs_audio_effect.h"
+#include "find_pitch_lags.h"
+
+#include "common_audio/resampler/include/push_resampler.h"
+#include "modules/audio_processing/include/audio_processing.h"
+#include "modules/audio_processing/audio_buffer.h"
+
+extern "C" {
+#include "avs_log.h"
+}
+
+#define FS_PROC 32000
+
+#define FRAME_PROC (FS_PROC / 100)
+#define FRAME_MAX  (48000 / 100)
+
+#define ALOAD(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ASTORE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+enum {
+	OVERRUN_MAX = 3,   /* consecutive overruns before bypassing */
+};
+
+/* The stream rates of the APM */
+static const int ratev[] = {8000, 16000, 32000, 48000};
+#define RATEC ARRAY_SIZE(ratev)
+
+
+struct chain_cfg {
+	struct chain_cfg *next;     /* on the retire list */
+	size_t effectc;
+	struct aueffect *effectv[AUEFFECT_CHAIN_MAX];
+	struct {
+		webrtc::PushResampler<int16_t> *in;
+		webrtc::PushResampler<int16_t> *out;
+	} rsv[RATEC];               /* per index of ratev, none at FS_PROC */
+	int16_t bufv[2][FRAME_PROC];
+
+	struct pitch_estimator pest;
+	uint32_t pitch_shared;      /* effects using pest */
+};
+
+struct aueffect_chain {
+	/* update side, app thread */
+	struct lock *lock;
+
+	int fs_hz;                  /* any thread -> audio */
+	struct chain_cfg *pending;  /* app -> audio */
+	struct chain_cfg *retired;  /* audio -> app */
+
+	/* audio thread only */
+	struct chain_cfg *active;
+	uint32_t overrunc;
+
+	uint32_t budget_us;
+	bool bypass;
+	bool overloaded;
+
+	struct {
+		uint32_t frames;
+		uint32_t bypassed;
+		uint32_t overruns;
+		uint32_t last_us;
+		uint32_t max_us;
+		uint32_t pitch_shared;
+	} stats;
+};
+
+
+static void cfg_destructor(void *arg)
+{
+	struct chain_cfg *cfg = (struct chain_cfg *)arg;
+
+	for (size_t i = 0; i < cfg->effectc; i++)
+		mem_deref(cfg->effectv[i]);
+
+	if (cfg->pitch_shared)
+		free_find_pitch_lags(&cfg->pest);
+
+	for (size_t i = 0; i < RATEC; i++) {
+		delete cfg->rsv[i].in;
+		delete cfg->rsv[i].out;
+	}
+}
+
+
+static int rate_index(int fs_hz)
+{
+	for (size_t i = 0; i < RATEC; i++) {
+		if (ratev[i] == fs_hz)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+
+/*
+ * The effects up to and including the first one that changes the
+ * pitch all see the pitch of the chain input. If more than one of
+ * them runs a pitch analysis, they share one.
+ */
+static void share_pitch(struct chain_cfg *cfg)
+{
+	size_t i, n = 0;
+
+	for (i = 0; i < cfg->effectc; i++) {
+		if (cfg->effectv[i]->e_share_h)
+			++n;
+		if (aueffect_alters_pitch(cfg->effectv[i]))
+			break;
+	}
+
+	if (n < 2)
+		return;
+
+	init_find_pitch_lags(&cfg->pest, FS_PROC, 2);
+
+	for (i = 0; i < cfg->effectc; i++) {
+		if (!aueffect_share_pitch(cfg->effectv[i], &cfg->pest))
+			++cfg->pitch_shared;
+		if (aueffect_alters_pitch(cfg->effectv[i]))
+			break;
+	}
+}
+
+
+static int cfg_alloc(struct chain_cfg **cfgp,
+		     const enum audio_effect *effectv, size_t effectc)
+{
+	struct chain_cfg *cfg;
+	int err = 0;
+
+	cfg = (struct chain_cfg *)mem_zalloc(sizeof(*cfg), cfg_destructor);
+	if (!cfg)
+		return ENOMEM;
+
+	for (size_t i = 0; i < effectc; i++) {
+		if (aueffect_alloc(&cfg->effectv[i], effectv[i], FS_PROC)) {
+			err = EINVAL;
+			goto out;
+		}
+		++cfg->effectc;
+	}
+
+	share_pitch(cfg);
+
+	for (size_t i = 0; effectc && i < RATEC; i++) {
+		if (ratev[i] == FS_PROC)
+			continue;
+
+		cfg->rsv[i].in = new webrtc::PushResampler<int16_t>();
+		cfg->rsv[i].out = new webrtc::PushResampler<int16_t>();
+
+		if (cfg->rsv[i].in->InitializeIfNeeded(ratev[i], FS_PROC, 1) ||
+		    cfg->rsv[i].out->InitializeIfNeeded(FS_PROC, ratev[i], 1)) {
+			err = EINVAL;
+			goto out;
+		}
+	}
+
+ out:
+	if (err)
+		mem_deref(cfg);
+	else
+		*cfgp = cfg;
+
+	return err;
+}
+
+
+/* Audio thread: hand a configuration back to the app side */
+static void retire(struct aueffect_chain *chain, struct chain_cfg *cfg)
+{
+	struct chain_cfg *head;
+
+	if (!cfg)
+		return;
+
+	head = __atomic_load_n(&chain->retired, __ATOMIC_RELAXED);
+	do {
+		cfg->next = head;
+	} while (!__atomic_compare_exchange_n(&chain->retired, &head, cfg,
+					      true, __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
+
+
+/* App side: free what the audio thread has retired */
+static void reclaim(struct aueffect_chain *chain)
+{
+	struct chain_cfg *cfg;
+
+	cfg = __atomic_exchange_n(&chain->retired, NULL, __ATOMIC_ACQUIRE);
+	while (cfg) {
+		struct chain_cfg *next = cfg->next;
+
+		mem_deref(cfg);
+		cfg = next;
+	}
+}
+
+
+/*
+ * Build a configuration and post it for the next frame. A posted
+ * configuration the audio thread has not picked up yet was never
+ * seen by it, so it can be freed right here.
+ */
+static int publish(struct aueffect_chain *chain,
+		   const enum audio_effect *effectv, size_t effectc)
+{
+	struct chain_cfg *cfg = NULL, *old;
+	int err;
+
+	reclaim(chain);
+
+	err = cfg_alloc(&cfg, effectv, effectc);
+	if (err)
+		return err;
+
+	old = __atomic_exchange_n(&chain->pending, cfg, __ATOMIC_ACQ_REL);
+	mem_deref(old);
+
+	return 0;
+}
+
+
+static void destructor(void *arg)
+{
+	struct aueffect_chain *chain = (struct aueffect_chain *)arg;
+
+	mem_deref(chain->pending);
+	mem_deref(chain->active);
+	reclaim(chain);
+	mem_deref(chain->lock);
+}
+
+
+static bool valid_srate(int fs_hz)
+{
+	return rate_index(fs_hz) >= 0;
+}
+
+
+int aueffect_chain_alloc(struct aueffect_chain **chainp, int fs_hz,
+			 uint32_t budget_us)
+{
+	struct aueffect_chain *chain;
+	int err;
+
+	if (!chainp || !valid_srate(fs_hz))
+		return EINVAL;
+
+	chain = (struct aueffect_chain *)mem_zalloc(sizeof(*chain),
+						    destructor);
+	if (!chain)
+		return ENOMEM;
+
+	err = lock_alloc(&chain->lock);
+	if (err)
+		goto out;
+
+	chain->fs_hz = fs_hz;
+	chain->budget_us = budget_us ? budget_us : AUEFFECT_CHAIN_BUDGET;
+
+ out:
+	if (err)
+		mem_deref(chain);
+	else
+		*chainp = chain;
+
+	return err;
+}
+
+
+/*
+ * Set the effects to run, in order. Effects that change the length of
+ * the signal cannot run on a live stream. An empty list turns the
+ * chain off. Takes effect from the next frame on, and lifts a bypass
+ * caused by overruns.
+ */
+int aueffect_chain_set(struct aueffect_chain *chain,
+		       const enum audio_effect *effectv, size_t effectc)
+{
+	int err;
+
+	if (!chain || (!effectv && effectc) || effectc > AUEFFECT_CHAIN_MAX)
+		return EINVAL;
+
+	for (size_t i = 0; i < effectc; i++) {
+		switch (effectv[i]) {
+
+		case AUDIO_EFFECT_PACE_DOWN_SHIFT_MIN:
+		case AUDIO_EFFECT_PACE_DOWN_SHIFT_MED:
+		case AUDIO_EFFECT_PACE_DOWN_SHIFT_MAX:
+		case AUDIO_EFFECT_PACE_UP_SHIFT_MIN:
+		case AUDIO_EFFECT_PACE_UP_SHIFT_MED:
+		case AUDIO_EFFECT_PACE_UP_SHIFT_MAX:
+		case AUDIO_EFFECT_REVERSE:
+			return ENOTSUP;
+
+		default:
+			if ((int)effectv[i] < AUDIO_EFFECT_CHORUS ||
+			    (int)effectv[i] > AUDIO_EFFECT_NONE)
+				return EINVAL;
+			break;
+		}
+	}
+
+	lock_write_get(chain->lock);
+
+	err = publish(chain, effectv, effectc);
+
+	lock_rel(chain->lock);
+
+	if (err) {
+		warning("aueffect_chain(%p): set %zu effects failed (%m)\n",
+			chain, effectc, err);
+	}
+
+	return err;
+}
+
+
+/*
+ * Follow a new stream sample rate, from the next frame on. The effects
+ * and their state are kept. Only stores the rate, so it is safe to call
+ * from the audio thread.
+ */
+int aueffect_chain_set_srate(struct aueffect_chain *chain, int fs_hz)
+{
+	if (!chain || !valid_srate(fs_hz))
+		return EINVAL;
+
+	ASTORE(&chain->fs_hz, fs_hz);
+
+	return 0;
+}
+
+
+void aueffect_chain_set_budget(struct aueffect_chain *chain,
+			       uint32_t budget_us)
+{
+	if (!chain)
+		return;
+
+	ASTORE(&chain->budget_us,
+	       budget_us ? budget_us : (uint32_t)AUEFFECT_CHAIN_BUDGET);
+}
+
+
+void aueffect_chain_set_bypass(struct aueffect_chain *chain, bool bypass)
+{
+	if (!chain)
+		return;
+
+	ASTORE(&chain->bypass, bypass);
+	if (!bypass)
+		ASTORE(&chain->overloaded, false);
+}
+
+
+static void stat_inc(uint32_t *stat)
+{
+	__atomic_fetch_add(stat, 1, __ATOMIC_RELAXED);
+}
+
+
+static void frame_done(struct aueffect_chain *chain, uint32_t us, bool over)
+{
+	ASTORE(&chain->stats.last_us, us);
+	if (us > chain->stats.max_us)
+		ASTORE(&chain->stats.max_us, us);
+
+	if (!over) {
+		chain->overrunc = 0;
+		return;
+	}
+
+	stat_inc(&chain->stats.overruns);
+
+	if (++chain->overrunc >= OVERRUN_MAX)
+		ASTORE(&chain->overloaded, true);
+}
+
+
+/*
+ * Audio thread: run one 10 ms frame through the chain, in place.
+ *
+ * The budget is checked between effects, not inside them: an effect
+ * that has started runs to the end of the frame, so a frame can go
+ * over by up to the cost of one effect. A frame that is over goes out
+ * unprocessed, and after a few overruns in a row the chain bypasses
+ * itself, rather than delaying the capture path.
+ */
+int aueffect_chain_process(struct aueffect_chain *chain,
+			   int16_t *sampv, size_t sampc)
+{
+	struct chain_cfg *cfg;
+	webrtc::PushResampler<int16_t> *rs_in, *rs_out;
+	uint64_t t0, budget;
+	size_t i, n = 0;
+	int ix, cur = 0;
+	bool over = false;
+
+	if (!chain || !sampv)
+		return EINVAL;
+
+	if (ALOAD(&chain->pending)) {
+		cfg = __atomic_exchange_n(&chain->pending, NULL,
+					  __ATOMIC_ACQ_REL);
+		if (cfg) {
+			retire(chain, chain->active);
+			chain->active = cfg;
+			chain->overrunc = 0;
+			ASTORE(&chain->overloaded, false);
+			ASTORE(&chain->stats.max_us, 0u);
+			ASTORE(&chain->stats.pitch_shared, cfg->pitch_shared);
+		}
+	}
+
+	cfg = chain->active;
+	if (!cfg || !cfg->effectc)
+		return 0;
+
+	stat_inc(&chain->stats.frames);
+
+	ix = rate_index(ALOAD(&chain->fs_hz));
+	if (ix < 0 || sampc != (size_t)ratev[ix] / 100) {
+		stat_inc(&chain->stats.bypassed);
+		return EPROTO;
+	}
+
+	rs_in = cfg->rsv[ix].in;
+	rs_out = cfg->rsv[ix].out;
+
+	if (ALOAD(&chain->bypass) || ALOAD(&chain->overloaded)) {
+		stat_inc(&chain->stats.bypassed);
+		return 0;
+	}
+
+	budget = ALOAD(&chain->budget_us);
+	t0 = tmr_jiffies_usec();
+
+	if (rs_in)
+		rs_in->Resample(sampv, sampc, cfg->bufv[0], FRAME_PROC);
+	else
+		memcpy(cfg->bufv[0], sampv, sampc * sizeof(*sampv));
+
+	if (cfg->pitch_shared)
+		find_pitch_lags(&cfg->pest, cfg->bufv[0], FRAME_PROC);
+
+	for (i = 0; i < cfg->effectc; i++) {
+		aueffect_process(cfg->effectv[i], cfg->bufv[cur],
+				 cfg->bufv[cur ^ 1], FRAME_PROC, &n);
+		cur ^= 1;
+
+		if (n != FRAME_PROC || tmr_jiffies_usec() - t0 > budget) {
+			over = true;
+			break;
+		}
+	}
+
+	if (over) {
+		stat_inc(&chain->stats.bypassed);
+	}
+	else if (rs_out) {
+		rs_out->Resample(cfg->bufv[cur], FRAME_PROC, sampv, sampc);
+	}
+	else {
+		memcpy(sampv, cfg->bufv[cur], sampc * sizeof(*sampv));
+	}
+
+	frame_done(chain, (uint32_t)(tmr_jiffies_usec() - t0), over);
+
+	return 0;
+}
+
+
+void aueffect_chain_get_stats(const struct aueffect_chain *chain,
+			      struct aueffect_chain_stats *stats)
+{
+	if (!chain || !stats)
+		return;
+
+	stats->frames    = ALOAD(&chain->stats.frames);
+	stats->bypassed  = ALOAD(&chain->stats.bypassed);
+	stats->overruns  = ALOAD(&chain->stats.overruns);
+	stats->last_us   = ALOAD(&chain->stats.last_us);
+	stats->max_us    = ALOAD(&chain->stats.max_us);
+	stats->pitch_shared = ALOAD(&chain->stats.pitch_shared);
+	stats->budget_us = ALOAD(&chain->budget_us);
+	stats->overloaded = ALOAD(&chain->overloaded);
+}
+
+
+namespace wire {
+
+/*
+ * Runs the chain as the capture post-processing step of the APM, so
+ * the effects apply after echo cancellation and noise suppression.
+ */
+class EffectChainProcessing : public webrtc::CustomProcessing {
+public:
+	EffectChainProcessing(struct aueffect_chain *chain)
+		: chain_((struct aueffect_chain *)mem_ref(chain))
+	{
+	}
+
+	~EffectChainProcessing() override
+	{
+		mem_deref(chain_);
+	}
+
+	/* Called on the audio thread, only picks the resamplers */
+	void Initialize(int sample_rate_hz, int num_channels) override
+	{
+		int err;
+
+		(void)num_channels;
+
+		err = aueffect_chain_set_srate(chain_, sample_rate_hz);
+		if (err) {
+			warning("aueffect_chain(%p): %d Hz not supported"
+				" (%m)\n", chain_, sample_rate_hz, err);
+		}
+	}
+
+	void Process(webrtc::AudioBuffer *audio) override
+	{
+		float *const *chv = audio->channels();
+		size_t n = audio->num_frames();
+		size_t i, ch;
+
+		if (n > FRAME_MAX || idle())
+			return;
+
+		for (i = 0; i < n; i++) {
+			float s = chv[0][i];
+
+			s16_[i] = s > 32767.f ? 32767
+				: s < -32768.f ? -32768 : (int16_t)s;
+		}
+
+		if (aueffect_chain_process(chain_, s16_, n))
+			return;
+
+		for (ch = 0; ch < audio->num_channels(); ch++) {
+			for (i = 0; i < n; i++)
+				chv[ch][i] = s16_[i];
+		}
+	}
+
+	std::string ToString() const override
+	{
+		return "wire::EffectChainProcessing";
+	}
+
+private:
+	/* Nothing to run, and nothing waiting to be swapped in */
+	bool idle() const
+	{
+		const struct chain_cfg *cfg = chain_->active;
+
+		return !ALOAD(&chain_->pending) && (!cfg || !cfg->effectc);
+	}
+
+	struct aueffect_chain *chain_;
+	int16_t s16_[FRAME_MAX];
+};
+
+}
+
+
+void *aueffect_chain_capture_processing(struct aueffect_chain *chain)
+{
+	webrtc::CustomProcessing *proc;
+
+	if (!chain)
+		return NULL;
+
+	proc = new wire::EffectChainProcessing(chain);
+
+	return proc;
+}
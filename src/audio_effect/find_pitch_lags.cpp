@@ -38,6 +38,7 @@ void init_find_pitch_lags(struct pitch_estimator *pest, int fs_hz, int complexit
     pest->resampler = new webrtc::PushResampler<int16_t>;
     pest->resampler->InitializeIfNeeded(fs_hz, 16000, 1);
     pest->fs_khz = fs_hz/1000;
+    pest->shared = NULL;
     if(complexity < 0){
         pest->complexity = 0;
     }
@@ -51,8 +52,20 @@ void free_find_pitch_lags(struct pitch_estimator *pest)
     delete pest->resampler;
 }
 
+static void copy_pitch_lags(struct pitch_estimator *pest,
+                            const struct pitch_estimator *src)
+{
+    memcpy(pest->pitchL, src->pitchL, sizeof(pest->pitchL));
+    pest->LTPCorr_Q15 = src->LTPCorr_Q15;
+    pest->voiced = src->voiced;
+}
+
 void find_pitch_lags(struct pitch_estimator *pest, int16_t x[], int L)
 {
+    if(pest->shared){
+        copy_pitch_lags(pest, pest->shared);
+        return;
+    }
 #if !defined(WEBRTC_ARCH_ARM)
     silk_float thrhld, res_nrg;
     silk_float auto_corr[ Z_LPC_ORDER + 1 ];
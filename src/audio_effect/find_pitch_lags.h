@@ -38,6 +38,11 @@
 #define Z_WIN_LEN_MS 2
 #define Z_FS_KHZ 16
 
+/*
+ * The analysis result (lags, voicing and LTP correlation) can be
+ * shared: an estimator with shared set takes the result of that one,
+ * which the owner analyses once per frame, and skips its own analysis.
+ */
 struct pitch_estimator {
     int16_t buf[Z_MAX_FS_KHZ*40];
     webrtc::PushResampler<int16_t> *resampler;
@@ -46,6 +51,7 @@ struct pitch_estimator {
     int fs_khz;
     int complexity;
     bool voiced;
+    const struct pitch_estimator *shared;
 };
 
 void init_find_pitch_lags(struct pitch_estimator *pest, int fs_hz, int complexity);
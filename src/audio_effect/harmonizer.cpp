@@ -265,3 +265,10 @@ void harmonizer_process(void *st, int16_t in[], int16_t out[], size_t L_in, size
     
     *L_out = L_in;
 }
+
+void harmonizer_share_pitch(void *st, const struct pitch_estimator *src)
+{
+    struct harmonizer_effect *he = (struct harmonizer_effect*)st;
+
+    he->pest.shared = src;
+}
@@ -17,5 +17,7 @@ AVS_SRCS += \
 	audio_effect/find_pitch_lags.cpp \
 	audio_effect/time_scale.cpp \
 	audio_effect/biquad.cpp \
+	audio_effect/effect_chain.cpp \
+	audio_effect/audio_file.c \
 	audio_effect/wav_interface.cpp \
 	audio_effect/pcm_interface.cpp
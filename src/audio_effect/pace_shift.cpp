@@ -139,3 +139,10 @@ void pace_shift_process(void *st, int16_t in[], int16_t out[], size_t L_in, size
 
     *L_out = L10_out*N;
 }
+
+void pace_shift_share_pitch(void *st, const struct pitch_estimator *src)
+{
+    struct pace_shift_effect *pse = (struct pace_shift_effect*)st;
+
+    pse->pest.shared = src;
+}
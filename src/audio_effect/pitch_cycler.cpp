@@ -155,3 +155,10 @@ void pitch_cycler_process(void *st, int16_t in[], int16_t out[], size_t L_in, si
     
     *L_out = L_in;
 }
+
+void pitch_cycler_share_pitch(void *st, const struct pitch_estimator *src)
+{
+    struct pitch_cycler_effect *pce = (struct pitch_cycler_effect*)st;
+
+    pce->pest.shared = src;
+}
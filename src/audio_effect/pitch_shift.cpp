@@ -157,3 +157,10 @@ void pitch_shift_process(void *st, int16_t in[], int16_t out[], size_t L_in, siz
     }
     *L_out = L_in;
 }
+
+void pitch_shift_share_pitch(void *st, const struct pitch_estimator *src)
+{
+    struct pitch_shift_effect *pse = (struct pitch_shift_effect*)st;
+
+    pse->pest.shared = src;
+}
@@ -77,6 +77,7 @@ void free_vocoder(void *st)
     
     delete ve->resampler_in;
     delete ve->resampler_out;
+    free_find_pitch_lags(&ve->pest);
     
     free(ve);
 }
@@ -391,3 +392,10 @@ void vocoder_process(void *st, int16_t in[], int16_t out[], size_t L_in, size_t
     }
     *L_out = n_samp;
 }
+
+void vocoder_share_pitch(void *st, const struct pitch_estimator *src)
+{
+    struct vocoder_effect *ve = (struct vocoder_effect*)st;
+
+    ve->pest.shared = src;
+}
@@ -0,0 +1,311 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_aufanout.h"
+
+
+struct frame {
+	uint32_t seq;
+	uint32_t hash;      /* hash of the PCM chunk, to compare fast */
+	size_t len;         /* encoded length, 0 when buffering       */
+	struct aufanout_meta meta;
+	int16_t *pcm;       /* the PCM chunk itself                   */
+	uint8_t *data;
+};
+
+struct aufanout {
+	struct frame framev[AUFANOUT_RING];
+	int16_t *pcm;
+	uint8_t *buf;
+	size_t sampc;
+	size_t maxsz;
+
+	uint32_t next_seq;  /* sequence of the next new chunk   */
+	uint32_t pending;   /* chunks buffered in the encoder   */
+	uint32_t nsinks;
+
+	aufanout_encode_h *encodeh;
+	void *arg;
+
+	struct lock *lock;
+	struct aufanout_stats stats;
+};
+
+struct aufanout_sink {
+	struct aufanout *af;
+	uint32_t last;      /* last sequence handed to the sink */
+	bool synced;
+	bool diverged;
+};
+
+
+static void destructor(void *arg)
+{
+	struct aufanout *af = arg;
+
+	mem_deref(af->buf);
+	mem_deref(af->pcm);
+	mem_deref(af->lock);
+}
+
+
+static void sink_destructor(void *arg)
+{
+	struct aufanout_sink *sink = arg;
+
+	lock_write_get(sink->af->lock);
+	--sink->af->nsinks;
+	lock_rel(sink->af->lock);
+
+	mem_deref(sink->af);
+}
+
+
+int aufanout_alloc(struct aufanout **afp, size_t sampc, size_t maxsz,
+		   aufanout_encode_h *encodeh, void *arg)
+{
+	struct aufanout *af;
+	size_t i;
+	int err;
+
+	if (!afp || !sampc || !maxsz || !encodeh)
+		return EINVAL;
+
+	af = mem_zalloc(sizeof(*af), destructor);
+	if (!af)
+		return ENOMEM;
+
+	af->buf = mem_alloc(AUFANOUT_RING * maxsz, NULL);
+	af->pcm = mem_alloc(AUFANOUT_RING * sampc * sizeof(*af->pcm), NULL);
+	if (!af->buf || !af->pcm) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = lock_alloc(&af->lock);
+	if (err)
+		goto out;
+
+	for (i = 0; i < AUFANOUT_RING; i++) {
+		af->framev[i].data = af->buf + i * maxsz;
+		af->framev[i].pcm = af->pcm + i * sampc;
+	}
+
+	af->sampc = sampc;
+	af->maxsz = maxsz;
+	af->encodeh = encodeh;
+	af->arg = arg;
+
+ out:
+	if (err)
+		mem_deref(af);
+	else
+		*afp = af;
+
+	return err;
+}
+
+
+int aufanout_sink_alloc(struct aufanout_sink **sinkp, struct aufanout *af)
+{
+	struct aufanout_sink *sink;
+
+	if (!sinkp || !af)
+		return EINVAL;
+
+	sink = mem_zalloc(sizeof(*sink), sink_destructor);
+	if (!sink)
+		return ENOMEM;
+
+	sink->af = mem_ref(af);
+
+	lock_write_get(af->lock);
+	++af->nsinks;
+	lock_rel(af->lock);
+
+	*sinkp = sink;
+
+	return 0;
+}
+
+
+static inline uint32_t ring_oldest(const struct aufanout *af)
+{
+	return af->next_seq > AUFANOUT_RING ? af->next_seq - AUFANOUT_RING : 0;
+}
+
+
+static inline struct frame *ring_frame(struct aufanout *af, uint32_t seq)
+{
+	return &af->framev[seq & (AUFANOUT_RING - 1)];
+}
+
+
+/* Oldest cached chunk from sequence 'from' onwards with the same PCM */
+static struct frame *ring_find(struct aufanout *af, uint32_t from,
+			       uint32_t hash, const int16_t *sampv)
+{
+	uint32_t seq;
+
+	for (seq = max(from, ring_oldest(af)); seq < af->next_seq; seq++) {
+		struct frame *f = ring_frame(af, seq);
+
+		if (f->hash == hash &&
+		    !memcmp(f->pcm, sampv, af->sampc * sizeof(*sampv)))
+			return f;
+	}
+
+	return NULL;
+}
+
+
+static int ring_encode(struct aufanout *af, struct frame **fp, uint32_t hash,
+		       const int16_t *sampv, size_t sampc)
+{
+	struct frame *f = ring_frame(af, af->next_seq);
+	struct aufanout_meta meta;
+	size_t len = af->maxsz;
+	int err;
+
+	memset(&meta, 0, sizeof(meta));
+
+	err = af->encodeh(f->data, &len, &meta, sampv, sampc, af->arg);
+	if (err) {
+		warning("aufanout(%p): encode failed (%m)\n", af, err);
+		return err;
+	}
+
+	++af->pending;
+
+	memcpy(f->pcm, sampv, sampc * sizeof(*sampv));
+	f->seq  = af->next_seq++;
+	f->hash = hash;
+	f->len  = len;
+	f->meta = meta;
+	f->meta.span = len ? af->pending : 0;
+
+	if (len)
+		af->pending = 0;
+
+	++af->stats.encoded;
+	*fp = f;
+
+	return 0;
+}
+
+
+/*
+ * Encode a chunk on behalf of a sink. The encoded packet, if any, is
+ * copied to dst and *meta describes it; meta->span is the number of
+ * chunks the packet covers (the sink uses it to derive the RTP
+ * timestamp of the packet).
+ *
+ * A synced sink must deliver either a cached chunk after the last one
+ * it got, or a new chunk when it is at the head of the sequence.
+ * Anything else means its audio differs from what the encoder has
+ * seen, and the sink gets EPROTO from then on.
+ */
+int aufanout_encode(struct aufanout_sink *sink,
+		    uint8_t *dst, size_t *lenp, struct aufanout_meta *meta,
+		    const int16_t *sampv, size_t sampc)
+{
+	struct aufanout *af;
+	struct frame *f = NULL;
+	uint32_t hash;
+	int err = 0;
+
+	if (!sink || !dst || !lenp || !sampv)
+		return EINVAL;
+
+	af = sink->af;
+	if (sampc != af->sampc)
+		return EINVAL;
+
+	if (sink->diverged)
+		return EPROTO;
+
+	hash = hash_fast((const char *)sampv, sampc * sizeof(*sampv));
+
+	lock_write_get(af->lock);
+
+	if (sink->synced) {
+
+		f = ring_find(af, sink->last + 1, hash, sampv);
+		if (f && f->seq != sink->last + 1)
+			++af->stats.resync;
+
+		if (!f && sink->last + 1 != af->next_seq) {
+			sink->diverged = true;
+			++af->stats.diverged;
+			err = EPROTO;
+			goto out;
+		}
+	}
+	else {
+		/* a new sink may pick up any cached chunk */
+		f = ring_find(af, 0, hash, sampv);
+	}
+
+	if (f) {
+		++af->stats.shared;
+	}
+	else {
+		err = ring_encode(af, &f, hash, sampv, sampc);
+		if (err)
+			goto out;
+	}
+
+	if (f->len > *lenp) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	memcpy(dst, f->data, f->len);
+	*lenp = f->len;
+	if (meta)
+		*meta = f->meta;
+
+	sink->last = f->seq;
+	sink->synced = true;
+
+ out:
+	lock_rel(af->lock);
+
+	return err;
+}
+
+
+uint32_t aufanout_sink_count(const struct aufanout *af)
+{
+	return af ? af->nsinks : 0;
+}
+
+
+void aufanout_get_stats(const struct aufanout *af,
+			struct aufanout_stats *stats)
+{
+	if (!af || !stats)
+		return;
+
+	lock_write_get(af->lock);
+	*stats = af->stats;
+	lock_rel(af->lock);
+}
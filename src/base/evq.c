@@ -0,0 +1,129 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Thread event queues -- one mqueue per thread and handler, shared by
+ * the objects of a module that live on that thread. An object takes
+ * its queue on the thread that owns it, so events pushed from WebRTC
+ * or usrsctp threads are handled on the owner's main loop, also when
+ * the calling instances are spread over several threads.
+ */
+
+#include <pthread.h>
+#include <re.h>
+
+#include "avs_log.h"
+#include "avs_base.h"
+
+
+struct avs_evq {
+	struct le le;
+	pthread_t tid;
+	mqueue_h *h;
+	struct mqueue *mq;
+};
+
+
+static struct {
+	pthread_mutex_t mutex;
+	struct list evql;
+} evqs = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.evql = LIST_INIT,
+};
+
+
+static void destructor(void *arg)
+{
+	struct avs_evq *evq = arg;
+
+	pthread_mutex_lock(&evqs.mutex);
+	list_unlink(&evq->le);
+	pthread_mutex_unlock(&evqs.mutex);
+
+	mem_deref(evq->mq);
+}
+
+
+/*
+ * Get the queue of the calling thread for handler h, allocating it
+ * on first use. The caller must run a re main loop, and must release
+ * the reference on the same thread.
+ */
+int avs_evq_get(struct avs_evq **evqp, mqueue_h *h)
+{
+	const pthread_t self = pthread_self();
+	struct avs_evq *evq = NULL;
+	struct le *le;
+	int err;
+
+	if (!evqp || !h)
+		return EINVAL;
+
+	pthread_mutex_lock(&evqs.mutex);
+	LIST_FOREACH(&evqs.evql, le) {
+		struct avs_evq *e = le->data;
+
+		if (e->h == h && pthread_equal(e->tid, self)) {
+			evq = mem_ref(e);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&evqs.mutex);
+
+	if (evq)
+		goto out;
+
+	evq = mem_zalloc(sizeof(*evq), destructor);
+	if (!evq)
+		return ENOMEM;
+
+	evq->tid = self;
+	evq->h = h;
+
+	err = mqueue_alloc(&evq->mq, h, NULL);
+	if (err) {
+		warning("evq: mqueue_alloc failed (%m)\n", err);
+		mem_deref(evq);
+		return err;
+	}
+
+	pthread_mutex_lock(&evqs.mutex);
+	list_append(&evqs.evql, &evq->le, evq);
+	pthread_mutex_unlock(&evqs.mutex);
+
+ out:
+	*evqp = evq;
+
+	return 0;
+}
+
+
+/* Can be called from any thread, while the queue is referenced */
+int avs_evq_push(struct avs_evq *evq, int id, void *data)
+{
+	if (!evq)
+		return EINVAL;
+
+	return mqueue_push(evq->mq, id, data);
+}
+
+
+bool avs_evq_is_last(const struct avs_evq *evq)
+{
+	return evq && mem_nrefs(evq) == 1;
+}
@@ -3,5 +3,6 @@
 #
 
 AVS_SRCS += \
-	base/base.c
+	base/base.c \
+	base/evq.c
 
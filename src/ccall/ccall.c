@@ -1119,6 +1119,11 @@ static int ccall_send_msg_sft(struct ccall *ccall,
 		if (err)
 			goto out;
 
+		if (ECONN_CONF_CONN == msg->msg_type) {
+			icall_timeline_mark(&ccall->icall.timeline,
+					    ICALL_PHASE_SFT_REQ);
+		}
+
 		if (ECONN_SETUP == msg->msg_type &&
 		    CCALL_STATE_ACTIVE != ccall->state) {
 			set_state(ccall, CCALL_STATE_CONNECTING);
@@ -1905,6 +1910,7 @@ static int create_ecall(struct ccall *ccall)
 	ecall_set_propsync_handler(ecall, ecall_propsync_handler);
 	ecall_set_ping_handler(ecall, ecall_ping_handler);
 	ecall_set_keystore(ecall, ccall->keystore);
+	ecall_set_timeline(ecall, &ccall->icall.timeline);
 	err = ecall_set_real_clientid(ecall, ccall->self->clientid_real);
 	if (err)
 		goto out;
@@ -2082,6 +2088,8 @@ static void config_update_handler(struct call_config *cfg, void *arg)
 	char *url = NULL;
 	int err = 0;
 
+	icall_timeline_mark(&ccall->icall.timeline, ICALL_PHASE_CONFIG_RESP);
+
 	urlv = config_get_sftservers(ccall->cfg, &urlc);
 
 	info("ccall(%p): cfg_update received %zu sfts state: %s\n",
@@ -2154,13 +2162,11 @@ static int  ccall_req_cfg_join(struct ccall *ccall,
 	je->upe.updh = config_update_handler;
 	je->upe.arg = je;
 
-	err = config_register_update_handler(&je->upe, ccall->cfg);
-	if (err)
-		goto out;
+	icall_timeline_mark(&ccall->icall.timeline, ICALL_PHASE_CONFIG_REQ);
 
-	err = config_request(ccall->cfg);
+	/* a still valid config saves the round trip to the backend */
+	err = config_request_cached(ccall->cfg, &je->upe);
 
- out:
 	return err;
 }
 
@@ -2181,6 +2187,7 @@ int  ccall_start(struct icall *icall,
 
 	case CCALL_STATE_IDLE:
 		ccall->is_caller = true;
+		icall_timeline_reset(&ccall->icall.timeline);
 		err = ccall_req_cfg_join(ccall, call_type, audio_cbr);
 		break;
 
@@ -2210,6 +2217,7 @@ int  ccall_answer(struct icall *icall,
 	case CCALL_STATE_INCOMING:
 		ccall->is_caller = false;
 		ccall->stop_ringing_reason = CCALL_STOP_RINGING_ANSWERED;
+		icall_timeline_reset(&ccall->icall.timeline);
 		err = ccall_join(ccall, call_type, audio_cbr);
 		break;
 
@@ -2765,6 +2773,7 @@ static int ccall_handle_confstart_check(struct ccall* ccall,
 			/* If remote call is earlier, drop connection and
 			   reconnect to the earlier call */
 			ecall_end(ccall->ecall);
+			ecall_set_timeline(ccall->ecall, NULL);
 			ccall->ecall = NULL;
 
 			set_state(ccall, CCALL_STATE_CONNSENT);
@@ -2777,6 +2786,7 @@ static int ccall_handle_confstart_check(struct ccall* ccall,
 			/* If remote call is earlier, drop connection and
 			   reconnect to the earlier call */
 			ecall_end(ccall->ecall);
+			ecall_set_timeline(ccall->ecall, NULL);
 			ccall->ecall = NULL;
 
 			set_state(ccall, CCALL_STATE_CONNSENT);
@@ -2994,6 +3004,8 @@ int  ccall_sft_msg_recv(struct icall* icall,
 			}
 
 			set_state(ccall, CCALL_STATE_SETUPRECV);
+			icall_timeline_mark(&ccall->icall.timeline,
+					    ICALL_PHASE_SFT_RESP);
 
 			if (msg->u.setup.url && !ccall->sft_resolved) {
 				info("ccall(%p): sft_msg_recv setting sft url: %s\n",
@@ -35,6 +35,7 @@ static void cm_destructor(void *arg)
 	mem_deref(cm->label);
 	mem_deref(cm->cname);
 	mem_deref(cm->msid);
+	mem_deref(cm->budget);
 }
 
 
@@ -23,6 +23,7 @@
 
 #define EXPIRY_MIN   300  /* in seconds (5 minutes)  */
 #define EXPIRY_MAX  3600  /* in seconds (60 minutes) */
+#define REQ_TIMEOUT   30  /* in seconds, a request counts as lost */
 
 struct config {
 	config_update_h *updh;
@@ -32,6 +33,9 @@ struct config {
 	struct tmr tmr;
 
 	struct call_config config;
+	uint64_t expires;  /* [ms], 0 without a valid config */
+	uint32_t ttl;      /* [s]                            */
+	uint64_t req_ts;   /* [ms], 0 without pending request */
 
 	struct list updl; /* list of update handlers */
 };
@@ -45,9 +49,14 @@ static int do_request(struct config *cfg)
 
 	tmr_cancel(&cfg->tmr);
 
+	cfg->req_ts = tmr_jiffies();
+
 	if (cfg->reqh)
 		err = cfg->reqh(cfg->arg);
 
+	if (err)
+		cfg->req_ts = 0;
+
 	return err;
 }
 	
@@ -115,6 +124,8 @@ int config_update(struct config *cfg, int err,
 	if (!cfg || !conf_json)
 		return EINVAL;
 
+	cfg->req_ts = 0;
+
 	if (err) {
 		warning("config: call_config response error (%m)\n", err);
 		tmr_start(&cfg->tmr, 60 * 1000, tmr_handler, cfg);
@@ -221,6 +232,10 @@ int config_update(struct config *cfg, int err,
 	}
 	else {
 		struct le *le;
+
+		/* refreshed in the background, before it expires */
+		cfg->ttl = ttl;
+		cfg->expires = tmr_jiffies() + ttl * 1000;
 		tmr_start(&cfg->tmr, ttl * 9/10 * 1000, tmr_handler, cfg);
 		if (cfg->updh)
 			cfg->updh(&cfg->config, cfg->arg);
@@ -230,6 +245,9 @@ int config_update(struct config *cfg, int err,
 
 			le = le->next;
 
+			/* delivered now, not from the cache */
+			tmr_cancel(&upel->tmr);
+
 			if (upel->updh)
 				upel->updh(&upel->cfg->config, upel->arg);
 		}
@@ -303,6 +321,77 @@ int config_request(struct config *cfg)
 	return err;
 }
 
+/* A config that has not expired, and can be used right away */
+bool config_is_valid(const struct config *cfg)
+{
+	if (!cfg || !cfg->expires)
+		return false;
+
+	return tmr_jiffies() < cfg->expires;
+}
+
+
+/*
+ * Request a new config ahead of a call, for instance when the app
+ * comes to the foreground or the network changed. Nothing is sent if
+ * a request is out already, or the config is good for another third
+ * of its lifetime.
+ */
+int config_prefetch(struct config *cfg)
+{
+	uint64_t now;
+
+	if (!cfg)
+		return EINVAL;
+
+	now = tmr_jiffies();
+
+	if (cfg->req_ts && now - cfg->req_ts < REQ_TIMEOUT * 1000)
+		return 0;
+
+	if (config_is_valid(cfg) && cfg->expires - now > cfg->ttl * 1000 / 3)
+		return 0;
+
+	info("config(%p): prefetching call config\n", cfg);
+
+	return do_request(cfg);
+}
+
+
+static void cached_handler(void *arg)
+{
+	struct config_update_elem *upe = arg;
+
+	if (upe->updh)
+		upe->updh(&upe->cfg->config, upe->arg);
+}
+
+
+/*
+ * Register upe for the next config. A valid config is handed to it on
+ * the next main loop iteration, without waiting for the backend;
+ * otherwise a new config is requested.
+ */
+int config_request_cached(struct config *cfg, struct config_update_elem *upe)
+{
+	int err;
+
+	err = config_register_update_handler(upe, cfg);
+	if (err)
+		return err;
+
+	if (!config_is_valid(cfg))
+		return do_request(cfg);
+
+	info("config(%p): using cached call config, expires in %llu ms\n",
+	     cfg, cfg->expires - tmr_jiffies());
+
+	tmr_start(&upe->tmr, 0, cached_handler, upe);
+
+	return config_prefetch(cfg);
+}
+
+
 int config_register_update_handler(struct config_update_elem *upe, struct config *cfg)
 {
 	if (!upe || !cfg)
@@ -326,6 +415,7 @@ int config_unregister_update_handler(struct config_update_elem *upe)
 	if (!upe->cfg)
 		return ENOSYS;
 
+	tmr_cancel(&upe->tmr);
 	list_unlink(&upe->le);
 
 	return 0;
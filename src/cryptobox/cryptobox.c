@@ -18,14 +18,39 @@
 
 
 #include <assert.h>
+#include <pthread.h>
 #include <re.h>
 #include <avs.h>
 #include <cbox.h>
 
 
+enum {
+	SESSION_HASH_SIZE = 256,
+	SAVE_DELAY        = 500,    /* [ms] */
+};
+
+
+struct preload;
+
 struct cryptobox {
 	CBox *cbox;
-	struct list sessionl;  /* (struct session) populated from disk */
+	struct lock *lock;  /* the preload thread uses cbox too */
+
+	/*
+	 * Open sessions, by session ID and in least recently used
+	 * order. At most maxsess are kept, the rest are on disk.
+	 */
+	struct hash *sessh;
+	struct list lrul;
+	size_t nsess;
+	size_t maxsess;
+
+	/* sessions with state that is not saved yet */
+	struct list dirtyl;
+	struct tmr tmr_save;
+
+	struct preload *preload;
+	struct mqueue *mq;
 };
 
 
@@ -36,9 +61,13 @@ struct cryptobox {
  * the remote user ID and client ID.
  */
 struct session {
-	struct le le;
+	struct le le;    /* in lrul    */
+	struct le he;    /* in sessh   */
+	struct le dle;   /* in dirtyl  */
+	struct cryptobox *cb;
 
 	/* aka "sid" or Session-ID: */
+	char *sid;
 	char *remote_userid;
 	char *remote_clientid;
 	char *local_clientid;
@@ -47,6 +76,35 @@ struct session {
 };
 
 
+/*
+ * Sessions loaded from disk by a worker thread. Only the thread
+ * touches cbox_sess until it has posted the batch to the main thread.
+ * A session that the main thread opens or closes in the meantime is
+ * marked stale, the state the thread loaded may be older than the one
+ * on disk now, so it is dropped.
+ */
+struct preload {
+	struct cryptobox *cb;
+	pthread_t tid;
+	volatile bool run;
+
+	struct peer_id {
+		struct le he;     /* in peerh, main thread only */
+		char *userid;
+		char *clientid;
+		char *sid;
+		CBoxSession *cbox_sess;
+		bool stale;       /* main thread only */
+	} *peerv;
+	size_t peerc;
+	struct hash *peerh;
+	char *local_clientid;
+
+	cryptobox_preload_h *h;
+	void *arg;
+};
+
+
 static void mk_sessid(char *sessid, size_t sz,
 		      const char *remote_userid,
 		      const char *remote_clientid,
@@ -56,16 +114,330 @@ static void mk_sessid(char *sessid, size_t sz,
 }
 
 
+static void session_save(struct session *sess)
+{
+	CBoxResult r;
+
+	list_unlink(&sess->dle);
+
+	lock_write_get(sess->cb->lock);
+	r = cbox_session_save(sess->cb->cbox, sess->cbox_sess);
+	lock_rel(sess->cb->lock);
+	if (CBOX_SUCCESS != r) {
+		warning("cryptobox: could not save session %s (result=%d)\n",
+			sess->sid, r);
+	}
+}
+
+
+static void save_dirty(struct cryptobox *cb)
+{
+	tmr_cancel(&cb->tmr_save);
+
+	while (cb->dirtyl.head)
+		session_save(cb->dirtyl.head->data);
+}
+
+
+static void save_handler(void *arg)
+{
+	struct cryptobox *cb = arg;
+	uint32_t n = list_count(&cb->dirtyl);
+
+	save_dirty(cb);
+
+	debug("cryptobox: saved %u sessions\n", n);
+}
+
+
+/*
+ * The ratchet state changes on every encrypt and decrypt. Saving is
+ * deferred a little, so that a burst of incoming messages writes each
+ * session once. Senders encrypt a whole batch and then call
+ * cryptobox_flush before the batch goes out.
+ */
+static void session_touch(struct session *sess)
+{
+	struct cryptobox *cb = sess->cb;
+
+	if (!sess->dle.list)
+		list_append(&cb->dirtyl, &sess->dle, sess);
+
+	if (!tmr_isrunning(&cb->tmr_save))
+		tmr_start(&cb->tmr_save, SAVE_DELAY, save_handler, cb);
+}
+
+
+/* Save and close the least recently used sessions, down to maxsess */
+static void cache_trim(struct cryptobox *cb, size_t maxsess)
+{
+	while (cb->nsess > maxsess) {
+		struct session *sess = cb->lrul.head->data;
+
+		if (sess->dle.list)
+			session_save(sess);
+
+		debug("cryptobox: evicting session %s\n", sess->sid);
+
+		mem_deref(sess);
+	}
+}
+
+
+static void preload_stop(struct preload *pl);
+
+
 static void cryptobox_destructor(void *data)
 {
 	struct cryptobox *cb = data;
 
-	list_flush(&cb->sessionl);
+	if (cb->preload) {
+		preload_stop(cb->preload);
+		cb->preload = mem_deref(cb->preload);
+	}
+
+	save_dirty(cb);
+
+	list_flush(&cb->lrul);
+	mem_deref(cb->sessh);
+	mem_deref(cb->mq);
 
 	if (cb->cbox) {
 		cbox_close(cb->cbox);
 		cb->cbox = NULL;
 	}
+
+	mem_deref(cb->lock);
+}
+
+
+static bool sess_cmp_handler(struct le *le, void *arg)
+{
+	const struct session *sess = le->data;
+
+	return 0 == str_casecmp(sess->sid, arg);
+}
+
+
+static struct session *session_lookup(const struct cryptobox *cb,
+				      const char *sid)
+{
+	return list_ledata(hash_lookup(cb->sessh, hash_joaat_str_ci(sid),
+				       sess_cmp_handler, (void *)sid));
+}
+
+
+/* Mark a session as just used */
+static void session_use(struct session *sess)
+{
+	struct cryptobox *cb = sess->cb;
+
+	if (cb->lrul.tail == &sess->le)
+		return;
+
+	list_unlink(&sess->le);
+	list_append(&cb->lrul, &sess->le, sess);
+}
+
+
+static bool peer_cmp_handler(struct le *le, void *arg)
+{
+	const struct peer_id *p = le->data;
+
+	return 0 == str_casecmp(p->sid, arg);
+}
+
+
+/* The main thread opens or closes a session, a preload of it is stale */
+static void preload_touch(struct cryptobox *cb, const char *sid)
+{
+	struct peer_id *p;
+
+	if (!cb->preload)
+		return;
+
+	p = list_ledata(hash_lookup(cb->preload->peerh,
+				    hash_joaat_str_ci(sid),
+				    peer_cmp_handler, (void *)sid));
+	if (p)
+		p->stale = true;
+}
+
+
+static void session_destructor(void *data)
+{
+	struct session *sess = data;
+
+	if (sess->le.list) {
+		--sess->cb->nsess;
+		preload_touch(sess->cb, sess->sid);
+	}
+
+	list_unlink(&sess->le);
+	hash_unlink(&sess->he);
+	list_unlink(&sess->dle);
+	mem_deref(sess->sid);
+	mem_deref(sess->local_clientid);
+	mem_deref(sess->remote_clientid);
+	mem_deref(sess->remote_userid);
+
+	if (sess->cbox_sess)
+		cbox_session_close(sess->cbox_sess);
+}
+
+
+static int session_alloc(struct session **sessp, struct cryptobox *cb,
+			 const char *remote_userid,
+			 const char *remote_clientid,
+			 const char *local_clientid)
+{
+	struct session *sess;
+	char sid[256];
+	int err;
+
+	sess = mem_zalloc(sizeof(*sess), session_destructor);
+	if (!sess)
+		return ENOMEM;
+
+	sess->cb = cb;
+
+	mk_sessid(sid, sizeof(sid), remote_userid, remote_clientid, local_clientid);
+
+	err  = str_dup(&sess->sid, sid);
+	err |= str_dup(&sess->remote_userid, remote_userid);
+	err |= str_dup(&sess->remote_clientid, remote_clientid);
+	err |= str_dup(&sess->local_clientid, local_clientid);
+	if (err)
+		mem_deref(sess);
+	else
+		*sessp = sess;
+
+	return err;
+}
+
+
+/*
+ * Add an open session as the most recently used one. A session that
+ * was already open under the same ID is replaced.
+ */
+static void session_insert(struct cryptobox *cb, struct session *sess)
+{
+	struct session *old;
+
+	preload_touch(cb, sess->sid);
+
+	old = session_lookup(cb, sess->sid);
+	if (old) {
+		if (old->dle.list)
+			session_save(old);
+		mem_deref(old);
+	}
+
+	hash_append(cb->sessh, hash_joaat_str_ci(sess->sid), &sess->he, sess);
+	list_append(&cb->lrul, &sess->le, sess);
+	++cb->nsess;
+
+	cache_trim(cb, cb->maxsess);
+}
+
+
+static void preload_destructor(void *data)
+{
+	struct preload *pl = data;
+	size_t i;
+
+	hash_clear(pl->peerh);
+	mem_deref(pl->peerh);
+
+	for (i = 0; i < pl->peerc; i++) {
+		struct peer_id *p = &pl->peerv[i];
+
+		if (p->cbox_sess)
+			cbox_session_close(p->cbox_sess);
+		mem_deref(p->userid);
+		mem_deref(p->clientid);
+		mem_deref(p->sid);
+	}
+
+	mem_deref(pl->peerv);
+	mem_deref(pl->local_clientid);
+}
+
+
+static void *preload_thread(void *arg)
+{
+	struct preload *pl = arg;
+	size_t i;
+
+	for (i = 0; i < pl->peerc && pl->run; i++) {
+		struct peer_id *p = &pl->peerv[i];
+		CBoxResult r;
+
+		lock_write_get(pl->cb->lock);
+		r = cbox_session_load(pl->cb->cbox, p->sid, &p->cbox_sess);
+		lock_rel(pl->cb->lock);
+		if (CBOX_SUCCESS != r)
+			p->cbox_sess = NULL;
+	}
+
+	mqueue_push(pl->cb->mq, 0, pl);
+
+	return NULL;
+}
+
+
+static void preload_stop(struct preload *pl)
+{
+	pl->run = false;
+	pthread_join(pl->tid, NULL);
+}
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct cryptobox *cb = arg;
+	struct preload *pl = data;
+	size_t i, n = 0, nstale = 0;
+
+	(void)id;
+
+	if (pl != cb->preload)
+		return;
+
+	pthread_join(pl->tid, NULL);
+	cb->preload = NULL;
+
+	for (i = 0; i < pl->peerc; i++) {
+		struct peer_id *p = &pl->peerv[i];
+		struct session *sess;
+
+		if (!p->cbox_sess)
+			continue;
+
+		/* opened or closed on the main thread in the meantime */
+		if (p->stale || session_lookup(cb, p->sid)) {
+			++nstale;
+			continue;
+		}
+
+		if (session_alloc(&sess, cb, p->userid, p->clientid,
+				  pl->local_clientid))
+			continue;
+
+		sess->cbox_sess = p->cbox_sess;
+		p->cbox_sess = NULL;
+
+		session_insert(cb, sess);
+		++n;
+	}
+
+	info("cryptobox: preloaded %zu of %zu sessions (%zu stale)\n",
+	     n, pl->peerc, nstale);
+
+	if (pl->h)
+		pl->h(0, n, pl->arg);
+
+	mem_deref(pl);
 }
 
 
@@ -85,6 +457,21 @@ int cryptobox_alloc(struct cryptobox **cbp, const char *store_dir)
 	if (!cb)
 		return ENOMEM;
 
+	cb->maxsess = CRYPTOBOX_CACHE_SIZE;
+	tmr_init(&cb->tmr_save);
+
+	err = hash_alloc(&cb->sessh, SESSION_HASH_SIZE);
+	if (err)
+		goto out;
+
+	err = lock_alloc(&cb->lock);
+	if (err)
+		goto out;
+
+	err = mqueue_alloc(&cb->mq, mqueue_handler, cb);
+	if (err)
+		goto out;
+
 	if (!cb->cbox) {
 
 		r = cbox_file_open(store_dir, &cb->cbox);
@@ -116,6 +503,131 @@ int cryptobox_alloc(struct cryptobox **cbp, const char *store_dir)
 }
 
 
+/*
+ * Set how many sessions are kept open. Sessions beyond that are
+ * saved and closed, least recently used first, and are loaded from
+ * disk again when needed.
+ */
+int cryptobox_set_cache_size(struct cryptobox *cb, size_t maxsess)
+{
+	if (!cb || !maxsess)
+		return EINVAL;
+
+	cb->maxsess = maxsess;
+	cache_trim(cb, maxsess);
+
+	return 0;
+}
+
+
+/*
+ * Load the sessions with the given peers from disk on a worker
+ * thread, e.g. before encrypting for every client in a conversation.
+ * Sessions that are already open are skipped, and no more than the
+ * cache size are loaded. The handler is called on the main thread
+ * once they are in the cache.
+ */
+int cryptobox_session_preload(struct cryptobox *cb,
+			      const char *local_clientid,
+			      const struct cryptobox_peer *peerv, size_t peerc,
+			      cryptobox_preload_h *h, void *arg)
+{
+	struct preload *pl;
+	size_t i;
+	int err = 0;
+
+	if (!cb || !str_isset(local_clientid) || (!peerv && peerc))
+		return EINVAL;
+
+	if (cb->preload)
+		return EBUSY;
+
+	pl = mem_zalloc(sizeof(*pl), preload_destructor);
+	if (!pl)
+		return ENOMEM;
+
+	pl->cb = cb;
+	pl->h = h;
+	pl->arg = arg;
+
+	pl->peerv = mem_zalloc(min(peerc, cb->maxsess) * sizeof(*pl->peerv),
+			       NULL);
+	if (!pl->peerv && peerc) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = str_dup(&pl->local_clientid, local_clientid);
+	if (err)
+		goto out;
+
+	err = hash_alloc(&pl->peerh, SESSION_HASH_SIZE);
+	if (err)
+		goto out;
+
+	for (i = 0; i < peerc && pl->peerc < cb->maxsess; i++) {
+		struct peer_id *p = &pl->peerv[pl->peerc];
+		char sid[256];
+
+		if (!str_isset(peerv[i].userid) ||
+		    !str_isset(peerv[i].clientid)) {
+			err = EINVAL;
+			goto out;
+		}
+
+		mk_sessid(sid, sizeof(sid), peerv[i].userid,
+			  peerv[i].clientid, local_clientid);
+
+		if (session_lookup(cb, sid))
+			continue;
+
+		err  = str_dup(&p->userid, peerv[i].userid);
+		err |= str_dup(&p->clientid, peerv[i].clientid);
+		err |= str_dup(&p->sid, sid);
+		++pl->peerc;
+		if (err)
+			goto out;
+
+		hash_append(pl->peerh, hash_joaat_str_ci(sid), &p->he, p);
+	}
+
+	if (!pl->peerc) {
+		if (h)
+			h(0, 0, arg);
+		goto out;
+	}
+
+	pl->run = true;
+	err = pthread_create(&pl->tid, NULL, preload_thread, pl);
+	if (err) {
+		warning("cryptobox: preload thread failed (%m)\n", err);
+		goto out;
+	}
+
+	cb->preload = pl;
+	pl = NULL;
+
+ out:
+	mem_deref(pl);
+
+	return err;
+}
+
+
+/*
+ * Save all sessions with unsaved state now. Call this after encrypting
+ * and before sending, and when the app goes to the background, where
+ * the save timer may never fire.
+ */
+void cryptobox_flush(struct cryptobox *cb)
+{
+	if (!cb)
+		return;
+
+	save_dirty(cb);
+}
+
+
 int cryptobox_generate_prekey(struct cryptobox *cb,
 			      uint8_t *key, size_t *sz, uint16_t id)
 {
@@ -128,7 +640,9 @@ int cryptobox_generate_prekey(struct cryptobox *cb,
 	if (!cb->cbox)
 		return EINVAL;
 
+	lock_write_get(cb->lock);
 	r = cbox_new_prekey(cb->cbox, id, &prekey);
+	lock_rel(cb->lock);
 	if (CBOX_SUCCESS != r) {
 		warning("cryptobox: new_prekey failed (result=%d)\n",
 			r);
@@ -147,20 +661,6 @@ int cryptobox_generate_prekey(struct cryptobox *cb,
 }
 
 
-static void session_destructor(void *data)
-{
-	struct session *sess = data;
-
-	list_unlink(&sess->le);
-	mem_deref(sess->local_clientid);
-	mem_deref(sess->remote_clientid);
-	mem_deref(sess->remote_userid);
-
-	if (sess->cbox_sess)
-		cbox_session_close(sess->cbox_sess);
-}
-
-
 int cryptobox_session_add_recv(struct cryptobox *cb,
 			       const char *remote_userid,
 			       const char *remote_clientid,
@@ -168,10 +668,9 @@ int cryptobox_session_add_recv(struct cryptobox *cb,
 			       uint8_t *plain, size_t *plain_len,
 			       const uint8_t *cipher, size_t cipher_len)
 {
-	struct session *sess;
+	struct session *sess = NULL;
 	CBoxVec *vec_plain = NULL;
 	CBoxResult r;
-	char sid[256];
 	int err = 0;
 
 	if (!cb || !plain || !plain_len || !cipher)
@@ -182,22 +681,19 @@ int cryptobox_session_add_recv(struct cryptobox *cb,
 	if (!str_isset(remote_userid) || !str_isset(remote_clientid) || !str_isset(local_clientid))
 		return EINVAL;
 
-	sess = mem_zalloc(sizeof(*sess), session_destructor);
-
-	err  = str_dup(&sess->remote_userid, remote_userid);
-	err |= str_dup(&sess->remote_clientid, remote_clientid);
-	err |= str_dup(&sess->local_clientid, local_clientid);
+	err = session_alloc(&sess, cb, remote_userid, remote_clientid,
+			    local_clientid);
 	if (err)
 		goto out;
 
-	mk_sessid(sid, sizeof(sid), remote_userid, remote_clientid, local_clientid);
-
+	lock_write_get(cb->lock);
 	r = cbox_session_init_from_message(cb->cbox,
-					   sid,
+					   sess->sid,
 					   cipher,
 					   cipher_len,
 					   &sess->cbox_sess,
 					   &vec_plain);
+	lock_rel(cb->lock);
 	if (CBOX_SUCCESS != r) {
 		warning("cryptobox: cbox_session_init_from_message"
 			" failed (result=%d)\n", r);
@@ -210,11 +706,14 @@ int cryptobox_session_add_recv(struct cryptobox *cb,
 		  remote_userid, remote_clientid, local_clientid);
 
 	/*
-	 * Save the session. (ignore any errors)
+	 * Save the session right away, the prekey it used is gone.
+	 * (ignore any errors)
 	 */
+	lock_write_get(cb->lock);
 	r = cbox_session_save(cb->cbox, sess->cbox_sess);
+	lock_rel(cb->lock);
 	if (CBOX_SUCCESS == r) {
-		info("cryptobox: session saved (%s)\n", sid);
+		info("cryptobox: session saved (%s)\n", sess->sid);
 	}
 	else {
 		warning("cryptobox: could not save session (result=%d)\n", r);
@@ -230,7 +729,7 @@ int cryptobox_session_add_recv(struct cryptobox *cb,
 		*plain_len = cbox_vec_len(vec_plain);
 	}
 
-	list_append(&cb->sessionl, &sess->le, sess);
+	session_insert(cb, sess);
 
  out:
 	if (vec_plain)
@@ -249,8 +748,7 @@ int cryptobox_session_add_send(struct cryptobox *cb,
 			       const char *local_clientid,
 			       const uint8_t *peer_key, size_t peer_key_len)
 {
-	struct session *sess;
-	char sid[256];
+	struct session *sess = NULL;
 	CBoxResult r;
 	int err = 0;
 
@@ -263,21 +761,18 @@ int cryptobox_session_add_send(struct cryptobox *cb,
 	    !peer_key || !peer_key_len)
 		return EINVAL;
 
-	sess = mem_zalloc(sizeof(*sess), session_destructor);
-
-	err  = str_dup(&sess->remote_userid, remote_userid);
-	err |= str_dup(&sess->remote_clientid, remote_clientid);
-	err |= str_dup(&sess->local_clientid, local_clientid);
+	err = session_alloc(&sess, cb, remote_userid, remote_clientid,
+			    local_clientid);
 	if (err)
 		goto out;
 
-	mk_sessid(sid, sizeof(sid), remote_userid, remote_clientid, local_clientid);
-
+	lock_write_get(cb->lock);
 	r = cbox_session_init_from_prekey(cb->cbox,
-					  sid,
+					  sess->sid,
 					  peer_key,
 					  peer_key_len,
 					  &sess->cbox_sess);
+	lock_rel(cb->lock);
 	if (CBOX_SUCCESS != r) {
 		warning("cryptobox: cbox_session_init_from_prekey"
 			" failed (result=%d)\n", r);
@@ -287,7 +782,8 @@ int cryptobox_session_add_send(struct cryptobox *cb,
 
 	info("cryptobox: send New crypto session successfully created\n");
 
-	list_append(&cb->sessionl, &sess->le, sess);
+	session_insert(cb, sess);
+	session_touch(sess);
 
  out:
 	if (err)
@@ -297,13 +793,16 @@ int cryptobox_session_add_send(struct cryptobox *cb,
 }
 
 
+/*
+ * Find a session, in the cache or else on disk. The session stays
+ * valid until the next call that may open another one.
+ */
 struct session *cryptobox_session_find(struct cryptobox *cb,
 				       const char *remote_userid,
 				       const char *remote_clientid,
 				       const char *local_clientid)
 {
 	struct session *sess = NULL;
-	struct le *le;
 	CBoxResult r;
 	char sessid[256];
 	CBoxSession *cbox_sess = NULL;
@@ -314,46 +813,36 @@ struct session *cryptobox_session_find(struct cryptobox *cb,
 
 	assert(cb->cbox != NULL);
 
-	for (le = cb->sessionl.head; le; le = le->next) {
-		sess = le->data;
+	mk_sessid(sessid, sizeof(sessid), remote_userid, remote_clientid, local_clientid);
 
-		if (0 == str_casecmp(sess->remote_userid, remote_userid) &&
-		    0 == str_casecmp(sess->remote_clientid, remote_clientid) &&
-		    0 == str_casecmp(sess->local_clientid, local_clientid))
-		{
-			return sess;
-		}
+	sess = session_lookup(cb, sessid);
+	if (sess) {
+		session_use(sess);
+		return sess;
 	}
 
-	mk_sessid(sessid, sizeof(sessid), remote_userid, remote_clientid, local_clientid);
-
+	lock_write_get(cb->lock);
 	r = cbox_session_load(cb->cbox, sessid, &cbox_sess);
+	lock_rel(cb->lock);
 	if (CBOX_SUCCESS != r) {
 		re_printf("cryptobox: find: session %s not found on disk\n",
 			sessid);
 		return NULL;
 	}
 
-	sess = mem_zalloc(sizeof(*sess), session_destructor);
-	if (!sess)
+	err = session_alloc(&sess, cb, remote_userid, remote_clientid,
+			    local_clientid);
+	if (err) {
+		cbox_session_close(cbox_sess);
 		return NULL;
-
-	err  = str_dup(&sess->remote_userid, remote_userid);
-	err |= str_dup(&sess->remote_clientid, remote_clientid);
-	err |= str_dup(&sess->local_clientid, local_clientid);
-	if (err)
-		goto out;
+	}
 
 	sess->cbox_sess = cbox_sess;
 
 	info("cryptobox: New crypto session successfully"
 	     " loaded from disk\n");
 
-	list_append(&cb->sessionl, &sess->le, sess);
-
- out:
-	if (err)
-		sess = mem_deref(sess);
+	session_insert(cb, sess);
 
 	return sess;
 }
@@ -365,39 +854,40 @@ int cryptobox_session_encrypt(struct cryptobox *cb, struct session *sess,
 {
 	CBoxVec *vec_cipher = NULL;
 	CBoxResult r;
+	int err = 0;
 
 	if (!cb || !sess || !cipher || !cipher_len || !plain || !plain_len)
 		return EINVAL;
 
+	/* the session refers to the box for its identity */
+	lock_write_get(cb->lock);
 	r = cbox_encrypt(sess->cbox_sess,
 			 plain,
 			 plain_len,
 			 &vec_cipher);
+	lock_rel(cb->lock);
 	if (CBOX_SUCCESS != r) {
 		warning("cryptobox: encrypt failed (result=%d)\n", r);
 		return EBADMSG;
 	}
 
-	/*
-	 * Save the session. (ignore any errors)
-	 */
-	r = cbox_session_save(cb->cbox, sess->cbox_sess);
-	if (CBOX_SUCCESS != r) {
-		warning("cryptobox: could not save session (result=%d)\n", r);
-	}
+	session_use(sess);
+	session_touch(sess);
 
 	if (cbox_vec_len(vec_cipher) > *cipher_len) {
 		warning("cryptobox: encrypt: buffer too small (%zu > %zu)\n",
 			cbox_vec_len(vec_cipher), *cipher_len);
-		return EINVAL;
+		err = EINVAL;
+		goto out;
 	}
 
 	*cipher_len = cbox_vec_len(vec_cipher);
 	memcpy(cipher, cbox_vec_data(vec_cipher), *cipher_len);
 
+ out:
 	if (vec_cipher)
 		cbox_vec_free(vec_cipher);
-	return 0;
+	return err;
 }
 
 
@@ -411,21 +901,19 @@ int cryptobox_session_decrypt(struct cryptobox *cb, struct session *sess,
 	if (!cb || !sess || !cipher || !cipher_len || !plain || !plain_len)
 		return EINVAL;
 
+	/* and may remove a used prekey from the box */
+	lock_write_get(cb->lock);
 	r = cbox_decrypt(sess->cbox_sess,
 			 cipher, cipher_len,
 			 &vec_plain);
+	lock_rel(cb->lock);
 	if (CBOX_SUCCESS != r) {
 		warning("cryptobox: decrypt failed (result=%d)\n", r);
 		return EBADMSG;
 	}
 
-	/*
-	 * Save the session. (ignore any errors)
-	 */
-	r = cbox_session_save(cb->cbox, sess->cbox_sess);
-	if (CBOX_SUCCESS != r) {
-		warning("cryptobox: could not save session (result=%d)\n", r);
-	}
+	session_use(sess);
+	session_touch(sess);
 
 	if (cbox_vec_len(vec_plain) > *plain_len) {
 		warning("cryptobox: decrypt: buffer too small (%zu > %zu)\n",
@@ -451,15 +939,17 @@ void cryptobox_dump(const struct cryptobox *cb)
 	if (!cb)
 		return;
 
-	re_printf("Cryptobox sessions: (%u)\n", list_count(&cb->sessionl));
+	re_printf("Cryptobox sessions: (%zu of %zu, %u unsaved)\n",
+		  cb->nsess, cb->maxsess, list_count(&cb->dirtyl));
 
-	for (le = cb->sessionl.head; le; le = le->next) {
+	for (le = cb->lrul.tail; le; le = le->prev) {
 		struct session *sess = le->data;
 
-		re_printf("....user=%s  cli=%s lcli=%s %p\n",
+		re_printf("....user=%s  cli=%s lcli=%s %p%s\n",
 			  sess->remote_userid,
 			  sess->remote_clientid,
 			  sess->local_clientid,
-			  sess->cbox_sess);
+			  sess->cbox_sess,
+			  sess->dle.list ? " (unsaved)" : "");
 	}
 }
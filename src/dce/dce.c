@@ -98,6 +98,9 @@
 
 #define PAYLOAD_MAGIC 0x60504030
 
+/* Number of spent payloads kept per DCE for reuse */
+#define PAYLOAD_POOL_SIZE 16
+
 
 enum mq_type {
 	ESTAB,
@@ -112,6 +115,7 @@ struct payload {
 	enum mq_type type;
 	struct dce *dce;           /* pointer */
 	struct dce_channel *ch;    /* pointer */
+	struct avs_evq *evq;       /* pointer, queue it was pushed to */
 	uint32_t magic;
 
 	union {
@@ -120,7 +124,7 @@ struct payload {
 		} chopen;
 
 		struct {
-			uint8_t *buf;
+			uint8_t *buf;      /* owned, from usrsctp */
 			size_t len;
 		} chdata;
 	} v;
@@ -131,7 +135,6 @@ static struct {
 	struct lock *lock;
 	struct list dcel;
 	struct list pendingl;
-	struct mqueue *mqueue;
 } g_dce = {
 	.lock = NULL
 };
@@ -184,6 +187,16 @@ struct dce {
 	void *arg;
 
 	struct le le; /* member of global active list */
+	struct avs_evq *evq;  /* events go to the thread that owns dce */
+
+	struct {
+		struct list pool;  /* spent payloads, for reuse */
+
+		uint64_t msgs;
+		uint64_t bytes;
+		uint64_t allocs;
+		uint64_t reused;
+	} rx;
 
 	uint32_t magic;
 };
@@ -257,7 +270,8 @@ static void payload_destructor(void *arg)
 	switch (pld->type) {
 
 	case CH_DATA:
-		mem_deref(pld->v.chdata.buf);
+		/* allocated by usrsctp */
+		free(pld->v.chdata.buf);
 		break;
 
 	default:
@@ -266,26 +280,118 @@ static void payload_destructor(void *arg)
 }
 
 
+static bool exist_dce(struct list *dcel, struct dce *dce);
+
+
 static struct payload *payload_new(struct dce *dce, struct dce_channel *ch,
 				   enum mq_type type)
 {
-	struct payload *pld;
+	struct payload *pld = NULL;
+	struct le *le;
 
-	pld = mem_zalloc(sizeof(*pld), payload_destructor);
-	if (!pld)
-		return NULL;
+	lock_write_get(g_dce.lock);
+	le = list_head(&dce->rx.pool);
+	if (le) {
+		pld = le->data;
+		list_unlink(le);
+		++dce->rx.reused;
+	}
+	lock_rel(g_dce.lock);
+
+	if (!pld) {
+		pld = mem_zalloc(sizeof(*pld), payload_destructor);
+		if (!pld)
+			return NULL;
+
+		++dce->rx.allocs;
+	}
 
 	pld->magic = PAYLOAD_MAGIC;
 	pld->type = type;
 	pld->dce = dce;
 	pld->ch = ch;
 
-	list_append(&g_dce.pendingl, &pld->le, pld);
-
 	return pld;
 }
 
 
+/* Hand a payload to the thread that owns its DCE */
+static void payload_push(struct payload *pld)
+{
+	int err = ENOENT;
+
+	lock_write_get(g_dce.lock);
+	if (exist_dce(&g_dce.dcel, pld->dce)) {
+		pld->evq = pld->dce->evq;
+		list_append(&g_dce.pendingl, &pld->le, pld);
+
+		err = avs_evq_push(pld->evq, pld->type, pld);
+		if (err)
+			list_unlink(&pld->le);
+	}
+	lock_rel(g_dce.lock);
+
+	if (err)
+		mem_deref(pld);
+}
+
+
+/*
+ * The last DCE of a thread takes its queue along, so the payloads
+ * still queued there are never delivered and are dropped here.
+ */
+static void payload_flush(struct avs_evq *evq)
+{
+	struct le *le;
+
+	lock_write_get(g_dce.lock);
+	le = g_dce.pendingl.head;
+	while (le) {
+		struct payload *pld = le->data;
+
+		le = le->next;
+
+		if (pld->evq == evq)
+			mem_deref(pld);
+	}
+	lock_rel(g_dce.lock);
+}
+
+
+/*
+ * Return a handled payload to the pool of its DCE, the received
+ * buffer it holds goes back to usrsctp's allocator.
+ */
+static void payload_release(struct payload *pld)
+{
+	struct dce *dce = pld->dce;
+	bool pooled = false;
+
+	if (pld->type == CH_DATA)
+		free(pld->v.chdata.buf);
+
+	pld->type = ESTAB;
+	pld->ch = NULL;
+	memset(&pld->v, 0, sizeof(pld->v));
+
+	lock_write_get(g_dce.lock);
+	if (exist_dce(&g_dce.dcel, dce)
+	    && list_count(&dce->rx.pool) < PAYLOAD_POOL_SIZE) {
+
+		list_unlink(&pld->le);
+		list_append(&dce->rx.pool, &pld->le, pld);
+		pooled = true;
+	}
+	else {
+		list_unlink(&pld->le);
+	}
+	lock_rel(g_dce.lock);
+
+	if (!pooled)
+		mem_deref(pld);
+}
+
+
 static bool exist_dce(struct list *dcel, struct dce *dce)
 {
 	bool found = false;
@@ -970,7 +1076,7 @@ handle_open_request_message(struct dce *dce,
 
 			pld->v.chopen.sid = channel->o_stream;
 
-			mqueue_push(g_dce.mqueue, pld->type, pld);
+			payload_push(pld);
 		}
 	}
 }
@@ -1010,7 +1116,7 @@ handle_open_ack_message(struct dce *dce,
 
 		pld->v.chopen.sid = channel->i_stream;
 
-		mqueue_push(g_dce.mqueue, pld->type, pld);
+		payload_push(pld);
 	}
 	return;
 }
@@ -1022,17 +1128,19 @@ handle_unknown_message(char *msg, size_t length, uint16_t i_stream)
 	return;
 }
 
-static void
+/* Returns true if the payload took over the buffer */
+static bool
 handle_data_message(struct dce *dce,
                     char *buffer, size_t length, uint16_t i_stream)
 {
 	struct peer_connection *pc = &dce->pc;
 	struct channel *channel;
+	bool taken = false;
 
 	channel = find_channel_by_i_stream(pc, i_stream);
 	if (channel == NULL) {
 		/* XXX: Some error handling */
-		return;
+		return false;
 	}
 	if (channel->state == DATA_CHANNEL_CONNECTING) {
 		/* Implicit ACK */
@@ -1041,7 +1149,7 @@ handle_data_message(struct dce *dce,
 	if (channel->state != DATA_CHANNEL_OPEN) {
 		/* XXX: What about other states? */
 		/* XXX: Some error handling */
-		return;
+		return false;
 	} else {
 		debug("dce: message received of length %zu on chan: %d\n",
 		      length, channel->id);
@@ -1055,14 +1163,20 @@ handle_data_message(struct dce *dce,
 			struct payload *pld;
 
 			pld = payload_new(dce, ch, CH_DATA);
-			if (!pld)
-				return;
-
-			pld->v.chdata.buf = mem_alloc(length, NULL);
-			memcpy(pld->v.chdata.buf, buffer, length);
-			pld->v.chdata.len = length;
-
-			mqueue_push(g_dce.mqueue, pld->type, pld);
+			if (pld) {
+				/* Hand the usrsctp buffer on as is,
+				 * it is freed once the channel's
+				 * data handler has run.
+				 */
+				pld->v.chdata.buf = (uint8_t *)buffer;
+				pld->v.chdata.len = length;
+				taken = true;
+
+				++dce->rx.msgs;
+				dce->rx.bytes += length;
+
+				payload_push(pld);
+			}
 		}
 
 		lock_peer_connection(&dce->pc);		
@@ -1070,10 +1184,11 @@ handle_data_message(struct dce *dce,
 		/* Assuming DATA_CHANNEL_PPID_DOMSTRING */
 		/* XXX: Protect for non 0 terminated buffer */
 	}
-	return;
+	return taken;
 }
 
-static void
+/* Returns true if the buffer was taken over */
+static bool
 handle_message(struct dce *dce,
 	       char *buffer, size_t length, uint32_t ppid, uint16_t i_stream)
 {
@@ -1083,14 +1198,14 @@ handle_message(struct dce *dce,
 	switch (ppid) {
 	case DATA_CHANNEL_PPID_CONTROL:
 		if (length < sizeof(struct rtcweb_datachannel_ack)) {
-			return;
+			return false;
 		}
 		msg = (struct rtcweb_datachannel_ack *)buffer;
 		switch (msg->msg_type) {
 		case DATA_CHANNEL_OPEN_REQUEST:
 			if (length < sizeof(struct rtcweb_datachannel_open_request_fixed)) {
 				/* XXX: error handling? */
-				return;
+				return false;
 			}
 			req = (struct rtcweb_datachannel_open_request *)buffer;
 			handle_open_request_message(dce, req, length, i_stream);
@@ -1098,7 +1213,7 @@ handle_message(struct dce *dce,
 		case DATA_CHANNEL_OPEN_ACK:
 			if (length < sizeof(struct rtcweb_datachannel_ack)) {
 				/* XXX: error handling? */
-				return;
+				return false;
 			}
 			ack = (struct rtcweb_datachannel_ack *)buffer;
 			handle_open_ack_message(dce, ack, length, i_stream);
@@ -1113,14 +1228,15 @@ handle_message(struct dce *dce,
 
 	case DATA_CHANNEL_PPID_DOMSTRING:
 	case DATA_CHANNEL_PPID_BINARY:
-		handle_data_message(dce, buffer, length, i_stream);
-		break;
+		return handle_data_message(dce, buffer, length, i_stream);
 
 	default:
 		debug("dce: msg len=%zu, PPID %u on stream %u received.\n",
 		       length, ppid, i_stream);
 		break;
 	}
+
+	return false;
 }
 
 
@@ -1143,7 +1259,7 @@ handle_association_change_event(struct dce *dce,
 			if (!pld)
 				return;
 
-			mqueue_push(g_dce.mqueue, pld->type, pld);
+			payload_push(pld);
 
 			LIST_FOREACH(&dce->channell, le) {
 				struct dce_channel *ch = le->data;
@@ -1152,7 +1268,7 @@ handle_association_change_event(struct dce *dce,
 				if (!pld)
 					return;
 
-				mqueue_push(g_dce.mqueue, pld->type, pld);
+				payload_push(pld);
 			}
 		}
 		lock_peer_connection(&dce->pc);		
@@ -1371,7 +1487,7 @@ handle_stream_reset_event(struct dce *dce, struct sctp_stream_reset_event *strrs
 				if (!pld)
 					return;
 
-				mqueue_push(g_dce.mqueue, pld->type, pld);
+				payload_push(pld);
 			}
 		}
 	}
@@ -1657,18 +1773,22 @@ receive_cb(struct socket *sock, union sctp_sockstore addr, void *data,
 		return 1;
 	
 	if (data) {
+		bool taken = false;
+
 		lock_peer_connection(&dce->pc);
 		if (flags & MSG_NOTIFICATION) {
 			handle_notification(dce,
 				  (union sctp_notification *)data, datalen);
 		} else {
-			handle_message(dce,
-				       data, datalen,
-				       ntohl(rcv.rcv_ppid), rcv.rcv_sid);
+			taken = handle_message(dce,
+					       data, datalen,
+					       ntohl(rcv.rcv_ppid),
+					       rcv.rcv_sid);
 		}
 		unlock_peer_connection(&dce->pc);
 
-		free(data);
+		if (!taken)
+			free(data);
 	}
 	else {
 		usrsctp_deregister_address(dce);
@@ -1696,6 +1816,13 @@ int dce_status(struct re_printf *pf, struct dce *dce)
 	int err = print_status(&dce->pc, pf);
 	unlock_peer_connection(&dce->pc);
 
+	err |= re_hprintf(pf, "rx: %llu msgs %llu bytes "
+			  "allocs=%llu reused=%llu\n",
+			  (unsigned long long)dce->rx.msgs,
+			  (unsigned long long)dce->rx.bytes,
+			  (unsigned long long)dce->rx.allocs,
+			  (unsigned long long)dce->rx.reused);
+
 	return err;
 }
 
@@ -1866,10 +1993,16 @@ static void dce_destructor(void *arg)
 {
 	struct dce *dce = arg;
 
+	/* the RX thread takes payloads from the pool under the lock */
 	lock_write_get(g_dce.lock);
 	list_unlink(&dce->le);
+	list_flush(&dce->rx.pool);
 	lock_rel(g_dce.lock);
 
+	if (avs_evq_is_last(dce->evq))
+		payload_flush(dce->evq);
+	dce->evq = mem_deref(dce->evq);
+
 	assert(DCE_MAGIC == dce->magic);
     
 	info("dce: destructor: %p\n", dce);
@@ -1969,6 +2102,10 @@ static void dce_mqueue_handler(int id, void *data, void *arg)
 		goto out;
 	}
 
+	lock_write_get(g_dce.lock);
+	list_unlink(&pld->le);
+	lock_rel(g_dce.lock);
+
 	ch = pld->ch;
 
 	switch (id) {
@@ -2011,7 +2148,14 @@ static void dce_mqueue_handler(int id, void *data, void *arg)
 		break;
 	}
 
+	payload_release(pld);
+	return;
+
  out:
+	lock_write_get(g_dce.lock);
+	list_unlink(&pld->le);
+	lock_rel(g_dce.lock);
+
 	mem_deref(pld);
 }
 
@@ -2033,10 +2177,6 @@ int dce_init(void)
 	if (err)
 		return err;
 
-	err = mqueue_alloc(&g_dce.mqueue, dce_mqueue_handler, NULL);
-	if (err)
-		return err;
-
 	usrsctp_init(0, usrsctp_send_handler, debug_printf);
     
 	dce_inited = true;
@@ -2061,8 +2201,6 @@ void dce_close(void)
 
 	mem_deref(g_dce.lock);
 
-	g_dce.mqueue = mem_deref(g_dce.mqueue);
-
 	if (!list_isempty(&g_dce.pendingl)) {
 		debug("dce: flush pending events: %u\n",
 			  list_count(&g_dce.pendingl));
@@ -2239,6 +2377,10 @@ int dce_alloc(struct dce **dcep,
     
 	dce->magic = DCE_MAGIC;
 
+	err = avs_evq_get(&dce->evq, dce_mqueue_handler);
+	if (err)
+		goto out;
+
 	lock_write_get(g_dce.lock);
 	list_append(&g_dce.dcel, &dce->le, dce);
 	lock_rel(g_dce.lock);
@@ -0,0 +1,384 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_audio_level.h"
+#include "avs_decbudget.h"
+
+
+struct decbudget {
+	struct list entl;
+	struct lock *lock;
+	uint32_t maxc;     /* 0 means no limit */
+	uint32_t ndec;
+};
+
+struct decbudget_ent {
+	struct le le;
+	struct decbudget *db;
+	char name[16];
+
+	uint8_t level;
+	uint64_t last_active;
+	bool decoding;     /* read from the media threads, atomic */
+};
+
+
+static void destructor(void *arg)
+{
+	struct decbudget *db = arg;
+
+	list_flush(&db->entl);
+	mem_deref(db->lock);
+}
+
+
+static void ent_destructor(void *arg)
+{
+	struct decbudget_ent *ent = arg;
+	struct decbudget *db = ent->db;
+
+	lock_write_get(db->lock);
+	list_unlink(&ent->le);
+	if (ent->decoding)
+		--db->ndec;
+	lock_rel(db->lock);
+
+	mem_deref(db);
+}
+
+
+int decbudget_alloc(struct decbudget **dbp, uint32_t maxc)
+{
+	struct decbudget *db;
+	int err;
+
+	if (!dbp)
+		return EINVAL;
+
+	db = mem_zalloc(sizeof(*db), destructor);
+	if (!db)
+		return ENOMEM;
+
+	err = lock_alloc(&db->lock);
+	if (err) {
+		mem_deref(db);
+		return err;
+	}
+
+	list_init(&db->entl);
+	db->maxc = maxc;
+
+	*dbp = db;
+
+	return 0;
+}
+
+
+void decbudget_set_max(struct decbudget *db, uint32_t maxc)
+{
+	if (!db || db->maxc == maxc)
+		return;
+
+	info("decbudget(%p): max decoded streams %u -> %u\n",
+	     db, db->maxc, maxc);
+
+	lock_write_get(db->lock);
+	db->maxc = maxc;
+	lock_rel(db->lock);
+}
+
+
+uint32_t decbudget_max(const struct decbudget *db)
+{
+	return db ? db->maxc : 0;
+}
+
+
+uint32_t decbudget_count(const struct decbudget *db)
+{
+	return db ? list_count(&db->entl) : 0;
+}
+
+
+int decbudget_ent_alloc(struct decbudget_ent **entp, struct decbudget *db,
+			const char *name)
+{
+	struct decbudget_ent *ent;
+
+	if (!entp || !db)
+		return EINVAL;
+
+	ent = mem_zalloc(sizeof(*ent), ent_destructor);
+	if (!ent)
+		return ENOMEM;
+
+	ent->db = mem_ref(db);
+	str_ncpy(ent->name, name ? name : "", sizeof(ent->name));
+
+	lock_write_get(db->lock);
+
+	/* new streams are decoded as long as there is room */
+	__atomic_store_n(&ent->decoding, !db->maxc || db->ndec < db->maxc,
+			 __ATOMIC_RELEASE);
+	if (ent->decoding)
+		++db->ndec;
+
+	list_append(&db->entl, &ent->le, ent);
+
+	lock_rel(db->lock);
+
+	*entp = ent;
+
+	return 0;
+}
+
+
+void decbudget_ent_set_level(struct decbudget_ent *ent, uint8_t level)
+{
+	if (!ent)
+		return;
+
+	ent->level = level;
+}
+
+
+bool decbudget_ent_decoding(const struct decbudget_ent *ent)
+{
+	return ent ? __atomic_load_n(&ent->decoding, __ATOMIC_ACQUIRE) : true;
+}
+
+
+/*
+ * The frame a stream on the level-only path hands to the decoder: the
+ * Opus TOC of the real frame, with the same number of empty frames.
+ * The packet, and with it the audio level in its RTP header, still
+ * reaches the receiver, so the stream keeps its place in the ranking.
+ * The decoder only runs its loss concealment on it. frame and dst may
+ * be the same buffer.
+ */
+int decbudget_level_frame(uint8_t *dst, size_t *lenp,
+			  const uint8_t *frame, size_t len)
+{
+	uint8_t toc, count;
+
+	if (!dst || !lenp || (len && !frame))
+		return EINVAL;
+
+	if (!len) {
+		*lenp = 0;
+		return 0;
+	}
+
+	if (*lenp < 2)
+		return ENOMEM;
+
+	toc = frame[0];
+
+	switch (toc & 0x3) {
+
+	case 0:  /* one frame */
+	case 1:  /* two frames of equal size */
+		dst[0] = toc;
+		*lenp = 1;
+		break;
+
+	case 2:  /* two frames, the size of the first one follows */
+		if (len < 2)
+			return EPROTO;
+
+		dst[0] = toc;
+		dst[1] = 0;
+		*lenp = 2;
+		break;
+
+	case 3:  /* frame count follows, drop the VBR and padding flags */
+		if (len < 2)
+			return EPROTO;
+
+		count = frame[1] & 0x3f;
+		if (!count)
+			return EPROTO;
+
+		dst[0] = toc;
+		dst[1] = count;
+		*lenp = 2;
+		break;
+	}
+
+	return 0;
+}
+
+
+static void set_decoding(struct decbudget *db, struct decbudget_ent *ent,
+			 bool decoding, uint32_t *changes)
+{
+	if (ent->decoding == decoding)
+		return;
+
+	__atomic_store_n(&ent->decoding, decoding, __ATOMIC_RELEASE);
+	if (decoding)
+		++db->ndec;
+	else
+		--db->ndec;
+
+	++*changes;
+}
+
+
+static inline bool is_held(const struct decbudget_ent *ent, uint64_t now)
+{
+	return ent->decoding && now - ent->last_active < DECBUDGET_HOLD_MS;
+}
+
+
+/* Quietest decoded stream, preferring the ones not held */
+static struct decbudget_ent *weakest(struct decbudget *db, uint64_t now,
+				     bool allow_held)
+{
+	struct decbudget_ent *w = NULL;
+	struct le *le;
+
+	LIST_FOREACH(&db->entl, le) {
+		struct decbudget_ent *ent = le->data;
+
+		if (!ent->decoding)
+			continue;
+		if (!allow_held && is_held(ent, now))
+			continue;
+
+		if (!w || ent->level < w->level
+		    || (ent->level == w->level
+			&& ent->last_active < w->last_active)) {
+			w = ent;
+		}
+	}
+
+	return w;
+}
+
+
+/* Loudest stream on the level-only path */
+static struct decbudget_ent *loudest(struct decbudget *db)
+{
+	struct decbudget_ent *l = NULL;
+	struct le *le;
+
+	LIST_FOREACH(&db->entl, le) {
+		struct decbudget_ent *ent = le->data;
+
+		if (ent->decoding || ent->level <= AUDIO_LEVEL_FLOOR)
+			continue;
+
+		if (!l || ent->level > l->level)
+			l = ent;
+	}
+
+	return l;
+}
+
+
+/*
+ * Recompute the set of decoded streams, returns the number of streams
+ * that were switched between the decode and the level-only path.
+ */
+uint32_t decbudget_update(struct decbudget *db, uint64_t now)
+{
+	struct decbudget_ent *cand, *w;
+	uint32_t changes = 0;
+	struct le *le;
+
+	if (!db)
+		return 0;
+
+	lock_write_get(db->lock);
+
+	LIST_FOREACH(&db->entl, le) {
+		struct decbudget_ent *ent = le->data;
+
+		if (ent->level > AUDIO_LEVEL_FLOOR)
+			ent->last_active = now;
+
+		/* no budget: decode everything */
+		if (!db->maxc)
+			set_decoding(db, ent, true, &changes);
+	}
+
+	if (!db->maxc)
+		goto out;
+
+	/* the budget was lowered */
+	while (db->ndec > db->maxc) {
+		w = weakest(db, now, false);
+		if (!w)
+			w = weakest(db, now, true);
+
+		set_decoding(db, w, false, &changes);
+	}
+
+	/* fill free slots with the loudest speakers */
+	while (db->ndec < db->maxc && (cand = loudest(db)) != NULL)
+		set_decoding(db, cand, true, &changes);
+
+	/* swap in new speakers that are clearly louder */
+	while ((cand = loudest(db)) != NULL) {
+
+		w = weakest(db, now, false);
+		if (!w || cand->level <= w->level + DECBUDGET_MARGIN)
+			break;
+
+		set_decoding(db, w, false, &changes);
+		set_decoding(db, cand, true, &changes);
+		cand->last_active = now;
+	}
+
+ out:
+	lock_rel(db->lock);
+
+	if (changes) {
+		debug("decbudget(%p): %u changes, decoding %u of %u\n",
+		      db, changes, db->ndec, list_count(&db->entl));
+	}
+
+	return changes;
+}
+
+
+int decbudget_debug(struct re_printf *pf, const struct decbudget *db)
+{
+	struct le *le;
+	int err;
+
+	if (!db)
+		return 0;
+
+	err = re_hprintf(pf, "decode budget: %u of %u streams (max %u)\n",
+			 db->ndec, list_count(&db->entl), db->maxc);
+
+	LIST_FOREACH(&db->entl, le) {
+		const struct decbudget_ent *ent = le->data;
+
+		err |= re_hprintf(pf, "\t%-16s level=%3u %s\n",
+				  ent->name, ent->level,
+				  ent->decoding ? "decode" : "level-only");
+	}
+
+	return err;
+}
@@ -0,0 +1,6 @@
+#
+# mod.mk
+#
+
+AVS_SRCS += \
+	decbudget/decbudget.c
@@ -0,0 +1,352 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+
+#include "avs_log.h"
+#include "avs_cdict.h"
+
+
+/*
+ * Open addressing with linear probing. A slot holds an immutable
+ * entry, so a reader needs nothing more than an atomic load per probe.
+ * Removed entries and outgrown tables are not freed right away, but
+ * parked until a writer sees no reader inside the table.
+ */
+
+enum {
+	MIN_SIZE = 16,
+};
+
+struct cdict_entry {
+	struct le le;       /* member of retired list */
+	uint32_t hash;
+	char *key;
+	void *val;
+};
+
+struct cdict_table {
+	struct le le;       /* member of retired list */
+	uint32_t size;      /* power of two */
+	struct cdict_entry *slotv[];
+};
+
+struct cdict {
+	struct cdict_table *tbl;
+	struct lock *lock;  /* writers only */
+	uint32_t readers;
+	uint32_t count;     /* live entries            */
+	uint32_t used;      /* live entries + removed  */
+	struct list retiredl;
+};
+
+
+/* Marks a removed slot, probing continues past it */
+static struct cdict_entry tombstone;
+
+
+static void entry_destructor(void *arg)
+{
+	struct cdict_entry *e = arg;
+
+	list_unlink(&e->le);
+	mem_deref(e->key);
+}
+
+
+static void table_destructor(void *arg)
+{
+	struct cdict_table *tbl = arg;
+
+	list_unlink(&tbl->le);
+}
+
+
+static void destructor(void *arg)
+{
+	struct cdict *cd = arg;
+	uint32_t i;
+
+	if (cd->tbl) {
+		for (i = 0; i < cd->tbl->size; i++) {
+			struct cdict_entry *e = cd->tbl->slotv[i];
+
+			if (e && e != &tombstone)
+				mem_deref(e);
+		}
+		mem_deref(cd->tbl);
+	}
+
+	list_flush(&cd->retiredl);
+	mem_deref(cd->lock);
+}
+
+
+static struct cdict_table *table_alloc(uint32_t size)
+{
+	struct cdict_table *tbl;
+
+	tbl = mem_zalloc(sizeof(*tbl) + size * sizeof(tbl->slotv[0]),
+			 table_destructor);
+	if (!tbl)
+		return NULL;
+
+	tbl->size = size;
+
+	return tbl;
+}
+
+
+static struct cdict_entry *slot_load(const struct cdict_table *tbl,
+				     uint32_t i)
+{
+	return __atomic_load_n(&tbl->slotv[i], __ATOMIC_SEQ_CST);
+}
+
+
+static void slot_store(struct cdict_table *tbl, uint32_t i,
+		       struct cdict_entry *e)
+{
+	__atomic_store_n(&tbl->slotv[i], e, __ATOMIC_SEQ_CST);
+}
+
+
+static struct cdict_entry *entry_find(const struct cdict_table *tbl,
+				      uint32_t hash, const char *key,
+				      uint32_t *slotp)
+{
+	const uint32_t mask = tbl->size - 1;
+	uint32_t i, n;
+
+	for (i = hash & mask, n = 0; n < tbl->size; i = (i + 1) & mask, n++) {
+		struct cdict_entry *e = slot_load(tbl, i);
+
+		if (!e)
+			break;
+
+		if (e != &tombstone && e->hash == hash && streq(e->key, key)) {
+			if (slotp)
+				*slotp = i;
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* Insert into a free or removed slot, the key is known to be new */
+static bool slot_insert(struct cdict_table *tbl, struct cdict_entry *e)
+{
+	const uint32_t mask = tbl->size - 1;
+	uint32_t i, n;
+
+	for (i = e->hash & mask, n = 0; n < tbl->size;
+	     i = (i + 1) & mask, n++) {
+		const struct cdict_entry *old = tbl->slotv[i];
+
+		if (!old || old == &tombstone) {
+			slot_store(tbl, i, e);
+			return old == NULL;
+		}
+	}
+
+	return false;
+}
+
+
+/* Free what was retired, if no reader can still see it */
+static void reclaim(struct cdict *cd)
+{
+	if (list_isempty(&cd->retiredl))
+		return;
+
+	if (__atomic_load_n(&cd->readers, __ATOMIC_SEQ_CST) == 0)
+		list_flush(&cd->retiredl);
+}
+
+
+static int rehash(struct cdict *cd, uint32_t size)
+{
+	struct cdict_table *old = cd->tbl;
+	struct cdict_table *tbl;
+	uint32_t i;
+
+	tbl = table_alloc(size);
+	if (!tbl)
+		return ENOMEM;
+
+	for (i = 0; i < old->size; i++) {
+		struct cdict_entry *e = old->slotv[i];
+
+		if (e && e != &tombstone)
+			slot_insert(tbl, e);
+	}
+
+	__atomic_store_n(&cd->tbl, tbl, __ATOMIC_SEQ_CST);
+	cd->used = cd->count;
+
+	list_append(&cd->retiredl, &old->le, old);
+
+	return 0;
+}
+
+
+int cdict_alloc(struct cdict **cdp)
+{
+	struct cdict *cd;
+	int err;
+
+	if (!cdp)
+		return EINVAL;
+
+	cd = mem_zalloc(sizeof(*cd), destructor);
+	if (!cd)
+		return ENOMEM;
+
+	list_init(&cd->retiredl);
+
+	err = lock_alloc(&cd->lock);
+	if (err)
+		goto out;
+
+	cd->tbl = table_alloc(MIN_SIZE);
+	if (!cd->tbl) {
+		err = ENOMEM;
+		goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(cd);
+	else
+		*cdp = cd;
+
+	return err;
+}
+
+
+int cdict_add(struct cdict *cd, const char *key, void *val)
+{
+	struct cdict_entry *e;
+	uint32_t hash, size;
+	int err = 0;
+
+	if (!cd || !key)
+		return EINVAL;
+
+	hash = hash_joaat_str(key);
+
+	lock_write_get(cd->lock);
+
+	if (entry_find(cd->tbl, hash, key, NULL)) {
+		err = EADDRINUSE;
+		goto out;
+	}
+
+	/* keep the load below 3/4, counting removed slots */
+	if ((cd->used + 1) * 4 > cd->tbl->size * 3) {
+		size = MIN_SIZE;
+		while (size < (cd->count + 1) * 2)
+			size *= 2;
+
+		err = rehash(cd, size);
+		if (err)
+			goto out;
+	}
+
+	e = mem_zalloc(sizeof(*e), entry_destructor);
+	if (!e) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err = str_dup(&e->key, key);
+	if (err) {
+		mem_deref(e);
+		goto out;
+	}
+	e->hash = hash;
+	e->val = val;
+
+	if (slot_insert(cd->tbl, e))
+		++cd->used;
+	__atomic_store_n(&cd->count, cd->count + 1, __ATOMIC_RELAXED);
+
+	reclaim(cd);
+
+ out:
+	lock_rel(cd->lock);
+
+	return err;
+}
+
+
+void cdict_remove(struct cdict *cd, const char *key)
+{
+	struct cdict_entry *e;
+	uint32_t i;
+
+	if (!cd || !key)
+		return;
+
+	lock_write_get(cd->lock);
+
+	e = entry_find(cd->tbl, hash_joaat_str(key), key, &i);
+	if (e) {
+		slot_store(cd->tbl, i, &tombstone);
+		__atomic_store_n(&cd->count, cd->count - 1, __ATOMIC_RELAXED);
+
+		list_append(&cd->retiredl, &e->le, e);
+	}
+
+	reclaim(cd);
+
+	lock_rel(cd->lock);
+}
+
+
+void *cdict_lookup(struct cdict *cd, const char *key)
+{
+	const struct cdict_table *tbl;
+	const struct cdict_entry *e;
+	void *val;
+
+	if (!cd || !key)
+		return NULL;
+
+	__atomic_add_fetch(&cd->readers, 1, __ATOMIC_SEQ_CST);
+
+	tbl = __atomic_load_n(&cd->tbl, __ATOMIC_SEQ_CST);
+
+	e = entry_find(tbl, hash_joaat_str(key), key, NULL);
+	val = e ? e->val : NULL;
+
+	__atomic_sub_fetch(&cd->readers, 1, __ATOMIC_SEQ_CST);
+
+	return val;
+}
+
+
+uint32_t cdict_count(const struct cdict *cd)
+{
+	if (!cd)
+		return 0;
+
+	return __atomic_load_n(&cd->count, __ATOMIC_RELAXED);
+}
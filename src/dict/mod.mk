@@ -3,5 +3,5 @@
 #
 
 AVS_SRCS += \
+	dict/cdict.c \
 	dict/dict.c
-
@@ -24,6 +24,8 @@
 #include "avs_zapi.h"
 #include "avs_icall.h"
 #include "avs_keystore.h"
+#include "avs_frame_encryptor.h"
+#include "avs_frame_stats.h"
 #include "avs_iflow.h"
 #include "avs_peerflow.h"
 #include "avs_uuid.h"
@@ -94,6 +96,22 @@ static const char *async_sdp_name(enum async_sdp sdp)
 	}
 }
 
+/*
+ * Take the first media phases from the frame crypto stats, which see
+ * every frame that is sent or received.
+ */
+static void timeline_update(const struct ecall *ecall,
+			    const struct iflow_stats *stats)
+{
+	icall_timeline_mark_at(ecall->tl, ICALL_PHASE_RTP_SENT,
+			       stats->fenc.first_ns / 1000);
+	icall_timeline_mark_at(ecall->tl, ICALL_PHASE_RTP_RECV,
+			       stats->fdec.first_ns / 1000);
+	icall_timeline_mark_at(ecall->tl, ICALL_PHASE_FRAME_DECRYPTED,
+			       stats->fdec.first_ok_ns / 1000);
+}
+
+
 /* NOTE: Should only be triggered by async events! */
 void ecall_close(struct ecall *ecall, int err, uint32_t msg_time)
 {
@@ -120,6 +138,15 @@ void ecall_close(struct ecall *ecall, int err, uint32_t msg_time)
 
 	char *json_str = NULL;
 
+	/* the media phases are only known to the flow */
+	if (ecall->flow) {
+		struct iflow_stats stats;
+
+		memset(&stats, 0, sizeof(stats));
+		if (0 == IFLOW_CALLE(ecall->flow, get_stats, &stats))
+			timeline_update(ecall, &stats);
+	}
+
 	/* Keep flow reference, but indicate that it's gone */
 	flow = ecall->flow;
 	ecall->flow = NULL;
@@ -618,8 +645,6 @@ static void ecall_destructor(void *data)
 	mem_deref(ecall->media_laddr);
 
 	//list_flush(&ecall->audio.level.l);
-	
-	list_flush(&ecall->tracel);
 
 	/* last thing to do */
 	ecall->magic = 0;
@@ -941,6 +966,13 @@ static int _icall_stats(struct re_printf *pf, const struct icall *icall)
 	return ecall_stats(pf, (const struct ecall*)icall);
 }
 
+static int _icall_trace_export(struct mbuf *mb, const struct icall *icall,
+			       int fmt)
+{
+	return ecall_trace_export(mb, (const struct ecall*)icall,
+				  (enum ecall_trace_fmt)fmt);
+}
+
 
 int ecall_alloc(struct ecall **ecallp, struct list *ecalls,
 		enum icall_conv_type conv_type,
@@ -951,6 +983,7 @@ int ecall_alloc(struct ecall **ecallp, struct list *ecalls,
 		const char *clientid)
 {
 	struct ecall *ecall;
+	struct ztime ztime;
 	bool muted;
 	int err = 0;
 
@@ -1005,6 +1038,7 @@ int ecall_alloc(struct ecall **ecallp, struct list *ecalls,
 		goto out;
 
 	ecall->msys = mem_ref(msys);
+	ecall->tl = &ecall->icall.timeline;
 
 	ecall->transp.sendh = send_handler;
 	ecall->transp.arg = ecall;
@@ -1029,11 +1063,16 @@ int ecall_alloc(struct ecall **ecallp, struct list *ecalls,
 			    _icall_update_mute_state,
 			    _icall_debug,
 			    _icall_stats);
+	ecall->icall.trace_export = _icall_trace_export;
 
 	list_append(ecalls, &ecall->le, ecall);
 	list_append(&g_ecalls, &ecall->ecall_le, ecall);
 
 	ecall->ts_start = tmr_jiffies();
+	if (0 == ztime_get(&ztime)) {
+		ecall->ts_start_wall = (uint64_t)ztime.sec * 1000
+			+ ztime.msec;
+	}
 
 	info("ecall(%p): allocated\n", ecall);
  out:
@@ -1096,6 +1135,8 @@ static int offer_and_connect(struct ecall *ecall)
 		goto out;
 	}
 
+	icall_timeline_mark(ecall->tl, ICALL_PHASE_LOCAL_SDP);
+
 	if (ecall->update) {
 		err = econn_update_req(ecall->econn, sdp, ecall->props_local);
 		if (err) {
@@ -1175,6 +1216,8 @@ static int generate_answer(struct ecall *ecall, struct econn *econn)
 		goto out;
 	}
 
+	icall_timeline_mark(ecall->tl, ICALL_PHASE_LOCAL_SDP);
+
 	if (ecall->update) {
 		ecall->num_retries++;
 		err = econn_update_resp(econn, sdp, ecall->props_local);
@@ -1255,6 +1298,8 @@ static void mf_estab_handler(struct iflow *iflow,
 	info("ecall(%p): flow established (crypto=%s)\n",
 	     ecall, crypto);
 
+	icall_timeline_mark(ecall->tl, ICALL_PHASE_DTLS_ESTAB);
+
 	if (ecall->call_estab_time < 0 && ecall->ts_answered) {
 		ecall->call_estab_time = tmr_jiffies() - ecall->ts_answered;
 	}
@@ -1378,6 +1423,8 @@ static void mf_gather_handler(struct iflow *iflow, void *arg)
 	     ecall,
 	     async_sdp_name(ecall->sdp.async));
 
+	icall_timeline_mark(ecall->tl, ICALL_PHASE_ICE_GATHERED);
+
 	switch (econn_current_state(ecall->econn)) {
 		case ECONN_TERMINATING:
 		case ECONN_HANGUP_SENT:
@@ -1530,6 +1577,8 @@ static void channel_estab_handler(struct iflow *iflow, void *arg)
 	}
 	info("ecall(%p): data channel established\n", ecall);
 
+	icall_timeline_mark(ecall->tl, ICALL_PHASE_DCE_ESTAB);
+
 	tmr_cancel(&ecall->dc_tmr);
 
 	econn_set_datachan_established(ecall->econn);
@@ -2065,6 +2114,8 @@ int ecall_start(struct ecall *ecall, enum icall_call_type call_type,
 	if (!ecall)
 		return EINVAL;
 
+	icall_timeline_mark(ecall->tl, ICALL_PHASE_START);
+
 #ifdef ECALL_CBR_ALWAYS_ON
 	audio_cbr = true;
 #endif
@@ -2148,6 +2199,7 @@ int ecall_answer(struct ecall *ecall, enum icall_call_type call_type,
 	audio_cbr = true;
 #endif
 	
+	icall_timeline_mark(ecall->tl, ICALL_PHASE_START);
 
 	info("ecall(%p): answer on pending econn %p call_type=%d\n", ecall, ecall->econn, call_type);
 
@@ -2763,6 +2815,38 @@ int ecall_debug(struct re_printf *pf, const struct ecall *ecall)
 	return err;
 }
 
+static struct json_object *frame_stats_json(const struct frame_stats *fs)
+{
+	struct json_object *jobj, *jdrops;
+	int i;
+
+	jobj = jzon_alloc_object();
+	jdrops = jzon_alloc_object();
+	if (!jobj || !jdrops) {
+		mem_deref(jdrops);
+		return jobj;
+	}
+
+	jzon_add_int(jobj, "frames", (int32_t)fs->frames);
+	jzon_add_int(jobj, "bytesIn", (int32_t)fs->bytes_in);
+	jzon_add_int(jobj, "bytesOut", (int32_t)fs->bytes_out);
+	jzon_add_int(jobj, "keySwitches", (int32_t)fs->key_switches);
+	jzon_add_int(jobj, "nsPerFrame",
+		     fs->frames ? (int32_t)(fs->ns_total / fs->frames) : 0);
+	jzon_add_int(jobj, "nsP50", (int32_t)frame_stats_percentile(fs, 50));
+	jzon_add_int(jobj, "nsP99", (int32_t)frame_stats_percentile(fs, 99));
+
+	for (i = 0; i < FRAME_DROP_MAX; i++) {
+		jzon_add_int(jdrops, frame_stats_drop_name(
+				     (enum frame_stats_drop)i),
+			     (int32_t)fs->dropv[i]);
+	}
+	json_object_object_add(jobj, "drops", jdrops);
+
+	return jobj;
+}
+
+
 int ecall_stats(struct re_printf *pf, const struct ecall *ecall)
 {
 	struct iflow_stats stats;
@@ -2774,6 +2858,8 @@ int ecall_stats(struct re_printf *pf, const struct ecall *ecall)
 	IFLOW_CALL(ecall->flow, get_stats,
 		&stats);
 
+	timeline_update(ecall, &stats);
+
 	jfstats = jzon_alloc_object();
 	jzon_add_str(jfstats, "remoteUserId", "%s", ecall->userid_peer);
 	jzon_add_str(jfstats, "remoteClientId", "%s", ecall->clientid_peer);
@@ -2781,6 +2867,15 @@ int ecall_stats(struct re_printf *pf, const struct ecall *ecall)
 	jzon_add_int(jfstats, "audioPacketsSent", stats.apkts_sent);
 	jzon_add_int(jfstats, "videoPacketsReceived", stats.vpkts_recv);
 	jzon_add_int(jfstats, "videoPacketsSent", stats.vpkts_sent);
+
+	if (stats.fenc.frames || stats.fdec.frames
+	    || frame_stats_drops(&stats.fenc)
+	    || frame_stats_drops(&stats.fdec)) {
+		json_object_object_add(jfstats, "frameEncryption",
+				       frame_stats_json(&stats.fenc));
+		json_object_object_add(jfstats, "frameDecryption",
+				       frame_stats_json(&stats.fdec));
+	}
 	
 	jzon_print(pf, jfstats);
 
@@ -3007,6 +3102,7 @@ static void quality_handler(void *arg)
 	err = IFLOW_CALLE(ecall->flow, get_stats,
 			  &stats);
 	if (!err) {
+		timeline_update(ecall, &stats);
 		ICALL_CALL_CB(ecall->icall, qualityh,
 			      &ecall->icall, 
 			      ecall->userid_peer,
@@ -3151,6 +3247,16 @@ int ecall_set_keystore(struct ecall *ecall,
 	return 0;
 }
 
+
+/* Record the setup phases into tl, NULL for the own timeline */
+void ecall_set_timeline(struct ecall *ecall, struct icall_timeline *tl)
+{
+	if (!ecall)
+		return;
+
+	ecall->tl = tl ? tl : &ecall->icall.timeline;
+}
+
 int ecall_ping(struct ecall *ecall, bool response)
 {
 	if (!ecall || !ecall->econn)
@@ -37,6 +37,9 @@ enum async_sdp {
  */
 struct conf_part;
 
+/* Number of trace records kept per call, must be a power of 2 */
+#define ECALL_TRACE_SIZE 256
+
 #ifndef _WIN32
 #define ECALL_PACKED __attribute__((packed))
 #else
@@ -159,14 +162,19 @@ struct ecall {
 	int32_t audio_setup_time;
 	uint64_t ts_started;
 	uint64_t ts_answered;
+	struct icall_timeline *tl;  /* own, or the one of the parent call */
 
 	struct econn_transp transp;
 	uint32_t magic;
 
 	struct conf_part *conf_part;
 
-	struct list tracel;
+	struct {
+		struct ecall_trace_rec entv[ECALL_TRACE_SIZE];
+		uint32_t n;  /* total number of records written */
+	} trace;
 	uint64_t ts_start;
+	uint64_t ts_start_wall;  /* wallclock in [ms] */
 
 	bool devpair;
 
@@ -224,16 +232,4 @@ int ecall_set_media_laddr(struct ecall *ecall, struct sa *laddr);
 
 /* Ecall trace */
 
-
-struct trace_entry {
-	struct le le;
-
-	uint64_t ts;
-	bool tx;
-	enum econn_transport tp;
-	enum econn_msg msg_type;
-	bool resp;
-	uint32_t age;
-};
-
 int ecall_show_trace(struct re_printf *pf, const struct ecall *ecall);
@@ -32,11 +32,19 @@
 #include "ecall.h"
 
 
-static void entry_destructor(void *arg)
+static inline uint32_t trace_count(const struct ecall *ecall)
 {
-	struct trace_entry *entry = arg;
+	return min(ecall->trace.n, (uint32_t)ECALL_TRACE_SIZE);
+}
+
 
-	list_unlink(&entry->le);
+/* Get the i'th oldest record that is still in the ring */
+static inline const struct ecall_trace_rec *trace_rec(const struct ecall *ecall,
+						      uint32_t i)
+{
+	const uint32_t first = ecall->trace.n - trace_count(ecall);
+
+	return &ecall->trace.entv[(first + i) & (ECALL_TRACE_SIZE - 1)];
 }
 
 
@@ -44,24 +52,26 @@ void ecall_trace(struct ecall *ecall, const struct econn_message *msg,
 		 bool tx, enum econn_transport tp,
 		 const char *fmt, ...)
 {
-	struct trace_entry *entry;
+	struct ecall_trace_rec *rec;
 	va_list ap;
 
 	if (!ecall)
 		return;
 
-	/* save the ECONN message in the trace queue */
-	entry = mem_zalloc(sizeof(*entry), entry_destructor);
-	if (entry) {
-		entry->ts = tmr_jiffies() - ecall->ts_start;
-		entry->tx = tx;
-		entry->tp = tp;
-		entry->msg_type = msg->msg_type;
-		entry->resp = msg->resp;
-		entry->age = msg->age;
-
-		list_append(&ecall->tracel, &entry->le, entry);
-	}
+	/* save the ECONN message in the trace ring,
+	 * the oldest record is overwritten when it is full
+	 */
+	rec = &ecall->trace.entv[ecall->trace.n & (ECALL_TRACE_SIZE - 1)];
+	++ecall->trace.n;
+
+	rec->ts = (uint32_t)(tmr_jiffies() - ecall->ts_start);
+	rec->age = msg->age;
+	rec->sessid = hash_fast_str(msg->sessid_sender);
+	rec->msg_type = (uint8_t)msg->msg_type;
+	rec->tp = (uint8_t)tp;
+	rec->flags = (tx ? ECALL_TRACE_TX : 0)
+		| (msg->resp ? ECALL_TRACE_RESP : 0);
+	rec->pad = 0;
 
 	if (!ecall->conf.trace)
 		return;
@@ -84,30 +94,34 @@ void ecall_trace(struct ecall *ecall, const struct econn_message *msg,
 
 int ecall_show_trace(struct re_printf *pf, const struct ecall *ecall)
 {
-	struct le *le;
+	uint32_t i, n;
 	int err;
 
 	if (!ecall)
 		return 0;
 
-	err = re_hprintf(pf, "Ecall message trace (%u messages):\n",
-			 list_count(&ecall->tracel));
+	n = trace_count(ecall);
+
+	err = re_hprintf(pf, "Ecall message trace (%u messages, %u dropped):\n",
+			 n, ecall->trace.n - n);
 
-	for (le = list_head(&ecall->tracel); le; le = le->next) {
-		struct trace_entry *ent = le->data;
+	for (i = 0; i < n; i++) {
+		const struct ecall_trace_rec *rec = trace_rec(ecall, i);
+		const bool tx = rec->flags & ECALL_TRACE_TX;
 
 		err = re_hprintf(pf, "* %.3fs  %s via %7s  %10s %-8s"
 				 ,
-				 .001 * ent->ts,
-				 ent->tx ? "send --->" : "recv <---",
-				 econn_transp_name(ent->tp),
-				 econn_msg_name(ent->msg_type),
-				 ent->resp ? "Response" : "Request");
+				 .001 * rec->ts,
+				 tx ? "send --->" : "recv <---",
+				 econn_transp_name(rec->tp),
+				 econn_msg_name(rec->msg_type),
+				 (rec->flags & ECALL_TRACE_RESP) ?
+				 "Response" : "Request");
 		if (err)
 			break;
 
-		if (!ent->tx && ent->tp == ECONN_TRANSP_BACKEND) {
-			err |= re_hprintf(pf, "    age=%usec", ent->age);
+		if (!tx && rec->tp == ECONN_TRANSP_BACKEND) {
+			err |= re_hprintf(pf, "    age=%usec", rec->age);
 		}
 
 		err |= re_hprintf(pf, "\n");
@@ -118,3 +132,201 @@ int ecall_show_trace(struct re_printf *pf, const struct ecall *ecall)
 
 	return err;
 }
+
+
+static int write_str(struct mbuf *mb, const char *str)
+{
+	const size_t len = min(str_len(str), (size_t)255);
+	int err;
+
+	err = mbuf_write_u8(mb, (uint8_t)len);
+	if (len)
+		err |= mbuf_write_mem(mb, (const uint8_t *)str, len);
+
+	return err;
+}
+
+
+/*
+ * Binary format, all fields in network byte order:
+ *
+ *   u32 magic, u8 version, u8 reserved, u16 count,
+ *   u32 dropped, u64 wallclock start [ms],
+ *   u8 len + userid (anonymized), u8 len + clientid (anonymized),
+ *   count * { u32 ts, u32 age, u32 sessid, u8 type, u8 tp, u8 flags, u8 0 }
+ */
+static int export_binary(struct mbuf *mb, const struct ecall *ecall)
+{
+	char userid_anon[ANON_ID_LEN];
+	char clientid_anon[ANON_CLIENT_LEN];
+	const uint32_t n = trace_count(ecall);
+	uint32_t i;
+	int err = 0;
+
+	err |= mbuf_write_u32(mb, htonl(ECALL_TRACE_MAGIC));
+	err |= mbuf_write_u8(mb, ECALL_TRACE_VERSION);
+	err |= mbuf_write_u8(mb, 0);
+	err |= mbuf_write_u16(mb, htons((uint16_t)n));
+	err |= mbuf_write_u32(mb, htonl(ecall->trace.n - n));
+	err |= mbuf_write_u64(mb, sys_htonll(ecall->ts_start_wall));
+	err |= write_str(mb, anon_id(userid_anon, ecall->userid_self));
+	err |= write_str(mb, anon_client(clientid_anon,
+					 ecall->clientid_self));
+	if (err)
+		return err;
+
+	for (i = 0; i < n; i++) {
+		const struct ecall_trace_rec *rec = trace_rec(ecall, i);
+
+		err |= mbuf_write_u32(mb, htonl(rec->ts));
+		err |= mbuf_write_u32(mb, htonl(rec->age));
+		err |= mbuf_write_u32(mb, htonl(rec->sessid));
+		err |= mbuf_write_u8(mb, rec->msg_type);
+		err |= mbuf_write_u8(mb, rec->tp);
+		err |= mbuf_write_u8(mb, rec->flags);
+		err |= mbuf_write_u8(mb, 0);
+		if (err)
+			break;
+	}
+
+	return err;
+}
+
+
+static int export_ndjson(struct mbuf *mb, const struct ecall *ecall)
+{
+	char userid_anon[ANON_ID_LEN];
+	char clientid_anon[ANON_CLIENT_LEN];
+	const uint32_t n = trace_count(ecall);
+	uint32_t i;
+	int err;
+
+	err = mbuf_printf(mb, "{\"userid\":\"%s\",\"clientid\":\"%s\","
+			  "\"start\":%llu,\"count\":%u,\"dropped\":%u}\n",
+			  anon_id(userid_anon, ecall->userid_self),
+			  anon_client(clientid_anon, ecall->clientid_self),
+			  ecall->ts_start_wall, n, ecall->trace.n - n);
+	if (err)
+		return err;
+
+	for (i = 0; i < n; i++) {
+		const struct ecall_trace_rec *rec = trace_rec(ecall, i);
+
+		err = mbuf_printf(mb, "{\"ts\":%u,\"dir\":\"%s\","
+				  "\"tp\":\"%s\",\"type\":\"%s\","
+				  "\"resp\":%s,\"age\":%u,\"sess\":\"%08x\"}\n",
+				  rec->ts,
+				  (rec->flags & ECALL_TRACE_TX) ?
+				  "send" : "recv",
+				  econn_transp_name(rec->tp),
+				  econn_msg_name(rec->msg_type),
+				  (rec->flags & ECALL_TRACE_RESP) ?
+				  "true" : "false",
+				  rec->age, rec->sessid);
+		if (err)
+			break;
+	}
+
+	return err;
+}
+
+
+/*
+ * Export the trace of a call, with the user and client anonymized.
+ * The binary format is read back with ecall_trace_decode_hdr() and
+ * ecall_trace_decode_rec().
+ */
+int ecall_trace_export(struct mbuf *mb, const struct ecall *ecall,
+		       enum ecall_trace_fmt fmt)
+{
+	if (!mb || !ecall)
+		return EINVAL;
+
+	switch (fmt) {
+
+	case ECALL_TRACE_FMT_BINARY:
+		return export_binary(mb, ecall);
+
+	case ECALL_TRACE_FMT_NDJSON:
+		return export_ndjson(mb, ecall);
+
+	default:
+		return EINVAL;
+	}
+}
+
+
+/* The strings are written without a terminating NUL */
+static int read_str(struct mbuf *mb, char *str, size_t sz)
+{
+	size_t len;
+
+	if (mbuf_get_left(mb) < 1)
+		return EBADMSG;
+
+	len = mbuf_read_u8(mb);
+	if (mbuf_get_left(mb) < len || len >= sz)
+		return EBADMSG;
+
+	if (mbuf_read_mem(mb, (uint8_t *)str, len))
+		return EBADMSG;
+	str[len] = '\0';
+
+	return 0;
+}
+
+
+/*
+ * Read the header of a binary export. Returns EBADMSG if the data is
+ * not a trace or is truncated, EPROTONOSUPPORT for another version.
+ */
+int ecall_trace_decode_hdr(struct mbuf *mb, struct ecall_trace_hdr *hdr)
+{
+	int err;
+
+	if (!mb || !hdr)
+		return EINVAL;
+
+	if (mbuf_get_left(mb) < 20
+	    || ntohl(mbuf_read_u32(mb)) != ECALL_TRACE_MAGIC)
+		return EBADMSG;
+
+	if (mbuf_read_u8(mb) != ECALL_TRACE_VERSION)
+		return EPROTONOSUPPORT;
+
+	(void)mbuf_read_u8(mb);
+	hdr->count = ntohs(mbuf_read_u16(mb));
+	hdr->dropped = ntohl(mbuf_read_u32(mb));
+	hdr->start = sys_ntohll(mbuf_read_u64(mb));
+
+	err  = read_str(mb, hdr->userid, sizeof(hdr->userid));
+	err |= read_str(mb, hdr->clientid, sizeof(hdr->clientid));
+	if (err)
+		return EBADMSG;
+
+	if (mbuf_get_left(mb) < (size_t)hdr->count * 16)
+		return EBADMSG;
+
+	return 0;
+}
+
+
+/* Read the next record of a binary export */
+int ecall_trace_decode_rec(struct mbuf *mb, struct ecall_trace_rec *rec)
+{
+	if (!mb || !rec)
+		return EINVAL;
+
+	if (mbuf_get_left(mb) < 16)
+		return EBADMSG;
+
+	rec->ts       = ntohl(mbuf_read_u32(mb));
+	rec->age      = ntohl(mbuf_read_u32(mb));
+	rec->sessid   = ntohl(mbuf_read_u32(mb));
+	rec->msg_type = mbuf_read_u8(mb);
+	rec->tp       = mbuf_read_u8(mb);
+	rec->flags    = mbuf_read_u8(mb);
+	rec->pad      = mbuf_read_u8(mb);
+
+	return 0;
+}
@@ -0,0 +1,1086 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Single-pass econn message decoder
+ *
+ * The message is walked once with the jzon pull parser. Scalar fields
+ * are kept as spans into the source buffer until the message type is
+ * known, containers (props, ICE servers, participants, keys) are
+ * decoded in place into their final objects.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_jzon.h"
+#include "avs_zapi.h"
+#include "avs_icall.h"
+#include "avs_econn.h"
+#include "avs_econn_fmt.h"
+
+
+enum field {
+	FIELD_VERSION = 0,
+	FIELD_TYPE,
+	FIELD_SESSID,
+	FIELD_SRC_USERID,
+	FIELD_SRC_CLIENTID,
+	FIELD_DEST_USERID,
+	FIELD_DEST_CLIENTID,
+	FIELD_RESP,
+	FIELD_SDP,
+	FIELD_URL,
+	FIELD_SFT_URL,
+	FIELD_SECRET,
+	FIELD_TIMESTAMP,
+	FIELD_SEQNO,
+	FIELD_UPDATE,
+	FIELD_TOOL,
+	FIELD_TOOLVER,
+	FIELD_STATUS,
+	FIELD_SELECTIVE_AUDIO,
+	FIELD_SELECTIVE_VIDEO,
+	FIELD_VSTREAMS,
+	FIELD_SHOULD_START,
+	FIELD_ENTROPY,
+	FIELD_USERNAME,
+	FIELD_LEVEL,
+	FIELD_DESCR,
+	FIELD_PROPS,
+	FIELD_ICE_SERVERS,
+	FIELD_PARTICIPANTS,
+	FIELD_KEYS,
+
+	FIELD_MAX
+};
+
+static const struct pl fieldv[FIELD_MAX] = {
+	[FIELD_VERSION]         = PL("version"),
+	[FIELD_TYPE]            = PL("type"),
+	[FIELD_SESSID]          = PL("sessid"),
+	[FIELD_SRC_USERID]      = PL("src_userid"),
+	[FIELD_SRC_CLIENTID]    = PL("src_clientid"),
+	[FIELD_DEST_USERID]     = PL("dest_userid"),
+	[FIELD_DEST_CLIENTID]   = PL("dest_clientid"),
+	[FIELD_RESP]            = PL("resp"),
+	[FIELD_SDP]             = PL("sdp"),
+	[FIELD_URL]             = PL("url"),
+	[FIELD_SFT_URL]         = PL("sft_url"),
+	[FIELD_SECRET]          = PL("secret"),
+	[FIELD_TIMESTAMP]       = PL("timestamp"),
+	[FIELD_SEQNO]           = PL("seqno"),
+	[FIELD_UPDATE]          = PL("update"),
+	[FIELD_TOOL]            = PL("tool"),
+	[FIELD_TOOLVER]         = PL("toolver"),
+	[FIELD_STATUS]          = PL("status"),
+	[FIELD_SELECTIVE_AUDIO] = PL("selective_audio"),
+	[FIELD_SELECTIVE_VIDEO] = PL("selective_video"),
+	[FIELD_VSTREAMS]        = PL("vstreams"),
+	[FIELD_SHOULD_START]    = PL("should_start"),
+	[FIELD_ENTROPY]         = PL("entropy"),
+	[FIELD_USERNAME]        = PL("username"),
+	[FIELD_LEVEL]           = PL("level"),
+	[FIELD_DESCR]           = PL("descr"),
+	[FIELD_PROPS]           = PL("props"),
+	[FIELD_ICE_SERVERS]     = PL("ice_servers"),
+	[FIELD_PARTICIPANTS]    = PL("participants"),
+	[FIELD_KEYS]            = PL("keys"),
+};
+
+enum {
+	PART_USERID = 0,
+	PART_CLIENTID,
+	PART_AUTHORIZED,
+	PART_SSRCA,
+	PART_SSRCV,
+
+	PART_MAX
+};
+
+static const struct pl part_fieldv[PART_MAX] = {
+	[PART_USERID]     = PL("userid"),
+	[PART_CLIENTID]   = PL("clientid"),
+	[PART_AUTHORIZED] = PL("authorized"),
+	[PART_SSRCA]      = PL("ssrc_audio"),
+	[PART_SSRCV]      = PL("ssrc_video"),
+};
+
+enum {
+	KEY_IDX = 0,
+	KEY_DATA,
+
+	KEY_MAX
+};
+
+static const struct pl key_fieldv[KEY_MAX] = {
+	[KEY_IDX]  = PL("idx"),
+	[KEY_DATA] = PL("data"),
+};
+
+enum {
+	ICE_URLS = 0,
+	ICE_URL,
+	ICE_USERNAME,
+	ICE_CREDENTIAL,
+
+	ICE_MAX
+};
+
+static const struct pl ice_fieldv[ICE_MAX] = {
+	[ICE_URLS]       = PL("urls"),
+	[ICE_URL]        = PL("url"),
+	[ICE_USERNAME]   = PL("username"),
+	[ICE_CREDENTIAL] = PL("credential"),
+};
+
+static const enum econn_msg typev[] = {
+	ECONN_SETUP,
+	ECONN_CANCEL,
+	ECONN_HANGUP,
+	ECONN_PROPSYNC,
+	ECONN_GROUP_START,
+	ECONN_GROUP_LEAVE,
+	ECONN_GROUP_CHECK,
+	ECONN_GROUP_SETUP,
+	ECONN_CONF_CONN,
+	ECONN_CONF_START,
+	ECONN_CONF_END,
+	ECONN_CONF_PART,
+	ECONN_CONF_KEY,
+	ECONN_CONF_CHECK,
+	ECONN_UPDATE,
+	ECONN_REJECT,
+	ECONN_ALERT,
+	ECONN_PING,
+	ECONN_DEVPAIR_PUBLISH,
+	ECONN_DEVPAIR_ACCEPT,
+};
+
+
+/* Consumes a container value found at the given field index */
+typedef int (container_h)(unsigned idx, const struct jzon_value *val,
+			  struct jzon_pull *jp, void *arg);
+
+struct decoder {
+	struct jzon_value valv[FIELD_MAX];
+	bool seenv[FIELD_MAX];
+
+	struct odict *props;
+
+	struct zapi_ice_server *turnv;
+	size_t turnc;
+	size_t turnsz;
+	bool turn_invalid;
+
+	struct list partl;
+	struct list keyl;
+};
+
+struct ice_arg {
+	struct jzon_value url;
+	bool arr;
+};
+
+
+/*
+ * Walk the object at the current pull position and pick up the values
+ * of the fields listed in keyv. The first occurrence of a field wins,
+ * unknown fields are skipped.
+ */
+static int object_collect(struct jzon_pull *jp,
+			  const struct pl *keyv, size_t keyc,
+			  struct jzon_value *valv, bool *seenv,
+			  container_h *ch, void *arg)
+{
+	struct pl key;
+	bool first = true;
+	size_t i;
+	int err;
+
+	err = jzon_pull_object_begin(jp);
+	while (!err) {
+
+		err = jzon_pull_object_next(jp, &key, &first);
+		if (err)
+			break;
+
+		for (i = 0; i < keyc; i++) {
+			if (key.l == keyv[i].l &&
+			    0 == memcmp(key.p, keyv[i].p, key.l))
+				break;
+		}
+
+		if (i == keyc || seenv[i]) {
+			err = jzon_pull_skip(jp);
+			continue;
+		}
+
+		seenv[i] = true;
+
+		err = jzon_pull_value(jp, &valv[i]);
+		if (err)
+			break;
+
+		switch (valv[i].type) {
+
+		case ODICT_OBJECT:
+		case ODICT_ARRAY:
+			if (ch)
+				err = ch((unsigned)i, &valv[i], jp, arg);
+			else
+				err = jzon_pull_skip(jp);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return err == ENOENT ? 0 : err;
+}
+
+
+static inline bool value_is(const struct jzon_value *valv, const bool *seenv,
+			    unsigned idx, enum odict_type type)
+{
+	return seenv[idx] && valv[idx].type == type;
+}
+
+
+/* Same semantics as jzon_strdup(): a string, or null */
+static int value_strdup(char **dstp, const struct jzon_value *valv,
+			const bool *seenv, unsigned idx)
+{
+	if (!seenv[idx])
+		return ENOENT;
+
+	switch (valv[idx].type) {
+
+	case ODICT_STRING:
+		return jzon_value_strdup(dstp, &valv[idx]);
+
+	case ODICT_NULL:
+		*dstp = NULL;
+		return 0;
+
+	default:
+		return EPROTO;
+	}
+}
+
+
+static int value_base64(uint8_t *buf, size_t *lenp,
+			const struct jzon_value *val)
+{
+	char *str;
+	int err;
+
+	if (!val->esc)
+		return base64_decode(val->pl.p, val->pl.l, buf, lenp);
+
+	err = jzon_value_strdup(&str, val);
+	if (err)
+		return err;
+
+	err = base64_decode(str, str_len(str), buf, lenp);
+	mem_deref(str);
+
+	return err;
+}
+
+
+static int value_base64_dup(uint8_t **datap, uint32_t *lenp,
+			    const struct jzon_value *val)
+{
+	uint8_t *data;
+	size_t len;
+	int err;
+
+	len = val->pl.l * 3 / 4;
+
+	data = mem_zalloc(len, NULL);
+	if (!data)
+		return ENOMEM;
+
+	err = value_base64(data, &len, val);
+	if (err) {
+		mem_deref(data);
+		return err;
+	}
+
+	*datap = data;
+	*lenp = (uint32_t)len;
+
+	return 0;
+}
+
+
+/* Numbers sent as strings, e.g. "timestamp" */
+static uint64_t value_u64str(const struct jzon_value *valv, const bool *seenv,
+			     unsigned idx)
+{
+	struct pl pl;
+	char buf[32];
+
+	if (!value_is(valv, seenv, idx, ODICT_STRING))
+		return 0;
+
+	jzon_value_strcpy(buf, sizeof(buf), &valv[idx]);
+	pl_set_str(&pl, buf);
+
+	return pl_u64(&pl);
+}
+
+
+static int ice_urls_handler(unsigned idx, const struct jzon_value *val,
+			    struct jzon_pull *jp, void *arg)
+{
+	struct ice_arg *ia = arg;
+	bool first = true;
+	int err;
+
+	if (idx != ICE_URLS || val->type != ODICT_ARRAY)
+		return jzon_pull_skip(jp);
+
+	/* NOTE: we use only the first server */
+	ia->arr = true;
+
+	err = jzon_pull_array_begin(jp);
+	if (err)
+		return err;
+
+	err = jzon_pull_array_next(jp, &first);
+	if (err)
+		return err == ENOENT ? 0 : err;
+
+	err = jzon_pull_value(jp, &ia->url);
+	if (err)
+		return err;
+
+	if (ia->url.type == ODICT_OBJECT || ia->url.type == ODICT_ARRAY) {
+		err = jzon_pull_skip(jp);
+		if (err)
+			return err;
+	}
+
+	while (!err) {
+		err = jzon_pull_array_next(jp, &first);
+		if (!err)
+			err = jzon_pull_skip(jp);
+	}
+
+	return err == ENOENT ? 0 : err;
+}
+
+
+static int ice_server_decode(struct zapi_ice_server *srv,
+			     struct jzon_pull *jp)
+{
+	struct jzon_value valv[ICE_MAX];
+	bool seenv[ICE_MAX] = {false};
+	struct ice_arg ia;
+	const struct jzon_value *url = NULL;
+	int err;
+
+	memset(&ia, 0, sizeof(ia));
+	ia.url.type = ODICT_NULL;
+
+	err = jzon_pull_value(jp, &valv[0]);
+	if (err)
+		return err;
+
+	if (valv[0].type != ODICT_OBJECT)
+		return jzon_pull_skip(jp);
+
+	err = object_collect(jp, ice_fieldv, ICE_MAX, valv, seenv,
+			     ice_urls_handler, &ia);
+	if (err)
+		return err;
+
+	if (ia.arr)
+		url = &ia.url;
+	else if (value_is(valv, seenv, ICE_URLS, ODICT_STRING))
+		url = &valv[ICE_URLS];
+	else if (value_is(valv, seenv, ICE_URL, ODICT_STRING))
+		url = &valv[ICE_URL];
+
+	if (url && url->type == ODICT_STRING)
+		jzon_value_strcpy(srv->url, sizeof(srv->url), url);
+
+	if (value_is(valv, seenv, ICE_USERNAME, ODICT_STRING)) {
+		jzon_value_strcpy(srv->username, sizeof(srv->username),
+				  &valv[ICE_USERNAME]);
+	}
+	if (value_is(valv, seenv, ICE_CREDENTIAL, ODICT_STRING)) {
+		jzon_value_strcpy(srv->credential, sizeof(srv->credential),
+				  &valv[ICE_CREDENTIAL]);
+	}
+
+	return 0;
+}
+
+
+static int ice_servers_decode(struct decoder *dec, struct jzon_pull *jp)
+{
+	bool first = true;
+	int err;
+
+	err = jzon_pull_array_begin(jp);
+	while (!err) {
+		struct zapi_ice_server *srv;
+
+		err = jzon_pull_array_next(jp, &first);
+		if (err)
+			break;
+
+		if (dec->turnc >= dec->turnsz) {
+			struct zapi_ice_server *turnv;
+			size_t sz = dec->turnsz ? dec->turnsz * 2 : 4;
+
+			turnv = mem_realloc(dec->turnv, sz * sizeof(*turnv));
+			if (!turnv)
+				return ENOMEM;
+
+			dec->turnv = turnv;
+			dec->turnsz = sz;
+		}
+
+		srv = &dec->turnv[dec->turnc++];
+		memset(srv, 0, sizeof(*srv));
+
+		err = ice_server_decode(srv, jp);
+		if (!err && !str_isset(srv->url)) {
+			warning("econn: ice_servers[%zu] is missing url\n",
+				dec->turnc - 1);
+			dec->turn_invalid = true;
+		}
+	}
+
+	return err == ENOENT ? 0 : err;
+}
+
+
+static int part_decode(struct list *partl, struct jzon_pull *jp)
+{
+	struct jzon_value valv[PART_MAX];
+	bool seenv[PART_MAX] = {false};
+	struct econn_group_part *part;
+	char ssrc[32];
+	int err;
+
+	err = jzon_pull_value(jp, &valv[0]);
+	if (err)
+		return err;
+
+	if (valv[0].type != ODICT_OBJECT) {
+		warning("econn: failed to parse participant entry\n");
+		return jzon_pull_skip(jp);
+	}
+
+	err = object_collect(jp, part_fieldv, PART_MAX, valv, seenv,
+			     NULL, NULL);
+	if (err)
+		return err;
+
+	if (!(value_is(valv, seenv, PART_USERID, ODICT_STRING) ||
+	      value_is(valv, seenv, PART_USERID, ODICT_NULL)) ||
+	    !(value_is(valv, seenv, PART_CLIENTID, ODICT_STRING) ||
+	      value_is(valv, seenv, PART_CLIENTID, ODICT_NULL)) ||
+	    !value_is(valv, seenv, PART_AUTHORIZED, ODICT_BOOL) ||
+	    !value_is(valv, seenv, PART_SSRCA, ODICT_STRING) ||
+	    !value_is(valv, seenv, PART_SSRCV, ODICT_STRING)) {
+		warning("econn: failed to parse participant entry\n");
+		return 0;
+	}
+
+	part = econn_part_alloc(NULL, NULL);
+	if (!part)
+		return ENOMEM;
+
+	err  = value_strdup(&part->userid, valv, seenv, PART_USERID);
+	err |= value_strdup(&part->clientid, valv, seenv, PART_CLIENTID);
+	if (err) {
+		mem_deref(part);
+		return ENOMEM;
+	}
+
+	part->authorized = valv[PART_AUTHORIZED].b;
+
+	jzon_value_strcpy(ssrc, sizeof(ssrc), &valv[PART_SSRCA]);
+	sscanf(ssrc, "%u", &part->ssrca);
+	jzon_value_strcpy(ssrc, sizeof(ssrc), &valv[PART_SSRCV]);
+	sscanf(ssrc, "%u", &part->ssrcv);
+
+	list_append(partl, &part->le, part);
+
+	return 0;
+}
+
+
+static int key_decode(struct list *keyl, struct jzon_pull *jp)
+{
+	struct jzon_value valv[KEY_MAX];
+	bool seenv[KEY_MAX] = {false};
+	struct econn_key_info *key;
+	size_t sz;
+	int err;
+
+	err = jzon_pull_value(jp, &valv[0]);
+	if (err)
+		return err;
+
+	if (valv[0].type != ODICT_OBJECT)
+		return jzon_pull_skip(jp);
+
+	err = object_collect(jp, key_fieldv, KEY_MAX, valv, seenv,
+			     NULL, NULL);
+	if (err)
+		return err;
+
+	if (!value_is(valv, seenv, KEY_IDX, ODICT_INT) ||
+	    !value_is(valv, seenv, KEY_DATA, ODICT_STRING))
+		return 0;
+
+	key = econn_key_info_alloc(valv[KEY_DATA].pl.l);
+	if (!key)
+		return ENOMEM;
+
+	sz = key->dlen;
+	err = value_base64(key->data, &sz, &valv[KEY_DATA]);
+	if (err) {
+		warning("econn: failed to base64 decode key\n");
+		mem_deref(key);
+		return 0;
+	}
+
+	key->idx = (uint32_t)jzon_value_i64(&valv[KEY_IDX]);
+	key->dlen = (uint32_t)sz;
+
+	list_append(keyl, &key->le, key);
+
+	return 0;
+}
+
+
+static int list_decode(struct list *lst, struct jzon_pull *jp,
+		       int (*elemh)(struct list *, struct jzon_pull *))
+{
+	bool first = true;
+	int err;
+
+	err = jzon_pull_array_begin(jp);
+	while (!err) {
+		err = jzon_pull_array_next(jp, &first);
+		if (!err)
+			err = elemh(lst, jp);
+	}
+
+	return err == ENOENT ? 0 : err;
+}
+
+
+static int container_handler(unsigned idx, const struct jzon_value *val,
+			     struct jzon_pull *jp, void *arg)
+{
+	struct decoder *dec = arg;
+
+	switch (idx) {
+
+	case FIELD_PROPS:
+		if (val->type == ODICT_OBJECT)
+			return jzon_pull_odict(&dec->props, jp);
+		break;
+
+	case FIELD_ICE_SERVERS:
+		if (val->type == ODICT_ARRAY)
+			return ice_servers_decode(dec, jp);
+		break;
+
+	case FIELD_PARTICIPANTS:
+		if (val->type == ODICT_ARRAY)
+			return list_decode(&dec->partl, jp, part_decode);
+		break;
+
+	case FIELD_KEYS:
+		if (val->type == ODICT_ARRAY)
+			return list_decode(&dec->keyl, jp, key_decode);
+		break;
+
+	default:
+		break;
+	}
+
+	return jzon_pull_skip(jp);
+}
+
+
+static void list_transfer(struct list *dst, struct list *src)
+{
+	struct le *le;
+
+	while ((le = list_head(src)) != NULL) {
+		void *data = le->data;
+
+		list_unlink(le);
+		list_append(dst, le, data);
+	}
+}
+
+
+static int props_get(struct econn_props **propsp, struct decoder *dec)
+{
+	if (!dec->seenv[FIELD_PROPS]) {
+		warning("econn: no props\n");
+		return ENOENT;
+	}
+	if (!dec->props) {
+		warning("econn: no props\n");
+		return EPROTO;
+	}
+
+	return econn_props_alloc(propsp, dec->props);
+}
+
+
+static int turn_get(struct zapi_ice_server **turnvp, size_t *turncp,
+		    struct decoder *dec)
+{
+	if (dec->turn_invalid)
+		return EPROTO;
+
+	*turnvp = dec->turnv;
+	*turncp = dec->turnc;
+
+	dec->turnv = NULL;
+	dec->turnc = 0;
+
+	return 0;
+}
+
+
+static int sdp_get(char **sdpp, struct decoder *dec)
+{
+	if (!value_is(dec->valv, dec->seenv, FIELD_SDP, ODICT_STRING)) {
+		warning("econn: missing 'sdp' field\n");
+		return EBADMSG;
+	}
+
+	return jzon_value_strdup(sdpp, &dec->valv[FIELD_SDP]);
+}
+
+
+static int message_build(struct econn_message *msg, struct decoder *dec)
+{
+	const struct jzon_value *valv = dec->valv;
+	const bool *seenv = dec->seenv;
+	int64_t i64;
+	int err = 0;
+
+	switch (msg->msg_type) {
+
+	case ECONN_SETUP:
+	case ECONN_GROUP_SETUP:
+	case ECONN_UPDATE:
+		err = sdp_get(&msg->u.setup.sdp_msg, dec);
+		if (err)
+			break;
+
+		err = props_get(&msg->u.setup.props, dec);
+		if (err) {
+			/* props is optional for UPDATE */
+			if (msg->msg_type != ECONN_UPDATE)
+				break;
+
+			info("econn: decode UPDATE: no props\n");
+			err = 0;
+		}
+
+		if (msg->msg_type == ECONN_SETUP &&
+		    value_is(valv, seenv, FIELD_URL, ODICT_STRING)) {
+			err = jzon_value_strdup(&msg->u.setup.url,
+						&valv[FIELD_URL]);
+		}
+		break;
+
+	case ECONN_PROPSYNC:
+		err = props_get(&msg->u.propsync.props, dec);
+		break;
+
+	case ECONN_GROUP_START:
+		/* Props are optional,
+		 * dont fail to decode message if they are missing
+		 */
+		if (props_get(&msg->u.groupstart.props, dec))
+			info("econn: decode GROUPSTART: no props\n");
+		break;
+
+	case ECONN_CONF_START:
+		err = value_strdup(&msg->u.confstart.sft_url,
+				   valv, seenv, FIELD_SFT_URL);
+		if (err) {
+			warning("econn: decode CONFSTART: "
+				"couldnt read SFT URL\n");
+			break;
+		}
+
+		msg->u.confstart.timestamp =
+			value_u64str(valv, seenv, FIELD_TIMESTAMP);
+		msg->u.confstart.seqno =
+			(uint32_t)value_u64str(valv, seenv, FIELD_SEQNO);
+
+		if (!value_is(valv, seenv, FIELD_SECRET, ODICT_STRING)) {
+			err = EBADMSG;
+			break;
+		}
+		err = value_base64_dup(&msg->u.confstart.secret,
+				       &msg->u.confstart.secretlen,
+				       &valv[FIELD_SECRET]);
+		if (err)
+			break;
+
+		/* Props are optional, dont fail to decode message
+		 * if they are missing
+		 */
+		if (props_get(&msg->u.confstart.props, dec))
+			info("econn: decode CONFSTART: no props\n");
+		break;
+
+	case ECONN_CONF_CHECK:
+		err = value_strdup(&msg->u.confcheck.sft_url,
+				   valv, seenv, FIELD_SFT_URL);
+		if (err) {
+			warning("econn: decode CONFCHECK: "
+				"couldnt read SFT URL\n");
+			break;
+		}
+
+		msg->u.confcheck.timestamp =
+			value_u64str(valv, seenv, FIELD_TIMESTAMP);
+		msg->u.confcheck.seqno =
+			(uint32_t)value_u64str(valv, seenv, FIELD_SEQNO);
+
+		if (!value_is(valv, seenv, FIELD_SECRET, ODICT_STRING)) {
+			err = EBADMSG;
+			break;
+		}
+		err = value_base64_dup(&msg->u.confcheck.secret,
+				       &msg->u.confcheck.secretlen,
+				       &valv[FIELD_SECRET]);
+		break;
+
+	case ECONN_CONF_CONN:
+		if (value_is(valv, seenv, FIELD_ICE_SERVERS, ODICT_ARRAY)) {
+			err = turn_get(&msg->u.confconn.turnv,
+				       &msg->u.confconn.turnc, dec);
+			if (err) {
+				warning("econn: confconn: "
+					"could not decode ICE servers (%m)\n",
+					err);
+				break;
+			}
+		}
+
+		if (value_is(valv, seenv, FIELD_UPDATE, ODICT_BOOL))
+			msg->u.confconn.update = valv[FIELD_UPDATE].b;
+
+		if (value_is(valv, seenv, FIELD_TOOL, ODICT_STRING)) {
+			err = jzon_value_strdup(&msg->u.confconn.tool,
+						&valv[FIELD_TOOL]);
+			if (err)
+				break;
+		}
+		if (value_is(valv, seenv, FIELD_TOOLVER, ODICT_STRING)) {
+			err = jzon_value_strdup(&msg->u.confconn.toolver,
+						&valv[FIELD_TOOLVER]);
+			if (err)
+				break;
+		}
+
+		/* status is optional, missing = 0 */
+		if (value_is(valv, seenv, FIELD_STATUS, ODICT_INT)) {
+			i64 = jzon_value_i64(&valv[FIELD_STATUS]);
+			msg->u.confconn.status =
+				(enum econn_confconn_status)(int32_t)i64;
+		}
+
+		/* selective_audio/video are optional, missing = false */
+		if (value_is(valv, seenv, FIELD_SELECTIVE_AUDIO, ODICT_BOOL)) {
+			msg->u.confconn.selective_audio =
+				valv[FIELD_SELECTIVE_AUDIO].b;
+		}
+		if (value_is(valv, seenv, FIELD_SELECTIVE_VIDEO, ODICT_BOOL)) {
+			msg->u.confconn.selective_video =
+				valv[FIELD_SELECTIVE_VIDEO].b;
+		}
+
+		/* vstreams is optional, missing = 0, range 0 to 32 */
+		if (value_is(valv, seenv, FIELD_VSTREAMS, ODICT_INT)) {
+			int32_t vstreams;
+
+			i64 = jzon_value_i64(&valv[FIELD_VSTREAMS]);
+			vstreams = (int32_t)i64;
+			if (vstreams < 0)
+				vstreams = 0;
+			if (vstreams > 32)
+				vstreams = 32;
+			msg->u.confconn.vstreams = vstreams;
+		}
+		break;
+
+	case ECONN_CONF_PART:
+		if (value_is(valv, seenv, FIELD_SHOULD_START, ODICT_BOOL)) {
+			msg->u.confpart.should_start =
+				valv[FIELD_SHOULD_START].b;
+		}
+
+		msg->u.confpart.timestamp =
+			value_u64str(valv, seenv, FIELD_TIMESTAMP);
+		msg->u.confpart.seqno =
+			(uint32_t)value_u64str(valv, seenv, FIELD_SEQNO);
+
+		if (value_is(valv, seenv, FIELD_ENTROPY, ODICT_STRING)) {
+			err = value_base64_dup(&msg->u.confpart.entropy,
+					       &msg->u.confpart.entropylen,
+					       &valv[FIELD_ENTROPY]);
+			if (err)
+				break;
+		}
+
+		if (!value_is(valv, seenv, FIELD_PARTICIPANTS, ODICT_ARRAY))
+			warning("econn: decode: CONF_PART no parts\n");
+
+		list_transfer(&msg->u.confpart.partl, &dec->partl);
+		break;
+
+	case ECONN_CONF_KEY:
+		if (!seenv[FIELD_KEYS]) {
+			warning("econn: keys decode: no keys\n");
+			err = ENOENT;
+			break;
+		}
+		if (valv[FIELD_KEYS].type != ODICT_ARRAY) {
+			warning("econn: keys decode: no keys\n");
+			err = EPROTO;
+			break;
+		}
+
+		list_transfer(&msg->u.confkey.keyl, &dec->keyl);
+		break;
+
+	case ECONN_DEVPAIR_PUBLISH:
+		if (!value_is(valv, seenv, FIELD_ICE_SERVERS, ODICT_ARRAY)) {
+			warning("econn: devpair_publish: no ICE servers\n");
+			err = seenv[FIELD_ICE_SERVERS] ? EPROTO : ENOENT;
+			break;
+		}
+
+		err = turn_get(&msg->u.devpair_publish.turnv,
+			       &msg->u.devpair_publish.turnc, dec);
+		if (err) {
+			warning("econn: devpair_publish: "
+				"could not decode ICE servers (%m)\n", err);
+			break;
+		}
+
+		err = value_strdup(&msg->u.devpair_publish.sdp,
+				   valv, seenv, FIELD_SDP);
+		if (err) {
+			warning("econn: devpair_publish: "
+				"could not find SDP in message\n");
+			break;
+		}
+		err = value_strdup(&msg->u.devpair_publish.username,
+				   valv, seenv, FIELD_USERNAME);
+		if (err) {
+			warning("econn: devpair_publish: "
+				"could not find username in message\n");
+			break;
+		}
+		break;
+
+	case ECONN_DEVPAIR_ACCEPT:
+		err = value_strdup(&msg->u.devpair_accept.sdp,
+				   valv, seenv, FIELD_SDP);
+		if (err) {
+			warning("econn: devpair_accept: "
+				"could not find SDP in message\n");
+		}
+		break;
+
+	case ECONN_ALERT:
+		if (!value_is(valv, seenv, FIELD_LEVEL, ODICT_INT)) {
+			warning("econn: alert: "
+				"could not find level in message\n");
+			err = seenv[FIELD_LEVEL] ? EPROTO : ENOENT;
+			break;
+		}
+		i64 = jzon_value_i64(&valv[FIELD_LEVEL]);
+		msg->u.alert.level = (uint32_t)(int32_t)i64;
+
+		err = value_strdup(&msg->u.alert.descr,
+				   valv, seenv, FIELD_DESCR);
+		if (err) {
+			warning("econn: alert: "
+				"could not find descr in message\n");
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return err;
+}
+
+
+static enum econn_msg type_lookup(const struct jzon_value *val)
+{
+	char type[32];
+	size_t i;
+
+	jzon_value_strcpy(type, sizeof(type), val);
+
+	for (i = 0; i < ARRAY_SIZE(typev); i++) {
+		if (0 == str_casecmp(type, econn_msg_name(typev[i])))
+			return typev[i];
+	}
+
+	warning("econn: decode: unknown message type '%s'\n", type);
+
+	return (enum econn_msg)0;
+}
+
+
+int econn_message_decode(struct econn_message **msgp,
+			 uint64_t curr_time, uint64_t msg_time,
+			 const char *str, size_t len)
+{
+	struct econn_message *msg = NULL;
+	struct decoder dec;
+	struct jzon_pull jp;
+	const struct jzon_value *valv = dec.valv;
+	const bool *seenv = dec.seenv;
+	char ver[16];
+	int err;
+
+	if (!msgp || !str)
+		return EINVAL;
+
+	memset(&dec, 0, sizeof(dec));
+
+	jzon_pull_init(&jp, str, len);
+
+	err = object_collect(&jp, fieldv, FIELD_MAX, dec.valv, dec.seenv,
+			     container_handler, &dec);
+	if (err)
+		goto out;
+
+	err = jzon_pull_end(&jp);
+	if (err) {
+		warning("econn: decode: trailing data after message\n");
+		goto out;
+	}
+
+	msg = econn_message_alloc();
+	if (!msg) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	if (!value_is(valv, seenv, FIELD_VERSION, ODICT_STRING)) {
+		warning("econn: missing 'version' field\n");
+		err = EBADMSG;
+		goto out;
+	}
+
+	jzon_value_strcpy(ver, sizeof(ver), &valv[FIELD_VERSION]);
+	if (0 != str_casecmp(econn_proto_version, ver)) {
+		warning("econn: version mismatch (us=%s, msg=%s)\n",
+			econn_proto_version, ver);
+		err = EPROTO;
+		goto out;
+	}
+
+	if (!value_is(valv, seenv, FIELD_TYPE, ODICT_STRING)) {
+		warning("econn: missing 'type' field\n");
+		err = EBADMSG;
+		goto out;
+	}
+
+	if (!value_is(valv, seenv, FIELD_SESSID, ODICT_STRING)) {
+		warning("econn: missing 'sessid' field\n");
+		err = EBADMSG;
+		goto out;
+	}
+	jzon_value_strcpy(msg->sessid_sender, sizeof(msg->sessid_sender),
+			  &valv[FIELD_SESSID]);
+
+	if (value_is(valv, seenv, FIELD_SRC_USERID, ODICT_STRING)) {
+		jzon_value_strcpy(msg->src_userid, sizeof(msg->src_userid),
+				  &valv[FIELD_SRC_USERID]);
+	}
+	if (value_is(valv, seenv, FIELD_SRC_CLIENTID, ODICT_STRING)) {
+		jzon_value_strcpy(msg->src_clientid,
+				  sizeof(msg->src_clientid),
+				  &valv[FIELD_SRC_CLIENTID]);
+	}
+	if (value_is(valv, seenv, FIELD_DEST_USERID, ODICT_STRING)) {
+		jzon_value_strcpy(msg->dest_userid, sizeof(msg->dest_userid),
+				  &valv[FIELD_DEST_USERID]);
+	}
+	if (value_is(valv, seenv, FIELD_DEST_CLIENTID, ODICT_STRING)) {
+		jzon_value_strcpy(msg->dest_clientid,
+				  sizeof(msg->dest_clientid),
+				  &valv[FIELD_DEST_CLIENTID]);
+	}
+
+	if (!value_is(valv, seenv, FIELD_RESP, ODICT_BOOL)) {
+		warning("econn: missing 'resp' field\n");
+		err = seenv[FIELD_RESP] ? EPROTO : ENOENT;
+		goto out;
+	}
+	msg->resp = valv[FIELD_RESP].b;
+
+	msg->msg_type = type_lookup(&valv[FIELD_TYPE]);
+	if (!msg->msg_type) {
+		err = EPROTONOSUPPORT;
+		goto out;
+	}
+
+	err = message_build(msg, &dec);
+	if (err)
+		goto out;
+
+	msg->time = msg_time;
+	msg->age = (msg_time > curr_time) ? 0 : curr_time - msg_time;
+
+ out:
+	mem_deref(dec.props);
+	mem_deref(dec.turnv);
+	list_flush(&dec.partl);
+	list_flush(&dec.keyl);
+
+	if (err)
+		mem_deref(msg);
+	else
+		*msgp = msg;
+
+	return err;
+}
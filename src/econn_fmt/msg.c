@@ -559,9 +559,13 @@ static int econn_props_decode(struct econn_props **props,
 }
 
 
-int econn_message_decode(struct econn_message **msgp,
-			 uint64_t curr_time, uint64_t msg_time,
-			 const char *str, size_t len)
+/*
+ * Tree-based reference decoder. The default decoder is the pull
+ * decoder in decode.c, this one is kept for testing and benchmarking.
+ */
+int econn_message_decode_jzon(struct econn_message **msgp,
+			      uint64_t curr_time, uint64_t msg_time,
+			      const char *str, size_t len)
 {
 	struct econn_message *msg = NULL;
 	struct json_object *jobj = NULL;
@@ -665,6 +665,8 @@ int egcall_start(struct icall *icall, enum icall_call_type call_type,
 		return EALREADY;
 	}
 
+	icall_timeline_reset(&egcall->icall.timeline);
+
 	err = send_msg(egcall, ECONN_GROUP_START, false, false);
 	if (err != 0) {
 		goto out;
@@ -693,6 +695,8 @@ int egcall_answer(struct icall *icall, enum icall_call_type call_type,
 		return EPROTO;
 	}
 
+	icall_timeline_reset(&egcall->icall.timeline);
+
 	err = send_msg(egcall, ECONN_GROUP_START, true, false);
 	if (err != 0) {
 		goto out;
@@ -1229,6 +1233,9 @@ static int add_ecall(struct ecall **ecallp, struct egcall *egcall,
 		goto out;
 	}
 
+	/* the first member to get through sets each phase */
+	ecall_set_timeline(ecall, &egcall->icall.timeline);
+
 	me = mem_zalloc(sizeof(*me), media_entry_destructor);
 	if (!me) {
 		err = ENOMEM;
@@ -106,6 +106,31 @@ static void prekey_handler(const char *userid,
 	}
 	send_otr_if_ready(ctx, ctx->ignore_missing);
 }
+
+
+static void preload_targets(struct context *ctx)
+{
+	struct cryptobox_peer *peerv;
+	size_t i;
+	int err;
+
+	peerv = mem_zalloc(ctx->num_targets * sizeof(*peerv), NULL);
+	if (!peerv)
+		return;
+
+	for (i = 0; i < ctx->num_targets; i++) {
+		peerv[i].userid = ctx->targets[i].userid;
+		peerv[i].clientid = ctx->targets[i].clientid;
+	}
+
+	err = cryptobox_session_preload(ctx->cb, ctx->local_clientid,
+					peerv, ctx->num_targets, NULL, NULL);
+	if (err && err != EBUSY) {
+		warning("OTR(%p) session preload failed (%m)\n", ctx, err);
+	}
+
+	mem_deref(peerv);
+}
 #endif
 
 static void otr_missing_handler(const char *userid, const char *clientid, void *arg)
@@ -298,6 +323,13 @@ static int send_otr_if_ready(struct context *ctx, bool ignore_missing)
 			mem_deref(cu);
 		}
 
+#ifdef HAVE_CRYPTOBOX
+		/* The ratchet state must be on disk before the message
+		 * is out, or a crash would reuse the message keys
+		 */
+		cryptobox_flush(ctx->cb);
+#endif
+
 		ctx->waiting_for_otr = true;
 		err = engine_send_message(ctx->conv,
 				      ctx->local_clientid,
@@ -389,6 +421,12 @@ int engine_send_otr_message(struct engine *engine,
 		ctx->num_targets = num_targets;
 	}
 
+#ifdef HAVE_CRYPTOBOX
+	/* Have the sessions off disk by the time the client list is in */
+	if (ctx->cb && ctx->num_targets > 0)
+		preload_targets(ctx);
+#endif
+
 	// First time will fail with 412 and fill the user-client list
 	err = send_otr_if_ready(ctx, false);
 
@@ -40,6 +40,9 @@ struct frame_decryptor
 	uint32_t csrc;
 	bool frame_recv;
 	bool frame_dec;
+	bool keyed;
+
+	struct frame_stats_stream *stats;
 };
 
 static void destructor(void *arg)
@@ -47,6 +50,7 @@ static void destructor(void *arg)
 	struct frame_decryptor *dec = arg;
 	dec->keystore = (struct keystore*)mem_deref(dec->keystore);
 	dec->userid_hash = mem_deref(dec->userid_hash);
+	dec->stats = mem_deref(dec->stats);
 	if (dec->ctx) {
 		EVP_CIPHER_CTX_free(dec->ctx);
 		dec->ctx = NULL;
@@ -124,6 +128,17 @@ int frame_decryptor_set_keystore(struct frame_decryptor *dec,
 	return err;
 }
 
+int frame_decryptor_set_stats(struct frame_decryptor *dec,
+			      struct frame_stats_group *grp)
+{
+	if (!dec || !grp)
+		return EINVAL;
+
+	dec->stats = mem_deref(dec->stats);
+
+	return frame_stats_stream_alloc(&dec->stats, grp, dec->mtype, false);
+}
+
 int frame_decryptor_decrypt(struct frame_decryptor *dec,
 			    uint32_t csrc,
 			    const uint8_t *src,
@@ -142,6 +157,8 @@ int frame_decryptor_decrypt(struct frame_decryptor *dec,
 	uint32_t fcsrc = 0;
 	size_t hsize = 0;
 	bool new_user = false;
+	enum frame_stats_drop reason = FRAME_DROP_CRYPTO;
+	uint64_t t0 = frame_stats_now();
 	int err = 0;
 
 	if (!dec || !src || !dst) {
@@ -149,6 +166,7 @@ int frame_decryptor_decrypt(struct frame_decryptor *dec,
 	}
 
 	if (srcsz < 1) {
+		reason = FRAME_DROP_SHORT;
 		err = EAGAIN;
 		goto out;
 	}
@@ -156,6 +174,12 @@ int frame_decryptor_decrypt(struct frame_decryptor *dec,
 	hsize = frame_hdr_read(src, srcsz, &frameid, &kid, &fcsrc);
 	fid32 = (uint32_t)frameid;
 
+	if (srcsz < hsize + TAG_SIZE) {
+		reason = FRAME_DROP_SHORT;
+		err = EBADMSG;
+		goto out;
+	}
+
 	if (fcsrc)
 		csrc = fcsrc;
 	if (csrc != 0 && csrc != dec->csrc) {
@@ -165,8 +189,10 @@ int frame_decryptor_decrypt(struct frame_decryptor *dec,
 						   csrc,
 						   dec->mtype == FRAME_MEDIA_VIDEO,
 						   &dec->userid_hash);
-		if (err) 
+		if (err) {
+			reason = FRAME_DROP_NO_USER;
 			goto out;
+		}
 
 		new_user = true;
 		dec->csrc = csrc;
@@ -183,6 +209,7 @@ int frame_decryptor_decrypt(struct frame_decryptor *dec,
 		typename = dec->mtype == FRAME_MEDIA_VIDEO ? "video_iv" : "audio_iv";
 
 		if (!dec->userid_hash) {
+			reason = FRAME_DROP_NO_USER;
 			err = EAGAIN;
 			goto out;
 		}
@@ -191,8 +218,10 @@ int frame_decryptor_decrypt(struct frame_decryptor *dec,
 					   typename,
 					   dec->iv,
 					   IV_SIZE);
-		if (err) 
+		if (err) {
+			reason = FRAME_DROP_NO_IV;
 			goto out;
+		}
 
 		info("frame_dec(%p): decrypt: first frame received "
 		     "type: %s uid: %s fid: %u csrc: %u\n",
@@ -222,10 +251,15 @@ int frame_decryptor_decrypt(struct frame_decryptor *dec,
 	if (!dec->ctx) {
 		if (keystore_get_media_key(dec->keystore, kid, key, sizeof(key)) != 0) {
 			//warning("frame_dec(%p): decrypt: cant find key %u\n", dec, kid);
+			reason = FRAME_DROP_NO_KEY;
 			err = EAGAIN;
 			goto out;
 		}
 
+		if (dec->keyed && kid != dec->kidx)
+			frame_stats_key_switch(dec->stats);
+		dec->keyed = true;
+
 		dec->ctx = EVP_CIPHER_CTX_new();
 		if (!EVP_DecryptInit_ex(dec->ctx, EVP_aes_256_gcm(), NULL, key, NULL))
 			warning("frame_dec(%p): decrypt: init 256_gcm failed\n", dec);
@@ -258,14 +292,18 @@ int frame_decryptor_decrypt(struct frame_decryptor *dec,
 	
 	if (!EVP_DecryptFinal_ex(dec->ctx, dst + dec_len, &blk_len)) {
 		warning("frame_dec(%p): decrypt: final failed\n", dec);
+		reason = FRAME_DROP_AUTH;
 		err = EIO;
 		goto out;
 	}
 
 	*dstsz = dec_len + blk_len;
+	frame_stats_frame(dec->stats, srcsz, *dstsz, t0);
 
 out:
 	sodium_memzero(key, E2EE_SESSIONKEY_SIZE);
+	if (err)
+		frame_stats_drop(dec->stats, reason);
 	if (err != 0 && dec->ctx) {
 		EVP_CIPHER_CTX_free(dec->ctx);
 		dec->ctx = NULL;
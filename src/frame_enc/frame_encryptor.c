@@ -40,6 +40,8 @@ struct frame_encryptor
 	bool frame_recv;
 	bool frame_enc;
 	uint64_t updated_ts;
+
+	struct frame_stats_stream *stats;
 };
 
 static void destructor(void *arg)
@@ -47,6 +49,7 @@ static void destructor(void *arg)
 	struct frame_encryptor *enc = arg;
 	enc->keystore = (struct keystore*)mem_deref(enc->keystore);
 	enc->userid_hash = mem_deref(enc->userid_hash);
+	enc->stats = mem_deref(enc->stats);
 	if (enc->ctx) {
 		EVP_CIPHER_CTX_free(enc->ctx);
 		enc->ctx = NULL;
@@ -153,6 +156,17 @@ int frame_encryptor_set_keystore(struct frame_encryptor *enc,
 	return err;
 }
 
+int frame_encryptor_set_stats(struct frame_encryptor *enc,
+			      struct frame_stats_group *grp)
+{
+	if (!enc || !grp)
+		return EINVAL;
+
+	enc->stats = mem_deref(enc->stats);
+
+	return frame_stats_stream_alloc(&enc->stats, grp, enc->mtype, true);
+}
+
 int frame_encryptor_encrypt(struct frame_encryptor *enc,
 			    uint32_t ssrc,
 			    const uint8_t *src,
@@ -168,11 +182,13 @@ int frame_encryptor_encrypt(struct frame_encryptor *enc,
 	uint32_t kid32 = 0;
 	size_t hlen = 0;
 	uint8_t key[E2EE_SESSIONKEY_SIZE];
+	uint64_t t0 = frame_stats_now();
 	int err = 0;
 
 	enc->frameid = (enc->frameid + 1) & 0xFFFFFFFF;
 
 	if (!enc->keystore) {
+		frame_stats_drop(enc->stats, FRAME_DROP_NO_KEY);
 		return EINVAL;
 	}
 
@@ -198,6 +214,7 @@ int frame_encryptor_encrypt(struct frame_encryptor *enc,
 	if (enc->ctx && (kid != enc->kidx || updated_ts != enc->updated_ts)) {
 		EVP_CIPHER_CTX_free(enc->ctx);
 		enc->ctx = NULL;
+		frame_stats_key_switch(enc->stats);
 	}
 
 	if (!enc->ctx) {
@@ -263,6 +280,7 @@ int frame_encryptor_encrypt(struct frame_encryptor *enc,
 	}
 
 	*dstsz = hlen + enc_len + TAG_SIZE;
+	frame_stats_frame(enc->stats, srcsz, *dstsz, t0);
 
 	if (!err && !enc->frame_enc) {
 		info("frame_enc(%p): encrypt: first frame encrypted "
@@ -275,6 +293,10 @@ int frame_encryptor_encrypt(struct frame_encryptor *enc,
 	}
 out:
 	sodium_memzero(key, E2EE_SESSIONKEY_SIZE);
+	if (err) {
+		frame_stats_drop(enc->stats, err == EAGAIN ? FRAME_DROP_NO_KEY
+				 : FRAME_DROP_CRYPTO);
+	}
 	return err;
 }
 
@@ -0,0 +1,386 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <time.h>
+#include <re.h>
+#include <avs.h>
+
+
+struct frame_stats_group {
+	struct lock *lock;
+	struct list streaml;
+
+	/* what released streams counted, [mtype][tx] */
+	struct frame_stats retiredv[2][2];
+};
+
+struct frame_stats_stream {
+	struct le le;
+	struct frame_stats_group *grp;
+	enum frame_media_type mtype;
+	bool tx;
+
+	struct frame_stats st;
+};
+
+
+/*
+ * A stream has a single writer, so a relaxed load and store is
+ * enough; the atomics only keep readers from seeing torn values.
+ */
+static inline void counter_add(uint64_t *c, uint64_t v)
+{
+	__atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + v,
+			 __ATOMIC_RELAXED);
+}
+
+
+static inline uint64_t counter_get(const uint64_t *c)
+{
+	return __atomic_load_n(c, __ATOMIC_RELAXED);
+}
+
+
+/* Keep the earliest of two first-frame times, 0 is unset */
+static inline void first_merge(uint64_t *dst, const uint64_t *src)
+{
+	const uint64_t ts = counter_get(src);
+
+	if (ts && (!*dst || ts < *dst))
+		*dst = ts;
+}
+
+
+static inline void first_set(uint64_t *c, uint64_t ts)
+{
+	if (!counter_get(c))
+		__atomic_store_n(c, ts, __ATOMIC_RELAXED);
+}
+
+
+/* Add src to dst, src may be updated concurrently */
+void frame_stats_add(struct frame_stats *dst, const struct frame_stats *src)
+{
+	int i;
+
+	if (!dst || !src)
+		return;
+
+	dst->frames       += counter_get(&src->frames);
+	dst->bytes_in     += counter_get(&src->bytes_in);
+	dst->bytes_out    += counter_get(&src->bytes_out);
+	dst->key_switches += counter_get(&src->key_switches);
+	dst->ns_total     += counter_get(&src->ns_total);
+
+	for (i = 0; i < FRAME_DROP_MAX; i++)
+		dst->dropv[i] += counter_get(&src->dropv[i]);
+	for (i = 0; i < FRAME_STATS_BUCKETS; i++)
+		dst->histv[i] += counter_get(&src->histv[i]);
+
+	first_merge(&dst->first_ns, &src->first_ns);
+	first_merge(&dst->first_ok_ns, &src->first_ok_ns);
+}
+
+
+static void group_destructor(void *arg)
+{
+	struct frame_stats_group *grp = arg;
+
+	/* streams hold a reference, the list is empty here */
+	mem_deref(grp->lock);
+}
+
+
+static void stream_destructor(void *arg)
+{
+	struct frame_stats_stream *fs = arg;
+	struct frame_stats_group *grp = fs->grp;
+
+	lock_write_get(grp->lock);
+	frame_stats_add(&grp->retiredv[fs->mtype][fs->tx], &fs->st);
+	list_unlink(&fs->le);
+	lock_rel(grp->lock);
+
+	mem_deref(grp);
+}
+
+
+int frame_stats_group_alloc(struct frame_stats_group **grpp)
+{
+	struct frame_stats_group *grp;
+	int err;
+
+	if (!grpp)
+		return EINVAL;
+
+	grp = mem_zalloc(sizeof(*grp), group_destructor);
+	if (!grp)
+		return ENOMEM;
+
+	err = lock_alloc(&grp->lock);
+	if (err) {
+		mem_deref(grp);
+		return err;
+	}
+
+	list_init(&grp->streaml);
+
+	*grpp = grp;
+
+	return 0;
+}
+
+
+int frame_stats_stream_alloc(struct frame_stats_stream **fsp,
+			     struct frame_stats_group *grp,
+			     enum frame_media_type mtype, bool tx)
+{
+	struct frame_stats_stream *fs;
+
+	if (!fsp || !grp || (unsigned)mtype > FRAME_MEDIA_VIDEO)
+		return EINVAL;
+
+	fs = mem_zalloc(sizeof(*fs), stream_destructor);
+	if (!fs)
+		return ENOMEM;
+
+	fs->grp = mem_ref(grp);
+	fs->mtype = mtype;
+	fs->tx = tx;
+
+	lock_write_get(grp->lock);
+	list_append(&grp->streaml, &fs->le, fs);
+	lock_rel(grp->lock);
+
+	*fsp = fs;
+
+	return 0;
+}
+
+
+/* Sum of the live and released streams of one type and direction */
+int frame_stats_group_get(struct frame_stats_group *grp,
+			  enum frame_media_type mtype, bool tx,
+			  struct frame_stats *stats)
+{
+	struct le *le;
+
+	if (!grp || !stats || (unsigned)mtype > FRAME_MEDIA_VIDEO)
+		return EINVAL;
+
+	memset(stats, 0, sizeof(*stats));
+
+	lock_write_get(grp->lock);
+
+	frame_stats_add(stats, &grp->retiredv[mtype][tx]);
+
+	LIST_FOREACH(&grp->streaml, le) {
+		const struct frame_stats_stream *fs = le->data;
+
+		if (fs->mtype == mtype && fs->tx == tx)
+			frame_stats_add(stats, &fs->st);
+	}
+
+	lock_rel(grp->lock);
+
+	return 0;
+}
+
+
+uint64_t frame_stats_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static unsigned bucket(uint64_t ns)
+{
+	unsigned b = 0;
+
+	ns >>= 8;
+	while (ns && b < FRAME_STATS_BUCKETS - 1) {
+		ns >>= 1;
+		++b;
+	}
+
+	return b;
+}
+
+
+/* A frame was processed, t0 is frame_stats_now() at its start */
+void frame_stats_frame(struct frame_stats_stream *fs,
+		       size_t bytes_in, size_t bytes_out, uint64_t t0)
+{
+	uint64_t ns;
+
+	if (!fs)
+		return;
+
+	ns = frame_stats_now() - t0;
+
+	counter_add(&fs->st.frames, 1);
+	counter_add(&fs->st.bytes_in, bytes_in);
+	counter_add(&fs->st.bytes_out, bytes_out);
+	counter_add(&fs->st.ns_total, ns);
+	counter_add(&fs->st.histv[bucket(ns)], 1);
+
+	first_set(&fs->st.first_ns, t0);
+	first_set(&fs->st.first_ok_ns, t0);
+}
+
+
+void frame_stats_drop(struct frame_stats_stream *fs,
+		      enum frame_stats_drop reason)
+{
+	if (!fs || (unsigned)reason >= FRAME_DROP_MAX)
+		return;
+
+	counter_add(&fs->st.dropv[reason], 1);
+
+	if (!counter_get(&fs->st.first_ns))
+		first_set(&fs->st.first_ns, frame_stats_now());
+}
+
+
+void frame_stats_key_switch(struct frame_stats_stream *fs)
+{
+	if (!fs)
+		return;
+
+	counter_add(&fs->st.key_switches, 1);
+}
+
+
+uint64_t frame_stats_drops(const struct frame_stats *stats)
+{
+	uint64_t n = 0;
+	int i;
+
+	if (!stats)
+		return 0;
+
+	for (i = 0; i < FRAME_DROP_MAX; i++)
+		n += stats->dropv[i];
+
+	return n;
+}
+
+
+/* Upper bound [ns] of the bucket that holds the pct percentile */
+uint64_t frame_stats_percentile(const struct frame_stats *stats,
+				unsigned pct)
+{
+	uint64_t rank, n = 0;
+	unsigned i;
+
+	if (!stats || !stats->frames || pct > 100)
+		return 0;
+
+	rank = (stats->frames * pct + 99) / 100;
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < FRAME_STATS_BUCKETS; i++) {
+		n += stats->histv[i];
+		if (n >= rank)
+			break;
+	}
+
+	return 1ULL << (MIN(i, FRAME_STATS_BUCKETS - 1) + 8);
+}
+
+
+const char *frame_stats_drop_name(enum frame_stats_drop reason)
+{
+	switch (reason) {
+
+	case FRAME_DROP_NO_KEY:   return "no_key";
+	case FRAME_DROP_NO_USER:  return "no_user";
+	case FRAME_DROP_NO_IV:    return "no_iv";
+	case FRAME_DROP_SHORT:    return "short";
+	case FRAME_DROP_AUTH:     return "auth";
+	case FRAME_DROP_CRYPTO:   return "crypto";
+	default:                  return "???";
+	}
+}
+
+
+static int stats_debug(struct re_printf *pf, const char *name,
+		       const struct frame_stats *st)
+{
+	int err;
+	int i;
+
+	err = re_hprintf(pf, "  %s: frames=%llu bytes=%llu/%llu"
+			 " keyswitch=%llu ns/frame=%llu p50<%lluns"
+			 " p99<%lluns drops=%llu",
+			 name,
+			 (unsigned long long)st->frames,
+			 (unsigned long long)st->bytes_in,
+			 (unsigned long long)st->bytes_out,
+			 (unsigned long long)st->key_switches,
+			 (unsigned long long)(st->frames
+					      ? st->ns_total / st->frames : 0),
+			 (unsigned long long)frame_stats_percentile(st, 50),
+			 (unsigned long long)frame_stats_percentile(st, 99),
+			 (unsigned long long)frame_stats_drops(st));
+
+	for (i = 0; i < FRAME_DROP_MAX; i++) {
+		if (st->dropv[i]) {
+			err |= re_hprintf(pf, " %s=%llu",
+					  frame_stats_drop_name(i),
+					  (unsigned long long)st->dropv[i]);
+		}
+	}
+
+	err |= re_hprintf(pf, "\n");
+
+	return err;
+}
+
+
+int frame_stats_group_debug(struct re_printf *pf,
+			    struct frame_stats_group *grp)
+{
+	static const char *namev[2][2] = {
+		{"audio rx", "audio tx"},
+		{"video rx", "video tx"},
+	};
+	struct frame_stats st;
+	int mtype, tx;
+	int err = 0;
+
+	if (!grp)
+		return 0;
+
+	err |= re_hprintf(pf, "frame crypto:\n");
+
+	for (mtype = FRAME_MEDIA_AUDIO; mtype <= FRAME_MEDIA_VIDEO; mtype++) {
+		for (tx = 0; tx < 2; tx++) {
+			frame_stats_group_get(grp, mtype, tx, &st);
+			err |= stats_debug(pf, namev[mtype][tx], &st);
+		}
+	}
+
+	return err;
+}
@@ -4,6 +4,7 @@
 
 AVS_SRCS += \
 	frame_enc/frame_encryptor.c \
-	frame_enc/frame_decryptor.c
+	frame_enc/frame_decryptor.c \
+	frame_enc/frame_stats.c
 
 
@@ -17,6 +17,7 @@
 */
 
 
+#include <string.h>
 #include <re.h>
 #include <avs.h>
 
@@ -50,67 +51,66 @@ size_t frame_hdr_max_size(void)
 	return 18 + 9 * 8;
 }
 
-static uint8_t calc_len(uint32_t val) {
-	uint8_t l = 0;
+/* Values are stored with the minimum number of big-endian bytes */
+static inline uint64_t be64(uint64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return __builtin_bswap64(v);
+#else
+	return v;
+#endif
+}
 
-	if (val == 0) {
-		return 1;
-	}
+/* Bytes needed for the low 32 bits of val, at least one */
+static inline uint8_t calc_len(uint32_t val)
+{
+	return (39 - __builtin_clz(val | 1)) >> 3;
+}
 
-	while (val != 0) {
-		l++;
-		val >>= 8;
-	}
-	return l;
+/* buf has room for a full 8-byte store */
+static inline size_t store_bytes(uint8_t *buf,
+				 uint8_t len,
+				 uint64_t val)
+{
+	const uint64_t v = be64(val << (64 - 8 * len));
+
+	memcpy(buf, &v, sizeof(v));
+
+	return len;
 }
 
 static size_t write_bytes(uint8_t *buf,
 			  uint8_t len,
 			  uint64_t val)
 {
-	switch (len) {
-	case 8:
-		*buf = (val >> 56) & 0xff;
-		buf++;
-	case 7:
-		*buf = (val >> 48) & 0xff;
-		buf++;
-	case 6:
-		*buf = (val >> 40) & 0xff;
-		buf++;
-	case 5:
-		*buf = (val >> 32) & 0xff;
-		buf++;
-	case 4:
-		*buf = (val >> 24) & 0xff;
-		buf++;
-	case 3:
-		*buf = (val >> 16) & 0xff;
-		buf++;
-	case 2:
-		*buf = (val >> 8) & 0xff;
-		buf++;
-	case 1:
-		*buf = val & 0xff;
-		break;
-	default:
-		return 0;
-	}
+	uint8_t l;
+
+	for (l = len; l > 0; l--)
+		*buf++ = val >> (8 * (l - 1));
+
 	return len;
 }
 
+/* buf has 8 readable bytes */
+static inline uint64_t load_bytes(const uint8_t *buf, uint8_t len)
+{
+	uint64_t v;
+
+	memcpy(&v, buf, sizeof(v));
+
+	return be64(v) >> (64 - 8 * len);
+}
+
 static size_t read_bytes(const uint8_t *buf,
 			 uint8_t len,
 			 uint64_t *val)
 {
-	uint8_t l = len;
 	uint64_t v = 0;
-	while (l > 0) {
-		v <<= 8;
-		v |= *buf;
-		buf++;
-		l--;
-	}
+	uint8_t l;
+
+	for (l = 0; l < len; l++)
+		v = v << 8 | buf[l];
+
 	*val = v;
 	return len;
 }
@@ -121,42 +121,42 @@ size_t frame_hdr_write(uint8_t  *buf,
 		       uint64_t key,
 		       uint32_t csrc)
 {
-	uint8_t sig = 0;
-	uint8_t x = 0;
-	uint8_t klen, flen;
+	const uint8_t x = key > 7;
+	const uint8_t ext = csrc != 0;
+	const uint8_t ksz = x ? calc_len(key) : 0;
+	const uint8_t klen = x ? ksz - 1u : key;
+	const uint8_t flen = calc_len(frame);
+	const size_t hsz = 2u + ksz + flen + 5u * ext;
 	size_t p = 2;
-	uint8_t ext = csrc ? 1 : 0;
-	size_t xsz = csrc ? 5 : 0;
-	size_t hsz, ksz;
-
-	if (key > 7) {
-		x = 1;
-		ksz = calc_len(key);
-		klen = ksz - 1;
-	}
-	else {
-		ksz = 0;
-		klen = key;
-	}
-
-	flen = calc_len(frame);
 
-	hsz = 2 + ksz + flen + xsz;
 	if (bsz < hsz)
 		return 0;
 
 	buf[0] = HDR_VERSION << 5 | ext << 4;
-	buf[1] = sig << 7 | (flen-1) << 4 | x << 3 | klen;
-	if (x) {
-		p += write_bytes(buf + p, klen+1, key);
+	buf[1] = (flen - 1) << 4 | x << 3 | klen;
+
+	/* with room behind the header, store whole words */
+	if (bsz >= hsz + 8) {
+		if (x)
+			p += store_bytes(buf + p, ksz, key);
+		p += store_bytes(buf + p, flen, frame);
+
+		if (ext) {
+			buf[p] = 0x31;
+			store_bytes(buf + p + 1, 4, csrc);
+			p += 5;
+		}
 	}
-	p += write_bytes(buf + p, flen, frame);
-
-	if (csrc) {
-		buf[p] = 0x31;
-		p++;
-		write_bytes(buf + p, 4, csrc);
-		p += 4;
+	else {
+		if (x)
+			p += write_bytes(buf + p, ksz, key);
+		p += write_bytes(buf + p, flen, frame);
+
+		if (ext) {
+			buf[p] = 0x31;
+			write_bytes(buf + p + 1, 4, csrc);
+			p += 5;
+		}
 	}
 
 	return p;
@@ -169,43 +169,53 @@ size_t frame_hdr_read(const uint8_t *buf,
 		      uint64_t *key,
 		      uint32_t *csrc)
 {
-	uint8_t x = 0;
-	uint8_t klen, flen, elen;
+	const uint8_t x = (buf[1] >> 3) & 1;
+	const uint8_t klen = buf[1] & 7;
+	const uint8_t flen = ((buf[1] >> 4) & 7) + 1;
+	uint8_t ext = buf[0] & 0x10;
 	size_t p = 2;
-	uint8_t ext, b, eid;
-	uint64_t csrc64;
-	uint32_t i = 0;
+	uint32_t i;
 
-	ext = buf[0] & 0x10;
-	flen = ((buf[1] >> 4) & 7) + 1;
-	x = (buf[1] >> 3) & 1;
-	klen = buf[1] & 7;
+	/* room for the longest key and frame id, load them directly */
+	if (bsz >= 2 + 8 + 8) {
+		if (x) {
+			*key = load_bytes(buf + p, klen + 1);
+			p += klen + 1;
+		}
+		else {
+			*key = klen;
+		}
 
-	if (x) {
-		p += read_bytes(buf + p, klen+1, key);
+		*frameid = load_bytes(buf + p, flen);
+		p += flen;
 	}
 	else {
-		*key = klen;
+		if (x)
+			p += read_bytes(buf + p, klen + 1, key);
+		else
+			*key = klen;
+
+		p += read_bytes(buf + p, flen, frameid);
 	}
 
-	p += read_bytes(buf + p, flen, frameid);
+	for (i = 0; ext && p < bsz && i < MAX_EXTS; i++) {
+		const uint8_t b = buf[p];
+		const uint8_t elen = ((b >> 4) & 7) + 1;
 
-	while(ext && p < bsz && i < MAX_EXTS) {
-		b = *(buf + p);
-		ext = b & 0x80;
-		elen = ((b >> 4) & 7) + 1;
 		if (p + elen + 1 >= bsz)
 			break;
-		eid = b &  0x0f;
 
-		if (eid == 0x01 && elen == 4) {
-			read_bytes(buf + p + 1, 4, &csrc64);
-			*csrc = csrc64;
+		/* EID 1 with ELEN 4, the only extension we know */
+		if ((b & 0x7f) == 0x31) {
+			uint64_t v;
+
+			read_bytes(buf + p + 1, 4, &v);
+			*csrc = v;
 		}
+
+		ext = b & 0x80;
 		p += elen + 1;
-		i++;
 	}
 
 	return p;
 }
-
@@ -4,5 +4,6 @@
 
 
 AVS_SRCS += \
-	icall/icall.c
+	icall/icall.c \
+	icall/timeline.c
 
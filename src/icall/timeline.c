@@ -0,0 +1,206 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <time.h>
+#include <re.h>
+#include <avs.h>
+
+
+uint64_t icall_timeline_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+
+void icall_timeline_reset(struct icall_timeline *tl)
+{
+	if (!tl)
+		return;
+
+	memset(tl, 0, sizeof(*tl));
+	tl->tsv[ICALL_PHASE_START] = icall_timeline_now();
+}
+
+
+/* Record ts [us] for phase, unless the phase was reached before */
+void icall_timeline_mark_at(struct icall_timeline *tl,
+			    enum icall_phase phase, uint64_t ts)
+{
+	if (!tl || (unsigned)phase >= ICALL_PHASE_MAX || !ts)
+		return;
+
+	if (!tl->tsv[phase])
+		tl->tsv[phase] = ts;
+}
+
+
+void icall_timeline_mark(struct icall_timeline *tl, enum icall_phase phase)
+{
+	if (!tl || (unsigned)phase >= ICALL_PHASE_MAX || tl->tsv[phase])
+		return;
+
+	tl->tsv[phase] = icall_timeline_now();
+}
+
+
+/* Time from the call start to phase in [ms], -1 if not reached */
+int64_t icall_timeline_elapsed(const struct icall_timeline *tl,
+			       enum icall_phase phase)
+{
+	uint64_t t0, ts;
+
+	if (!tl || (unsigned)phase >= ICALL_PHASE_MAX)
+		return -1;
+
+	t0 = tl->tsv[ICALL_PHASE_START];
+	ts = tl->tsv[phase];
+	if (!t0 || !ts)
+		return -1;
+
+	/* media may have flowed before a restart of the timeline */
+	if (ts < t0)
+		return 0;
+
+	return (int64_t)((ts - t0) / 1000);
+}
+
+
+const char *icall_phase_name(enum icall_phase phase)
+{
+	switch (phase) {
+
+	case ICALL_PHASE_START:           return "start";
+	case ICALL_PHASE_CONFIG_REQ:      return "config_req";
+	case ICALL_PHASE_CONFIG_RESP:     return "config_resp";
+	case ICALL_PHASE_SFT_REQ:         return "sft_req";
+	case ICALL_PHASE_SFT_RESP:        return "sft_resp";
+	case ICALL_PHASE_LOCAL_SDP:       return "local_sdp";
+	case ICALL_PHASE_ICE_GATHERED:    return "ice_gathered";
+	case ICALL_PHASE_DTLS_ESTAB:      return "dtls_estab";
+	case ICALL_PHASE_DCE_ESTAB:       return "dce_estab";
+	case ICALL_PHASE_RTP_SENT:        return "rtp_sent";
+	case ICALL_PHASE_RTP_RECV:        return "rtp_recv";
+	case ICALL_PHASE_FRAME_DECRYPTED: return "frame_decrypted";
+	default:                          return "???";
+	}
+}
+
+
+int icall_timeline_debug(struct re_printf *pf,
+			 const struct icall_timeline *tl)
+{
+	int err = 0;
+	int i;
+
+	if (!tl)
+		return 0;
+
+	err |= re_hprintf(pf, "setup timeline [ms]:");
+
+	for (i = ICALL_PHASE_START + 1; i < ICALL_PHASE_MAX; i++) {
+		const int64_t ms = icall_timeline_elapsed(tl, i);
+
+		if (ms < 0)
+			err |= re_hprintf(pf, " %s=-", icall_phase_name(i));
+		else
+			err |= re_hprintf(pf, " %s=%lld",
+					  icall_phase_name(i), ms);
+	}
+
+	return err;
+}
+
+
+/* JSON object with the [ms] of each phase that was reached */
+int icall_timeline_json(struct re_printf *pf,
+			const struct icall_timeline *tl)
+{
+	bool first = true;
+	int err = 0;
+	int i;
+
+	if (!tl)
+		return 0;
+
+	err |= re_hprintf(pf, "{");
+
+	for (i = ICALL_PHASE_START + 1; i < ICALL_PHASE_MAX; i++) {
+		const int64_t ms = icall_timeline_elapsed(tl, i);
+
+		if (ms < 0)
+			continue;
+
+		err |= re_hprintf(pf, "%s\"%s\":%lld",
+				  first ? "" : ",", icall_phase_name(i), ms);
+		first = false;
+	}
+
+	err |= re_hprintf(pf, "}");
+
+	return err;
+}
+
+
+static bool is_ws(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+
+/*
+ * Add the timeline to the metrics object of a call as "setup_timeline",
+ * or make it the only member without metrics. The metrics are copied
+ * unchanged if they are not a JSON object.
+ */
+int icall_timeline_metrics(char **jsonp, const char *metrics_json,
+			   const struct icall_timeline *tl)
+{
+	struct pl body;
+
+	if (!jsonp || !tl)
+		return EINVAL;
+
+	if (!metrics_json)
+		return re_sdprintf(jsonp, "{\"setup_timeline\":%H}",
+				   icall_timeline_json, tl);
+
+	pl_set_str(&body, metrics_json);
+
+	while (body.l && is_ws(body.p[0]))
+		pl_advance(&body, 1);
+	while (body.l && is_ws(body.p[body.l - 1]))
+		--body.l;
+
+	if (body.l < 2 || body.p[0] != '{' || body.p[body.l - 1] != '}')
+		return re_sdprintf(jsonp, "%s", metrics_json);
+
+	/* the members between the braces */
+	pl_advance(&body, 1);
+	--body.l;
+	while (body.l && is_ws(body.p[body.l - 1]))
+		--body.l;
+
+	return re_sdprintf(jsonp, "{%r%s\"setup_timeline\":%H}",
+			   &body, body.l ? "," : "",
+			   icall_timeline_json, tl);
+}
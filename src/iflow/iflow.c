@@ -154,12 +154,14 @@ struct {
 	iflow_destroyf	*destroy;
 	iflow_set_mutef	*set_mute;
 	iflow_get_mutef	*get_mute;
+	iflow_set_voice_effectsf *set_voice_effects;
 } statics = {
 #ifdef __EMSCRIPTEN__
 	jsflow_alloc,
 #else
 	NULL,
 #endif
+	NULL,
 	NULL,
 	NULL,
 	NULL
@@ -174,6 +176,7 @@ void iflow_destroy(void)
 	statics.destroy = NULL;
 	statics.set_mute = NULL;
 	statics.get_mute = NULL;
+	statics.set_voice_effects = NULL;
 }
 
 
@@ -194,6 +197,15 @@ bool iflow_get_mute(void)
 }
 
 
+int iflow_set_voice_effects(const int *effectv, size_t effectc)
+{
+	if (statics.set_voice_effects) {
+		return statics.set_voice_effects(effectv, effectc);
+	}
+	return ENOSYS;
+}
+
+
 void iflow_register_statics(iflow_destroyf *destroy,
 			    iflow_set_mutef *set_mute,
 			    iflow_get_mutef *get_mute)
@@ -205,6 +217,12 @@ void iflow_register_statics(iflow_destroyf *destroy,
 }
 
 
+void iflow_register_voice_effects(iflow_set_voice_effectsf *set_voice_effects)
+{
+	statics.set_voice_effects = set_voice_effects;
+}
+
+
 void iflow_set_alloc(iflow_allocf *allocf)
 {
 	statics.alloc = allocf;
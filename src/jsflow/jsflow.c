@@ -225,6 +225,7 @@ struct jsflow {
 	struct tmr tmr_disconnect;
 	struct tmr tmr_stats;
 	char *remote_sdp;	
+	struct bundle_cache *bundle;
 	bool selective_audio;
 
 	struct tmr tmr_cbr;
@@ -419,6 +420,7 @@ static void destructor(void *arg)
 
 	mem_deref(flow->remote_sdp);
 	mem_deref(flow->bundle_sync);
+	mem_deref(flow->bundle);
 
 	mem_deref(flow->convid);
 	mem_deref(flow->userid_self);
@@ -569,6 +571,7 @@ int jsflow_alloc(struct iflow		**flowp,
 		 void			*extarg)
 {
 	struct jsflow *flow;
+	int err;
 
 	info("jsflow_alloc: initialized=%d call_type=%d vstate=%s\n",
 	     g_jf.initialized, call_type, icall_vstate_name(vstate));
@@ -628,6 +631,12 @@ int jsflow_alloc(struct iflow		**flowp,
 	tmr_init(&flow->tmr_stats);
 	tmr_init(&flow->tmr_cbr);
 
+	err = bundle_cache_alloc(&flow->bundle);
+	if (err) {
+		mem_deref(flow);
+		return err;
+	}
+
 	*flowp = (struct iflow *)flow;
 
 	return 0;
@@ -1145,7 +1154,8 @@ int jsflow_sync_decoders(struct iflow *iflow)
 	if (!jf)
 		return EINVAL;
 	
-	err = bundle_update((struct iflow *)jf,
+	err = bundle_update(jf->bundle,
+			    (struct iflow *)jf,
 			    jf->conv_type,
 			    !jf->selective_audio,
 			    jf->remote_sdp,
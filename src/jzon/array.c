@@ -0,0 +1,227 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * JSON arrays
+ *
+ * An array is still an odict keyed by the decimal index, so that it is
+ * encoded and nested like any other container. In addition it keeps a
+ * vector of its entries and their count, so that indexing and getting
+ * the length do not walk the list or look up a key.
+ *
+ * Arrays are only ever appended to. Entries appended through the odict
+ * API are picked up from the list on the next access; an array must
+ * not have entries removed, as the vector would still point at them.
+ */
+
+#include <re.h>
+#include "avs_log.h"
+#include "avs_jzon.h"
+#include "priv_jzon.h"
+
+
+enum {
+	ARRAY_HASH_SIZE = 4,   /* entries are not looked up by key */
+	ARRAY_MIN_SIZE  = 8,
+};
+
+
+struct jzon_array {
+	struct odict odict;    /* base class -- must be first */
+
+	const struct odict_entry **entv;
+	uint32_t entc;
+	uint32_t entsz;
+};
+
+
+/* The teardown of odict_alloc, plus the vector */
+static void destructor(void *data)
+{
+	struct jzon_array *arr = data;
+
+	hash_clear(arr->odict.ht);
+	list_flush(&arr->odict.lst);
+	mem_deref(arr->odict.ht);
+	mem_deref(arr->entv);
+}
+
+
+int jzon_array_alloc(struct odict **op)
+{
+	struct jzon_array *arr;
+	int err;
+
+	if (!op)
+		return EINVAL;
+
+	arr = mem_zalloc(sizeof(*arr), destructor);
+	if (!arr)
+		return ENOMEM;
+
+	list_init(&arr->odict.lst);
+
+	err = hash_alloc(&arr->odict.ht, ARRAY_HASH_SIZE);
+	if (err) {
+		mem_deref(arr);
+		return err;
+	}
+
+	*op = &arr->odict;
+
+	return 0;
+}
+
+
+static int array_grow(struct jzon_array *arr, uint32_t n)
+{
+	const struct odict_entry **entv;
+	uint32_t sz;
+
+	if (n <= arr->entsz)
+		return 0;
+
+	sz = arr->entsz ? arr->entsz : ARRAY_MIN_SIZE;
+	while (sz < n)
+		sz *= 2;
+
+	if (arr->entv)
+		entv = mem_realloc(arr->entv, sz * sizeof(*entv));
+	else
+		entv = mem_alloc(sz * sizeof(*entv), NULL);
+	if (!entv)
+		return ENOMEM;
+
+	arr->entv = entv;
+	arr->entsz = sz;
+
+	return 0;
+}
+
+
+/* Index the entries added after the last indexed one, O(1) if none */
+static int array_sync(struct jzon_array *arr)
+{
+	struct le *le;
+	int err;
+
+	le = arr->entc ? arr->entv[arr->entc - 1]->le.next
+		       : list_head(&arr->odict.lst);
+
+	for (; le; le = le->next) {
+		err = array_grow(arr, arr->entc + 1);
+		if (err)
+			return err;
+
+		arr->entv[arr->entc++] = le->data;
+	}
+
+	return 0;
+}
+
+
+uint32_t jzon_array_count(const struct odict *o)
+{
+	struct jzon_array *arr = (struct jzon_array *)o;
+
+	if (!o || array_sync(arr))
+		return 0;
+
+	return arr->entc;
+}
+
+
+const struct odict_entry *jzon_array_get(const struct odict *o, uint32_t idx)
+{
+	struct jzon_array *arr = (struct jzon_array *)o;
+
+	if (!o)
+		return NULL;
+
+	/* appends through the odict API are picked up here */
+	if (idx >= arr->entc && array_sync(arr))
+		return NULL;
+
+	return idx < arr->entc ? arr->entv[idx] : NULL;
+}
+
+
+/*
+ * Turn the arrays of a tree decoded by libre into jzon arrays, moving
+ * their entries over. The odict at *op is replaced if it is an array.
+ */
+int jzon_array_adopt(struct odict **op, enum odict_type type)
+{
+	struct odict *o, *arr;
+	struct le *le;
+	int err;
+
+	if (!op || !*op)
+		return EINVAL;
+
+	o = *op;
+
+	LIST_FOREACH(&o->lst, le) {
+		struct odict_entry *e = le->data;
+
+		if (!odict_type_iscontainer(e->type))
+			continue;
+
+		err = jzon_array_adopt(&e->u.odict, e->type);
+		if (err)
+			return err;
+	}
+
+	if (type != ODICT_ARRAY)
+		return 0;
+
+	err = jzon_array_alloc(&arr);
+	if (err)
+		return err;
+
+	while ((le = list_head(&o->lst))) {
+		struct odict_entry *e = le->data;
+
+		list_unlink(&e->le);
+		hash_unlink(&e->he);
+
+		list_append(&arr->lst, &e->le, e);
+		hash_append(arr->ht, hash_fast_str(e->key), &e->he, e);
+	}
+
+	mem_deref(o);
+	*op = arr;
+
+	return 0;
+}
+
+
+/* Format an array index as odict key */
+void jzon_array_key(char key[JZON_ARRAY_KEY_SIZE], uint32_t idx)
+{
+	char buf[JZON_ARRAY_KEY_SIZE];
+	size_t n = 0, i;
+
+	do {
+		buf[n++] = (char)('0' + idx % 10);
+		idx /= 10;
+	} while (idx);
+
+	for (i = 0; i < n; i++)
+		key[i] = buf[n - 1 - i];
+	key[n] = '\0';
+}
@@ -23,7 +23,7 @@
 
 
 enum {
-	HASH_SIZE = 16
+	HASH_SIZE = 16,
 };
 
 
@@ -80,7 +80,10 @@ struct json_object *jzon_container_alloc(enum odict_type type)
 
 	jobj->entry.type = type;
 
-	err = odict_alloc(&jobj->entry.u.odict, HASH_SIZE);
+	if (type == ODICT_ARRAY)
+		err = jzon_array_alloc(&jobj->entry.u.odict);
+	else
+		err = odict_alloc(&jobj->entry.u.odict, HASH_SIZE);
 	if (err)
 		jobj = mem_deref(jobj);
 
@@ -271,7 +274,7 @@ void json_object_object_add(struct json_object *jobj, const char *key,
 /* return 0 for success, -1 for errors */
 int json_object_array_add(struct json_object *jobj, struct json_object *val)
 {
-	char key[16];
+	char key[JZON_ARRAY_KEY_SIZE];
 	int err;
 
 	if (!jobj)
@@ -282,9 +285,7 @@ int json_object_array_add(struct json_object *jobj, struct json_object *val)
 		return -1;
 	}
 
-	if (re_snprintf(key, sizeof(key), "%zu",
-			odict_count(jzon_odict(jobj), false)) < 0)
-		return -1;
+	jzon_array_key(key, jzon_array_count(jobj->entry.u.odict));
 
 	if (val) {
 		err = add_entry(jobj, key, val);
@@ -309,8 +310,6 @@ int json_object_array_add(struct json_object *jobj, struct json_object *val)
 
 int json_object_array_length(struct json_object *jobj)
 {
-	size_t n;
-
 	if (!jobj)
 		return 0;
 
@@ -319,16 +318,12 @@ int json_object_array_length(struct json_object *jobj)
 		return 0;
 	}
 
-	n = odict_count(jobj->entry.u.odict, false);
-
-	return (int)n;
+	return (int)jzon_array_count(jobj->entry.u.odict);
 }
 
 
 struct json_object *json_object_array_get_idx(struct json_object *obj, int idx)
 {
-	char key[16];
-
 	if (!obj || idx<0)
 		return NULL;
 
@@ -337,10 +332,8 @@ struct json_object *json_object_array_get_idx(struct json_object *obj, int idx)
 		return 0;
 	}
 
-	if (re_snprintf(key, sizeof(key), "%d", idx) < 0)
-		return NULL;
-
-	return (struct json_object *)odict_lookup(jzon_odict(obj), key);
+	return (struct json_object *)jzon_array_get(obj->entry.u.odict,
+						    (uint32_t)idx);
 }
 
 
@@ -393,6 +393,11 @@ int jzon_decode(struct json_object **jobjp, const char *buf, size_t len)
 	if (err)
 		goto out;
 
+	/* index the arrays of the decoded tree */
+	err = jzon_array_adopt(&jobj->entry.u.odict, type);
+	if (err)
+		goto out;
+
 	if (jobjp)
 		*jobjp = jobj;
 
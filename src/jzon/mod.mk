@@ -3,6 +3,8 @@
 #
 
 AVS_SRCS += \
+	jzon/array.c \
 	jzon/jsonc.c \
 	jzon/jzon.c \
-	jzon/pretty.c
+	jzon/pretty.c \
+	jzon/pull.c
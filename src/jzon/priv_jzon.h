@@ -45,3 +45,16 @@ int             json_object_is_type(struct json_object *obj,
 				    enum odict_type type);
 
 
+
+
+/* Arrays -- odicts with an index of their entries */
+enum {
+	JZON_ARRAY_KEY_SIZE = 12,  /* UINT32_MAX in decimal, plus NUL */
+};
+
+int       jzon_array_alloc(struct odict **op);
+int       jzon_array_adopt(struct odict **op, enum odict_type type);
+uint32_t  jzon_array_count(const struct odict *o);
+const struct odict_entry *jzon_array_get(const struct odict *o,
+					 uint32_t idx);
+void      jzon_array_key(char key[JZON_ARRAY_KEY_SIZE], uint32_t idx);
@@ -0,0 +1,751 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * JSON pull parser
+ *
+ * Walks a JSON buffer token by token without building an intermediate
+ * tree. Strings and numbers are returned as spans into the source
+ * buffer, and are only copied when the caller asks for it.
+ */
+
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_jzon.h"
+#include "priv_jzon.h"
+
+
+enum {
+	PULL_MAX_DEPTH = 8,
+	ODICT_HASH_SIZE = 16,
+};
+
+
+static inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+
+static inline int hex_val(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+
+static uint32_t hex4(const char *p)
+{
+	return (uint32_t)(hex_val(p[0]) << 12 | hex_val(p[1]) << 8 |
+			  hex_val(p[2]) << 4  | hex_val(p[3]));
+}
+
+
+static size_t utf8_put(char *b, uint32_t cp)
+{
+	if (cp < 0x80) {
+		b[0] = (char)cp;
+		return 1;
+	}
+	else if (cp < 0x800) {
+		b[0] = (char)(0xc0 | (cp >> 6));
+		b[1] = (char)(0x80 | (cp & 0x3f));
+		return 2;
+	}
+	else if (cp < 0x10000) {
+		b[0] = (char)(0xe0 | (cp >> 12));
+		b[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		b[2] = (char)(0x80 | (cp & 0x3f));
+		return 3;
+	}
+	else {
+		b[0] = (char)(0xf0 | (cp >> 18));
+		b[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+		b[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		b[3] = (char)(0x80 | (cp & 0x3f));
+		return 4;
+	}
+}
+
+
+static inline void skip_ws(struct jzon_pull *jp)
+{
+	while (jp->p < jp->end) {
+
+		switch (*jp->p) {
+
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+			++jp->p;
+			break;
+
+		default:
+			return;
+		}
+	}
+}
+
+
+static inline int peek(struct jzon_pull *jp)
+{
+	skip_ws(jp);
+
+	return jp->p < jp->end ? (unsigned char)*jp->p : -1;
+}
+
+
+static int read_literal(struct jzon_pull *jp, const char *lit)
+{
+	const size_t n = strlen(lit);
+
+	if ((size_t)(jp->end - jp->p) < n || memcmp(jp->p, lit, n))
+		return EBADMSG;
+
+	jp->p += n;
+
+	return 0;
+}
+
+
+static int read_string(struct jzon_pull *jp, struct pl *pl, bool *esc)
+{
+	const char *start;
+	int i;
+
+	if (peek(jp) != '"')
+		return EBADMSG;
+
+	start = ++jp->p;
+	*esc = false;
+
+	while (jp->p < jp->end) {
+		const unsigned char c = *jp->p;
+
+		if (c == '"') {
+			pl->p = start;
+			pl->l = jp->p - start;
+			++jp->p;
+			return 0;
+		}
+		else if (c == '\\') {
+			*esc = true;
+			if (++jp->p >= jp->end)
+				return EBADMSG;
+
+			switch (*jp->p) {
+
+			case '"':
+			case '\\':
+			case '/':
+			case 'b':
+			case 'f':
+			case 'n':
+			case 'r':
+			case 't':
+				++jp->p;
+				break;
+
+			case 'u':
+				if (jp->end - jp->p < 5)
+					return EBADMSG;
+				for (i = 1; i <= 4; i++) {
+					if (hex_val(jp->p[i]) < 0)
+						return EBADMSG;
+				}
+				jp->p += 5;
+				break;
+
+			default:
+				return EBADMSG;
+			}
+		}
+		else if (c < 0x20) {
+			return EBADMSG;
+		}
+		else {
+			++jp->p;
+		}
+	}
+
+	return EBADMSG;
+}
+
+
+static int read_number(struct jzon_pull *jp, struct jzon_value *val)
+{
+	const char *start = jp->p;
+	bool dbl = false;
+
+	if (jp->p < jp->end && *jp->p == '-')
+		++jp->p;
+
+	if (jp->p >= jp->end || !is_digit(*jp->p))
+		return EBADMSG;
+
+	while (jp->p < jp->end) {
+		const char c = *jp->p;
+
+		if (is_digit(c))
+			;
+		else if (c == '.' || c == 'e' || c == 'E' ||
+			 c == '+' || c == '-')
+			dbl = true;
+		else
+			break;
+
+		++jp->p;
+	}
+
+	val->type = dbl ? ODICT_DOUBLE : ODICT_INT;
+	val->pl.p = start;
+	val->pl.l = jp->p - start;
+
+	return 0;
+}
+
+
+void jzon_pull_init(struct jzon_pull *jp, const char *buf, size_t len)
+{
+	if (!jp)
+		return;
+
+	jp->p = buf;
+	jp->end = buf ? buf + len : buf;
+	jp->depth = 0;
+}
+
+
+/*
+ * Read the next value. Scalars are consumed, for objects and arrays
+ * only the type is returned and the pull position is left at the
+ * opening token, to be entered with jzon_pull_object_begin() or
+ * jzon_pull_array_begin(), or skipped with jzon_pull_skip().
+ */
+int jzon_pull_value(struct jzon_pull *jp, struct jzon_value *val)
+{
+	int c;
+
+	if (!jp || !val)
+		return EINVAL;
+
+	val->pl = pl_null;
+	val->esc = false;
+	val->b = false;
+
+	c = peek(jp);
+	switch (c) {
+
+	case '"':
+		val->type = ODICT_STRING;
+		return read_string(jp, &val->pl, &val->esc);
+
+	case '{':
+		val->type = ODICT_OBJECT;
+		return 0;
+
+	case '[':
+		val->type = ODICT_ARRAY;
+		return 0;
+
+	case 't':
+		val->type = ODICT_BOOL;
+		val->b = true;
+		return read_literal(jp, "true");
+
+	case 'f':
+		val->type = ODICT_BOOL;
+		return read_literal(jp, "false");
+
+	case 'n':
+		val->type = ODICT_NULL;
+		return read_literal(jp, "null");
+
+	default:
+		if (c == '-' || (c >= '0' && c <= '9'))
+			return read_number(jp, val);
+
+		return EBADMSG;
+	}
+}
+
+
+int jzon_pull_skip(struct jzon_pull *jp)
+{
+	struct jzon_value val;
+	struct pl key;
+	bool first = true;
+	int err;
+
+	err = jzon_pull_value(jp, &val);
+	if (err)
+		return err;
+
+	switch (val.type) {
+
+	case ODICT_OBJECT:
+		err = jzon_pull_object_begin(jp);
+		while (!err) {
+			err = jzon_pull_object_next(jp, &key, &first);
+			if (!err)
+				err = jzon_pull_skip(jp);
+		}
+		break;
+
+	case ODICT_ARRAY:
+		err = jzon_pull_array_begin(jp);
+		while (!err) {
+			err = jzon_pull_array_next(jp, &first);
+			if (!err)
+				err = jzon_pull_skip(jp);
+		}
+		break;
+
+	default:
+		return 0;
+	}
+
+	return err == ENOENT ? 0 : err;
+}
+
+
+int jzon_pull_object_begin(struct jzon_pull *jp)
+{
+	if (!jp)
+		return EINVAL;
+
+	if (peek(jp) != '{')
+		return EPROTO;
+
+	if (jp->depth >= PULL_MAX_DEPTH)
+		return EOVERFLOW;
+
+	++jp->depth;
+	++jp->p;
+
+	return 0;
+}
+
+
+/*
+ * Advance to the next member of the current object. On success the
+ * key is returned and the pull position is at the value. Returns
+ * ENOENT when the closing brace has been consumed.
+ */
+int jzon_pull_object_next(struct jzon_pull *jp, struct pl *key, bool *first)
+{
+	bool esc;
+	int c, err;
+
+	if (!jp || !key || !first)
+		return EINVAL;
+
+	c = peek(jp);
+	if (c == '}') {
+		++jp->p;
+		--jp->depth;
+		return ENOENT;
+	}
+
+	if (!*first) {
+		if (c != ',')
+			return EBADMSG;
+		++jp->p;
+	}
+	*first = false;
+
+	err = read_string(jp, key, &esc);
+	if (err)
+		return err;
+
+	if (peek(jp) != ':')
+		return EBADMSG;
+	++jp->p;
+
+	return 0;
+}
+
+
+int jzon_pull_array_begin(struct jzon_pull *jp)
+{
+	if (!jp)
+		return EINVAL;
+
+	if (peek(jp) != '[')
+		return EPROTO;
+
+	if (jp->depth >= PULL_MAX_DEPTH)
+		return EOVERFLOW;
+
+	++jp->depth;
+	++jp->p;
+
+	return 0;
+}
+
+
+/*
+ * Advance to the next element of the current array. Returns ENOENT
+ * when the closing bracket has been consumed.
+ */
+int jzon_pull_array_next(struct jzon_pull *jp, bool *first)
+{
+	int c;
+
+	if (!jp || !first)
+		return EINVAL;
+
+	c = peek(jp);
+	if (c == ']') {
+		++jp->p;
+		--jp->depth;
+		return ENOENT;
+	}
+
+	if (!*first) {
+		if (c != ',')
+			return EBADMSG;
+		++jp->p;
+	}
+	*first = false;
+
+	return 0;
+}
+
+
+/* Verify that only whitespace (or NUL padding) is left in the buffer */
+int jzon_pull_end(struct jzon_pull *jp)
+{
+	if (!jp)
+		return EINVAL;
+
+	skip_ws(jp);
+	while (jp->p < jp->end && *jp->p == '\0')
+		++jp->p;
+
+	return jp->p == jp->end ? 0 : EBADMSG;
+}
+
+
+/*
+ * Copy a string value into a fixed-size buffer, unescaping it on the
+ * way. The result is truncated like str_ncpy(). Returns the number of
+ * bytes written, excluding the terminating NUL.
+ */
+size_t jzon_value_strcpy(char *dst, size_t sz, const struct jzon_value *val)
+{
+	const char *p, *end;
+	size_t n = 0;
+
+	if (!dst || !sz || !val)
+		return 0;
+
+	p = val->pl.p;
+	end = p + val->pl.l;
+
+	if (!val->esc) {
+		n = min(val->pl.l, sz - 1);
+		if (n)
+			memcpy(dst, p, n);
+		dst[n] = '\0';
+		return n;
+	}
+
+	while (p < end && n < sz - 1) {
+		char u[4];
+		uint32_t cp;
+		size_t ul;
+
+		if (*p != '\\') {
+			dst[n++] = *p++;
+			continue;
+		}
+
+		++p;
+		switch (*p++) {
+
+		case 'b': dst[n++] = '\b'; break;
+		case 'f': dst[n++] = '\f'; break;
+		case 'n': dst[n++] = '\n'; break;
+		case 'r': dst[n++] = '\r'; break;
+		case 't': dst[n++] = '\t'; break;
+
+		case 'u':
+			cp = hex4(p);
+			p += 4;
+
+			/* combine UTF-16 surrogate pairs */
+			if (cp >= 0xd800 && cp < 0xdc00 && end - p >= 6 &&
+			    p[0] == '\\' && p[1] == 'u') {
+				const uint32_t lo = hex4(p + 2);
+
+				if (lo >= 0xdc00 && lo < 0xe000) {
+					cp = 0x10000 + ((cp - 0xd800) << 10)
+						+ (lo - 0xdc00);
+					p += 6;
+				}
+			}
+
+			ul = utf8_put(u, cp);
+			if (n + ul > sz - 1)
+				goto out;
+			memcpy(&dst[n], u, ul);
+			n += ul;
+			break;
+
+		default:
+			/* '"', '\\' and '/' */
+			dst[n++] = p[-1];
+			break;
+		}
+	}
+
+ out:
+	dst[n] = '\0';
+
+	return n;
+}
+
+
+int jzon_value_strdup(char **dstp, const struct jzon_value *val)
+{
+	char *str;
+
+	if (!dstp || !val || val->type != ODICT_STRING)
+		return EINVAL;
+
+	/* an unescaped string is never longer than its source */
+	str = mem_alloc(val->pl.l + 1, NULL);
+	if (!str)
+		return ENOMEM;
+
+	jzon_value_strcpy(str, val->pl.l + 1, val);
+
+	*dstp = str;
+
+	return 0;
+}
+
+
+int64_t jzon_value_i64(const struct jzon_value *val)
+{
+	const char *p, *end;
+	uint64_t v = 0;
+	bool neg = false;
+
+	if (!val || val->type != ODICT_INT)
+		return 0;
+
+	p = val->pl.p;
+	end = p + val->pl.l;
+
+	if (p < end && *p == '-') {
+		neg = true;
+		++p;
+	}
+
+	while (p < end)
+		v = v * 10 + (uint64_t)(*p++ - '0');
+
+	return neg ? -(int64_t)v : (int64_t)v;
+}
+
+
+double jzon_value_double(const struct jzon_value *val)
+{
+	if (!val)
+		return .0;
+
+	switch (val->type) {
+
+	case ODICT_INT:
+		return (double)jzon_value_i64(val);
+
+	case ODICT_DOUBLE:
+		return pl_float(&val->pl);
+
+	default:
+		return .0;
+	}
+}
+
+
+static int odict_decode(struct odict *o, struct jzon_pull *jp,
+			enum odict_type type);
+
+
+static int entry_decode(struct odict *o, const char *key,
+			struct jzon_pull *jp)
+{
+	struct jzon_value val;
+	struct odict *oo;
+	char *str;
+	int err;
+
+	err = jzon_pull_value(jp, &val);
+	if (err)
+		return err;
+
+	switch (val.type) {
+
+	case ODICT_OBJECT:
+	case ODICT_ARRAY:
+		if (val.type == ODICT_ARRAY)
+			err = jzon_array_alloc(&oo);
+		else
+			err = odict_alloc(&oo, ODICT_HASH_SIZE);
+		if (err)
+			return err;
+
+		err = odict_decode(oo, jp, val.type);
+		if (!err)
+			err = odict_entry_add(o, key, val.type, oo);
+		mem_deref(oo);
+		break;
+
+	case ODICT_STRING:
+		err = jzon_value_strdup(&str, &val);
+		if (err)
+			return err;
+
+		err = odict_entry_add(o, key, ODICT_STRING, str);
+		mem_deref(str);
+		break;
+
+	case ODICT_INT:
+		err = odict_entry_add(o, key, ODICT_INT,
+				      jzon_value_i64(&val));
+		break;
+
+	case ODICT_DOUBLE:
+		err = odict_entry_add(o, key, ODICT_DOUBLE,
+				      jzon_value_double(&val));
+		break;
+
+	case ODICT_BOOL:
+		err = odict_entry_add(o, key, ODICT_BOOL, (int)val.b);
+		break;
+
+	case ODICT_NULL:
+		err = odict_entry_add(o, key, ODICT_NULL);
+		break;
+
+	default:
+		err = EPROTO;
+		break;
+	}
+
+	return err;
+}
+
+
+static int odict_decode(struct odict *o, struct jzon_pull *jp,
+			enum odict_type type)
+{
+	bool first = true;
+	unsigned idx = 0;
+	int err;
+
+	if (type == ODICT_OBJECT) {
+		struct pl pkey;
+		struct jzon_value vkey;
+
+		err = jzon_pull_object_begin(jp);
+		while (!err) {
+			char *key;
+
+			err = jzon_pull_object_next(jp, &pkey, &first);
+			if (err)
+				break;
+
+			vkey.type = ODICT_STRING;
+			vkey.pl = pkey;
+			vkey.esc = pl_strchr(&pkey, '\\') != NULL;
+
+			err = jzon_value_strdup(&key, &vkey);
+			if (err)
+				break;
+
+			err = entry_decode(o, key, jp);
+			mem_deref(key);
+		}
+	}
+	else {
+		char key[16];
+
+		err = jzon_pull_array_begin(jp);
+		while (!err) {
+			err = jzon_pull_array_next(jp, &first);
+			if (err)
+				break;
+
+			if (re_snprintf(key, sizeof(key), "%u", idx++) < 0)
+				return ENOMEM;
+
+			err = entry_decode(o, key, jp);
+		}
+	}
+
+	return err == ENOENT ? 0 : err;
+}
+
+
+/*
+ * Decode the object or array at the current pull position into a new
+ * odict. Used for opaque sub-trees (e.g. properties) that are kept as
+ * a dictionary by the caller.
+ */
+int jzon_pull_odict(struct odict **op, struct jzon_pull *jp)
+{
+	struct jzon_value val;
+	struct odict *o;
+	int err;
+
+	if (!op || !jp)
+		return EINVAL;
+
+	err = jzon_pull_value(jp, &val);
+	if (err)
+		return err;
+
+	if (val.type != ODICT_OBJECT && val.type != ODICT_ARRAY)
+		return EPROTO;
+
+	if (val.type == ODICT_ARRAY)
+		err = jzon_array_alloc(&o);
+	else
+		err = odict_alloc(&o, ODICT_HASH_SIZE);
+	if (err)
+		return err;
+
+	err = odict_decode(o, jp, val.type);
+	if (err)
+		mem_deref(o);
+	else
+		*op = o;
+
+	return err;
+}
@@ -75,11 +75,13 @@ typedef enum {
 	MM_MARSHAL_DEREGISTER_MEDIA,
 	MM_MARSHAL_SET_INTENSITY,
 	MM_MARSHAL_SET_USER_START_AUDIO,
+	MM_MARSHAL_SET_AUDIO_PREWARM,
 	MM_MARSHAL_ENTER_CALL,
 	MM_MARSHAL_EXIT_CALL,
 	MM_MARSHAL_AUDIO_ALLOC,
 	MM_MARSHAL_AUDIO_RELEASE,
 	MM_MARSHAL_AUDIO_RESET,
+	MM_MARSHAL_AUDIO_PREWARM,
 	MM_MARSHAL_SYS_INCOMING,
 	MM_MARSHAL_SYS_ENTERED_CALL,
 	MM_MARSHAL_SYS_LEFT_CALL,
@@ -149,6 +151,13 @@ struct mm {
 	bool user_starts_audio;
     
 	struct audio_io *aio;
+
+	/* audio device opened while ringing, see audio_prewarm() */
+	struct {
+		bool enabled;
+		struct tmr tmr;
+		struct mediamgr_prewarm pw;
+	} prewarm;
     
 	struct list mml;
 };
@@ -174,6 +183,8 @@ static void *mediamgr_thread(void *arg);
 static void enter_call(struct mm *mm);
 static void exit_call(struct mm *mm);
 static void enable_speaker(struct mm *mm, bool enable);
+static void audio_release(struct mm *mm);
+static void prewarm_handover(struct mm *mm, bool warm);
 
 
 
@@ -625,6 +636,7 @@ static int mm_alloc(struct mm **mmp)
 
 	mm->intensity_thres = MM_INTENSITY_THRES_ALL;
 	mm->user_starts_audio = false;
+	tmr_init(&mm->prewarm.tmr);
     
  out:
 	if (err) {
@@ -1244,6 +1256,45 @@ void mediamgr_set_user_starts_audio(struct mediamgr *mediamgr, bool enable)
 	}
 }
 
+/*
+ * Open the audio device as soon as a call rings, instead of when it
+ * is answered. Costs an open device for calls that are not answered.
+ */
+void mediamgr_set_audio_prewarm(struct mediamgr *mediamgr, bool enable)
+{
+	struct mm_message *elem;
+	struct mm *mm;
+
+	if (!mediamgr)
+		return;
+
+	mm = mediamgr->mm;
+
+	elem = mem_zalloc(sizeof(struct mm_message), NULL);
+	if (!elem) {
+		error("mediamgr_set_audio_prewarm failed \n");
+		return;
+	}
+	elem->bool_elem.val = enable;
+	if (mqueue_push(mm->mq, MM_MARSHAL_SET_AUDIO_PREWARM, elem) != 0) {
+		error("mediamgr_set_audio_prewarm failed \n");
+	}
+}
+
+
+int mediamgr_get_audio_stats(const struct mediamgr *mediamgr,
+			     struct mediamgr_audio_stats *stats)
+{
+	if (!mediamgr || !mediamgr->mm || !stats)
+		return EINVAL;
+
+	/* written by the mediamgr thread, good enough for reporting */
+	*stats = mediamgr->mm->prewarm.pw.stats;
+
+	return 0;
+}
+
+
 enum mediamgr_auplay mediamgr_get_route(const struct mediamgr *mediamgr)
 {
 	return mm_platform_get_route();
@@ -1415,6 +1466,7 @@ static void audio_alloc(struct mm *mm)
 #endif
 	if (mm->aio) {
 		info("mediamgr: audio already allocated, firing callback\n");
+		prewarm_handover(mm, true);
 		fire_callback(mm);		
 		return;
 	}
@@ -1434,6 +1486,8 @@ static void audio_alloc(struct mm *mm)
 	voe_register_adm(mm->aio);
 #endif	
 
+	prewarm_handover(mm, false);
+
 	info("mediamgr: audio_alloc: fire_callback\n");	
 	fire_callback(mm);
 
@@ -1442,9 +1496,90 @@ static void audio_alloc(struct mm *mm)
 }
 
 
+static void prewarm_timeout_handler(void *arg)
+{
+	struct mm *mm = arg;
+
+	if (!mediamgr_prewarm_expired(&mm->prewarm.pw, tmr_jiffies()))
+		return;
+
+	info("mediamgr: prewarm: not answered within %d seconds,"
+	     " releasing audio\n", MEDIAMGR_PREWARM_TIMEOUT / 1000);
+
+	audio_release(mm);
+}
+
+
+/*
+ * Open the audio device while the call is ringing, so that answering
+ * does not wait for the device to initialize. The ADM is registered,
+ * but silent until the call starts its audio streams.
+ */
+static void audio_prewarm(struct mm *mm)
+{
+	int err = 0;
+
+	if (!mm->prewarm.enabled || mm->aio)
+		return;
+
+	switch (mm->call_state) {
+	case MEDIAMGR_STATE_INCOMING_AUDIO_CALL:
+	case MEDIAMGR_STATE_INCOMING_VIDEO_CALL:
+	case MEDIAMGR_STATE_OUTGOING_AUDIO_CALL:
+	case MEDIAMGR_STATE_OUTGOING_VIDEO_CALL:
+		break;
+
+	default:
+		/* answered or gone already */
+		return;
+	}
+
+#if ENABLE_AUDIO_IO
+	info("mediamgr: prewarm: allocating audio\n");
+	err = audio_io_alloc(&mm->aio, AUDIO_IO_MODE_NORMAL);
+#else
+	/* no device to warm up */
+	return;
+#endif
+	if (err) {
+		/* the call will try again when it is answered */
+		warning("mediamgr: prewarm: failed to alloc audio (%m)\n",
+			err);
+		mm->aio = NULL;
+		return;
+	}
+#if USE_AVSLIB
+	voe_register_adm(mm->aio);
+#endif
+
+	mediamgr_prewarm_opened(&mm->prewarm.pw, tmr_jiffies());
+	tmr_start(&mm->prewarm.tmr, MEDIAMGR_PREWARM_TIMEOUT,
+		  prewarm_timeout_handler, mm);
+}
+
+
+/* The call got its audio device, warm or cold */
+static void prewarm_handover(struct mm *mm, bool warm)
+{
+	const bool was_warm = warm && mm->prewarm.pw.warm;
+	int64_t ms;
+
+	ms = mediamgr_prewarm_handover(&mm->prewarm.pw, warm, tmr_jiffies());
+	if (ms >= 0) {
+		info("mediamgr: audio ready %lld ms after answer (%s)\n",
+		     ms, was_warm ? "pre-warmed" : "cold");
+	}
+
+	tmr_cancel(&mm->prewarm.tmr);
+}
+
+
 static void audio_release(struct mm *mm)
 {
 	info("mediamgr: audio_release: aio=%p\n", mm->aio);
+
+	mediamgr_prewarm_release(&mm->prewarm.pw);
+	tmr_cancel(&mm->prewarm.tmr);
 	
 	if (mm->aio) {
 #if USE_AVSLIB
@@ -1532,6 +1667,30 @@ static void call_state_handler(struct mm *mm, enum mediamgr_state new_state)
 		return;
 	}
 
+	switch (new_state) {
+	case MEDIAMGR_STATE_INCOMING_AUDIO_CALL:
+	case MEDIAMGR_STATE_INCOMING_VIDEO_CALL:
+	case MEDIAMGR_STATE_OUTGOING_AUDIO_CALL:
+	case MEDIAMGR_STATE_OUTGOING_VIDEO_CALL:
+		/* after the ringtone is started below */
+		if (mm->prewarm.enabled && !mm->aio)
+			mediamgr_post_media_cmd(mm, MM_MARSHAL_AUDIO_PREWARM,
+						NULL);
+		break;
+
+	case MEDIAMGR_STATE_INCALL:
+	case MEDIAMGR_STATE_INVIDEOCALL:
+		if (old_state != MEDIAMGR_STATE_INCALL &&
+		    old_state != MEDIAMGR_STATE_INVIDEOCALL &&
+		    old_state != MEDIAMGR_STATE_HOLD)
+			mediamgr_prewarm_answered(&mm->prewarm.pw,
+						  tmr_jiffies());
+		break;
+
+	default:
+		break;
+	}
+
 	switch (new_state) {
 	case MEDIAMGR_STATE_NORMAL:
 		set_state(mm, new_state);
@@ -1708,6 +1867,7 @@ static void mqueue_handler(int id, void *data, void *arg)
 	switch ((mm_marshal_id)id) {
             
 	case MM_MARSHAL_EXIT:
+		tmr_cancel(&mm->prewarm.tmr);
 		re_cancel();
 		break;
 
@@ -1798,6 +1958,11 @@ static void mqueue_handler(int id, void *data, void *arg)
 	}
 	break;
 
+	case MM_MARSHAL_SET_AUDIO_PREWARM: {
+		mm->prewarm.enabled = msg->bool_elem.val;
+	}
+	break;
+
 	case MM_MARSHAL_ENTER_CALL:
 		enter_call(mm);
 		break;		
@@ -1813,6 +1978,10 @@ static void mqueue_handler(int id, void *data, void *arg)
 	case MM_MARSHAL_AUDIO_RESET:
 		audio_reset(mm);
 		break;
+
+	case MM_MARSHAL_AUDIO_PREWARM:
+		audio_prewarm(mm);
+		break;
 		
 	case MM_MARSHAL_EXIT_CALL:
 		exit_call(mm);
@@ -4,6 +4,7 @@
 
 AVS_SRCS += \
 	mediamgr/mediamgr.c \
+	mediamgr/prewarm.c \
 	mediamgr/sound.c
 
 
@@ -0,0 +1,100 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+
+
+/* The device was opened while the call rings */
+void mediamgr_prewarm_opened(struct mediamgr_prewarm *pw, uint64_t now)
+{
+	if (!pw)
+		return;
+
+	pw->warm = true;
+	pw->ts_warm = now;
+}
+
+
+void mediamgr_prewarm_answered(struct mediamgr_prewarm *pw, uint64_t now)
+{
+	if (!pw)
+		return;
+
+	pw->ts_answer = now;
+}
+
+
+/*
+ * The call got its audio device, pre-warmed or opened just now.
+ * Returns the [ms] from answer to audio ready, -1 if not answered.
+ */
+int64_t mediamgr_prewarm_handover(struct mediamgr_prewarm *pw, bool warm,
+				  uint64_t now)
+{
+	struct mediamgr_audio_stats *st;
+	int64_t ms = -1;
+
+	if (!pw)
+		return -1;
+
+	st = &pw->stats;
+
+	if (pw->ts_answer) {
+		ms = now > pw->ts_answer ? (int64_t)(now - pw->ts_answer) : 0;
+
+		/* an open device that was not pre-warmed counts as cold */
+		if (warm && pw->warm) {
+			++st->warm;
+			st->warm_ready_ms = (uint32_t)ms;
+		}
+		else if (!warm) {
+			++st->cold;
+			st->cold_ready_ms = (uint32_t)ms;
+		}
+	}
+
+	pw->warm = false;
+	pw->ts_answer = 0;
+
+	return ms;
+}
+
+
+/* A pre-warmed device that was not used in time */
+bool mediamgr_prewarm_expired(const struct mediamgr_prewarm *pw,
+			      uint64_t now)
+{
+	if (!pw || !pw->warm)
+		return false;
+
+	return now - pw->ts_warm >= MEDIAMGR_PREWARM_TIMEOUT;
+}
+
+
+void mediamgr_prewarm_release(struct mediamgr_prewarm *pw)
+{
+	if (!pw)
+		return;
+
+	if (pw->warm)
+		++pw->stats.unused;
+
+	pw->warm = false;
+	pw->ts_answer = 0;
+}
@@ -0,0 +1,388 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_jzon.h"
+#include "avs_wcall.h"
+#include "avs_membdelta.h"
+
+
+enum {
+	HASH_SIZE = 64,
+};
+
+
+struct membdelta {
+	struct hash *ht;
+	struct list membl;
+
+	uint32_t snapshot_interval;
+	uint32_t since_snapshot;
+	bool resync;
+
+	uint32_t seq;
+	uint32_t gen;
+
+	struct {
+		bool full;
+		uint32_t joined;
+		uint32_t changed;
+		uint32_t left;
+	} last;
+};
+
+struct memb {
+	struct le le;      /* member of membl */
+	struct le he;      /* member of ht    */
+	char *userid;
+	char *clientid;
+
+	int audio_state;
+	int video_recv;
+	int muted;
+	uint32_t gen;
+};
+
+struct memb_key {
+	const char *userid;
+	const char *clientid;
+};
+
+
+static void destructor(void *arg)
+{
+	struct membdelta *md = arg;
+
+	hash_flush(md->ht);
+	mem_deref(md->ht);
+}
+
+
+static void memb_destructor(void *arg)
+{
+	struct memb *m = arg;
+
+	list_unlink(&m->le);
+	hash_unlink(&m->he);
+	mem_deref(m->userid);
+	mem_deref(m->clientid);
+}
+
+
+static uint32_t memb_hash(const char *userid, const char *clientid)
+{
+	return hash_fast_str(userid) * 33 ^ hash_fast_str(clientid);
+}
+
+
+static bool memb_cmp_handler(struct le *le, void *arg)
+{
+	const struct memb *m = le->data;
+	const struct memb_key *key = arg;
+
+	return streq(m->userid, key->userid)
+		&& streq(m->clientid, key->clientid);
+}
+
+
+static struct memb *memb_find(const struct membdelta *md,
+			      const char *userid, const char *clientid)
+{
+	struct memb_key key = {userid, clientid};
+
+	return list_ledata(hash_lookup(md->ht, memb_hash(userid, clientid),
+				       memb_cmp_handler, &key));
+}
+
+
+static struct memb *memb_add(struct membdelta *md,
+			     const struct wcall_member *wm)
+{
+	struct memb *m;
+	int err;
+
+	m = mem_zalloc(sizeof(*m), memb_destructor);
+	if (!m)
+		return NULL;
+
+	err  = str_dup(&m->userid, wm->userid);
+	err |= str_dup(&m->clientid, wm->clientid);
+	if (err)
+		return mem_deref(m);
+
+	list_append(&md->membl, &m->le, m);
+	hash_append(md->ht, memb_hash(m->userid, m->clientid), &m->he, m);
+
+	return m;
+}
+
+
+int membdelta_alloc(struct membdelta **mdp, uint32_t snapshot_interval)
+{
+	struct membdelta *md;
+	int err;
+
+	if (!mdp)
+		return EINVAL;
+
+	md = mem_zalloc(sizeof(*md), destructor);
+	if (!md)
+		return ENOMEM;
+
+	err = hash_alloc(&md->ht, HASH_SIZE);
+	if (err) {
+		mem_deref(md);
+		return err;
+	}
+
+	list_init(&md->membl);
+	md->snapshot_interval = snapshot_interval;
+	md->resync = true;
+
+	*mdp = md;
+
+	return 0;
+}
+
+
+/* Make the next notification a full roster */
+void membdelta_resync(struct membdelta *md)
+{
+	if (!md)
+		return;
+
+	md->resync = true;
+}
+
+
+uint32_t membdelta_seq(const struct membdelta *md)
+{
+	return md ? md->seq : 0;
+}
+
+
+static int add_member(struct json_object *jarr, const struct memb *m,
+		      bool state)
+{
+	struct json_object *jmemb;
+	int err;
+
+	jmemb = jzon_alloc_object();
+	if (!jmemb)
+		return ENOMEM;
+
+	err  = jzon_add_str(jmemb, "userid", "%s", m->userid);
+	err |= jzon_add_str(jmemb, "clientid", "%s", m->clientid);
+	if (state) {
+		err |= jzon_add_int(jmemb, "aestab", m->audio_state);
+		err |= jzon_add_int(jmemb, "vrecv", m->video_recv);
+		err |= jzon_add_int(jmemb, "muted", m->muted);
+	}
+
+	if (err) {
+		mem_deref(jmemb);
+		return err;
+	}
+
+	if (json_object_array_add(jarr, jmemb)) {
+		mem_deref(jmemb);
+		return ENOMEM;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Update the tracked roster from members, and encode a notification
+ * into jsonp. Returns ENOENT if nothing changed and no full roster
+ * is due, in which case nothing needs to be sent.
+ */
+int membdelta_update(struct membdelta *md, const char *convid,
+		     const struct wcall_members *members, char **jsonp)
+{
+	struct json_object *jobj = NULL, *jjoined = NULL;
+	struct json_object *jchanged = NULL, *jleft = NULL;
+	struct le *le;
+	bool full;
+	size_t i;
+	int err = 0;
+
+	if (!md || !members || !jsonp)
+		return EINVAL;
+
+	full = md->resync || (md->snapshot_interval
+			      && md->since_snapshot >= md->snapshot_interval);
+
+	md->last.full = full;
+	md->last.joined = md->last.changed = md->last.left = 0;
+	++md->gen;
+
+	jjoined  = json_object_new_array();
+	jchanged = json_object_new_array();
+	jleft    = json_object_new_array();
+	if (!jjoined || !jchanged || !jleft) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < members->membc; i++) {
+		const struct wcall_member *wm = &members->membv[i];
+		struct json_object *jarr = NULL;
+		struct memb *m;
+
+		if (!wm->userid || !wm->clientid)
+			continue;
+
+		m = memb_find(md, wm->userid, wm->clientid);
+		if (!m) {
+			m = memb_add(md, wm);
+			if (!m) {
+				err = ENOMEM;
+				goto out;
+			}
+			jarr = jjoined;
+			++md->last.joined;
+		}
+		else if (m->gen == md->gen) {
+			continue;  /* listed twice */
+		}
+		else if (m->audio_state != wm->audio_state
+			 || m->video_recv != wm->video_recv
+			 || m->muted != wm->muted) {
+			jarr = jchanged;
+			++md->last.changed;
+		}
+
+		m->audio_state = wm->audio_state;
+		m->video_recv = wm->video_recv;
+		m->muted = wm->muted;
+		m->gen = md->gen;
+
+		if (jarr && !full) {
+			err = add_member(jarr, m, true);
+			if (err)
+				goto out;
+		}
+	}
+
+	le = md->membl.head;
+	while (le) {
+		struct memb *m = le->data;
+
+		le = le->next;
+
+		if (m->gen == md->gen)
+			continue;
+
+		++md->last.left;
+		if (!full) {
+			err = add_member(jleft, m, false);
+			if (err)
+				goto out;
+		}
+		mem_deref(m);
+	}
+
+	if (!full && !md->last.joined && !md->last.changed && !md->last.left) {
+		err = ENOENT;
+		goto out;
+	}
+
+	jobj = jzon_alloc_object();
+	if (!jobj) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = jzon_add_str(jobj, "convid", "%s", convid);
+	err |= jzon_add_int(jobj, "seq", (int32_t)(md->seq + 1));
+	err |= jzon_add_str(jobj, "type", "%s", full ? "full" : "delta");
+	if (err)
+		goto out;
+
+	if (full) {
+		struct json_object *jmembs;
+
+		jmembs = json_object_new_array();
+		if (!jmembs) {
+			err = ENOMEM;
+			goto out;
+		}
+
+		LIST_FOREACH(&md->membl, le) {
+			const struct memb *m = le->data;
+
+			err = add_member(jmembs, m, true);
+			if (err)
+				break;
+		}
+		json_object_object_add(jobj, "members", jmembs);
+	}
+	else {
+		if (md->last.joined) {
+			json_object_object_add(jobj, "joined", jjoined);
+			jjoined = NULL;
+		}
+		if (md->last.changed) {
+			json_object_object_add(jobj, "changed", jchanged);
+			jchanged = NULL;
+		}
+		if (md->last.left) {
+			json_object_object_add(jobj, "left", jleft);
+			jleft = NULL;
+		}
+	}
+	if (err)
+		goto out;
+
+	err = jzon_encode(jsonp, jobj);
+	if (err)
+		goto out;
+
+	++md->seq;
+	md->resync = false;
+	md->since_snapshot = full ? 0 : md->since_snapshot + 1;
+
+ out:
+	/* the app and our state may disagree now */
+	if (err && err != ENOENT)
+		md->resync = true;
+
+	mem_deref(jleft);
+	mem_deref(jchanged);
+	mem_deref(jjoined);
+	mem_deref(jobj);
+
+	return err;
+}
+
+
+int membdelta_debug(struct re_printf *pf, const struct membdelta *md)
+{
+	if (!md)
+		return 0;
+
+	return re_hprintf(pf, "seq=%u %s members=%u"
+			  " joined=%u changed=%u left=%u",
+			  md->seq, md->last.full ? "full" : "delta",
+			  list_count(&md->membl),
+			  md->last.joined, md->last.changed, md->last.left);
+}
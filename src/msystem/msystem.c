@@ -44,6 +44,7 @@ struct msystem {
 	bool loopback;
 	bool privacy;
 	bool crypto_kase;
+	uint32_t decode_budget;
 	char ifname[256];
 
 	char version[256];
@@ -69,7 +70,9 @@ struct mute_elem {
 	struct le le;
 };
 
+/* g_msys and its fields are used from the app and the AVS threads */
 static struct msystem *g_msys = NULL;
+static pthread_mutex_t g_msys_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static int msys_env = 0;
 
@@ -85,34 +88,42 @@ int msystem_get_env(void)
 
 void msystem_set_version(const char *ver)
 {
-	if (!g_msys)
-		return;
-
-	str_ncpy(g_msys->version, ver, sizeof(g_msys->version));
+	pthread_mutex_lock(&g_msys_mutex);
+	if (g_msys)
+		str_ncpy(g_msys->version, ver, sizeof(g_msys->version));
+	pthread_mutex_unlock(&g_msys_mutex);
 }
 
 const char *msystem_get_version(void)
 {
-	if (!g_msys)
-		return NULL;
+	const char *ver = NULL;
+
+	pthread_mutex_lock(&g_msys_mutex);
+	if (g_msys && g_msys->version[0] != '\0')
+		ver = g_msys->version;
+	pthread_mutex_unlock(&g_msys_mutex);
 
-	return g_msys->version[0] == '\0' ? NULL : g_msys->version;
+	return ver;
 }
 
 void msystem_set_project(const char *proj)
 {
-	if (!g_msys)
-		return;
-
-	str_ncpy(g_msys->project, proj, sizeof(g_msys->project));
+	pthread_mutex_lock(&g_msys_mutex);
+	if (g_msys)
+		str_ncpy(g_msys->project, proj, sizeof(g_msys->project));
+	pthread_mutex_unlock(&g_msys_mutex);
 }
 
 const char *msystem_get_project(void)
 {
-	if (!g_msys)
-		return NULL;
+	const char *proj = NULL;
 
-	return g_msys->project[0] == '\0' ? NULL : g_msys->project;
+	pthread_mutex_lock(&g_msys_mutex);
+	if (g_msys && g_msys->project[0] != '\0')
+		proj = g_msys->project;
+	pthread_mutex_unlock(&g_msys_mutex);
+
+	return proj;
 }
 
 
@@ -121,6 +132,14 @@ static void msystem_destructor(void *data)
 {
 	struct msystem *msys = data;
 
+	/* only an initialized msystem was made the global one */
+	if (msys->inited) {
+		pthread_mutex_lock(&g_msys_mutex);
+		if (g_msys == msys)
+			g_msys = NULL;
+		pthread_mutex_unlock(&g_msys_mutex);
+	}
+
 	if (msys->name) {
 		if (streq(msys->name, "audummy")) {
 		}
@@ -139,9 +158,6 @@ static void msystem_destructor(void *data)
 	iflow_destroy();
 
 	msys->inited = false;
-
-	if (g_msys == msys)
-		g_msys = NULL;
 }
 
 
@@ -229,7 +245,13 @@ static void me_destructor(void *arg)
 
 struct msystem *msystem_instance(void)
 {
-	return g_msys;
+	struct msystem *msys;
+
+	pthread_mutex_lock(&g_msys_mutex);
+	msys = g_msys;
+	pthread_mutex_unlock(&g_msys_mutex);
+
+	return msys;
 }
 
 int msystem_get(struct msystem **msysp, const char *msysname,
@@ -241,24 +263,35 @@ int msystem_get(struct msystem **msysp, const char *msysname,
 	
 	if (!msysp)
 		return EINVAL;
-	
+
+	/* held across init, so that only one msystem is created */
+	pthread_mutex_lock(&g_msys_mutex);
+
 	if (g_msys)
 		*msysp = mem_ref(g_msys);
 	else {
 		err = msystem_init(msysp, msysname, config);
 		if (err)
-			return err;
+			goto out;
 	}
 
 	if (muteh) {
 		struct mute_elem *me;
 		
 		me = mem_zalloc(sizeof(*me), me_destructor);
+		if (!me) {
+			pthread_mutex_unlock(&g_msys_mutex);
+			*msysp = mem_deref(*msysp);
+			return ENOMEM;
+		}
 		me->muteh = muteh;
 		me->arg = arg;
 		list_append(&g_msys->mutel, &me->le, me);
 	}
-	
+
+ out:
+	pthread_mutex_unlock(&g_msys_mutex);
+
 	return err;
 }
 
@@ -266,7 +299,8 @@ void msystem_unregister_listener(void *arg)
 {
 	struct le *le;
 
-	LIST_FOREACH(&g_msys->mutel, le) {
+	pthread_mutex_lock(&g_msys_mutex);
+	LIST_FOREACH(g_msys ? &g_msys->mutel : NULL, le) {
 		struct mute_elem *me = le->data;
 
 		if (arg == me->arg) {
@@ -274,6 +308,7 @@ void msystem_unregister_listener(void *arg)
 			break;
 		}
 	}
+	pthread_mutex_unlock(&g_msys_mutex);
 }
 
 
@@ -342,6 +377,12 @@ bool msystem_get_privacy(struct msystem *msys)
 }
 
 
+uint32_t msystem_get_decode_budget(const struct msystem *msys)
+{
+	return msys ? msys->decode_budget : 0;
+}
+
+
 const char *msystem_get_interface(struct msystem *msys)
 {
 	return msys ? msys->ifname : NULL;
@@ -405,6 +446,16 @@ void msystem_enable_privacy(struct msystem *msys, bool enable)
 }
 
 
+/* Maximum number of audio streams to decode, 0 for no limit */
+void msystem_set_decode_budget(struct msystem *msys, uint32_t maxc)
+{
+	if (!msys)
+		return;
+
+	msys->decode_budget = maxc;
+}
+
+
 void msystem_enable_kase(struct msystem *msys, bool enable)
 {
 	if (!msys)
@@ -492,83 +543,111 @@ int msystem_update_conf_parts(struct list *partl)
 
 void msystem_set_auplay(const char *dev)
 {
-	if (!g_msys)
-		return;
+	(void)dev;
 }
 
 void msystem_stop_silencing(void)
 {
-	if (!g_msys)
-		return;
 }
 
-bool msystem_get_muted(void)
+static bool using_voe(void)
 {
-	bool muted = false;
+	bool voe;
 
-	if (!g_msys)
-		return false;
+	pthread_mutex_lock(&g_msys_mutex);
+	voe = g_msys && g_msys->using_voe;
+	pthread_mutex_unlock(&g_msys_mutex);
 
-	if (streq(g_msys->name, "voe")) {
-			muted = iflow_get_mute();
-	}
+	return voe;
+}
 
-	return muted;
+bool msystem_get_muted(void)
+{
+	if (!using_voe())
+		return false;
+
+	return iflow_get_mute();
 }
 
+/*
+ * The handlers are called without the lock held, as they may call
+ * back into msystem. A handler must not unregister another listener.
+ */
 static void call_muteh(bool muted)
 {
+	struct mute_elem **mev = NULL;
+	size_t mec = 0, i;
 	struct le *le;
 
-	LIST_FOREACH(&g_msys->mutel, le) {
-		struct mute_elem *me = le->data;
+	pthread_mutex_lock(&g_msys_mutex);
+	if (g_msys) {
+		mec = list_count(&g_msys->mutel);
+		mev = mem_zalloc(mec * sizeof(*mev), NULL);
+	}
+	if (mev) {
+		i = 0;
+		LIST_FOREACH(&g_msys->mutel, le)
+			mev[i++] = le->data;
+	}
+	pthread_mutex_unlock(&g_msys_mutex);
 
-		if (me->muteh)
-			me->muteh(muted, me->arg);
+	for (i = 0; mev && i < mec; i++) {
+		if (mev[i]->muteh)
+			mev[i]->muteh(muted, mev[i]->arg);
 	}
+
+	mem_deref(mev);
 }
 
 void msystem_set_muted(bool muted)
 {
-	bool mute_state = false;
+	bool mute_state;
 
-	info("msys(%p): set_muted: %d\n", g_msys, muted);
-	
-	if (g_msys) {
-		if (streq(g_msys->name, "voe")) {
-			mute_state = iflow_get_mute();
-			info("msys(%p): muted_state=%d->%d\n", g_msys, mute_state, muted);
-			if (muted != mute_state) {
-				iflow_set_mute(muted);
-				call_muteh(muted);
-			}
-		}
+	info("msys: set_muted: %d\n", muted);
+
+	if (!using_voe())
+		return;
+
+	mute_state = iflow_get_mute();
+	info("msys: muted_state=%d->%d\n", mute_state, muted);
+	if (muted != mute_state) {
+		iflow_set_mute(muted);
+		call_muteh(muted);
 	}
 }
 
 
 struct dnsc *msystem_dnsc(void)
 {
-	return g_msys ? g_msys->dnsc : NULL;
+	struct dnsc *dnsc;
+
+	pthread_mutex_lock(&g_msys_mutex);
+	dnsc = g_msys ? g_msys->dnsc : NULL;
+	pthread_mutex_unlock(&g_msys_mutex);
+
+	return dnsc;
 }
 
 
 bool msystem_audio_is_activated(void)
 {
-	if (!g_msys)
-		return false;
-	
-	return g_msys->audio_activated;
+	bool activated;
+
+	pthread_mutex_lock(&g_msys_mutex);
+	activated = g_msys && g_msys->audio_activated;
+	pthread_mutex_unlock(&g_msys_mutex);
+
+	return activated;
 }
 
 void msystem_audio_set_activated(bool activated)
 {
-	if (!g_msys) {
+	pthread_mutex_lock(&g_msys_mutex);
+	if (g_msys)
+		g_msys->audio_activated = activated;
+	else
 		warning("msystem: activate: no msystem available\n");
-		return;
-	}
-
-	g_msys->audio_activated = activated;
+	pthread_mutex_unlock(&g_msys_mutex);
 }
 
 static void proxy_destructor(void *arg)
@@ -591,15 +670,31 @@ int msystem_set_proxy(const char *host, int port)
 	
 	str_dup(&proxy->host, host);
 	proxy->port = port;
-	
-	mem_deref(g_msys->proxy);
-	g_msys->proxy = proxy;
+
+	pthread_mutex_lock(&g_msys_mutex);
+	if (g_msys) {
+		mem_deref(g_msys->proxy);
+		g_msys->proxy = proxy;
+		proxy = NULL;
+	}
+	pthread_mutex_unlock(&g_msys_mutex);
+
+	if (proxy) {
+		mem_deref(proxy);
+		return ENOSYS;
+	}
 
 	return 0;
 }
 
 struct msystem_proxy *msystem_get_proxy(void)
 {
-	return g_msys ? g_msys->proxy : NULL;
+	struct msystem_proxy *proxy;
+
+	pthread_mutex_lock(&g_msys_mutex);
+	proxy = g_msys ? g_msys->proxy : NULL;
+	pthread_mutex_unlock(&g_msys_mutex);
+
+	return proxy;
 }
 
@@ -27,9 +27,10 @@
 #include "netprobe.h"
 
 
-struct result {
-	bool ok;
-	uint32_t rtt_us;
+enum {
+	PROBE_SIZE       = 160,
+	TRAIN_GAP_MS     = 50,
+	COMPLETE_WAIT_MS = 1000,
 };
 
 
@@ -49,8 +50,19 @@ struct netprobe {
 	netprobe_h *h;
 	void *arg;
 
-	struct result *resultv;
-	size_t resultc;
+	struct mbuf *mb_tx;      /* preallocated for all sends */
+
+	struct netprobe_sample *sampv;
+	size_t sampc;            /* probe packets + train packets */
+	size_t probec;
+	size_t recvc;
+
+	struct {
+		uint32_t trainc;
+		uint32_t train_len;
+		uint32_t max_size;
+		uint32_t cur;
+	} bw;
 };
 
 
@@ -72,13 +84,31 @@ static uint64_t tmr_microseconds(void)
 }
 
 
+static void tmr_completed_handler(void *arg)
+{
+	struct netprobe_result result;
+	struct netprobe *np = arg;
+	int err;
+
+	err = netprobe_analyze(&result, np->sampv, np->sampc);
+	if (err) {
+		warning("netprobe: analyze failed (%m)\n", err);
+		np->h(err, NULL, np->arg);
+		return;
+	}
+
+	info("netprobe: %H\n", netprobe_result_debug, &result);
+
+	np->h(0, &result, np->arg);
+}
+
+
 static void receive_packet(struct netprobe *np,
 			   const struct sa *src, struct mbuf *mb)
 {
 	struct packet pkt;
 	uint64_t ts_now = tmr_microseconds();
-	uint32_t rtt;
-	struct result *result;
+	struct netprobe_sample *samp;
 	int err;
 
 	err = packet_decode(&pkt, mb);
@@ -92,17 +122,23 @@ static void receive_packet(struct netprobe *np,
 		return;
 	}
 
-	rtt = (uint32_t)(ts_now - pkt.timestamp_tx);
-
-	if (pkt.seq >= np->resultc) {
+	if (pkt.seq >= np->seq_ctr) {
 		warning("netprobe: seq %u out of range\n", pkt.seq);
 		return;
 	}
 
-	result = &np->resultv[pkt.seq];
+	samp = &np->sampv[pkt.seq];
+
+	if (samp->ts_rx) {
+		++samp->dup;
+		return;
+	}
+
+	samp->ts_rx = ts_now;
 
-	result->ok = true;
-	result->rtt_us = rtt;
+	/* everything is back, no need to wait for stragglers */
+	if (++np->recvc == np->sampc)
+		tmr_start(&np->tmr_tx, 0, tmr_completed_handler, np);
 }
 
 
@@ -116,53 +152,56 @@ static void udp_recv(const struct sa *src, struct mbuf *mb, void *arg)
 
 static int send_one(struct netprobe *np, uint32_t seq)
 {
-	struct mbuf *mb;
-	uint64_t ts_now;
+	struct netprobe_sample *samp = &np->sampv[seq];
+	struct mbuf *mb = np->mb_tx;
 	int err;
 
-	mb = mbuf_alloc(1024);
+	mbuf_rewind(mb);
 
-	ts_now = tmr_microseconds();
+	samp->ts_tx = tmr_microseconds();
 
-	err = packet_encode(mb, ts_now, np->secret, seq, 160);
+	err = packet_encode(mb, samp->ts_tx, np->secret, seq,
+			    samp->size - PACKET_HDR_SIZE);
 	if (err)
-		goto out;
+		return err;
 
 	mb->pos = 0;
-	err = udp_send(np->us_tx, &np->relay_addr, mb);
-
- out:
-	mem_deref(mb);
 
-	return err;
+	return udp_send(np->us_tx, &np->relay_addr, mb);
 }
 
 
-static void tmr_completed_handler(void *arg)
+/* Size ramp: the trains go from a probe packet up to max_size */
+static uint32_t train_size(const struct netprobe *np, uint32_t train)
 {
-	struct netprobe_result result;
-	struct netprobe *np = arg;
-	uint64_t rtt_acc = 0;
-	size_t i;
+	const uint32_t min_size = PROBE_SIZE + PACKET_HDR_SIZE;
 
-	memset(&result, 0, sizeof(result));
+	if (np->bw.trainc < 2)
+		return np->bw.max_size;
 
-	result.n_pkt_sent = np->resultc;
+	return min_size + (np->bw.max_size - min_size) * (train - 1)
+		/ (np->bw.trainc - 1);
+}
 
-	for (i=0; i<np->resultc; i++) {
 
-		struct result *res = &np->resultv[i];
+static void tmr_train_handler(void *arg)
+{
+	struct netprobe *np = arg;
+	uint32_t i;
 
-		if (res->ok) {
-			rtt_acc += res->rtt_us;
-			result.n_pkt_recv++;
-		}
+	if (np->bw.cur >= np->bw.trainc) {
+		tmr_start(&np->tmr_tx, COMPLETE_WAIT_MS,
+			  tmr_completed_handler, np);
+		return;
 	}
 
-	if (result.n_pkt_recv)
-		result.rtt_avg = (uint32_t)(rtt_acc / result.n_pkt_recv);
+	++np->bw.cur;
 
-	np->h(0, &result, np->arg);
+	/* back-to-back, the receiver measures the dispersion */
+	for (i = 0; i < np->bw.train_len; i++)
+		send_one(np, np->seq_ctr++);
+
+	tmr_start(&np->tmr_tx, TRAIN_GAP_MS, tmr_train_handler, np);
 }
 
 
@@ -170,13 +209,17 @@ static void tmr_handler(void *arg)
 {
 	struct netprobe *np = arg;
 
-	if (np->seq_ctr < np->resultc) {
+	if (np->seq_ctr < np->probec) {
 
 		tmr_start(&np->tmr_tx, np->pkt_interval, tmr_handler, np);
 		send_one(np, np->seq_ctr++);
 	}
+	else if (np->bw.trainc) {
+		tmr_start(&np->tmr_tx, TRAIN_GAP_MS, tmr_train_handler, np);
+	}
 	else {
-		tmr_start(&np->tmr_tx, 50, tmr_completed_handler, np);
+		tmr_start(&np->tmr_tx, COMPLETE_WAIT_MS,
+			  tmr_completed_handler, np);
 	}
 }
 
@@ -245,7 +288,8 @@ static void destructor(void *arg)
 	mem_deref(np->turnc);
 	mem_deref(np->us_tx);
 	mem_deref(np->us_rx);
-	mem_deref(np->resultv);
+	mem_deref(np->mb_tx);
+	mem_deref(np->sampv);
 }
 
 
@@ -260,6 +304,7 @@ int netprobe_alloc(struct netprobe **npb, const struct sa *turn_srv,
 {
 	struct netprobe *np;
 	struct sa laddr;
+	size_t i;
 	int err;
 
 	if (!npb || !turn_srv || !pkt_count || !pkt_interval_ms)
@@ -296,8 +341,18 @@ int netprobe_alloc(struct netprobe **npb, const struct sa *turn_srv,
 	if (err)
 		goto out;
 
-	np->resultv = mem_zalloc(sizeof(struct result) * pkt_count, NULL);
-	np->resultc = pkt_count;
+	np->mb_tx = mbuf_alloc(PACKET_MAX_SIZE);
+	np->sampv = mem_zalloc(sizeof(*np->sampv) * pkt_count, NULL);
+	if (!np->mb_tx || !np->sampv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < pkt_count; i++)
+		np->sampv[i].size = PROBE_SIZE + PACKET_HDR_SIZE;
+
+	np->sampc = pkt_count;
+	np->probec = pkt_count;
 
 	np->h = h;
 	np->arg = arg;
@@ -310,3 +365,62 @@ int netprobe_alloc(struct netprobe **npb, const struct sa *turn_srv,
 
 	return err;
 }
+
+
+/*
+ * Follow the probe packets with trainc trains of train_len packets
+ * sent back-to-back, ramping the packet size up to max_size, to
+ * estimate the bandwidth available through the TURN relay. Must be
+ * called before the probing starts, i.e. right after netprobe_alloc.
+ */
+int netprobe_set_bwprobe(struct netprobe *np, uint32_t trainc,
+			 uint32_t train_len, uint32_t max_size)
+{
+	struct netprobe_sample *sampv;
+	size_t sampc, i;
+
+	if (!np || !trainc || train_len < 2 || trainc > UINT16_MAX)
+		return EINVAL;
+
+	if (np->seq_ctr)
+		return EALREADY;
+
+	max_size = min(max_size, (uint32_t)PACKET_MAX_SIZE);
+	max_size = max(max_size, (uint32_t)(PROBE_SIZE + PACKET_HDR_SIZE));
+
+	sampc = np->probec + (size_t)trainc * train_len;
+
+	sampv = mem_realloc(np->sampv, sampc * sizeof(*sampv));
+	if (!sampv)
+		return ENOMEM;
+
+	np->sampv = sampv;
+	np->sampc = sampc;
+	np->bw.trainc = trainc;
+	np->bw.train_len = train_len;
+	np->bw.max_size = max_size;
+
+	for (i = np->probec; i < sampc; i++) {
+		struct netprobe_sample *samp = &sampv[i];
+		uint32_t train = (uint32_t)((i - np->probec) / train_len) + 1;
+
+		memset(samp, 0, sizeof(*samp));
+		samp->train = (uint16_t)train;
+		samp->size = train_size(np, train);
+	}
+
+	return 0;
+}
+
+
+const struct netprobe_sample *netprobe_samples(const struct netprobe *np,
+					       size_t *sampc)
+{
+	if (!np)
+		return NULL;
+
+	if (sampc)
+		*sampc = np->seq_ctr;
+
+	return np->sampv;
+}
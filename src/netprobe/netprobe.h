@@ -17,6 +17,12 @@
 */
 
 
+enum {
+	PACKET_HDR_SIZE = 20,
+	PACKET_MAX_SIZE = 1200,  /* fits the MTU after TURN overhead */
+};
+
+
 /*
  * code: host-order
  * wire: network-order 
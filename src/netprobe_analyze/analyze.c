@@ -0,0 +1,281 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_netprobe.h"
+
+
+struct arrival {
+	uint64_t ts_rx;
+	size_t seq;
+};
+
+
+static int arrival_cmp(const void *a, const void *b)
+{
+	const struct arrival *x = a, *y = b;
+
+	if (x->ts_rx != y->ts_rx)
+		return x->ts_rx < y->ts_rx ? -1 : 1;
+
+	return x->seq < y->seq ? -1 : (x->seq > y->seq);
+}
+
+
+static int u32_cmp(const void *a, const void *b)
+{
+	const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : (x > y);
+}
+
+
+/* nearest-rank percentile of a sorted vector */
+static uint32_t percentile(const uint32_t *v, size_t n, unsigned p)
+{
+	size_t rank = (n * p + 99) / 100;
+
+	return v[rank ? rank - 1 : 0];
+}
+
+
+static void analyze_loss(struct netprobe_result *result,
+			 const struct netprobe_sample *sampv, size_t sampc)
+{
+	size_t burst = 0;
+	size_t i;
+
+	for (i = 0; i < sampc; i++) {
+		const struct netprobe_sample *s = &sampv[i];
+
+		if (s->train)
+			continue;
+
+		if (s->ts_rx) {
+			burst = 0;
+			continue;
+		}
+
+		++result->n_lost;
+		if (++burst == 1)
+			++result->n_loss_bursts;
+		result->loss_burst_max = max(result->loss_burst_max, burst);
+	}
+}
+
+
+/*
+ * Walk the received probe packets in the order they arrived: RTT
+ * percentiles, RFC 3550 inter-arrival jitter and reordering.
+ */
+static int analyze_rtt(struct netprobe_result *result,
+		       const struct netprobe_sample *sampv, size_t sampc)
+{
+	struct arrival *arrv;
+	uint32_t *rttv;
+	uint64_t rtt_acc = 0;
+	int64_t jitter = 0;
+	size_t seq_max = 0;
+	size_t n = 0, i;
+	int err = 0;
+
+	arrv = mem_alloc(sampc * sizeof(*arrv), NULL);
+	rttv = mem_alloc(sampc * sizeof(*rttv), NULL);
+	if (!arrv || !rttv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < sampc; i++) {
+		const struct netprobe_sample *s = &sampv[i];
+
+		if (s->train || !s->ts_rx)
+			continue;
+
+		arrv[n].ts_rx = s->ts_rx;
+		arrv[n].seq = i;
+		rttv[n] = (uint32_t)(s->ts_rx - s->ts_tx);
+		rtt_acc += rttv[n];
+		++n;
+	}
+
+	result->n_pkt_recv = n;
+	if (!n)
+		goto out;
+
+	qsort(arrv, n, sizeof(*arrv), arrival_cmp);
+
+	for (i = 0; i < n; i++) {
+		const struct netprobe_sample *s = &sampv[arrv[i].seq];
+
+		if (i > 0) {
+			const struct netprobe_sample *p;
+			int64_t d;
+
+			p = &sampv[arrv[i-1].seq];
+
+			d = (int64_t)(s->ts_rx - s->ts_tx)
+				- (int64_t)(p->ts_rx - p->ts_tx);
+			if (d < 0)
+				d = -d;
+
+			jitter += d - ((jitter + 8) >> 4);
+		}
+
+		if (i > 0 && arrv[i].seq < seq_max)
+			++result->n_reordered;
+		else
+			seq_max = arrv[i].seq;
+	}
+
+	qsort(rttv, n, sizeof(*rttv), u32_cmp);
+
+	result->rtt_avg = (uint32_t)(rtt_acc / n);
+	result->rtt_min = rttv[0];
+	result->rtt_p50 = percentile(rttv, n, 50);
+	result->rtt_p90 = percentile(rttv, n, 90);
+	result->rtt_p99 = percentile(rttv, n, 99);
+	result->rtt_max = rttv[n - 1];
+	result->jitter = (uint32_t)(jitter >> 4);
+
+ out:
+	mem_deref(rttv);
+	mem_deref(arrv);
+
+	return err;
+}
+
+
+/*
+ * Packet train dispersion: a train is sent back-to-back, so the time
+ * between the first and the last packet arriving is set by the
+ * narrowest link of the path. The estimate is the median over trains.
+ */
+static int analyze_bw(struct netprobe_result *result,
+		      const struct netprobe_sample *sampv, size_t sampc)
+{
+	uint32_t *bwv = NULL;
+	uint16_t trainc = 0;
+	size_t bwc = 0, i;
+	uint16_t t;
+
+	for (i = 0; i < sampc; i++)
+		trainc = max(trainc, sampv[i].train);
+
+	if (!trainc)
+		return 0;
+
+	bwv = mem_alloc(trainc * sizeof(*bwv), NULL);
+	if (!bwv)
+		return ENOMEM;
+
+	for (t = 1; t <= trainc; t++) {
+		uint64_t first = 0, last = 0;
+		uint64_t bytes = 0;
+		uint32_t first_size = 0;
+		size_t recv = 0;
+
+		for (i = 0; i < sampc; i++) {
+			const struct netprobe_sample *s = &sampv[i];
+
+			if (s->train != t || !s->ts_rx)
+				continue;
+
+			if (!recv || s->ts_rx < first) {
+				first = s->ts_rx;
+				first_size = s->size;
+			}
+			last = max(last, s->ts_rx);
+			bytes += s->size;
+			++recv;
+		}
+
+		if (recv < 2 || last <= first)
+			continue;
+
+		/* the first packet only marks the start of the train */
+		bytes -= first_size;
+
+		bwv[bwc++] = (uint32_t)(bytes * 8 * 1000 / (last - first));
+	}
+
+	if (bwc) {
+		qsort(bwv, bwc, sizeof(*bwv), u32_cmp);
+		result->bw_kbps = bwv[bwc / 2];
+	}
+
+	mem_deref(bwv);
+
+	return 0;
+}
+
+
+int netprobe_analyze(struct netprobe_result *result,
+		     const struct netprobe_sample *sampv, size_t sampc)
+{
+	size_t i;
+	int err;
+
+	if (!result || (!sampv && sampc))
+		return EINVAL;
+
+	memset(result, 0, sizeof(*result));
+
+	if (!sampc)
+		return 0;
+
+	for (i = 0; i < sampc; i++) {
+		if (sampv[i].train)
+			continue;
+
+		++result->n_pkt_sent;
+		result->n_dup += sampv[i].dup;
+	}
+
+	analyze_loss(result, sampv, sampc);
+
+	err = analyze_rtt(result, sampv, sampc);
+	if (err)
+		return err;
+
+	return analyze_bw(result, sampv, sampc);
+}
+
+
+int netprobe_result_debug(struct re_printf *pf,
+			  const struct netprobe_result *result)
+{
+	if (!result)
+		return 0;
+
+	return re_hprintf(pf, "sent=%zu recv=%zu"
+			  " rtt(avg=%u min=%u p50=%u p90=%u p99=%u max=%u)us"
+			  " jitter=%uus lost=%zu bursts=%zu burst_max=%zu"
+			  " reordered=%zu dup=%zu bw=%ukbps",
+			  result->n_pkt_sent, result->n_pkt_recv,
+			  result->rtt_avg, result->rtt_min,
+			  result->rtt_p50, result->rtt_p90,
+			  result->rtt_p99, result->rtt_max,
+			  result->jitter, result->n_lost,
+			  result->n_loss_bursts, result->loss_burst_max,
+			  result->n_reordered, result->n_dup,
+			  result->bw_kbps);
+}
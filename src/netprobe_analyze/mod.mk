@@ -0,0 +1,6 @@
+#
+# mod.mk
+#
+
+AVS_SRCS += \
+	netprobe_analyze/analyze.c
@@ -0,0 +1,70 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <re.h>
+#include <avs.h>
+
+#include "decode_gate.h"
+
+namespace wire {
+
+DecodeGate::DecodeGate(struct decbudget_ent *budget)
+	: budget_((struct decbudget_ent *)mem_ref(budget))
+{
+}
+
+DecodeGate::~DecodeGate()
+{
+	mem_deref(budget_);
+}
+
+DecodeGate::Result DecodeGate::Decrypt(cricket::MediaType media_type,
+				       const std::vector<uint32_t>& csrcs,
+				       rtc::ArrayView<const uint8_t> additional_data,
+				       rtc::ArrayView<const uint8_t> encrypted_frame,
+				       rtc::ArrayView<uint8_t> frame)
+{
+	size_t len = frame.size();
+	int err;
+
+	if (decbudget_ent_decoding(budget_)) {
+		memcpy(frame.data(), encrypted_frame.data(),
+		       encrypted_frame.size());
+
+		return DecodeGate::Result(DecodeGate::Status::kOk,
+					  encrypted_frame.size());
+	}
+
+	/* Keep the packet, and its audio level, but not the payload */
+	err = decbudget_level_frame(frame.data(), &len,
+				    encrypted_frame.data(),
+				    encrypted_frame.size());
+	if (err)
+		len = 0;
+
+	return DecodeGate::Result(DecodeGate::Status::kOk, len);
+}
+
+size_t DecodeGate::GetMaxPlaintextByteSize(cricket::MediaType media_type,
+					   size_t encrypted_frame_size)
+{
+	return encrypted_frame_size;
+}
+
+}  // namespace wire
@@ -0,0 +1,55 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DECODE_GATE_H_
+#define DECODE_GATE_H_
+
+#include "api/crypto/frame_decryptor_interface.h"
+#include "rtc_base/ref_counted_object.h"
+
+struct decbudget_ent;
+
+namespace wire {
+
+/* Passes audio frames to the decoder only while the stream is
+ * within the decode budget, used where there is no frame decryptor.
+ * Outside the budget only the bare Opus TOC is passed on.
+ */
+class DecodeGate : public rtc::RefCountedObject<webrtc::FrameDecryptorInterface>
+{
+public:
+	DecodeGate(struct decbudget_ent *budget);
+	~DecodeGate();
+
+	Result Decrypt(cricket::MediaType media_type,
+		       const std::vector<uint32_t>& csrcs,
+		       rtc::ArrayView<const uint8_t> additional_data,
+		       rtc::ArrayView<const uint8_t> encrypted_frame,
+		       rtc::ArrayView<uint8_t> frame);
+
+	size_t GetMaxPlaintextByteSize(cricket::MediaType media_type,
+				       size_t encrypted_frame_size);
+
+private:
+	struct decbudget_ent *budget_;
+};
+
+}  // namespace wire
+
+#endif  // DECODE_GATE_H_
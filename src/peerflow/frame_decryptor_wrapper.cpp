@@ -25,6 +25,8 @@ namespace wire {
 
 FrameDecryptor::FrameDecryptor(enum frame_media_type mtype,
 			       struct peerflow *pf)
+	: _dec(NULL),
+	  _budget(NULL)
 {
 	int err;
 
@@ -48,6 +50,7 @@ FrameDecryptor::~FrameDecryptor()
 	info("FrameDecryptor::dtor: %p\n", this);
 
 	_dec = (struct frame_decryptor*)mem_deref(_dec);
+	_budget = (struct decbudget_ent *)mem_deref(_budget);
 }
 
 int FrameDecryptor::SetKeystore(struct keystore *keystore)
@@ -60,6 +63,17 @@ int FrameDecryptor::SetUserID(const char *userid_hash)
 	return frame_decryptor_set_uid(_dec, userid_hash);
 }
 
+int FrameDecryptor::SetStats(struct frame_stats_group *grp)
+{
+	return frame_decryptor_set_stats(_dec, grp);
+}
+
+void FrameDecryptor::SetBudget(struct decbudget_ent *budget)
+{
+	mem_deref(_budget);
+	_budget = (struct decbudget_ent *)mem_ref(budget);
+}
+
 FrameDecryptor::Result FrameDecryptor::Decrypt(cricket::MediaType media_type,
 				     const std::vector<uint32_t>& csrcs,
 				     rtc::ArrayView<const uint8_t> additional_data,
@@ -80,6 +94,18 @@ FrameDecryptor::Result FrameDecryptor::Decrypt(cricket::MediaType media_type,
 				      frame.data(),
 				      &decsz);
 
+	/* Outside the decode budget: keep the packet, and with it the
+	 * audio level, but hand only the bare Opus TOC to the decoder.
+	 */
+	if (!err && !decbudget_ent_decoding(_budget)) {
+		size_t len = frame.size();
+
+		if (decbudget_level_frame(frame.data(), &len,
+					  frame.data(), decsz))
+			len = 0;
+		decsz = len;
+	}
+
 	switch (err) {
 	case 0:
 		return FrameDecryptor::Result(FrameDecryptor::Status::kOk, decsz);
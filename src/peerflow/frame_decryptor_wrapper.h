@@ -24,6 +24,7 @@
 #include "rtc_base/ref_counted_object.h"
 
 struct frame_decryptor;
+struct decbudget_ent;
 struct peerflow;
 
 namespace wire {
@@ -39,6 +40,10 @@ public:
 
 	int SetUserID(const char *userid_hash);
 
+	int SetStats(struct frame_stats_group *grp);
+
+	void SetBudget(struct decbudget_ent *budget);
+
 	Result Decrypt(cricket::MediaType media_type,
 			       const std::vector<uint32_t>& csrcs,
 			       rtc::ArrayView<const uint8_t> additional_data,
@@ -50,6 +55,7 @@ public:
 
 private:
 	struct frame_decryptor *_dec;
+	struct decbudget_ent *_budget;
 };
 
 }  // namespace wire
@@ -44,6 +44,11 @@ int FrameEncryptor::SetKeystore(struct keystore *keystore)
 	return frame_encryptor_set_keystore(_enc, keystore);
 }
 
+int FrameEncryptor::SetStats(struct frame_stats_group *grp)
+{
+	return frame_encryptor_set_stats(_enc, grp);
+}
+
 int FrameEncryptor::Encrypt(cricket::MediaType media_type,
 			    uint32_t ssrc,
 			    rtc::ArrayView<const uint8_t> additional_data,
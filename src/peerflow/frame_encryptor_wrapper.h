@@ -36,6 +36,8 @@ public:
 
 	int SetKeystore(struct keystore *keystore);
 
+	int SetStats(struct frame_stats_group *grp);
+
 	int Encrypt(cricket::MediaType media_type,
 		    uint32_t ssrc,
 		    rtc::ArrayView<const uint8_t> additional_data,
@@ -6,9 +6,11 @@ AVS_SRCS += \
 	peerflow/capture_source.cpp \
 	peerflow/cbr_detector_local.cpp \
 	peerflow/cbr_detector_remote.cpp \
+	peerflow/decode_gate.cpp \
 	peerflow/frame_decryptor_wrapper.cpp \
 	peerflow/frame_encryptor_wrapper.cpp \
 	peerflow/peerflow.cpp \
+	peerflow/shared_audio_encoder.cpp \
 	peerflow/video_renderer.cpp
 
 AVS_CPPFLAGS_src/peerflow := \
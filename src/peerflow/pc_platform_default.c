@@ -21,6 +21,8 @@
 #include <avs_base.h>
 #include <avs_icall.h>
 #include <avs_keystore.h>
+#include <avs_frame_encryptor.h>
+#include <avs_frame_stats.h>
 #include <avs_iflow.h>
 #include <avs_peerflow.h>
 #include "peerflow.h"
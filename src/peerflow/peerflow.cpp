@@ -17,6 +17,7 @@
 */
 
 #include <stdio.h>
+#include <pthread.h>
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -54,8 +55,10 @@ extern "C" {
 #include "capture_source.h"
 #include "cbr_detector_local.h"
 #include "cbr_detector_remote.h"
+#include "decode_gate.h"
 #include "frame_encryptor_wrapper.h"
 #include "frame_decryptor_wrapper.h"
+#include "shared_audio_encoder.h"
 #include "video_renderer.h"
 #include "stats.h"
 
@@ -64,6 +67,7 @@ extern "C" {
 #include "peerflow.h"
 
 #define TMR_STATS_INTERVAL  1000
+#define TMR_LEVEL_INTERVAL   200
 #define TMR_CBR_INTERVAL    2500
 
 #define DOUBLE_ENCRYPTION 1
@@ -82,6 +86,7 @@ static struct {
 		struct lock *lock;
 		struct mqueue *q;
 		struct list l;
+		struct list pfl;  /* flows that take events, by le_mq */
 	} mq;
 	
 	struct lock *lock;
@@ -93,6 +98,20 @@ static struct {
 		bool muted;
 	} audio;
 
+	struct decbudget *budget;
+
+	/* voice effects on the capture path */
+	struct {
+		struct aueffect_chain *chain;
+		enum audio_effect effectv[AUEFFECT_CHAIN_MAX];
+		size_t effectc;
+	} fx;
+
+	/* data channel receive path */
+	struct {
+		uint64_t msgs;
+		uint64_t bytes;
+	} dcrx;
 
 #if PC_STANDALONE
 	struct dnsc *dnsc;
@@ -105,6 +124,7 @@ static struct {
 	.audio = {
 		  .muted = false,
 	},
+	.budget = NULL,
 #if  PC_STANDALONE
 	.dnsc = NULL,
 	.http_cli = NULL,
@@ -112,6 +132,10 @@ static struct {
 };
 
 
+/* Guards g_pf.fx, set from any app thread, also before init */
+static pthread_mutex_t g_fx_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
 struct peerflow {
 	struct iflow iflow;
 	char *convid;
@@ -155,6 +179,8 @@ struct peerflow {
 		
 		bool local_cbr;
 		bool remote_cbr;
+
+		struct decbudget_ent *budget;
 	} audio;
 
 	struct {
@@ -177,12 +203,18 @@ struct peerflow {
 		struct lock *lock;
 	} cml;
 
+	struct bundle_cache *bundle;
+	struct frame_stats_group *fstats;
+
 	char *userid_remote;
 	char *clientid_remote;
 
 	struct le le;
+	struct le le_mq;
+	struct avs_evq *evq;  /* events go to the thread that owns pf */
 
 	struct tmr tmr_stats;
+	struct tmr tmr_level;
 	rtc::scoped_refptr<wire::NetStatsCallback> netStatsCb;
 	std::string remoteSdp;
 	bool selective_audio;
@@ -215,6 +247,7 @@ enum {
 
 struct mq_data {
 	struct peerflow *pf;
+	struct avs_evq *evq;
 	int id;
 	struct le le;
 	bool handled;
@@ -236,7 +269,7 @@ struct mq_data {
 		
 		struct {
 			int id;
-			struct mbuf *mb;
+			rtc::CopyOnWriteBuffer *buf;  /* shares WebRTC's bytes */
 		} dcdata;
 	} u;
 };
@@ -392,7 +425,7 @@ static void md_destructor(void *arg)
 		break;
 		
 	case MQ_DC_DATA:
-		mem_deref(md->u.dcdata.mb);
+		delete md->u.dcdata.buf;
 		break;
 
 	default:
@@ -402,14 +435,69 @@ static void md_destructor(void *arg)
 	list_unlink(&md->le);
 }
 
+/* Call with g_pf.mq.lock held, pf is not dereferenced */
+static bool mq_registered(const struct peerflow *pf)
+{
+	struct le *le;
+
+	LIST_FOREACH(&g_pf.mq.pfl, le) {
+		if (le->data == pf)
+			return true;
+	}
+
+	return false;
+}
+
+
+/*
+ * Events of a peerflow are handled on the thread that allocated it,
+ * events without a peerflow on the thread that called peerflow_init.
+ *
+ * Called from the signaling thread, so only g_pf.mq.lock is taken:
+ * a flow stays registered, with its queue referenced, until its
+ * destructor unlinks it under the same lock.
+ */
 static void push_mq(struct mq_data *md)
 {
 	lock_write_get(g_pf.mq.lock);
+	if (md->pf) {
+		if (!mq_registered(md->pf)) {
+			lock_rel(g_pf.mq.lock);
+			mem_deref(md);
+			return;
+		}
+		md->evq = md->pf->evq;
+	}
+
 	list_append(&g_pf.mq.l, &md->le, md);
-		
-	mqueue_push(g_pf.mq.q, md->id, md);
+
+	if (md->evq)
+		avs_evq_push(md->evq, md->id, md);
+	else
+		mqueue_push(g_pf.mq.q, md->id, md);
+	lock_rel(g_pf.mq.lock);
+}
+
+
+/*
+ * The last peerflow of a thread takes its queue along, so the events
+ * still queued there are never delivered and are dropped here.
+ */
+static void flush_mq(struct avs_evq *evq)
+{
+	struct le *le;
+
+	lock_write_get(g_pf.mq.lock);
+	le = g_pf.mq.l.head;
+	while (le) {
+		struct mq_data *md = (struct mq_data *)le->data;
+
+		le = le->next;
+
+		if (md->evq == evq)
+			mem_deref(md);
+	}
 	lock_rel(g_pf.mq.lock);
-	
 }
 
 static void send_close(struct peerflow *pf, int err)
@@ -428,17 +516,27 @@ static void send_close(struct peerflow *pf, int err)
 	push_mq(md);
 }
 
+/*
+ * The tracks are proxies that block until the signaling thread runs
+ * the call, and that thread may be waiting for a lock of ours, so they
+ * are called with no lock held.
+ */
 static void set_all_mute(bool muted)
 {
+	std::vector<rtc::scoped_refptr<webrtc::AudioTrackInterface>> tracks;
 	struct le *le;
 
+	lock_write_get(g_pf.lock);
 	for(le = g_pf.pfl.head; le; le = le->next) {
 		struct peerflow *pf = (struct peerflow *)le->data;
 
-		if (pf && pf->audio.track) {
-			pf->audio.track->set_enabled(!muted);
-		}
+		if (pf && pf->audio.track)
+			tracks.push_back(pf->audio.track);
 	}
+	lock_rel(g_pf.lock);
+
+	for (auto &track : tracks)
+		track->set_enabled(!muted);
 }
 
 static void handle_mq(struct peerflow *pf, struct mq_data *md, int id)
@@ -480,8 +578,8 @@ static void handle_mq(struct peerflow *pf, struct mq_data *md, int id)
 
 	case MQ_DC_DATA:
 		IFLOW_CALL_CB(pf->iflow, dce_recvh,
-			      md->u.dcdata.mb->buf,
-			      md->u.dcdata.mb->end,
+			      md->u.dcdata.buf->cdata(),
+			      md->u.dcdata.buf->size(),
 			      pf->iflow.arg);
 		break;
 
@@ -644,6 +742,40 @@ static bool peerflow_get_mute(void)
 		return false;
 }
 
+static int peerflow_set_voice_effects(const int *effectv, size_t effectc)
+{
+	enum audio_effect fxv[AUEFFECT_CHAIN_MAX];
+	size_t i;
+	int err;
+
+	if ((!effectv && effectc) || effectc > AUEFFECT_CHAIN_MAX)
+		return EINVAL;
+
+	for (i = 0; i < effectc; i++)
+		fxv[i] = (enum audio_effect)effectv[i];
+
+	pthread_mutex_lock(&g_fx_mutex);
+
+	/* before init, the list is kept for the chain to come */
+	if (g_pf.fx.chain) {
+		err = aueffect_chain_set(g_pf.fx.chain, fxv, effectc);
+		if (err)
+			goto out;
+	}
+
+	memcpy(g_pf.fx.effectv, fxv, effectc * sizeof(fxv[0]));
+	g_pf.fx.effectc = effectc;
+	err = 0;
+
+ out:
+	pthread_mutex_unlock(&g_fx_mutex);
+
+	if (!err)
+		info("pf: set_voice_effects: %zu effects\n", effectc);
+
+	return err;
+}
+
 int peerflow_set_funcs(void)
 {
 	iflow_set_alloc(peerflow_alloc);
@@ -651,6 +783,7 @@ int peerflow_set_funcs(void)
 	iflow_register_statics(peerflow_destroy,
 			       peerflow_set_mute,
 			       peerflow_get_mute);
+	iflow_register_voice_effects(peerflow_set_voice_effects);
 
 	return 0;
 }
@@ -675,8 +808,32 @@ int peerflow_init(void)
 		goto out;
 	
 	list_init(&g_pf.mq.l);
+	list_init(&g_pf.mq.pfl);
 
 	err = lock_alloc(&g_pf.lock);
+	if (err)
+		goto out;
+
+	err = decbudget_alloc(&g_pf.budget, 0);
+	if (err)
+		goto out;
+
+	pthread_mutex_lock(&g_fx_mutex);
+
+	err = aueffect_chain_alloc(&g_pf.fx.chain, 48000, 0);
+	if (!err && g_pf.fx.effectc) {
+		err = aueffect_chain_set(g_pf.fx.chain, g_pf.fx.effectv,
+					 g_pf.fx.effectc);
+		if (err) {
+			warning("pf_init: voice effects not applied (%m)\n",
+				err);
+			g_pf.fx.effectc = 0;
+			err = 0;
+		}
+	}
+
+	pthread_mutex_unlock(&g_fx_mutex);
+
 	if (err)
 		goto out;
 
@@ -702,11 +859,21 @@ int peerflow_init(void)
 
 	me_deps.adm = adm;
 	me_deps.task_queue_factory = webrtc::CreateDefaultTaskQueueFactory().release();
-	me_deps.audio_encoder_factory = webrtc::CreateBuiltinAudioEncoderFactory();
+	/* Encode the local audio once for all peers of a mesh call,
+	 * see mark_fanout(), other calls get plain encoders.
+	 */
+	me_deps.audio_encoder_factory = new wire::SharedAudioEncoderFactory(
+		webrtc::CreateBuiltinAudioEncoderFactory());
 	me_deps.audio_decoder_factory = webrtc::CreateBuiltinAudioDecoderFactory();
 	me_deps.video_encoder_factory = webrtc::CreateBuiltinVideoEncoderFactory();
 	me_deps.video_decoder_factory = webrtc::CreateBuiltinVideoDecoderFactory();
-	me_deps.audio_processing = webrtc::AudioProcessingBuilder().Create();
+	/* The APM owns the processor, which holds its own chain reference */
+	me_deps.audio_processing = webrtc::AudioProcessingBuilder()
+		.SetCapturePostProcessing(
+			std::unique_ptr<webrtc::CustomProcessing>(
+				(webrtc::CustomProcessing *)
+				aueffect_chain_capture_processing(g_pf.fx.chain)))
+		.Create();
 
 	pc_deps.signaling_thread = g_pf.thread.get();
 	pc_deps.media_engine = cricket::CreateMediaEngine(std::move(me_deps));
@@ -744,6 +911,21 @@ void peerflow_destroy(void)
 	g_pf.mq.lock = (struct lock *)mem_deref(g_pf.mq.lock);
 
 	g_pf.lock = (struct lock *)mem_deref(g_pf.lock);
+	g_pf.budget = (struct decbudget *)mem_deref(g_pf.budget);
+
+	pthread_mutex_lock(&g_fx_mutex);
+
+	if (g_pf.fx.chain) {
+		struct aueffect_chain_stats st;
+
+		aueffect_chain_get_stats(g_pf.fx.chain, &st);
+		info("peerflow_destroy: voice effects: frames=%u bypassed=%u"
+		     " overruns=%u max=%uus\n",
+		     st.frames, st.bypassed, st.overruns, st.max_us);
+	}
+	g_pf.fx.chain = (struct aueffect_chain *)mem_deref(g_pf.fx.chain);
+
+	pthread_mutex_unlock(&g_fx_mutex);
 
 	g_pf.initialized = false;
 
@@ -835,19 +1017,21 @@ class DataChanObserver : public webrtc::DataChannelObserver {
 		struct mq_data *md;
 
 		md = (struct mq_data *)mem_zalloc(sizeof(*md), md_destructor);
-		md->pf = pf_; //(struct peerflow *)mem_ref(pf_);
-		md->u.dcdata.mb = mbuf_alloc(buffer.size());
-		if (!md->u.dcdata.mb) {
-			warning("pf(%p): dce data: no mbuf\n", pf_);
-			mem_deref(md);
+		if (!md) {
+			warning("pf(%p): dce data: no md\n", pf_);
 			return;
 		}
+		md->pf = pf_; //(struct peerflow *)mem_ref(pf_);
 
-		mbuf_write_mem(md->u.dcdata.mb,
-			       (const uint8_t *)buffer.data.cdata(),
-			       buffer.size());
-
+		/* Take a reference on the received buffer rather than
+		 * copying it, the bytes are released back to WebRTC
+		 * when the message has been handled.
+		 */
+		md->u.dcdata.buf = new rtc::CopyOnWriteBuffer(buffer.data);
 		md->u.dcdata.id = dc_->id();
+
+		++g_pf.dcrx.msgs;
+		g_pf.dcrx.bytes += buffer.size();
 		
 		md->id = MQ_DC_DATA;
 
@@ -1195,6 +1379,8 @@ public:
 		const char *userid = NULL;
 		const char *clientid = NULL;
 		const char *dec_uid = NULL;
+		struct decbudget_ent *budget = NULL;
+		bool is_audio;
 		int err = 0;
 
 		if (track == nullptr)
@@ -1206,6 +1392,7 @@ public:
 		info("pf(%p): OnAddTrack %s track added id=%s\n", pf_, kind, label);
 
 		track->set_enabled(true);
+		is_audio = streq(kind, webrtc::MediaStreamTrackInterface::kAudioKind);
 
 		struct conf_member *cm;
 
@@ -1215,6 +1402,14 @@ public:
 			userid = cm->userid;
 			clientid = cm->clientid;
 			dec_uid = cm->userid_hash;
+
+			if (is_audio && !cm->budget) {
+				char userid_anon[ANON_ID_LEN];
+
+				decbudget_ent_alloc(&cm->budget, g_pf.budget,
+						    anon_id(userid_anon, userid));
+			}
+			budget = (struct decbudget_ent *)mem_ref(cm->budget);
 		}
 		else if (pf_->conv_type == ICALL_CONV_TYPE_CONFERENCE) {
 			userid = "user";
@@ -1259,6 +1454,7 @@ public:
 						"decryptor (%m)\n",
 						pf_, err);
 				}
+				decryptor->SetStats(pf_->fstats);
 				if (dec_uid) {
 					err = decryptor->SetUserID(dec_uid);
 					if (err) {
@@ -1271,7 +1467,7 @@ public:
 			}
 #endif
 		}
-		else if (streq(kind, webrtc::MediaStreamTrackInterface::kAudioKind))
+		else if (is_audio)
 		{
 #if DOUBLE_ENCRYPTION
 			if (pf_->conv_type == ICALL_CONV_TYPE_CONFERENCE) {
@@ -1283,6 +1479,7 @@ public:
 						"decryptor (%m)\n",
 						pf_, err);
 				}
+				decryptor->SetStats(pf_->fstats);
 				if (dec_uid) {
 					err = decryptor->SetUserID(dec_uid);
 					if (err) {
@@ -1291,6 +1488,7 @@ public:
 							pf_, err);
 					}
 				}
+				decryptor->SetBudget(budget);
 				rx->SetFrameDecryptor(decryptor);
 			}
 			else
@@ -1298,9 +1496,22 @@ public:
 			if (pf_->conv_type == ICALL_CONV_TYPE_ONEONONE) {
 				rx->SetFrameDecryptor(pf_->cbr_det_remote);
 			}
+			else if (pf_->conv_type == ICALL_CONV_TYPE_GROUP) {
+				/* mesh: one audio stream per peerflow */
+				char userid_anon[ANON_ID_LEN];
+
+				if (!pf_->audio.budget) {
+					decbudget_ent_alloc(&pf_->audio.budget,
+						g_pf.budget,
+						anon_id(userid_anon, userid));
+				}
+				rx->SetFrameDecryptor(
+					new wire::DecodeGate(pf_->audio.budget));
+			}
 		}
 
 out:
+		mem_deref(budget);
 		mem_deref(label);
 		mem_deref(kind);
 	}
@@ -1761,6 +1972,7 @@ static int create_pf(struct peerflow *pf)
 				pf, err);
 			goto out;
 		}
+		encryptor->SetStats(pf->fstats);
 		pf->rtpSender->SetFrameEncryptor(encryptor);
 	} else
 #endif
@@ -1794,6 +2006,7 @@ static int create_pf(struct peerflow *pf)
 					pf, err);
 				goto out;
 			}
+			encryptor->SetStats(pf->fstats);
 			video_track->SetFrameEncryptor(encryptor);
 		}
 #endif
@@ -1812,6 +2025,7 @@ static void pf_destructor(void *arg)
 
 	pf->netStatsCb->setActive(false);
 	tmr_cancel(&pf->tmr_stats);
+	tmr_cancel(&pf->tmr_level);
 	pf->netStatsCb = NULL;
 
 	tmr_cancel(&pf->tmr_cbr);
@@ -1826,6 +2040,14 @@ static void pf_destructor(void *arg)
 	list_unlink(&pf->le);
 	lock_rel(g_pf.lock);
 
+	lock_write_get(g_pf.mq.lock);
+	list_unlink(&pf->le_mq);
+	lock_rel(g_pf.mq.lock);
+
+	if (avs_evq_is_last(pf->evq))
+		flush_mq(pf->evq);
+	pf->evq = (struct avs_evq *)mem_deref(pf->evq);
+
 	delete pf->offerOptions;
 	delete pf->answerOptions;
 	delete pf->config;
@@ -1847,11 +2069,15 @@ static void pf_destructor(void *arg)
 
 	list_flush(&pf->cml.list);
 	mem_deref(pf->cml.lock);
+	mem_deref(pf->bundle);
+	mem_deref(pf->fstats);
 
 	list_flush(&pf->video.renderl);
+
+	mem_deref(pf->audio.budget);
 }
 
-static void timer_stats(void *arg)
+static void timer_level(void *arg)
 {
 	struct peerflow *pf = (struct peerflow *)arg;
 
@@ -1860,6 +2086,12 @@ static void timer_stats(void *arg)
 	if (!pf || !pf->peerConn)
 		goto out;
 
+	decbudget_set_max(g_pf.budget,
+			  msystem_get_decode_budget(msystem_instance()));
+
+	/* The RTP audio level is available for every stream,
+	 * also the ones that are not decoded.
+	 */
 	trxs = pf->peerConn->GetTransceivers();
 
 	for(rtc::scoped_refptr<webrtc::RtpTransceiverInterface> trx: trxs) {
@@ -1875,14 +2107,32 @@ static void timer_stats(void *arg)
 			uint32_t ssrc = src.source_id();
 			struct conf_member *cm = conf_member_find_by_ssrca(&pf->cml.list, ssrc);
 			uint8_t level = src.audio_level() ? *src.audio_level() : 127;
+			float flevel = powf(10.0f, -level / 30.0f) * 255.0f;
 			if (cm) {
-				float flevel = powf(10.0f, -level / 30.0f) * 255.0f;
 				conf_member_set_audio_level(cm, (uint8_t)flevel);
+				decbudget_ent_set_level(cm->budget, (uint8_t)flevel);
+			}
+			else if (pf->audio.budget) {
+				decbudget_ent_set_level(pf->audio.budget,
+							(uint8_t)flevel);
 			}
 		}
 		lock_rel(pf->cml.lock);
 	}
 
+	decbudget_update(g_pf.budget, tmr_jiffies());
+
+ out:
+	tmr_start(&pf->tmr_level, TMR_LEVEL_INTERVAL, timer_level, pf);
+}
+
+static void timer_stats(void *arg)
+{
+	struct peerflow *pf = (struct peerflow *)arg;
+
+	if (!pf || !pf->peerConn)
+		goto out;
+
 	pf->peerConn->GetStats(pf->netStatsCb);
 
  out:
@@ -2009,6 +2259,14 @@ int peerflow_alloc(struct iflow		**flowp,
 	if (err)
 		goto out;
 
+	err = bundle_cache_alloc(&pf->bundle);
+	if (err)
+		goto out;
+
+	err = frame_stats_group_alloc(&pf->fstats);
+	if (err)
+		goto out;
+
 #if 0
 	pf->dc.ch = pf->pf->CreateDataChannel("calling-3.0", nullptr);
 	if (!pf->dc.ch) {
@@ -2025,14 +2283,23 @@ int peerflow_alloc(struct iflow		**flowp,
 	pf->sdpRemoteObserver = new SdpRemoteObserver(pf);
 	pf->offerObserver = new OfferObserver(pf);
 	pf->answerObserver = new AnswerObserver(pf);
+
+	err = avs_evq_get(&pf->evq, mq_handler);
+	if (err)
+		goto out;
 	
 	lock_write_get(g_pf.lock);
 	list_append(&g_pf.pfl, &pf->le, pf);
 	lock_rel(g_pf.lock);
 
+	lock_write_get(g_pf.mq.lock);
+	list_append(&g_pf.mq.pfl, &pf->le_mq, pf);
+	lock_rel(g_pf.mq.lock);
+
 	pf->netStatsCb = new wire::NetStatsCallback(pf);
 
 	tmr_start(&pf->tmr_stats, TMR_STATS_INTERVAL, timer_stats, pf);
+	tmr_start(&pf->tmr_level, TMR_LEVEL_INTERVAL, timer_level, pf);
  out:
 	if (err)
 		mem_deref(pf);
@@ -2260,6 +2527,17 @@ static void pf_tool_handler(const char *tool, void *arg)
 }
 
 
+/* All PeerConnections of a mesh call share one audio encoder */
+static void mark_fanout(struct peerflow *pf,
+			webrtc::SessionDescriptionInterface *sdp)
+{
+	if (pf->conv_type != ICALL_CONV_TYPE_GROUP)
+		return;
+
+	wire::SharedAudioEncoderFactory::MarkShared(sdp, pf->convid);
+}
+
+
 int peerflow_handle_offer(struct iflow *iflow,
 			  const char *sdp_str)
 {
@@ -2304,6 +2582,7 @@ int peerflow_handle_offer(struct iflow *iflow,
 				goto out;
 		}
 
+		mark_fanout(pf, sdp.get());
 		pf->peerConn->SetRemoteDescription(std::move(sdp),
 						   pf->sdpRemoteObserver);
 		
@@ -2344,6 +2623,7 @@ int peerflow_handle_answer(struct iflow *iflow,
 		err = EPROTO;
 	}
 	else {
+		mark_fanout(pf, sdp.get());
 		pf->peerConn->SetRemoteDescription(std::move(sdp),
 					     pf->sdpRemoteObserver);
 		const webrtc::SessionDescriptionInterface *rsdp = pf->peerConn->remote_description();
@@ -2523,7 +2803,8 @@ int peerflow_sync_decoders(struct iflow *iflow)
 		return EINVAL;
 	
 	str_dup(&sdp, pf->remoteSdp.c_str());
-	err = bundle_update((struct iflow *)pf,
+	err = bundle_update(pf->bundle,
+			    (struct iflow *)pf,
 			    pf->conv_type,
 			    !pf->selective_audio,
 			    sdp,
@@ -2798,12 +3079,51 @@ int peerflow_get_stats(struct iflow *flow,
 	}
 
 	*stats = pf->stats;
+
+	for (int m = FRAME_MEDIA_AUDIO; m <= FRAME_MEDIA_VIDEO; m++) {
+		struct frame_stats fs;
+
+		frame_stats_group_get(pf->fstats, (enum frame_media_type)m,
+				      true, &fs);
+		frame_stats_add(&stats->fenc, &fs);
+		frame_stats_group_get(pf->fstats, (enum frame_media_type)m,
+				      false, &fs);
+		frame_stats_add(&stats->fdec, &fs);
+	}
+
 	return 0;
 }
 
+
+int peerflow_get_frame_stats(const struct iflow *flow,
+			     enum frame_media_type mtype, bool tx,
+			     struct frame_stats *stats)
+{
+	const struct peerflow *pf = (const struct peerflow*)flow;
+
+	if (!pf || !stats)
+		return EINVAL;
+
+	return frame_stats_group_get(pf->fstats, mtype, tx, stats);
+}
+
 int peerflow_debug(struct re_printf *pf, const struct iflow *flow)
 {
-	return 0;
+	int err;
+
+	err = decbudget_debug(pf, g_pf.budget);
+
+	err |= re_hprintf(pf, "data channel rx: %llu msgs %llu bytes\n",
+			  (unsigned long long)g_pf.dcrx.msgs,
+			  (unsigned long long)g_pf.dcrx.bytes);
+
+	if (flow) {
+		const struct peerflow *pfl = (const struct peerflow*)flow;
+
+		err |= frame_stats_group_debug(pf, pfl->fstats);
+	}
+
+	return err;
 }
 
 
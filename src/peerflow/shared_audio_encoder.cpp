@@ -0,0 +1,603 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <string>
+
+#include <re.h>
+#include <avs.h>
+
+#include "absl/strings/match.h"
+#include "api/audio_codecs/audio_encoder.h"
+#include "pc/session_description.h"
+
+#include "shared_audio_encoder.h"
+
+#define MAX_PACKET_SIZE 1500
+
+/* Local-only Opus parameter naming the fan-out group of a stream */
+#define FANOUT_PARAM "x-wire-fanout"
+
+namespace wire {
+
+/* The real encoder, shared by all proxies with the same format */
+class SharedEncoder {
+public:
+	SharedEncoder(std::unique_ptr<webrtc::AudioEncoder> enc,
+		      const std::string& key,
+		      const webrtc::SdpAudioFormat& format);
+	~SharedEncoder();
+
+	int Init();
+
+	static int EncodeHandler(uint8_t *dst, size_t *lenp,
+				 struct aufanout_meta *meta,
+				 const int16_t *sampv, size_t sampc,
+				 void *arg);
+
+	std::unique_ptr<webrtc::AudioEncoder> enc;
+	std::string key;
+	webrtc::SdpAudioFormat format;  /* without the fan-out group */
+	struct aufanout *af;
+	struct list proxyl;
+	struct le le;
+
+	uint32_t ts;
+
+	/* written by the factory, applied from the encode handler */
+	std::atomic<int> target_bps;
+	std::atomic<float> loss;
+	int applied_bps;
+	float applied_loss;
+};
+
+
+/* One per send stream, hands out the shared encoded frames */
+class SharedAudioEncoder : public webrtc::AudioEncoder {
+public:
+	SharedAudioEncoder(SharedAudioEncoderFactory *factory,
+			   SharedEncoder *shared,
+			   int payload_type);
+	~SharedAudioEncoder() override;
+
+	int Init();
+
+	int SampleRateHz() const override;
+	size_t NumChannels() const override;
+	int RtpTimestampRateHz() const override;
+	size_t Num10MsFramesInNextPacket() const override;
+	size_t Max10MsFramesInAPacket() const override;
+	int GetTargetBitrate() const override;
+	void Reset() override;
+
+	void OnReceivedUplinkPacketLossFraction(
+		float uplink_packet_loss_fraction) override;
+	void OnReceivedUplinkBandwidth(
+		int target_audio_bitrate_bps,
+		absl::optional<int64_t> bwe_period_ms) override;
+	void OnReceivedTargetAudioBitrate(int target_bps) override;
+
+protected:
+	EncodedInfo EncodeImpl(uint32_t rtp_timestamp,
+			       rtc::ArrayView<const int16_t> audio,
+			       rtc::Buffer* encoded) override;
+
+private:
+	friend class SharedAudioEncoderFactory;
+
+	webrtc::AudioEncoder *Encoder() const;
+	int Detach();
+
+	rtc::scoped_refptr<SharedAudioEncoderFactory> factory_;
+	SharedEncoder *shared_;
+	struct aufanout_sink *sink_;
+	std::unique_ptr<webrtc::AudioEncoder> private_;
+	int payload_type_;
+
+	int target_bps_;
+	float loss_;
+	struct le le_;
+};
+
+
+SharedEncoder::SharedEncoder(std::unique_ptr<webrtc::AudioEncoder> enc,
+			     const std::string& key,
+			     const webrtc::SdpAudioFormat& format) :
+	enc(std::move(enc)),
+	key(key),
+	format(format),
+	af(NULL),
+	ts(0),
+	target_bps(0),
+	loss(0.0f),
+	applied_bps(0),
+	applied_loss(0.0f)
+{
+	list_init(&proxyl);
+	memset(&le, 0, sizeof(le));
+}
+
+
+SharedEncoder::~SharedEncoder()
+{
+	mem_deref(af);
+}
+
+
+int SharedEncoder::Init()
+{
+	const size_t sampc = enc->SampleRateHz() / 100 * enc->NumChannels();
+
+	return aufanout_alloc(&af, sampc, MAX_PACKET_SIZE,
+			      EncodeHandler, this);
+}
+
+
+/* Called with the aufanout lock held, i.e. never concurrently */
+int SharedEncoder::EncodeHandler(uint8_t *dst, size_t *lenp,
+				 struct aufanout_meta *meta,
+				 const int16_t *sampv, size_t sampc,
+				 void *arg)
+{
+	SharedEncoder *shared = (SharedEncoder *)arg;
+	webrtc::AudioEncoder::EncodedInfo info;
+	rtc::Buffer buf;
+	const int bps = shared->target_bps;
+	const float loss = shared->loss;
+
+	if (bps && bps != shared->applied_bps) {
+		shared->enc->OnReceivedUplinkBandwidth(bps, absl::nullopt);
+		shared->applied_bps = bps;
+	}
+	if (loss != shared->applied_loss) {
+		shared->enc->OnReceivedUplinkPacketLossFraction(loss);
+		shared->applied_loss = loss;
+	}
+
+	info = shared->enc->Encode(shared->ts,
+				   rtc::ArrayView<const int16_t>(sampv, sampc),
+				   &buf);
+	shared->ts += shared->enc->RtpTimestampRateHz() / 100;
+
+	if (info.encoded_bytes > *lenp)
+		return EOVERFLOW;
+
+	memcpy(dst, buf.data(), info.encoded_bytes);
+	*lenp = info.encoded_bytes;
+	meta->speech = info.speech;
+	meta->codec = (int)info.encoder_type;
+
+	return 0;
+}
+
+
+SharedAudioEncoder::SharedAudioEncoder(SharedAudioEncoderFactory *factory,
+				       SharedEncoder *shared,
+				       int payload_type) :
+	factory_(factory),
+	shared_(shared),
+	sink_(NULL),
+	payload_type_(payload_type),
+	target_bps_(0),
+	loss_(0.0f)
+{
+	memset(&le_, 0, sizeof(le_));
+}
+
+
+SharedAudioEncoder::~SharedAudioEncoder()
+{
+	if (shared_)
+		factory_->Release(this);
+}
+
+
+int SharedAudioEncoder::Init()
+{
+	return aufanout_sink_alloc(&sink_, shared_->af);
+}
+
+
+/* Once detached, the stream runs an encoder of its own */
+webrtc::AudioEncoder *SharedAudioEncoder::Encoder() const
+{
+	return private_ ? private_.get() : shared_->enc.get();
+}
+
+
+/*
+ * The audio of this stream no longer matches the shared stream.
+ * Leave the shared encoder alone and continue with a private one.
+ */
+int SharedAudioEncoder::Detach()
+{
+	std::unique_ptr<webrtc::AudioEncoder> enc;
+
+	enc = factory_->base_->MakeAudioEncoder(payload_type_,
+						shared_->format,
+						absl::nullopt);
+	if (!enc)
+		return ENOENT;
+
+	if (target_bps_)
+		enc->OnReceivedUplinkBandwidth(target_bps_, absl::nullopt);
+	enc->OnReceivedUplinkPacketLossFraction(loss_);
+
+	warning("shared_audio_encoder(%p): audio diverged from %s, "
+		"using a private encoder\n", this, shared_->key.c_str());
+
+	factory_->Release(this);
+	shared_ = NULL;
+	private_ = std::move(enc);
+
+	return 0;
+}
+
+
+int SharedAudioEncoder::SampleRateHz() const
+{
+	return Encoder()->SampleRateHz();
+}
+
+
+size_t SharedAudioEncoder::NumChannels() const
+{
+	return Encoder()->NumChannels();
+}
+
+
+int SharedAudioEncoder::RtpTimestampRateHz() const
+{
+	return Encoder()->RtpTimestampRateHz();
+}
+
+
+size_t SharedAudioEncoder::Num10MsFramesInNextPacket() const
+{
+	return Encoder()->Num10MsFramesInNextPacket();
+}
+
+
+size_t SharedAudioEncoder::Max10MsFramesInAPacket() const
+{
+	return Encoder()->Max10MsFramesInAPacket();
+}
+
+
+int SharedAudioEncoder::GetTargetBitrate() const
+{
+	return Encoder()->GetTargetBitrate();
+}
+
+
+void SharedAudioEncoder::Reset()
+{
+	/* The shared encoder keeps running for the other peers,
+	 * this stream simply picks up the next frame.
+	 */
+	if (private_)
+		private_->Reset();
+}
+
+
+void SharedAudioEncoder::OnReceivedUplinkPacketLossFraction(
+	float uplink_packet_loss_fraction)
+{
+	loss_ = uplink_packet_loss_fraction;
+
+	if (private_)
+		private_->OnReceivedUplinkPacketLossFraction(loss_);
+	else
+		factory_->UpdateTargets(shared_);
+}
+
+
+void SharedAudioEncoder::OnReceivedUplinkBandwidth(
+	int target_audio_bitrate_bps,
+	absl::optional<int64_t> bwe_period_ms)
+{
+	target_bps_ = target_audio_bitrate_bps;
+
+	if (private_) {
+		private_->OnReceivedUplinkBandwidth(target_audio_bitrate_bps,
+						    bwe_period_ms);
+	}
+	else {
+		factory_->UpdateTargets(shared_);
+	}
+}
+
+
+void SharedAudioEncoder::OnReceivedTargetAudioBitrate(int target_bps)
+{
+	target_bps_ = target_bps;
+
+	if (private_)
+		private_->OnReceivedTargetAudioBitrate(target_bps);
+	else
+		factory_->UpdateTargets(shared_);
+}
+
+
+webrtc::AudioEncoder::EncodedInfo SharedAudioEncoder::EncodeImpl(
+	uint32_t rtp_timestamp,
+	rtc::ArrayView<const int16_t> audio,
+	rtc::Buffer* encoded)
+{
+	EncodedInfo info;
+	struct aufanout_meta meta;
+	size_t len = 0;
+	int err = 0;
+
+	if (private_)
+		return private_->Encode(rtp_timestamp, audio, encoded);
+
+	encoded->AppendData(MAX_PACKET_SIZE,
+			    [&](rtc::ArrayView<uint8_t> dst) {
+		len = dst.size();
+		err = aufanout_encode(sink_, dst.data(), &len, &meta,
+				      audio.data(), audio.size());
+		if (err)
+			len = 0;
+
+		return len;
+	});
+
+	if (err == EPROTO) {
+		err = Detach();
+		if (!err)
+			return private_->Encode(rtp_timestamp, audio, encoded);
+	}
+	if (err) {
+		warning("shared_audio_encoder(%p): encode failed (%m)\n",
+			this, err);
+		return info;
+	}
+	if (!len)
+		return info;
+
+	/* The packet started span-1 chunks before the current one */
+	info.encoded_bytes = len;
+	info.encoded_timestamp = rtp_timestamp
+		- (meta.span - 1) * (RtpTimestampRateHz() / 100);
+	info.payload_type = payload_type_;
+	info.send_even_if_empty = true;
+	info.speech = meta.speech;
+	info.encoder_type = (webrtc::CodecType)meta.codec;
+
+	return info;
+}
+
+
+SharedAudioEncoderFactory::SharedAudioEncoderFactory(
+	rtc::scoped_refptr<webrtc::AudioEncoderFactory> base) :
+	base_(base),
+	lock_(NULL)
+{
+	list_init(&encl_);
+	lock_alloc(&lock_);
+}
+
+
+SharedAudioEncoderFactory::~SharedAudioEncoderFactory()
+{
+	mem_deref(lock_);
+}
+
+
+std::vector<webrtc::AudioCodecSpec>
+SharedAudioEncoderFactory::GetSupportedEncoders()
+{
+	return base_->GetSupportedEncoders();
+}
+
+
+/* The format as the real encoder sees it */
+static webrtc::SdpAudioFormat base_format(const webrtc::SdpAudioFormat& format)
+{
+	webrtc::SdpAudioFormat base(format);
+
+	base.parameters.erase(FANOUT_PARAM);
+
+	return base;
+}
+
+
+absl::optional<webrtc::AudioCodecInfo>
+SharedAudioEncoderFactory::QueryAudioEncoder(
+	const webrtc::SdpAudioFormat& format)
+{
+	return base_->QueryAudioEncoder(base_format(format));
+}
+
+
+static std::string format_key(const webrtc::SdpAudioFormat& format)
+{
+	std::string key = format.name + "/"
+		+ std::to_string(format.clockrate_hz) + "/"
+		+ std::to_string(format.num_channels);
+
+	for (const auto& param : format.parameters)
+		key += ";" + param.first + "=" + param.second;
+
+	return key;
+}
+
+
+std::unique_ptr<webrtc::AudioEncoder>
+SharedAudioEncoderFactory::MakeAudioEncoder(
+	int payload_type,
+	const webrtc::SdpAudioFormat& format,
+	absl::optional<webrtc::AudioCodecPairId> codec_pair_id)
+{
+	std::unique_ptr<SharedAudioEncoder> proxy;
+	SharedEncoder *shared = NULL;
+	const webrtc::SdpAudioFormat bformat = base_format(format);
+	const std::string key = format_key(format);
+	struct le *le;
+	int err = 0;
+
+	/* Only streams marked by MarkShared are shared */
+	if (!lock_ || !format.parameters.count(FANOUT_PARAM)) {
+		return base_->MakeAudioEncoder(payload_type, bformat,
+					       codec_pair_id);
+	}
+
+	lock_write_get(lock_);
+
+	LIST_FOREACH(&encl_, le) {
+		SharedEncoder *enc = (SharedEncoder *)le->data;
+
+		if (enc->key == key) {
+			shared = enc;
+			break;
+		}
+	}
+
+	if (!shared) {
+		std::unique_ptr<webrtc::AudioEncoder> enc;
+
+		enc = base_->MakeAudioEncoder(payload_type, bformat,
+					      absl::nullopt);
+		if (!enc) {
+			err = ENOENT;
+			goto out;
+		}
+
+		shared = new SharedEncoder(std::move(enc), key, bformat);
+		err = shared->Init();
+		if (err) {
+			delete shared;
+			shared = NULL;
+			goto out;
+		}
+
+		list_append(&encl_, &shared->le, shared);
+		info("shared_audio_encoder: new encoder for %s\n",
+		     key.c_str());
+	}
+
+	proxy.reset(new SharedAudioEncoder(this, shared, payload_type));
+	list_append(&shared->proxyl, &proxy->le_, proxy.get());
+
+	err = proxy->Init();
+	if (err)
+		goto out;
+
+	info("shared_audio_encoder: %u stream(s) share %s\n",
+	     list_count(&shared->proxyl), key.c_str());
+
+ out:
+	lock_rel(lock_);
+
+	if (err) {
+		warning("shared_audio_encoder: failed to create encoder "
+			"for %s (%m)\n", key.c_str(), err);
+		/* the proxy destructor releases the shared encoder */
+		proxy.reset();
+		return nullptr;
+	}
+
+	return std::move(proxy);
+}
+
+
+void SharedAudioEncoderFactory::Release(SharedAudioEncoder *proxy)
+{
+	SharedEncoder *shared = proxy->shared_;
+
+	lock_write_get(lock_);
+
+	list_unlink(&proxy->le_);
+	proxy->sink_ = (struct aufanout_sink *)mem_deref(proxy->sink_);
+
+	if (list_isempty(&shared->proxyl)) {
+		list_unlink(&shared->le);
+		delete shared;
+	}
+
+	lock_rel(lock_);
+}
+
+
+/*
+ * Mark the Opus send codecs of a remote description as members of a
+ * fan-out group. The send encoder takes its format from the remote
+ * description, so all PeerConnections that mark the same group, and
+ * negotiate the same parameters, share one encoder.
+ */
+void SharedAudioEncoderFactory::MarkShared(
+	webrtc::SessionDescriptionInterface *sdp,
+	const char *group)
+{
+	cricket::SessionDescription *desc;
+
+	if (!sdp || !group)
+		return;
+
+	desc = sdp->description();
+	if (!desc)
+		return;
+
+	for (cricket::ContentInfo& content : desc->contents()) {
+		cricket::MediaContentDescription *mdesc;
+		cricket::AudioContentDescription *adesc;
+
+		mdesc = content.media_description();
+		if (!mdesc || mdesc->type() != cricket::MEDIA_TYPE_AUDIO)
+			continue;
+
+		adesc = mdesc->as_audio();
+		std::vector<cricket::AudioCodec> codecs = adesc->codecs();
+
+		for (cricket::AudioCodec& codec : codecs) {
+			if (absl::EqualsIgnoreCase(codec.name, "opus"))
+				codec.SetParam(FANOUT_PARAM, group);
+		}
+
+		adesc->set_codecs(codecs);
+	}
+}
+
+
+/* The shared encoder follows the weakest link */
+void SharedAudioEncoderFactory::UpdateTargets(SharedEncoder *shared)
+{
+	int bps = 0;
+	float loss = 0.0f;
+	struct le *le;
+
+	lock_write_get(lock_);
+
+	LIST_FOREACH(&shared->proxyl, le) {
+		const SharedAudioEncoder *proxy =
+			(const SharedAudioEncoder *)le->data;
+
+		if (proxy->target_bps_ && (!bps || proxy->target_bps_ < bps))
+			bps = proxy->target_bps_;
+		if (proxy->loss_ > loss)
+			loss = proxy->loss_;
+	}
+
+	shared->target_bps = bps;
+	shared->loss = loss;
+
+	lock_rel(lock_);
+}
+
+}  // namespace wire
@@ -0,0 +1,77 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef SHARED_AUDIO_ENCODER_H_
+#define SHARED_AUDIO_ENCODER_H_
+
+#include "api/audio_codecs/audio_encoder_factory.h"
+#include "api/jsep.h"
+#include "rtc_base/ref_counted_object.h"
+
+namespace wire {
+
+class SharedEncoder;
+class SharedAudioEncoder;
+
+/*
+ * Audio encoder factory for mesh group calls: every PeerConnection
+ * gets its own encoder object, but all Opus encoders of the same
+ * fan-out group and format share one real encoder through aufanout.
+ * The local track is thus encoded once, while packetization and
+ * frame encryption still happen per peer.
+ *
+ * Only streams whose remote description went through MarkShared
+ * are shared, all others get a plain encoder. A shared stream whose
+ * audio stops matching the others falls back to a private encoder.
+ */
+class SharedAudioEncoderFactory
+	: public rtc::RefCountedObject<webrtc::AudioEncoderFactory>
+{
+public:
+	SharedAudioEncoderFactory(
+		rtc::scoped_refptr<webrtc::AudioEncoderFactory> base);
+	~SharedAudioEncoderFactory();
+
+	std::vector<webrtc::AudioCodecSpec> GetSupportedEncoders() override;
+
+	absl::optional<webrtc::AudioCodecInfo> QueryAudioEncoder(
+		const webrtc::SdpAudioFormat& format) override;
+
+	std::unique_ptr<webrtc::AudioEncoder> MakeAudioEncoder(
+		int payload_type,
+		const webrtc::SdpAudioFormat& format,
+		absl::optional<webrtc::AudioCodecPairId> codec_pair_id) override;
+
+	static void MarkShared(webrtc::SessionDescriptionInterface *sdp,
+			       const char *group);
+
+private:
+	friend class SharedAudioEncoder;
+
+	void Release(SharedAudioEncoder *proxy);
+	void UpdateTargets(SharedEncoder *shared);
+
+	rtc::scoped_refptr<webrtc::AudioEncoderFactory> base_;
+	struct lock *lock_;
+	struct list encl_;
+};
+
+}  // namespace wire
+
+#endif  // SHARED_AUDIO_ENCODER_H_
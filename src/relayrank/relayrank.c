@@ -0,0 +1,419 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_zapi.h"
+#include "avs_turn.h"
+#include "avs_netprobe.h"
+#include "avs_relayrank.h"
+
+
+enum {
+	PROBE_COUNT     = 10,
+	PROBE_INTERVAL  = 20,       /* [ms] */
+
+	LOSS_PENALTY    = 1000,     /* [us] per permille of loss */
+	COST_UNKNOWN    = 500000,   /* not probed yet            */
+	EWMA_SHIFT      = 2,        /* weight of a new sample is 1/4 */
+};
+
+
+struct relayrank {
+	struct list srvl;
+	struct tmr tmr;
+	uint32_t interval;
+	uint32_t pending;
+
+	relayrank_h *h;
+	void *arg;
+};
+
+struct relay {
+	struct le le;
+	struct relayrank *rr;
+	struct zapi_ice_server srv;
+	struct netprobe *np;
+
+	bool measured;
+	bool present;
+	uint32_t rtt;          /* [us], decayed       */
+	uint32_t loss;         /* permille, decayed   */
+	uint32_t nprobes;
+	uint32_t nfailed;
+};
+
+
+static void destructor(void *arg)
+{
+	struct relayrank *rr = arg;
+
+	tmr_cancel(&rr->tmr);
+	list_flush(&rr->srvl);
+}
+
+
+static void relay_destructor(void *arg)
+{
+	struct relay *r = arg;
+
+	list_unlink(&r->le);
+	mem_deref(r->np);
+}
+
+
+static bool relay_cmp_handler(struct le *le, void *arg)
+{
+	const struct relay *r = le->data;
+
+	return streq(r->srv.url, arg);
+}
+
+
+static struct relay *relay_find(const struct relayrank *rr, const char *url)
+{
+	return list_ledata(list_apply(&rr->srvl, true, relay_cmp_handler,
+				      (void *)url));
+}
+
+
+static uint32_t relay_cost(const struct relay *r)
+{
+	if (!r || !r->measured)
+		return COST_UNKNOWN;
+
+	return r->rtt + r->loss * LOSS_PENALTY;
+}
+
+
+static uint32_t ewma(uint32_t avg, uint32_t sample)
+{
+	int64_t d = (int64_t)sample - (int64_t)avg;
+
+	return (uint32_t)((int64_t)avg + d / (1 << EWMA_SHIFT));
+}
+
+
+int relayrank_alloc(struct relayrank **rrp, relayrank_h *h, void *arg)
+{
+	struct relayrank *rr;
+
+	if (!rrp)
+		return EINVAL;
+
+	rr = mem_zalloc(sizeof(*rr), destructor);
+	if (!rr)
+		return ENOMEM;
+
+	list_init(&rr->srvl);
+	tmr_init(&rr->tmr);
+	rr->h = h;
+	rr->arg = arg;
+
+	*rrp = rr;
+
+	return 0;
+}
+
+
+/*
+ * Set the servers to rank. Servers that were known before keep their
+ * score, so that a config refresh does not reset the ranking.
+ */
+int relayrank_set_servers(struct relayrank *rr,
+			  const struct zapi_ice_server *srvv, size_t srvc)
+{
+	struct le *le;
+	size_t i;
+
+	if (!rr || (!srvv && srvc))
+		return EINVAL;
+
+	LIST_FOREACH(&rr->srvl, le) {
+		struct relay *r = le->data;
+
+		r->present = false;
+	}
+
+	for (i = 0; i < srvc; i++) {
+		struct relay *r;
+
+		r = relay_find(rr, srvv[i].url);
+		if (!r) {
+			r = mem_zalloc(sizeof(*r), relay_destructor);
+			if (!r)
+				return ENOMEM;
+
+			r->rr = rr;
+			list_append(&rr->srvl, &r->le, r);
+		}
+
+		/* credentials may have been renewed */
+		r->srv = srvv[i];
+		r->present = true;
+	}
+
+	le = rr->srvl.head;
+	while (le) {
+		struct relay *r = le->data;
+
+		le = le->next;
+
+		if (!r->present) {
+			if (r->np && rr->pending)
+				--rr->pending;
+			mem_deref(r);
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * Feed one probe result into the score of a server. A failed probe
+ * counts as a round with 100% loss.
+ */
+int relayrank_update(struct relayrank *rr, const char *url, int err,
+		     const struct netprobe_result *result)
+{
+	struct relay *r;
+	uint32_t loss = 1000;
+	uint32_t rtt;
+
+	if (!rr || !url || (!err && !result))
+		return EINVAL;
+
+	r = relay_find(rr, url);
+	if (!r)
+		return ENOENT;
+
+	++r->nprobes;
+
+	if (err || !result->n_pkt_sent) {
+		++r->nfailed;
+		rtt = r->measured ? r->rtt : COST_UNKNOWN;
+	}
+	else {
+		loss = (uint32_t)((result->n_pkt_sent - result->n_pkt_recv)
+				  * 1000 / result->n_pkt_sent);
+		rtt = result->n_pkt_recv ? result->rtt_p50
+			: (r->measured ? r->rtt : COST_UNKNOWN);
+	}
+
+	if (r->measured) {
+		r->rtt = ewma(r->rtt, rtt);
+		r->loss = ewma(r->loss, loss);
+	}
+	else {
+		r->rtt = rtt;
+		r->loss = loss;
+		r->measured = true;
+	}
+
+	return 0;
+}
+
+
+uint32_t relayrank_cost(const struct relayrank *rr, const char *url)
+{
+	if (!rr || !url)
+		return COST_UNKNOWN;
+
+	return relay_cost(relay_find(rr, url));
+}
+
+
+/*
+ * Order srvv by cost, cheapest first. The sort is stable, servers
+ * that cost the same keep the order of the call config.
+ */
+int relayrank_sort(const struct relayrank *rr,
+		   struct zapi_ice_server *srvv, size_t srvc)
+{
+	uint32_t *costv;
+	size_t i, j;
+
+	if (!rr || (!srvv && srvc))
+		return EINVAL;
+
+	if (srvc < 2)
+		return 0;
+
+	costv = mem_alloc(srvc * sizeof(*costv), NULL);
+	if (!costv)
+		return ENOMEM;
+
+	for (i = 0; i < srvc; i++)
+		costv[i] = relayrank_cost(rr, srvv[i].url);
+
+	/* a handful of servers, insertion sort is fine */
+	for (i = 1; i < srvc; i++) {
+		struct zapi_ice_server srv = srvv[i];
+		uint32_t cost = costv[i];
+
+		for (j = i; j > 0 && costv[j - 1] > cost; j--) {
+			srvv[j] = srvv[j - 1];
+			costv[j] = costv[j - 1];
+		}
+
+		srvv[j] = srv;
+		costv[j] = cost;
+	}
+
+	mem_deref(costv);
+
+	return 0;
+}
+
+
+#if USE_AVSLIB
+static void probe_round(struct relayrank *rr);
+
+
+static void tmr_handler(void *arg)
+{
+	struct relayrank *rr = arg;
+
+	probe_round(rr);
+}
+
+
+static void netprobe_handler(int err, const struct netprobe_result *result,
+			     void *arg)
+{
+	struct relay *r = arg;
+	struct relayrank *rr = r->rr;
+
+	r->np = mem_deref(r->np);
+
+	relayrank_update(rr, r->srv.url, err, result);
+
+	if (rr->pending && --rr->pending)
+		return;
+
+	info("relayrank(%p): probe round done: %H\n",
+	     rr, relayrank_debug, rr);
+
+	if (rr->h)
+		rr->h(rr->arg);
+}
+
+
+/* Probe all servers in parallel, each over its own transport */
+static void probe_round(struct relayrank *rr)
+{
+	struct le *le;
+
+	tmr_start(&rr->tmr, rr->interval * 1000, tmr_handler, rr);
+
+	if (rr->pending) {
+		info("relayrank(%p): previous round still running\n", rr);
+		return;
+	}
+
+	LIST_FOREACH(&rr->srvl, le) {
+		struct relay *r = le->data;
+		struct stun_uri uri;
+		int err;
+
+		err = stun_uri_decode(&uri, r->srv.url);
+		if (err || uri.scheme != STUN_SCHEME_TURN)
+			continue;
+
+		err = netprobe_alloc(&r->np, &uri.addr,
+				     uri.proto, uri.secure,
+				     r->srv.username, r->srv.credential,
+				     PROBE_COUNT, PROBE_INTERVAL,
+				     netprobe_handler, r);
+		if (err) {
+			warning("relayrank(%p): netprobe_alloc failed for"
+				" %s (%m)\n", rr, r->srv.url, err);
+			relayrank_update(rr, r->srv.url, err, NULL);
+			continue;
+		}
+
+		++rr->pending;
+	}
+}
+#endif
+
+
+/*
+ * Start probing now, and then every interval [seconds] in the
+ * background, until relayrank_stop is called.
+ */
+int relayrank_start(struct relayrank *rr, uint32_t interval)
+{
+	if (!rr || !interval)
+		return EINVAL;
+
+#if USE_AVSLIB
+	rr->interval = interval;
+	probe_round(rr);
+
+	return 0;
+#else
+	return ENOSYS;
+#endif
+}
+
+
+void relayrank_stop(struct relayrank *rr)
+{
+	struct le *le;
+
+	if (!rr)
+		return;
+
+	tmr_cancel(&rr->tmr);
+
+	LIST_FOREACH(&rr->srvl, le) {
+		struct relay *r = le->data;
+
+		r->np = mem_deref(r->np);
+	}
+	rr->pending = 0;
+}
+
+
+int relayrank_debug(struct re_printf *pf, const struct relayrank *rr)
+{
+	struct le *le;
+	int err = 0;
+
+	if (!rr)
+		return 0;
+
+	LIST_FOREACH(&rr->srvl, le) {
+		const struct relay *r = le->data;
+
+		if (!r->measured) {
+			err |= re_hprintf(pf, "\n  %s: not probed", r->srv.url);
+			continue;
+		}
+
+		err |= re_hprintf(pf, "\n  %s: cost=%uus rtt=%uus loss=%u/1000"
+				  " probes=%u failed=%u",
+				  r->srv.url, relay_cost(r), r->rtt,
+				  r->loss, r->nprobes, r->nfailed);
+	}
+
+	return err;
+}
@@ -32,6 +32,7 @@
 
 
 static const struct pl cookie_header = PL("Cookie: ");
+static const struct pl pl_semi       = PL("; ");
 
 static const struct pl param_expires   = PL("expires");
 static const struct pl param_max_age   = PL("max-age");
@@ -41,9 +42,29 @@ static const struct pl param_secure    = PL("secure");
 static const struct pl param_http_only = PL("httponly");
 
 
+enum {
+	COOKIE_HASH_SIZE = 16,
+	SITE_HASH_SIZE   = 8,
+	SITE_MAX         = 32,
+	SAVE_DELAY       = 1000,   /* [ms] */
+};
+
+
+/*
+ * The cookies are kept in a list, in order of creation, and indexed by
+ * domain. The Cookie header for a request only depends on the scheme,
+ * the host and the longest cookie path that matches the request path,
+ * so it is rendered once and cached per site for each such path.
+ * Any change to the stored cookies drops the cache, and so does the
+ * expiry of a cookie that a cached site holds.
+ */
 struct cookie_jar {
 	struct store *store;
 	struct list cookiel;
+	struct hash *cookies;   /* by domain          */
+	struct hash *sites;     /* by scheme://host   */
+	uint32_t nsites;
+	struct tmr tmr_save;
 };
 
 struct raw_cookie {
@@ -61,6 +82,7 @@ struct raw_cookie {
 
 struct stored_cookie {
 	struct le le;
+	struct le he;
 
 	struct pl name;
 	struct pl value;
@@ -75,6 +97,26 @@ struct stored_cookie {
 	bool http_only;
 };
 
+/* All cookies that may go to a scheme://host, longest path first */
+struct cookie_site {
+	struct le he;
+	char *key;
+	struct stored_cookie **cv;
+	size_t cc;
+	time_t expires;         /* earliest of cv, -1 for none */
+	struct list hdrl;
+};
+
+/* The rendered header, for requests where cv[first] is the longest
+ * matching path
+ */
+struct cookie_hdr {
+	struct le le;
+	size_t first;
+	char *str;
+	size_t len;
+};
+
 
 /*** struct stored_cookie
  */
@@ -84,6 +126,7 @@ static void stored_cookie_destructor(void *arg)
 	struct stored_cookie *sc = arg;
 
 	list_unlink(&sc->le);
+	hash_unlink(&sc->he);
 	mem_deref((void *) sc->name.p);
 	mem_deref((void *) sc->value.p);
 	mem_deref((void *) sc->domain.p);
@@ -91,6 +134,14 @@ static void stored_cookie_destructor(void *arg)
 }
 
 
+static void add_cookie(struct cookie_jar *jar, struct stored_cookie *c)
+{
+	list_append(&jar->cookiel, &c->le, c);
+	hash_append(jar->cookies, hash_joaat_ci(c->domain.p, c->domain.l),
+		    &c->he, c);
+}
+
+
 static int load_stored_cookie(struct cookie_jar *jar, struct sobject *so)
 {
 	struct stored_cookie *cookie;
@@ -134,7 +185,7 @@ static int load_stored_cookie(struct cookie_jar *jar, struct sobject *so)
 	cookie->secure = v8 & 0x04;
 	cookie->http_only = v8 & 0x08;
 
-	list_append(&jar->cookiel, &cookie->le, cookie);
+	add_cookie(jar, cookie);
 
  out:
 	if (err)
@@ -201,12 +252,24 @@ static void dump_stored_cookie(const struct stored_cookie *c)
 /*** struct cookie_jar
  */
 
+static int save_cookies(struct cookie_jar *jar);
+
+
 static void cookie_jar_destructor(void *arg)
 {
 	struct cookie_jar *jar = arg;
 
-	mem_deref(jar->store);
+	/* write out a pending save */
+	if (tmr_isrunning(&jar->tmr_save)) {
+		tmr_cancel(&jar->tmr_save);
+		save_cookies(jar);
+	}
+
+	hash_flush(jar->sites);
 	list_flush(&jar->cookiel);
+	mem_deref(jar->sites);
+	mem_deref(jar->cookies);
+	mem_deref(jar->store);
 }
 
 
@@ -257,7 +320,28 @@ static int save_cookies(struct cookie_jar *jar)
 	mem_deref(so);
 	return err;
 }
-	
+
+
+static void save_handler(void *arg)
+{
+	struct cookie_jar *jar = arg;
+	int err;
+
+	err = save_cookies(jar);
+	if (err)
+		warning("cookie: saving cookies failed (%m)\n", err);
+}
+
+
+/* Coalesce the writes of a burst of Set-Cookie headers */
+static void save_later(struct cookie_jar *jar)
+{
+	if (!jar->store || tmr_isrunning(&jar->tmr_save))
+		return;
+
+	tmr_start(&jar->tmr_save, SAVE_DELAY, save_handler, jar);
+}
+
 
 int cookie_jar_alloc(struct cookie_jar **jarp, struct store *store)
 {
@@ -271,6 +355,13 @@ int cookie_jar_alloc(struct cookie_jar **jarp, struct store *store)
 	if (!jar)
 		return ENOMEM;
 
+	tmr_init(&jar->tmr_save);
+
+	err  = hash_alloc(&jar->cookies, COOKIE_HASH_SIZE);
+	err |= hash_alloc(&jar->sites, SITE_HASH_SIZE);
+	if (err)
+		goto out;
+
 	if (store) {
 		jar->store = mem_ref(store);
 		err = load_cookies(jar);
@@ -318,90 +409,354 @@ static bool path_match(const struct pl *str, const struct pl *path)
 	tmp.p = str->p;
 	tmp.l = path->l;
 
-	if (pl_cmp(str, &tmp))
+	if (pl_cmp(&tmp, path))
 		return false;
 
-	return *(tmp.p + tmp.l - 1) == '/' || *(path->p + str->l) == '/';
+	return *(path->p + path->l - 1) == '/' || *(str->p + path->l) == '/';
 }
 
 
-int cookie_jar_print_to_request(struct cookie_jar *jar, struct re_printf *pf,
-				const char *uri)
+/* scheme://host[:port][/path][?query], the path defaults to "/" */
+static int uri_split(const char *uri, struct pl *scheme, struct pl *host,
+		     struct pl *path)
 {
-	struct pl scheme, host, port, path;
-	bool http_scheme, secure;
-	struct le *le;
-	bool printing = false;
+	const char *p;
+	size_t n;
 
-	if (!jar || !pf || !uri)
+	p = strstr(uri, "://");
+	if (!p || p == uri)
 		return EINVAL;
 
-	debug("Cookies for %s:\n", uri);
+	scheme->p = uri;
+	scheme->l = p - uri;
 
-	if (re_regex(uri, strlen(uri), "[a-z]+://[^:/]+[:]*[0-9]*[^?]+",
-		     &scheme, &host, NULL, &port, &path) || scheme.p != uri)
+	host->p = p + 3;
+	host->l = strcspn(host->p, ":/?");
+	if (!host->l)
 		return EINVAL;
 
-	http_scheme = !pl_strcmp(&scheme, "http") ||
-		      !pl_strcmp(&scheme, "https");
+	p = host->p + host->l;
+	p += strcspn(p, "/?");
 
-	/* XXX There are more secure protocols.
+	n = strcspn(p, "?");
+	if (n) {
+		path->p = p;
+		path->l = n;
+	}
+	else {
+		pl_set_str(path, "/");
+	}
+
+	return 0;
+}
+
+
+static void site_destructor(void *arg)
+{
+	struct cookie_site *site = arg;
+
+	hash_unlink(&site->he);
+	list_flush(&site->hdrl);
+	mem_deref(site->cv);
+	mem_deref(site->key);
+}
+
+
+static void hdr_destructor(void *arg)
+{
+	struct cookie_hdr *hdr = arg;
+
+	list_unlink(&hdr->le);
+	mem_deref(hdr->str);
+}
+
+
+static void cache_flush(struct cookie_jar *jar)
+{
+	hash_flush(jar->sites);
+	jar->nsites = 0;
+}
+
+
+/* An expiry of -1 is a session cookie, which does not expire */
+static bool expired(time_t expires, time_t now)
+{
+	return expires != (time_t)-1 && expires < now;
+}
+
+
+/* Remove the expired cookies, the cached headers may point at them */
+static void remove_expired(struct cookie_jar *jar, time_t now)
+{
+	struct le *le;
+	bool removed = false;
+
+	le = list_head(&jar->cookiel);
+	while (le) {
+		struct stored_cookie *c = le->data;
+
+		le = le->next;
+
+		if (expired(c->expires, now)) {
+			mem_deref(c);
+			removed = true;
+		}
+	}
+
+	if (removed) {
+		cache_flush(jar);
+		save_later(jar);
+	}
+}
+
+
+static void site_add(struct cookie_site *site, struct stored_cookie *c)
+{
+	size_t i;
+
+	if (c->expires != (time_t)-1 &&
+	    (site->expires == (time_t)-1 || c->expires < site->expires))
+		site->expires = c->expires;
+
+	/* RFC 6265, section 5.4, step 2: longer paths first, then
+	 * earlier creation times first.
 	 */
-	secure = !pl_strcmp(&scheme, "https") || !pl_strcmp(&scheme, "wss");
+	for (i = site->cc; i > 0; i--) {
+		const struct stored_cookie *prev = site->cv[i - 1];
+
+		if (prev->path.l > c->path.l ||
+		    (prev->path.l == c->path.l && prev->created <= c->created))
+			break;
+
+		site->cv[i] = site->cv[i - 1];
+	}
+
+	site->cv[i] = c;
+	++site->cc;
+}
+
+
+/* Collect the cookies of the host and of each of its parent domains */
+static int site_alloc(struct cookie_site **sitep, struct cookie_jar *jar,
+		      const struct pl *key, const struct pl *scheme,
+		      const struct pl *host)
+{
+	struct cookie_site *site;
+	bool http_scheme, secure;
+	struct pl d = *host;
+	time_t now = time(NULL);
+	int err;
+
+	site = mem_zalloc(sizeof(*site), site_destructor);
+	if (!site)
+		return ENOMEM;
+
+	site->expires = (time_t)-1;
+
+	err = pl_strdup(&site->key, key);
+	if (err)
+		goto out;
 
-	/* Add cookies according to RFC 6265, section 5.4.
+	site->cv = mem_zalloc((list_count(&jar->cookiel) + 1)
+			      * sizeof(*site->cv), NULL);
+	if (!site->cv) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	http_scheme = !pl_strcmp(scheme, "http") ||
+		      !pl_strcmp(scheme, "https");
+
+	/* XXX There are more secure protocols.
 	 */
-	LIST_FOREACH(&jar->cookiel, le) {
-		struct stored_cookie *c = le->data;
+	secure = !pl_strcmp(scheme, "https") || !pl_strcmp(scheme, "wss");
 
-		/* Step 1.
-		 */
-		if (c->host_only) {
-			if (pl_cmp(&host, &c->domain))
+	for (;;) {
+		const char *dot;
+		struct le *le;
+
+		LIST_FOREACH(hash_list(jar->cookies,
+				       hash_joaat_ci(d.p, d.l)), le) {
+			struct stored_cookie *c = le->data;
+
+			if (pl_casecmp(&c->domain, &d))
 				continue;
-		}
-		else {
-			if (!domain_match(&host, &c->domain)) {
+
+			if (c->host_only && d.l != host->l)
 				continue;
-			}
+
+			if (c->secure && !secure)
+				continue;
+
+			if (c->http_only && !http_scheme)
+				continue;
+
+			if (expired(c->expires, now))
+				continue;
+
+			site_add(site, c);
 		}
 
-		if (!path_match(&path, &c->path))
-			continue;
+		dot = pl_strchr(&d, '.');
+		if (!dot)
+			break;
 
-		if (c->secure && !secure)
-			continue;
+		pl_advance(&d, dot + 1 - d.p);
+	}
 
-		if (c->http_only && !http_scheme)
-			continue;
+	if (jar->nsites >= SITE_MAX)
+		cache_flush(jar);
 
-		/* Step 2.
-		 *
-		 * XXX We don't sort yet. We should probably keep
-		 *     jar->cookiel in the order specified by step 2.
-		 */
+	hash_append(jar->sites, hash_joaat_ci(key->p, key->l),
+		    &site->he, site);
+	++jar->nsites;
+
+ out:
+	if (err)
+		mem_deref(site);
+	else
+		*sitep = site;
+
+	return err;
+}
+
+
+static struct cookie_site *site_find(const struct cookie_jar *jar,
+				     const struct pl *key)
+{
+	struct le *le;
+
+	LIST_FOREACH(hash_list(jar->sites, hash_joaat_ci(key->p, key->l)), le) {
+		struct cookie_site *site = le->data;
+
+		if (!pl_strcasecmp(key, site->key))
+			return site;
+	}
+
+	return NULL;
+}
+
+
+/* Add cookies according to RFC 6265, section 5.4. */
+static int hdr_alloc(struct cookie_hdr **hdrp, struct cookie_site *site,
+		     size_t first)
+{
+	const struct pl *path = &site->cv[first]->path;
+	struct cookie_hdr *hdr;
+	struct mbuf *mb;
+	time_t now = time(NULL);
+	size_t i;
+	int err = 0;
+
+	mb = mbuf_alloc(256);
+	hdr = mem_zalloc(sizeof(*hdr), hdr_destructor);
+	if (!mb || !hdr) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	debug("Cookies for %s%r:\n", site->key, path);
+
+	/* cookies before first have longer paths, and do not match */
+	for (i = first; i < site->cc; i++) {
+		struct stored_cookie *c = site->cv[i];
+
+		if (i != first && !path_match(path, &c->path))
+			continue;
 
 		/* Step 3.
 		 */
-		c->last_access = time(NULL);
+		c->last_access = now;
 
 		/* Step 4.
 		 */
-		if (!printing) {
-			pf->vph(cookie_header.p, cookie_header.l, pf->arg);
-			printing = true;
-		}
-		else
-			pf->vph("; ", 2, pf->arg);
+		err |= mbuf_printf(mb, "%r%r=%r",
+				   i == first ? &cookie_header : &pl_semi,
+				   &c->name, &c->value);
 		debug("\t%r=%r\n", &c->name, &c->value);
-		pf->vph(c->name.p, c->name.l, pf->arg);
-		pf->vph("=", 1, pf->arg);
-		pf->vph(c->value.p, c->value.l, pf->arg);
 	}
-	if (printing)
-		pf->vph("\r\n", 2, pf->arg);
+	err |= mbuf_write_str(mb, "\r\n");
+	if (err)
+		goto out;
 
-	return 0;
+	hdr->first = first;
+	hdr->len = mb->end;
+	mb->pos = 0;
+	err = mbuf_strdup(mb, &hdr->str, hdr->len);
+	if (err)
+		goto out;
+
+	list_append(&site->hdrl, &hdr->le, hdr);
+
+ out:
+	mem_deref(mb);
+	if (err)
+		mem_deref(hdr);
+	else
+		*hdrp = hdr;
+
+	return err;
+}
+
+
+int cookie_jar_print_to_request(struct cookie_jar *jar, struct re_printf *pf,
+				const char *uri)
+{
+	struct pl scheme, host, path, key;
+	struct cookie_site *site;
+	struct cookie_hdr *hdr = NULL;
+	struct le *le;
+	time_t now = time(NULL);
+	size_t first;
+	int err;
+
+	if (!jar || !pf || !uri)
+		return EINVAL;
+
+	err = uri_split(uri, &scheme, &host, &path);
+	if (err)
+		return err;
+
+	key.p = uri;
+	key.l = host.p + host.l - uri;
+
+	site = site_find(jar, &key);
+
+	/* a cookie of the site expired, its headers are stale */
+	if (site && expired(site->expires, now)) {
+		remove_expired(jar, now);
+		site = NULL;
+	}
+
+	if (!site) {
+		err = site_alloc(&site, jar, &key, &scheme, &host);
+		if (err)
+			return err;
+	}
+
+	for (first = 0; first < site->cc; first++) {
+		if (path_match(&path, &site->cv[first]->path))
+			break;
+	}
+	if (first == site->cc)
+		return 0;
+
+	LIST_FOREACH(&site->hdrl, le) {
+		struct cookie_hdr *h = le->data;
+
+		if (h->first == first) {
+			hdr = h;
+			break;
+		}
+	}
+
+	if (!hdr) {
+		err = hdr_alloc(&hdr, site, first);
+		if (err)
+			return err;
+	}
+
+	return pf->vph(hdr->str, hdr->len, pf->arg);
 }
 
 
@@ -611,7 +966,7 @@ static int process_set_cookie(struct cookie_jar *jar, const struct pl *hval,
 			      const char *uri)
 {
 	struct raw_cookie rawc;
-	struct pl scheme, host, port, path;
+	struct pl scheme, host, path;
 	bool http_scheme;
 	struct stored_cookie *newc = NULL;
 	struct le *le;
@@ -626,9 +981,9 @@ static int process_set_cookie(struct cookie_jar *jar, const struct pl *hval,
 	if (err)
 		return err;
 
-	if (re_regex(uri, strlen(uri), "[a-z]+://[^:/]+[:]*[0-9]*[^?]+",
-		     &scheme, &host, NULL, &port, &path) || scheme.p != uri)
-		return EINVAL;
+	err = uri_split(uri, &scheme, &host, &path);
+	if (err)
+		return err;
 
 	http_scheme = !pl_strcmp(&scheme, "http") ||
 		      !pl_strcmp(&scheme, "https");
@@ -730,7 +1085,11 @@ static int process_set_cookie(struct cookie_jar *jar, const struct pl *hval,
 	}
 
 	/* Step 11.
+	 *
+	 * The cached headers point at the stored cookies.
 	 */
+	cache_flush(jar);
+
 	le = list_head(&jar->cookiel);
 	while (le) {
 		struct stored_cookie *oldc = le->data;
@@ -755,7 +1114,7 @@ static int process_set_cookie(struct cookie_jar *jar, const struct pl *hval,
 			 */
 			mem_deref(oldc);
 		}
-		else if (oldc->expires < now) {
+		else if (expired(oldc->expires, now)) {
 			mem_deref(oldc);
 		}
 		le = next;
@@ -763,9 +1122,8 @@ static int process_set_cookie(struct cookie_jar *jar, const struct pl *hval,
 
 	/* Step 12.
 	 */
-	list_append(&jar->cookiel, &newc->le, newc);
-	if (jar->store)
-		save_cookies(jar);
+	add_cookie(jar, newc);
+	save_later(jar);
 	dump_stored_cookie(newc);
 	debug(": added.\n");
 
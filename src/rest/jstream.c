@@ -0,0 +1,348 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <re.h>
+#include "avs_log.h"
+#include "avs_jzon.h"
+#include "avs_store.h"
+#include "avs_rest.h"
+
+
+enum {
+	KEY_MAX  = 64,
+	ENV_SIZE = 256,
+};
+
+
+/**
+ * Incremental JSON array splitter
+ *
+ * The body is fed in as it arrives from the network. Each element of
+ * the streamed array is decoded as soon as its last byte is seen and
+ * handed to the item handler, and then dropped. Everything else is
+ * kept as the envelope, which then holds the body with an empty
+ * array in place of the streamed one:
+ *
+ *    body       {"conversations":[{..},{..},{..}],"has_more":true}
+ *
+ *    items                        {..} {..} {..}
+ *
+ *    envelope   {"conversations":[],"has_more":true}
+ *
+ * The streamed array is the top-level value when no key is given,
+ * or the value of the key in the top-level object otherwise. Its
+ * elements must be objects or arrays.
+ */
+struct jstream {
+	struct mbuf *env;
+	struct mbuf *item;
+	char *key;
+	size_t keylen;
+
+	jstream_item_h *itemh;
+	void *arg;
+
+	size_t depth;
+	size_t arr_depth;       /* depth inside the streamed array */
+	size_t count;
+	bool instr;
+	bool esc;
+	bool in_arr;
+	bool in_item;
+	bool done;
+
+	/* the last key of the top-level object */
+	char keybuf[KEY_MAX];
+	size_t keybuf_len;
+	bool collect;
+	bool key_match;
+};
+
+enum dest {
+	DEST_ENV,
+	DEST_ITEM,
+	DEST_NONE,
+};
+
+
+static void destructor(void *arg)
+{
+	struct jstream *js = arg;
+
+	mem_deref(js->env);
+	mem_deref(js->item);
+	mem_deref(js->key);
+}
+
+
+int jstream_alloc(struct jstream **jsp, const char *key,
+		  jstream_item_h *itemh, void *arg)
+{
+	struct jstream *js;
+	int err = 0;
+
+	if (!jsp || !itemh)
+		return EINVAL;
+
+	js = mem_zalloc(sizeof(*js), destructor);
+	if (!js)
+		return ENOMEM;
+
+	js->env = mbuf_alloc(ENV_SIZE);
+	js->item = mbuf_alloc(ENV_SIZE);
+	if (!js->env || !js->item) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	if (key) {
+		err = str_dup(&js->key, key);
+		if (err)
+			goto out;
+
+		js->keylen = strlen(key);
+	}
+
+	js->itemh = itemh;
+	js->arg = arg;
+
+ out:
+	if (err)
+		mem_deref(js);
+	else
+		*jsp = js;
+
+	return err;
+}
+
+
+static enum dest cur_dest(const struct jstream *js)
+{
+	if (js->in_item)
+		return DEST_ITEM;
+
+	return js->in_arr ? DEST_NONE : DEST_ENV;
+}
+
+
+static int put(struct jstream *js, enum dest dest,
+	       const uint8_t *p, size_t len)
+{
+	if (!len)
+		return 0;
+
+	switch (dest) {
+
+	case DEST_ENV:
+		return mbuf_write_mem(js->env, p, len);
+
+	case DEST_ITEM:
+		return mbuf_write_mem(js->item, p, len);
+
+	default:
+		return 0;
+	}
+}
+
+
+static int item_complete(struct jstream *js)
+{
+	struct json_object *jobj;
+	int err;
+
+	err = jzon_decode(&jobj, (char *)js->item->buf, js->item->end);
+	if (err) {
+		warning("jstream: item %zu: decode failed (%m)\n",
+			js->count, err);
+		return err;
+	}
+
+	mbuf_rewind(js->item);
+	++js->count;
+
+	js->itemh(jobj, js->arg);
+
+	mem_deref(jobj);
+
+	return 0;
+}
+
+
+static bool is_target(const struct jstream *js)
+{
+	if (js->done)
+		return false;
+
+	if (js->key)
+		return js->depth == 1 && js->key_match;
+	else
+		return js->depth == 0;
+}
+
+
+int jstream_write(struct jstream *js, const uint8_t *buf, size_t len)
+{
+	enum dest span;
+	size_t i, start = 0;
+	int err;
+
+	if (!js || (!buf && len))
+		return EINVAL;
+
+	span = cur_dest(js);
+
+	for (i = 0; i < len; i++) {
+		const uint8_t c = buf[i];
+		enum dest dest = cur_dest(js);
+		bool complete = false;
+
+		if (js->instr) {
+			if (js->esc)
+				js->esc = false;
+			else if (c == '\\')
+				js->esc = true;
+			else if (c == '"')
+				js->instr = false;
+
+			if (js->collect && js->instr) {
+				if (js->keybuf_len < sizeof(js->keybuf))
+					js->keybuf[js->keybuf_len] = c;
+				++js->keybuf_len;
+			}
+			else if (js->collect) {
+				js->collect = false;
+				js->key_match = js->keybuf_len == js->keylen
+					&& js->keylen <= sizeof(js->keybuf)
+					&& 0 == memcmp(js->keybuf, js->key,
+						       js->keylen);
+			}
+		}
+		else switch (c) {
+
+		case '"':
+			if (js->in_arr && !js->in_item)
+				return EPROTO;
+
+			js->instr = true;
+			js->key_match = false;
+
+			if (js->key && js->depth == 1 && !js->in_arr) {
+				js->collect = true;
+				js->keybuf_len = 0;
+			}
+			break;
+
+		case '{':
+		case '[':
+			if (js->in_arr && !js->in_item) {
+				js->in_item = true;
+				dest = DEST_ITEM;
+			}
+			else if (c == '[' && is_target(js)) {
+				js->in_arr = true;
+				js->arr_depth = js->depth + 1;
+			}
+
+			++js->depth;
+			js->key_match = false;
+			break;
+
+		case '}':
+		case ']':
+			if (!js->depth)
+				return EBADMSG;
+
+			--js->depth;
+
+			if (js->in_item && js->depth == js->arr_depth) {
+				js->in_item = false;
+				complete = true;
+			}
+			else if (js->in_arr && !js->in_item) {
+				js->in_arr = false;
+				js->done = true;
+				dest = DEST_ENV;
+			}
+
+			js->key_match = false;
+			break;
+
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+		case ':':
+			break;
+
+		case ',':
+			js->key_match = false;
+			break;
+
+		default:
+			if (js->in_arr && !js->in_item)
+				return EPROTO;
+
+			js->key_match = false;
+			break;
+		}
+
+		if (dest != span) {
+			err = put(js, span, &buf[start], i - start);
+			if (err)
+				return err;
+
+			start = i;
+			span = dest;
+		}
+
+		if (complete) {
+			err = put(js, DEST_ITEM, &buf[start], i + 1 - start);
+			if (err)
+				return err;
+
+			err = item_complete(js);
+			if (err)
+				return err;
+
+			start = i + 1;
+			span = cur_dest(js);
+		}
+	}
+
+	return put(js, span, &buf[start], len - start);
+}
+
+
+/* The body without the streamed items, once the last byte is written */
+struct mbuf *jstream_envelope(const struct jstream *js)
+{
+	return js ? js->env : NULL;
+}
+
+
+size_t jstream_count(const struct jstream *js)
+{
+	return js ? js->count : 0;
+}
+
+
+size_t jstream_buffered(const struct jstream *js)
+{
+	return js ? js->env->size + js->item->size : 0;
+}
@@ -5,5 +5,6 @@
 AVS_SRCS += \
 	rest/chunk.c \
 	rest/cookie.c \
+	rest/jstream.c \
 	rest/login.c \
 	rest/rest.c
@@ -19,6 +19,9 @@
 #include <assert.h>
 #include <ctype.h>
 #include <re.h>
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
 #include "avs_version.h"
 #include "avs_jzon.h"
 #include "avs_log.h"
@@ -28,6 +31,20 @@
 
 #define REST_MAGIC 0x0e5100a3
 
+#ifdef USE_ZLIB
+#define ACCEPT_ENCODING "Accept-Encoding: gzip\r\n"
+#else
+#define ACCEPT_ENCODING ""
+#endif
+
+enum {
+	HEAP_MIN        = 16,
+	PRIO_AGE        = 1000,     /* [ms] queued per prio level caught up */
+	BODY_SIZE       = 1024,
+	BODY_PREALLOC   = 1 << 20,  /* cap for Content-Length preallocation */
+	INFLATE_SIZE    = 4096,
+};
+
 
 struct rest_cli {
 	struct http_cli *http_cli;
@@ -35,16 +52,36 @@ struct rest_cli {
 	struct login_token login_token;
 	struct cookie_jar *jar;
 	struct list openl;
+	struct list hostl;
 	size_t maxopen;
 	char *user_agent;
-	struct list reql;
+	uint64_t seq;
+	uint32_t prio_age;
 	bool shutdown;
+
+	struct rest_stats stats;
+};
+
+/*
+ * One scheduling pool per host. Requests wait in a binary heap ordered
+ * by deadline, see req_before(), and at most maxopen of them are in
+ * flight, so that the http_cli keeps reusing the same set of
+ * keep-alive connections to the host.
+ */
+struct rest_host {
+	struct le le;
+	char *name;
+	struct rest_req **heapv;
+	size_t heapc;
+	size_t heapsz;
+	size_t nopen;
 };
 
 struct rest_req {
 	uint32_t magic;
 	struct le le;
 	struct rest_cli *rest_cli;
+	struct rest_host *host;
 	struct rest_req **reqp;
 	struct http_req *http_req;
 	struct http_msg *msg;
@@ -55,12 +92,23 @@ struct rest_req {
 	char *header;
 	char *ctype;
 	struct mbuf *req_body;
+	struct jstream *js;
+	char *items_key;
+	jstream_item_h *itemh;
+#ifdef USE_ZLIB
+	z_stream *zs;
+#endif
 	bool json;
 	bool raw;
+	bool queued;
 	int prio;
+	uint64_t seq;
+	int64_t deadline;
+	size_t hidx;
 	rest_resp_h *resph;
 	void *arg;
 
+	uint64_t ts_queued;
 	uint64_t ts_req;
 	uint64_t ts_resp;
 };
@@ -90,6 +138,209 @@ static void flush_requests(struct list *lst)
 }
 
 
+/*** request heap
+ */
+
+/*
+ * A request is due prio * prio_age after it was queued. Lower prio
+ * still goes first, but a queued request is only overtaken by
+ * requests queued less than its own delay after it, so a steady
+ * stream of high prio requests can not starve it.
+ */
+static bool req_before(const struct rest_req *a, const struct rest_req *b)
+{
+	if (a->deadline != b->deadline)
+		return a->deadline < b->deadline;
+
+	return a->seq < b->seq;
+}
+
+
+static void heap_set(struct rest_host *host, size_t i, struct rest_req *req)
+{
+	host->heapv[i] = req;
+	req->hidx = i;
+}
+
+
+static void heap_up(struct rest_host *host, size_t i)
+{
+	struct rest_req *req = host->heapv[i];
+
+	while (i > 0) {
+		const size_t parent = (i - 1) / 2;
+
+		if (!req_before(req, host->heapv[parent]))
+			break;
+
+		heap_set(host, i, host->heapv[parent]);
+		i = parent;
+	}
+
+	heap_set(host, i, req);
+}
+
+
+static void heap_down(struct rest_host *host, size_t i)
+{
+	struct rest_req *req = host->heapv[i];
+
+	for (;;) {
+		size_t child = 2 * i + 1;
+
+		if (child >= host->heapc)
+			break;
+
+		if (child + 1 < host->heapc &&
+		    req_before(host->heapv[child + 1], host->heapv[child]))
+			++child;
+
+		if (!req_before(host->heapv[child], req))
+			break;
+
+		heap_set(host, i, host->heapv[child]);
+		i = child;
+	}
+
+	heap_set(host, i, req);
+}
+
+
+static int heap_push(struct rest_host *host, struct rest_req *req)
+{
+	if (host->heapc >= host->heapsz) {
+		const size_t sz = host->heapsz ? 2 * host->heapsz : HEAP_MIN;
+		struct rest_req **heapv;
+
+		heapv = mem_realloc(host->heapv, sz * sizeof(*heapv));
+		if (!heapv)
+			return ENOMEM;
+
+		host->heapv = heapv;
+		host->heapsz = sz;
+	}
+
+	heap_set(host, host->heapc++, req);
+	heap_up(host, req->hidx);
+
+	req->queued = true;
+	++req->rest_cli->stats.queued;
+
+	return 0;
+}
+
+
+static void heap_remove(struct rest_host *host, struct rest_req *req)
+{
+	const size_t i = req->hidx;
+
+	if (!req->queued)
+		return;
+
+	req->queued = false;
+	--req->rest_cli->stats.queued;
+
+	if (i != --host->heapc) {
+		heap_set(host, i, host->heapv[host->heapc]);
+		heap_down(host, i);
+		heap_up(host, i);
+	}
+}
+
+
+static struct rest_req *heap_pop(struct rest_host *host)
+{
+	struct rest_req *req;
+
+	if (!host->heapc)
+		return NULL;
+
+	req = host->heapv[0];
+	heap_remove(host, req);
+
+	return req;
+}
+
+
+/*** request hosts
+ */
+
+static void host_destructor(void *arg)
+{
+	struct rest_host *host = arg;
+
+	list_unlink(&host->le);
+	mem_deref(host->heapv);
+	mem_deref(host->name);
+}
+
+
+/* scheme://host[:port] part of the URI, the key of the pool */
+static void uri_host(struct pl *pl, const char *uri)
+{
+	const char *p, *end;
+
+	p = strstr(uri, "://");
+	p = p ? p + 3 : uri;
+
+	end = strchr(p, '/');
+
+	pl->p = uri;
+	pl->l = end ? (size_t)(end - uri) : strlen(uri);
+}
+
+
+static int host_get(struct rest_host **hostp, struct rest_cli *cli,
+		    const char *uri)
+{
+	struct rest_host *host;
+	struct pl name;
+	struct le *le;
+	int err;
+
+	uri_host(&name, uri);
+
+	LIST_FOREACH(&cli->hostl, le) {
+		host = le->data;
+
+		if (0 == pl_strcasecmp(&name, host->name)) {
+			*hostp = host;
+			return 0;
+		}
+	}
+
+	host = mem_zalloc(sizeof(*host), host_destructor);
+	if (!host)
+		return ENOMEM;
+
+	err = pl_strdup(&host->name, &name);
+	if (err) {
+		mem_deref(host);
+		return err;
+	}
+
+	list_append(&cli->hostl, &host->le, host);
+
+	*hostp = host;
+
+	return 0;
+}
+
+
+static void flush_queued(struct rest_cli *cli)
+{
+	struct le *le;
+
+	LIST_FOREACH(&cli->hostl, le) {
+		struct rest_host *host = le->data;
+		struct rest_req *req;
+
+		while ((req = heap_pop(host)))
+			req_close(req, ECONNABORTED, NULL, NULL, NULL);
+	}
+}
+
+
 /*** rest_client_alloc
  */
 
@@ -100,8 +351,9 @@ static void cli_destructor(void *arg)
 	rest->shutdown = true;
 
 	flush_requests(&rest->openl);
-	flush_requests(&rest->reql);
+	flush_queued(rest);
 
+	list_flush(&rest->hostl);
 	mem_deref(rest->jar);
 	mem_deref(rest->http_cli);
 	mem_deref(rest->server_uri);
@@ -136,6 +388,7 @@ int rest_client_alloc(struct rest_cli **restp, struct http_cli *http_cli,
 	}
 
 	rest->maxopen = maxopen;
+	rest->prio_age = PRIO_AGE;
 
 	if (user_agent)
 		err = str_dup(&rest->user_agent, user_agent);
@@ -155,36 +408,29 @@ int rest_client_alloc(struct rest_cli **restp, struct http_cli *http_cli,
 
 static void wake_request(struct rest_req *req);
 
-static void trigger_queue(struct rest_cli *cli)
+static void trigger_queue(struct rest_host *host, size_t maxopen)
 {
-	struct le *le;
-	struct rest_req *rq = NULL;
-
-	debug("trigger_queue: reql %i, openl %i.\n",
-	      (int) list_count(&cli->reql), (int) list_count(&cli->openl));
-
-	if (list_isempty(&cli->reql)
-	    || list_count(&cli->openl) >= cli->maxopen)
-	{
-		return;
-	}
-
-	LIST_FOREACH(&cli->reql, le) {
-		struct rest_req *rrq = le->data;
+	debug("trigger_queue: %s: queued %zu, open %zu.\n",
+	      host->name, host->heapc, host->nopen);
 
-		if (!rq || rrq->prio < rq->prio)
-			rq = rrq;
-	}
-	list_unlink(&rq->le);
-
-	wake_request(rq);
-}	
+	while (host->heapc && host->nopen < maxopen)
+		wake_request(heap_pop(host));
+}
 
 
 static void req_destructor(void *arg)
 {
 	struct rest_req *req = arg;
 
+	if (req->host) {
+		heap_remove(req->host, req);
+
+		if (req->le.list) {
+			--req->host->nopen;
+			--req->rest_cli->stats.inflight;
+		}
+	}
+
 	list_unlink(&req->le);
 	mem_deref(req->http_req);
 	mem_deref(req->method);
@@ -195,6 +441,11 @@ static void req_destructor(void *arg)
 	mem_deref(req->req_body);
 	mem_deref(req->msg);
 	mem_deref(req->mb_body);
+	mem_deref(req->js);
+	mem_deref(req->items_key);
+#ifdef USE_ZLIB
+	mem_deref(req->zs);
+#endif
 }
 
 
@@ -203,6 +454,7 @@ static void req_close(struct rest_req *req, int err,
 		      struct json_object *jobj)
 {
 	struct rest_cli *cli = req->rest_cli;
+	struct rest_host *host = req->host;
 
 	debug("rest: [%s %s] request closed\n", req->method, req->path);
 
@@ -219,8 +471,8 @@ static void req_close(struct rest_req *req, int err,
 	}
 	mem_deref(req);
 
-	if (!cli->shutdown)
-		trigger_queue(cli);
+	if (host && !cli->shutdown)
+		trigger_queue(host, cli->maxopen);
 }
 
 
@@ -231,6 +483,12 @@ static void response(struct rest_req *req, const struct http_msg *msg,
 	size_t len;
 	int err;
 
+	/* the streamed items are already handed out, decode the rest */
+	if (req->js) {
+		mb = jstream_envelope(req->js);
+		mb->pos = 0;
+	}
+
 	len = mbuf_get_left(mb);
 
 	/* Optional parsing of JSON body here */
@@ -257,6 +515,130 @@ static void response(struct rest_req *req, const struct http_msg *msg,
 }
 
 
+static bool msg_is_json(const struct http_msg *msg)
+{
+	return 0 == pl_strcasecmp(&msg->ctyp.type, "application") &&
+		0 == pl_strcasecmp(&msg->ctyp.subtype, "json");
+}
+
+
+#ifdef USE_ZLIB
+static void zs_destructor(void *arg)
+{
+	z_stream *zs = arg;
+
+	inflateEnd(zs);
+}
+
+
+static int inflate_alloc(z_stream **zsp)
+{
+	z_stream *zs;
+
+	/* inflateEnd is safe on a stream that failed to init */
+	zs = mem_zalloc(sizeof(*zs), zs_destructor);
+	if (!zs)
+		return ENOMEM;
+
+	/* 16 + MAX_WBITS: expect the gzip wrapper */
+	if (Z_OK != inflateInit2(zs, 16 + MAX_WBITS)) {
+		mem_deref(zs);
+		return ENOMEM;
+	}
+
+	*zsp = zs;
+
+	return 0;
+}
+#endif
+
+
+static int body_alloc(struct rest_req *req, const struct http_msg *msg,
+		      bool chunked)
+{
+	size_t sz = BODY_SIZE;
+
+#ifdef USE_ZLIB
+	if (http_msg_hdr_has_value(msg, HTTP_HDR_CONTENT_ENCODING, "gzip")) {
+		int err = inflate_alloc(&req->zs);
+		if (err)
+			return err;
+	}
+#endif
+
+	/* error responses are buffered, so that the caller sees them */
+	if (req->itemh && msg->scode < 300 && msg_is_json(msg)) {
+		return jstream_alloc(&req->js, req->items_key,
+				     req->itemh, req->arg);
+	}
+
+	/* size the body from Content-Length, instead of growing it */
+	if (!chunked && msg->clen > sz)
+		sz = min(msg->clen, (size_t)BODY_PREALLOC);
+
+	req->mb_body = mbuf_alloc(sz);
+	if (!req->mb_body)
+		return ENOMEM;
+
+	return 0;
+}
+
+
+static int body_append(struct rest_req *req, const uint8_t *buf, size_t size)
+{
+	struct rest_stats *stats = &req->rest_cli->stats;
+	size_t buffered;
+	int err;
+
+	if (req->js) {
+		err = jstream_write(req->js, buf, size);
+		buffered = jstream_buffered(req->js);
+	}
+	else {
+		err = mbuf_write_mem(req->mb_body, buf, size);
+		buffered = req->mb_body->size;
+	}
+
+	stats->body_max = max(stats->body_max, buffered);
+
+	return err;
+}
+
+
+#ifdef USE_ZLIB
+static int body_inflate(struct rest_req *req, const uint8_t *buf,
+			size_t size)
+{
+	uint8_t out[INFLATE_SIZE];
+	z_stream *zs = req->zs;
+	int ret, err;
+
+	zs->next_in = (uint8_t *)buf;
+	zs->avail_in = (uInt)size;
+
+	do {
+		zs->next_out = out;
+		zs->avail_out = sizeof(out);
+
+		ret = inflate(zs, Z_NO_FLUSH);
+		if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+			warning("rest: [%s %s] inflate failed (%s)\n",
+				req->method, req->path,
+				zs->msg ? zs->msg : "?");
+			return EBADMSG;
+		}
+
+		err = body_append(req, out, sizeof(out) - zs->avail_out);
+		if (err)
+			return err;
+
+	} while (ret != Z_STREAM_END && (zs->avail_in || !zs->avail_out));
+
+	return 0;
+}
+#endif
+
+
 /* NOTE: dont call response_complete() from here! */
 static int http_data_handler(const uint8_t *buf, size_t size,
 			     const struct http_msg *msg, void *arg)
@@ -269,19 +651,21 @@ static int http_data_handler(const uint8_t *buf, size_t size,
 
 	chunked = http_msg_hdr_has_value(msg, HTTP_HDR_TRANSFER_ENCODING,
 					 "chunked");
-	
-	if (!req->mb_body) {
-		req->mb_body = mbuf_alloc(1024);
-		if (!req->mb_body) {
-			err = ENOMEM;
+
+	if (!req->mb_body && !req->js) {
+		err = body_alloc(req, msg, chunked);
+		if (err)
 			goto out;
-		}
 	}
 
-	/* append data to the body-buffer */
-	err = mbuf_write_mem(req->mb_body, buf, size);
+#ifdef USE_ZLIB
+	if (req->zs)
+		err = body_inflate(req, buf, size);
+	else
+#endif
+		err = body_append(req, buf, size);
 	if (err)
-		return err;
+		goto out;
 
 	debug("rest: [%s %s] chunked=%d append %zu bytes, "
 	      " total_length=%zu\n",
@@ -339,9 +723,7 @@ static void http_resp_handler(int err, const struct http_msg *msg, void *arg)
 	cookie_jar_handle_response(req->rest_cli->jar, req->uri,
 				   msg);
 
-	req->json =
-		(0 == pl_strcasecmp(&msg->ctyp.type, "application")) &&
-		(0 == pl_strcasecmp(&msg->ctyp.subtype, "json"));
+	req->json = msg_is_json(msg);
 
 #if 1
 	if (msg && msg->scode >= 300) {
@@ -472,6 +854,33 @@ int rest_req_set_raw(struct rest_req *rr, bool raw)
 }
 
 
+/*
+ * Stream the elements of an array in a JSON response to itemh, with
+ * the arg of the request, as they arrive instead of buffering the
+ * whole body. The array is the value
+ * of key in the top-level object, or the top-level value if key is
+ * NULL. The response handler then gets the rest of the body, with the
+ * array emptied.
+ */
+int rest_req_set_items(struct rest_req *rr, const char *key,
+		       jstream_item_h *itemh)
+{
+	if (!rr || !itemh)
+		return EINVAL;
+
+	rr->items_key = mem_deref(rr->items_key);
+	if (key) {
+		int err = str_dup(&rr->items_key, key);
+		if (err)
+			return err;
+	}
+
+	rr->itemh = itemh;
+
+	return 0;
+}
+
+
 int rest_req_add_header(struct rest_req *rr, const char *fmt, ...)
 {
 	va_list ap;
@@ -628,6 +1037,7 @@ int rest_req_start(struct rest_req **rrp, struct rest_req *rr,
 	rr->rest_cli = rest_cli;
 
 	rr->prio = prio;
+	rr->seq = rest_cli->seq++;
 
 	if (rr->raw) {
 		debug("rest_req_start: %s\n\t%s\n",
@@ -639,22 +1049,41 @@ int rest_req_start(struct rest_req **rrp, struct rest_req *rr,
 		      cookie_print, rr, rr->header ? rr->header : "");
 	}
 
-	list_append(&rest_cli->reql, &rr->le, rr);
+	err = host_get(&rr->host, rest_cli, rr->uri);
+	if (err)
+		goto out;
+
+	rr->ts_queued = tmr_jiffies();
+	rr->deadline = (int64_t)rr->ts_queued
+		+ (int64_t)prio * rest_cli->prio_age;
+
+	err = heap_push(rr->host, rr);
+	if (err)
+		goto out;
 
 	if (rrp) {
 		rr->reqp = rrp;
 		*rrp = rr;
 	}
 
-	trigger_queue(rest_cli);
+	trigger_queue(rr->host, rest_cli->maxopen);
 
  out:
 	return err;
 }
 
 
+static void update_wait(struct rest_stats *stats, uint32_t wait_ms)
+{
+	++stats->nreq;
+	stats->wait_total_ms += wait_ms;
+	stats->wait_max_ms = max(stats->wait_max_ms, wait_ms);
+}
+
+
 static void wake_request(struct rest_req *rr)
 {
+	struct rest_stats *stats;
 	int err;
 
 	if (!rr) {
@@ -664,6 +1093,9 @@ static void wake_request(struct rest_req *rr)
 
 	rr->ts_req = tmr_jiffies();
 
+	stats = &rr->rest_cli->stats;
+	update_wait(stats, (uint32_t)(rr->ts_req - rr->ts_queued));
+
 	if (rr->req_body) {
 		err = http_request(&rr->http_req, rr->rest_cli->http_cli,
 				   rr->method, rr->uri, http_resp_handler,
@@ -671,6 +1103,7 @@ static void wake_request(struct rest_req *rr)
 				   "%H"
 				   "Accept: application/json\r\n"
 				   "%s"
+				   "%s"
 				   "%H"
 				   "Content-Type: %s\r\n"
 				   "Content-Length: %zu\r\n"
@@ -680,6 +1113,7 @@ static void wake_request(struct rest_req *rr)
 				   ,
 				   rr->raw ? null_print : auth_print,
 				   rr->raw ? NULL : &rr->rest_cli->login_token,
+				   rr->raw ? "" : ACCEPT_ENCODING,
 				   rr->header ? rr->header : "",
 				   cookie_print, rr,
 				   rr->ctype, rr->req_body->end,
@@ -693,6 +1127,7 @@ static void wake_request(struct rest_req *rr)
 				   "%H"
 				   "Accept: application/json\r\n"
 				   "%s"
+				   "%s"
 				   "%H"
 				   "Content-Length: 0\r\n"
 				   "User-Agent: %s\r\n"
@@ -700,6 +1135,7 @@ static void wake_request(struct rest_req *rr)
 				   ,
 				   rr->raw ? null_print : auth_print,
 				   rr->raw ? NULL : &rr->rest_cli->login_token,
+				   rr->raw ? "" : ACCEPT_ENCODING,
 				   rr->header ? rr->header : "",
 				   cookie_print, rr,
 				   rr->rest_cli->user_agent);
@@ -718,6 +1154,10 @@ static void wake_request(struct rest_req *rr)
 	}
 
 	list_append(&rr->rest_cli->openl, &rr->le, rr);
+	++rr->host->nopen;
+
+	++stats->inflight;
+	stats->inflight_max = max(stats->inflight_max, stats->inflight);
 
  out:
 	if (err)
@@ -866,22 +1306,58 @@ int rest_request_jobj(struct rest_req **rrp, struct rest_cli *rest_cli,
 }
 
 
+/* Queue time [ms] after which a request has caught up one prio level */
+void rest_client_set_prio_age(struct rest_cli *cli, uint32_t ms)
+{
+	if (!cli)
+		return;
+
+	cli->prio_age = ms;
+}
+
+
+int rest_client_get_stats(const struct rest_cli *cli,
+			  struct rest_stats *stats)
+{
+	if (!cli || !stats)
+		return EINVAL;
+
+	*stats = cli->stats;
+
+	return 0;
+}
+
+
 int rest_client_debug(struct re_printf *pf, const struct rest_cli *cli)
 {
+	const struct rest_stats *stats = &cli->stats;
 	struct le *le;
 	int err = 0;
 
 	err |= re_hprintf(pf, "rest client:\n");
 	err |= re_hprintf(pf, "server_uri = %s\n", cli->server_uri);
+	err |= re_hprintf(pf, "requests: %llu inflight: %u (max %u)"
+			  " wait: avg %llums max %ums\n",
+			  stats->nreq, stats->inflight, stats->inflight_max,
+			  stats->nreq ? stats->wait_total_ms / stats->nreq : 0,
+			  stats->wait_max_ms);
 	err |= re_hprintf(pf, "pending HTTP requests: (%u)\n",
-			  list_count(&cli->reql));
+			  stats->queued);
+
+	LIST_FOREACH(&cli->hostl, le) {
+		const struct rest_host *host = le->data;
+		size_t i;
 
-	for (le = cli->reql.head; le; le = le->next) {
+		err |= re_hprintf(pf, " %s: open=%zu queued=%zu\n",
+				  host->name, host->nopen, host->heapc);
 
-		struct rest_req *rr = le->data;
+		for (i = 0; i < host->heapc; i++) {
+			const struct rest_req *rr = host->heapv[i];
 
-		err |= re_hprintf(pf, "  [%s %s] json=%d\n",
-				  rr->method, rr->path, rr->json);
+			err |= re_hprintf(pf, "  [%s %s] prio=%d json=%d\n",
+					  rr->method, rr->path, rr->prio,
+					  rr->json);
+		}
 	}
 
 	return err;
@@ -27,9 +27,43 @@ enum bundle_type {
         BUNDLE_TYPE_VIDEO,
 };
 
-struct bundle {
+enum {
+	SECT_HASH_SIZE = 64,
+};
+
+/*
+ * The parsed remote SDP is kept for as long as it does not change,
+ * and so is the encoded media section of every member. An update only
+ * regenerates the sections of members that changed, and then joins
+ * the cached text.
+ */
+struct bundle_cache {
+	char *remote_sdp;
+	enum icall_conv_type conv_type;
+	struct sdp_session *sess;   /* no local media, only the header */
+	struct sdp_media *sdpa;
+	struct sdp_media *sdpv;
+
+	struct hash *secth;         /* struct section, by mid */
+	struct list sectl;          /* sections in order, this update */
+	uint32_t gen;
+};
+
+struct section {
+	struct le he;
+	struct le le;
 	uint32_t mid;
-	struct mbuf *mb;
+	uint32_t gen;
+
+	/* the inputs the text was generated from */
+	uint32_t ssrc;
+	bool disabled;
+	char *cname;
+	char *msid;
+	char *label;
+
+	char *text;
+	size_t len;
 };
 
 
@@ -103,14 +137,26 @@ static bool media_rattr_handler(const char *name, const char *value, void *arg)
 }
 
 
+static uint32_t member_mid(enum bundle_type type, struct conf_member *cm)
+{
+	uint32_t *midp = type == BUNDLE_TYPE_AUDIO ? &cm->mida : &cm->midv;
+
+	if (*midp == 0) {
+		*midp = g_mid;
+		g_mid++;
+	}
+
+	return *midp;
+}
+
+
 static void bundle_ssrc(enum bundle_type type, struct conf_member *cm,
-			struct bundle *bundle,
+			uint32_t mid,
 			struct sdp_session *sess, struct sdp_media *sdpm)
 {
 	struct sdp_media *newm;
 	const char *mtype;
 	uint32_t ssrc;
-	uint32_t mid;
 	bool disabled = false;
 	int lport;
 	int err;
@@ -119,21 +165,11 @@ static void bundle_ssrc(enum bundle_type type, struct conf_member *cm,
 	case BUNDLE_TYPE_AUDIO:
 		ssrc = cm->ssrca;
 		mtype = sdp_media_audio;
-		if (cm->mida == 0) {
-			cm->mida = g_mid;
-			g_mid++;
-		}
-		mid = cm->mida;
 		break;
 
 	case BUNDLE_TYPE_VIDEO:
 		ssrc = cm->ssrcv;
 		mtype = sdp_media_video;
-		if (cm->midv == 0) {
-			cm->midv = g_mid;
-			g_mid++;
-		}
-		mid = cm->midv;
 		break;
 
 	default:
@@ -174,63 +210,383 @@ static void bundle_ssrc(enum bundle_type type, struct conf_member *cm,
 	sdp_media_set_ldir(newm, disabled ? SDP_INACTIVE : SDP_SENDONLY);
 	sdp_media_set_lbandwidth(newm, SDP_BANDWIDTH_AS,
 				 sdp_media_rbandwidth(sdpm, SDP_BANDWIDTH_AS));
+}
+
 
-	mbuf_printf(bundle->mb, " %u", mid);
+static void section_destructor(void *arg)
+{
+	struct section *sect = arg;
+
+	hash_unlink(&sect->he);
+	list_unlink(&sect->le);
+
+	mem_deref(sect->cname);
+	mem_deref(sect->msid);
+	mem_deref(sect->label);
+	mem_deref(sect->text);
 }
 
 
-int bundle_update(struct iflow *flow,
-		  enum icall_conv_type conv_type,
-		  bool include_audio,
-		  const char *remote_sdp,
-		  struct list *membl,
-		  bundle_flow_update_h *flow_updateh)
+static void cache_destructor(void *arg)
 {
-	struct sdp_media *sdpa = NULL;
-	struct sdp_media *sdpv = NULL;
-	char *grpstr;
-	int err = 0;
-	struct le *le;
-	struct sdp_session *sess;
-	struct bundle bundle;
-	char *sdpres = NULL;
-	struct mbuf *mbb;
+	struct bundle_cache *bc = arg;
 
-	sdp_dup(&sess, conv_type, remote_sdp, false);
-	sdpa = find_media(sess, "audio");
-	sdpv = find_media(sess, "video");
-	
-	bundle.mid = 0;
-	bundle.mb = mbuf_alloc(128);
-	mbuf_printf(bundle.mb, sdp_session_rattr(sess, "group"));
+	list_clear(&bc->sectl);
+	hash_flush(bc->secth);
+	mem_deref(bc->secth);
+	mem_deref(bc->sess);
+	mem_deref(bc->remote_sdp);
+}
+
+
+int bundle_cache_alloc(struct bundle_cache **bcp)
+{
+	struct bundle_cache *bc;
+	int err;
+
+	if (!bcp)
+		return EINVAL;
+
+	bc = mem_zalloc(sizeof(*bc), cache_destructor);
+	if (!bc)
+		return ENOMEM;
+
+	err = hash_alloc(&bc->secth, SECT_HASH_SIZE);
+	if (err)
+		goto out;
+
+	list_init(&bc->sectl);
+
+ out:
+	if (err)
+		mem_deref(bc);
+	else
+		*bcp = bc;
+
+	return err;
+}
+
+
+/* Drop everything that was derived from the remote SDP */
+void bundle_cache_flush(struct bundle_cache *bc)
+{
+	if (!bc)
+		return;
+
+	list_clear(&bc->sectl);
+	hash_flush(bc->secth);
+	bc->sess = mem_deref(bc->sess);
+	bc->remote_sdp = mem_deref(bc->remote_sdp);
+	bc->sdpa = NULL;
+	bc->sdpv = NULL;
+}
+
+
+static int base_update(struct bundle_cache *bc,
+		       enum icall_conv_type conv_type,
+		       const char *remote_sdp)
+{
+	struct sdp_session *sess = NULL;
+	int err;
+
+	if (bc->sess && bc->conv_type == conv_type
+	    && streq(bc->remote_sdp, remote_sdp))
+		return 0;
+
+	bundle_cache_flush(bc);
+
+	err = sdp_dup(&sess, conv_type, remote_sdp, false);
+	if (err)
+		return err;
+
+	err = str_dup(&bc->remote_sdp, remote_sdp);
+	if (err) {
+		mem_deref(sess);
+		return err;
+	}
 
 	list_flush((struct list *)sdp_session_medial(sess, true));
-	
+
+	bc->sess = sess;
+	bc->conv_type = conv_type;
+	bc->sdpa = find_media(sess, "audio");
+	bc->sdpv = find_media(sess, "video");
+
+	return 0;
+}
+
+
+static bool section_cmp_handler(struct le *le, void *arg)
+{
+	const struct section *sect = le->data;
+	const uint32_t *mid = arg;
+
+	return sect->mid == *mid;
+}
+
+
+static bool section_changed(const struct section *sect,
+			    uint32_t ssrc, bool disabled,
+			    const struct conf_member *cm)
+{
+	if (sect->ssrc != ssrc || sect->disabled != disabled)
+		return true;
+
+	/* the identity is only part of the text when enabled */
+	if (disabled)
+		return false;
+
+	return !streq(sect->cname, cm->cname)
+		|| !streq(sect->msid, cm->msid)
+		|| !streq(sect->label, cm->label);
+}
+
+
+/* Encode a single media section, by way of the header-only session */
+static int section_generate(struct bundle_cache *bc, struct section *sect,
+			    enum bundle_type type, struct conf_member *cm,
+			    struct sdp_media *sdpm)
+{
+	struct list *lmedial = (struct list *)sdp_session_medial(bc->sess,
+								 true);
+	struct mbuf *mb = NULL;
+	size_t i;
+	int err;
+
+	sect->text = mem_deref(sect->text);
+	sect->len = 0;
+
+	bundle_ssrc(type, cm, sect->mid, bc->sess, sdpm);
+	if (list_isempty(lmedial))
+		return ENOMEM;
+
+	err = sdp_encode(&mb, bc->sess, true);
+	list_flush(lmedial);
+	if (err)
+		return err;
+
+	/* skip the session header */
+	for (i = 0; i + 3 < mb->end; i++) {
+		if (0 == memcmp(&mb->buf[i], "\r\nm=", 4))
+			break;
+	}
+	if (i + 3 >= mb->end) {
+		err = EPROTO;
+		goto out;
+	}
+
+	mb->pos = i + 2;
+	sect->len = mbuf_get_left(mb);
+	err = mbuf_strdup(mb, &sect->text, sect->len);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static int section_update(struct bundle_cache *bc, enum bundle_type type,
+			  struct conf_member *cm, struct sdp_media *sdpm)
+{
+	struct section *sect;
+	uint32_t mid, ssrc;
+	bool disabled;
+	int err;
+
+	mid = member_mid(type, cm);
+	ssrc = type == BUNDLE_TYPE_AUDIO ? cm->ssrca : cm->ssrcv;
+	disabled = ssrc == 0 || !cm->active;
+
+	sect = list_ledata(hash_lookup(bc->secth, mid,
+				       section_cmp_handler, &mid));
+	if (!sect) {
+		sect = mem_zalloc(sizeof(*sect), section_destructor);
+		if (!sect)
+			return ENOMEM;
+
+		sect->mid = mid;
+		hash_append(bc->secth, mid, &sect->he, sect);
+	}
+	else if (sect->text && !section_changed(sect, ssrc, disabled, cm)) {
+		goto out;
+	}
+
+	sect->ssrc = ssrc;
+	sect->disabled = disabled;
+	sect->cname = mem_deref(sect->cname);
+	sect->msid = mem_deref(sect->msid);
+	sect->label = mem_deref(sect->label);
+	err  = str_dup(&sect->cname, cm->cname);
+	err |= str_dup(&sect->msid, cm->msid);
+	err |= str_dup(&sect->label, cm->label);
+	if (err)
+		goto error;
+
+	err = section_generate(bc, sect, type, cm, sdpm);
+	if (err)
+		goto error;
+
+ out:
+	sect->gen = bc->gen;
+	list_append(&bc->sectl, &sect->le, sect);
+
+	return 0;
+
+ error:
+	mem_deref(sect);
+	return err;
+}
+
+
+static bool stale_handler(struct le *le, void *arg)
+{
+	struct section *sect = le->data;
+	const struct bundle_cache *bc = arg;
+
+	if (sect->gen != bc->gen)
+		mem_deref(sect);
+
+	return false;
+}
+
+
+/*
+ * Generate the bundled SDP with one media section per member and
+ * media type. The cache is optional, without one every section is
+ * generated from scratch.
+ */
+int bundle_generate(struct bundle_cache *bc,
+		    char **sdpp,
+		    enum icall_conv_type conv_type,
+		    bool include_audio,
+		    const char *remote_sdp,
+		    struct list *membl)
+{
+	struct bundle_cache *tmp = NULL;
+	struct mbuf *mbb = NULL;
+	struct mbuf *grp = NULL;
+	const char *rgroup;
+	char *grpstr = NULL;
+	size_t len;
+	struct le *le;
+	int err = 0;
+
+	if (!sdpp || !remote_sdp)
+		return EINVAL;
+
+	if (!bc) {
+		err = bundle_cache_alloc(&tmp);
+		if (err)
+			return err;
+		bc = tmp;
+	}
+
+	err = base_update(bc, conv_type, remote_sdp);
+	if (err) {
+		warning("bundle_generate: remote sdp failed (%m)\n", err);
+		goto out;
+	}
+
+	grp = mbuf_alloc(128);
+	if (!grp) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	rgroup = sdp_session_rattr(bc->sess, "group");
+	if (rgroup)
+		mbuf_write_str(grp, rgroup);
+
+	++bc->gen;
+	list_clear(&bc->sectl);
+
 	LIST_FOREACH(membl, le) {
 		struct conf_member *cm = (struct conf_member *)le->data;
 
-		if (include_audio && sdpa)
-			bundle_ssrc(BUNDLE_TYPE_AUDIO, cm, &bundle, sess, sdpa);
-		if (sdpv && cm->ssrcv)
-			bundle_ssrc(BUNDLE_TYPE_VIDEO, cm, &bundle, sess, sdpv);
+		if (include_audio && bc->sdpa) {
+			err = section_update(bc, BUNDLE_TYPE_AUDIO, cm,
+					     bc->sdpa);
+			if (err)
+				goto out;
+			mbuf_printf(grp, " %u", cm->mida);
+		}
+		if (bc->sdpv && cm->ssrcv) {
+			err = section_update(bc, BUNDLE_TYPE_VIDEO, cm,
+					     bc->sdpv);
+			if (err)
+				goto out;
+			mbuf_printf(grp, " %u", cm->midv);
+		}
+	}
+
+	/* members that left, or stopped sending video */
+	hash_apply(bc->secth, stale_handler, bc);
+
+	grp->pos = 0;
+	err = mbuf_strdup(grp, &grpstr, mbuf_get_left(grp));
+	if (err)
+		goto out;
+	sdp_safe_session_set_lattr(bc->sess, true, "group", grpstr);
+
+	err = sdp_encode(&mbb, bc->sess, true);
+	if (err)
+		goto out;
+
+	len = mbb->end;
+	LIST_FOREACH(&bc->sectl, le) {
+		const struct section *sect = le->data;
+
+		len += sect->len;
 	}
 
-	bundle.mb->pos = 0;
-	mbuf_strdup(bundle.mb, &grpstr, mbuf_get_left(bundle.mb));
-	sdp_safe_session_set_lattr(sess, true, "group", grpstr);
-	mem_deref(grpstr);
-	mem_deref(bundle.mb);
+	err = mbuf_resize(mbb, len + 1);
+	if (err)
+		goto out;
+
+	mbb->pos = mbb->end;
+	LIST_FOREACH(&bc->sectl, le) {
+		const struct section *sect = le->data;
+
+		err |= mbuf_write_mem(mbb, (uint8_t *)sect->text, sect->len);
+	}
+	if (err)
+		goto out;
 
-	sdp_encode(&mbb, sess, true);
-	mbuf_strdup(mbb, &sdpres, mbb->end);
+	mbb->pos = 0;
+	err = mbuf_strdup(mbb, sdpp, mbb->end);
+
+ out:
+	mem_deref(grpstr);
+	mem_deref(grp);
 	mem_deref(mbb);
-		
+	mem_deref(tmp);
+
+	return err;
+}
+
+
+int bundle_update(struct bundle_cache *bc,
+		  struct iflow *flow,
+		  enum icall_conv_type conv_type,
+		  bool include_audio,
+		  const char *remote_sdp,
+		  struct list *membl,
+		  bundle_flow_update_h *flow_updateh)
+{
+	char *sdpres = NULL;
+	int err;
+
+	err = bundle_generate(bc, &sdpres, conv_type, include_audio,
+			      remote_sdp, membl);
+	if (err)
+		return err;
+
 	if (flow_updateh) {
 		flow_updateh(flow, sdpres);
 	}
 
 	mem_deref(sdpres);
-	mem_deref(sess);
 
-	return err;
+	return 0;
 }
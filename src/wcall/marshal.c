@@ -45,12 +45,14 @@ enum mq_event {
 	WCALL_MEV_MCAT_CHANGED,
 	WCALL_MEV_AUDIO_ROUTE_CHANGED,
 	WCALL_MEV_NETWORK_CHANGED,
+	WCALL_MEV_APP_FOREGROUND,
 	WCALL_MEV_INCOMING,
 	WCALL_MEV_SFT_RESP,
 	WCALL_MEV_SET_CLIENTS,
 	WCALL_MEV_DCE_SEND,
 	WCALL_MEV_DESTROY,
 	WCALL_MEV_SET_MUTE,
+	WCALL_MEV_SET_RELAY_RANKING,
 };
 
 
@@ -138,6 +140,10 @@ struct mq_data {
 		struct {
 			int muted;
 		} set_mute;
+
+		struct {
+			int interval;
+		} set_relay_ranking;
 	} u;
 };
 
@@ -294,7 +300,11 @@ static void mqueue_handler(int id, void *data, void *arg)
 		break;
 
 	case WCALL_MEV_NETWORK_CHANGED:
-		wcall_i_network_changed();
+		wcall_i_network_changed(md->inst);
+		break;
+
+	case WCALL_MEV_APP_FOREGROUND:
+		wcall_i_app_foreground(md->inst);
 		break;
 
 	case WCALL_MEV_INCOMING:
@@ -325,6 +335,11 @@ static void mqueue_handler(int id, void *data, void *arg)
 		wcall_i_set_mute(md->u.set_mute.muted);
 		break;
 
+	case WCALL_MEV_SET_RELAY_RANKING:
+		wcall_i_set_relay_ranking(md->inst,
+					  md->u.set_relay_ranking.interval);
+		break;
+
 	default:
 		warning("wcall: marshal: unknown event: %d\n", id);
 		break;
@@ -866,6 +881,30 @@ void wcall_network_changed(WUSER_HANDLE wuser)
 }
 
 
+AVS_EXPORT
+void wcall_app_foreground(WUSER_HANDLE wuser)
+{
+	struct calling_instance *inst;
+	struct mq_data *md = NULL;
+	int err = 0;
+
+	inst = wuser2inst(wuser);
+	if (!inst) {
+		warning("wcall: app_foreground: invalid handle: 0x%08X\n",
+			wuser);
+		return;
+	}
+
+	md = md_new(inst, NULL, WCALL_MEV_APP_FOREGROUND);
+	if (!md)
+		return;
+
+	err = md_enqueue(md);
+	if (err)
+		mem_deref(md);
+}
+
+
 AVS_EXPORT
 void wcall_invoke_incoming_handler(const char *convid,
 			           uint32_t msg_time,
@@ -991,6 +1030,37 @@ void wcall_set_mute(WUSER_HANDLE wuser, int muted)
 		mem_deref(md);
 }
 
+AVS_EXPORT
+int wcall_set_relay_ranking(WUSER_HANDLE wuser, int interval)
+{
+	struct calling_instance *inst;
+	struct mq_data *md = NULL;
+	int err = 0;
+
+	inst = wuser2inst(wuser);
+	if (!inst) {
+		warning("wcall: set_relay_ranking: "
+			"invalid handle: 0x%08X\n",
+			wuser);
+		return EINVAL;
+	}
+
+	md = md_new(inst, NULL, WCALL_MEV_SET_RELAY_RANKING);
+	if (!md)
+		return ENOMEM;
+
+	md->u.set_relay_ranking.interval = interval;
+
+	info("wcall_set_relay_ranking: inst=%p interval=%d\n",
+	     inst, interval);
+
+	err = md_enqueue(md);
+	if (err)
+		mem_deref(md);
+
+	return err;
+}
+
 void wcall_marshal_destroy(struct calling_instance *inst)
 {
 	struct mq_data *md = NULL;
@@ -5,4 +5,5 @@
 
 AVS_SRCS += \
 	wcall/wcall.c \
-	wcall/marshal.c
+	wcall/marshal.c \
+	wcall/shard.c
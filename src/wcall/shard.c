@@ -0,0 +1,296 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * Sharded AVS runtime -- hosts the calling instances on N threads,
+ * each running its own re main loop. An instance is created on the
+ * shard its wuser handle maps to, so its timers, sockets and marshal
+ * queue all belong to that thread and its events never wait behind
+ * the instances of another shard.
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <re/re.h>
+#include <avs.h>
+
+#include <avs_wcall.h>
+
+#include "wcall.h"
+
+
+enum {
+	MAX_SHARDS = 64,
+};
+
+enum shard_event {
+	SHARD_EV_JOB,
+	SHARD_EV_STOP,
+};
+
+struct shard {
+	pthread_t tid;
+	struct mqueue *mq;
+	unsigned idx;
+	bool started;
+	int run_err;
+	int run_init;
+};
+
+struct shard_job {
+	wcall_shard_h *h;
+	void *arg;
+	int err;
+	bool done;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+
+static struct {
+	struct shard *shardv;
+	unsigned shardc;
+} sharding;
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct shard_job *job = data;
+	int err;
+
+	(void)arg;
+
+	switch (id) {
+
+	case SHARD_EV_JOB:
+		err = job->h(job->arg);
+
+		pthread_mutex_lock(&job->mutex);
+		job->err = err;
+		job->done = true;
+		pthread_cond_signal(&job->cond);
+		pthread_mutex_unlock(&job->mutex);
+		break;
+
+	case SHARD_EV_STOP:
+		re_cancel();
+		break;
+
+	default:
+		warning("wcall: shard: unknown event: %d\n", id);
+		break;
+	}
+}
+
+
+static void *shard_thread(void *arg)
+{
+	struct shard *sh = arg;
+	int err;
+
+	err = re_thread_init();
+	if (err) {
+		warning("wcall: shard %u: re_thread_init failed (%m)\n",
+			sh->idx, err);
+		goto out;
+	}
+
+	err = mqueue_alloc(&sh->mq, mqueue_handler, sh);
+	if (err) {
+		warning("wcall: shard %u: cannot allocate mqueue (%m)\n",
+			sh->idx, err);
+		re_thread_close();
+		goto out;
+	}
+
+	info("wcall: shard %u: running\n", sh->idx);
+	__atomic_store_n(&sh->run_init, 1, __ATOMIC_RELEASE);
+
+	re_main(NULL);
+
+	info("wcall: shard %u: done\n", sh->idx);
+
+	sh->mq = mem_deref(sh->mq);
+	re_thread_close();
+
+ out:
+	if (err)
+		__atomic_store_n(&sh->run_err, err, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+
+static void shards_destructor(void *arg)
+{
+	struct shard *shardv = arg;
+	unsigned i;
+
+	for (i = 0; i < sharding.shardc; i++) {
+		struct shard *sh = &shardv[i];
+
+		if (!sh->started)
+			continue;
+
+		if (sh->mq)
+			mqueue_push(sh->mq, SHARD_EV_STOP, NULL);
+
+		pthread_join(sh->tid, NULL);
+	}
+}
+
+
+AVS_EXPORT
+int wcall_run_shards(unsigned n)
+{
+	struct shard *shardv;
+	unsigned i;
+	int err = 0;
+
+	if (n < 1 || n > MAX_SHARDS)
+		return EINVAL;
+
+	if (sharding.shardv)
+		return EALREADY;
+
+	shardv = mem_zalloc(n * sizeof(*shardv), shards_destructor);
+	if (!shardv)
+		return ENOMEM;
+
+	/* the destructor needs to know how many threads to join */
+	sharding.shardc = n;
+
+	for (i = 0; i < n; i++) {
+		struct shard *sh = &shardv[i];
+
+		sh->idx = i;
+
+		err = pthread_create(&sh->tid, NULL, shard_thread, sh);
+		if (err) {
+			warning("wcall: shard %u: pthread_create failed"
+				" (%m)\n", i, err);
+			goto out;
+		}
+		sh->started = true;
+
+		while (!__atomic_load_n(&sh->run_init, __ATOMIC_ACQUIRE)) {
+			err = __atomic_load_n(&sh->run_err, __ATOMIC_ACQUIRE);
+			if (err)
+				goto out;
+			usleep(1000);
+		}
+	}
+
+	info("wcall: running %u shards\n", n);
+
+ out:
+	if (err) {
+		mem_deref(shardv);
+		sharding.shardc = 0;
+	}
+	else {
+		__atomic_store_n(&sharding.shardv, shardv, __ATOMIC_RELEASE);
+	}
+
+	return err;
+}
+
+
+AVS_EXPORT
+void wcall_stop_shards(void)
+{
+	struct shard *shardv;
+
+	shardv = __atomic_exchange_n(&sharding.shardv, NULL, __ATOMIC_ACQ_REL);
+	if (!shardv)
+		return;
+
+	mem_deref(shardv);
+	sharding.shardc = 0;
+}
+
+
+unsigned wcall_shard_count(void)
+{
+	return __atomic_load_n(&sharding.shardv, __ATOMIC_ACQUIRE)
+		? sharding.shardc : 0;
+}
+
+
+/* The shard of an instance follows from its handle, no lookup needed */
+int wcall_shard_index(WUSER_HANDLE wuser)
+{
+	const unsigned shardc = wcall_shard_count();
+
+	if (!shardc)
+		return -1;
+
+	return (int)((wuser & 0xFFFF) % shardc);
+}
+
+
+/*
+ * Run h on the thread of the shard that hosts wuser, and wait for it
+ * to return. Without shards, or when already on that thread, h runs
+ * in place.
+ */
+int wcall_shard_exec(WUSER_HANDLE wuser, wcall_shard_h *h, void *arg)
+{
+	struct shard *shardv;
+	struct shard *sh;
+	struct shard_job job;
+	int idx;
+	int err;
+
+	if (!h)
+		return EINVAL;
+
+	shardv = __atomic_load_n(&sharding.shardv, __ATOMIC_ACQUIRE);
+	idx = wcall_shard_index(wuser);
+	if (!shardv || idx < 0)
+		return h(arg);
+
+	sh = &shardv[idx];
+	if (pthread_equal(sh->tid, pthread_self()))
+		return h(arg);
+
+	memset(&job, 0, sizeof(job));
+	job.h = h;
+	job.arg = arg;
+	pthread_mutex_init(&job.mutex, NULL);
+	pthread_cond_init(&job.cond, NULL);
+
+	err = mqueue_push(sh->mq, SHARD_EV_JOB, &job);
+	if (err) {
+		warning("wcall: shard %d: mqueue_push failed (%m)\n",
+			idx, err);
+		goto out;
+	}
+
+	pthread_mutex_lock(&job.mutex);
+	while (!job.done)
+		pthread_cond_wait(&job.cond, &job.mutex);
+	err = job.err;
+	pthread_mutex_unlock(&job.mutex);
+
+ out:
+	pthread_cond_destroy(&job.cond);
+	pthread_mutex_destroy(&job.mutex);
+
+	return err;
+}
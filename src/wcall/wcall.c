@@ -78,6 +78,23 @@ struct log_entry {
 
 #define WU_MAGIC 0x57550000 /* WU */
 
+/*
+ * The low bits of a handle are its slot in the handle table, and a
+ * generation that is bumped every time the slot is reused, so that a
+ * stale handle does not resolve to the instance that took its slot.
+ */
+enum {
+	WU_SLOT_BITS = 10,
+	WU_SLOTS     = 1 << WU_SLOT_BITS,
+	WU_GEN_MASK  = 0xFFFF >> WU_SLOT_BITS,
+};
+
+/* Read without locks; a free slot keeps its last handle, sans magic */
+static struct {
+	struct calling_instance *instv[WU_SLOTS];
+	uint32_t wuserv[WU_SLOTS];
+} handles;
+
 struct calling_instance {
 	struct wcall_marshal *marshal;
 	struct mediamgr *mm;
@@ -91,6 +108,7 @@ struct calling_instance {
 
 	struct list ecalls;
 	struct list wcalls;
+	struct cdict *convd;  /* convid -> wcall, read without lock */
 	struct list ctxl;
 
 	pthread_t tid;
@@ -123,6 +141,11 @@ struct calling_instance {
 			wcall_participant_changed_h *chgh;
 			void *arg;
 		} json;
+		struct {
+			wcall_participant_delta_h *h;
+			uint32_t snapshot_interval;
+			void *arg;
+		} delta;
 	} group;
 
 	struct {
@@ -138,8 +161,11 @@ struct calling_instance {
 
 	struct netprobe *netprobe;
 	wcall_netprobe_h *netprobeh;
+	wcall_netprobe_stats_h *netprobe_statsh;
 	void *netprobeh_arg;
 
+	struct relayrank *relayrank;
+
 	struct {
 		wcall_network_quality_h *netqh;
 		int interval;
@@ -153,6 +179,7 @@ struct calling_instance {
 
 struct wcall {
 	struct calling_instance *inst;
+	WUSER_HANDLE wuser;
 	char *convid;
 	int conv_type;
 
@@ -170,6 +197,8 @@ struct wcall {
 
 	int state; /* wcall state */
 	bool disable_audio;
+
+	struct membdelta *delta;
 	
 	struct le le;
 };
@@ -190,95 +219,102 @@ static void call_group_change_json(struct calling_instance *inst,
 				   struct wcall *wcall);
 
 
+static bool has_group_json_handler(const struct calling_instance *inst)
+{
+	return inst->group.json.chgh || inst->group.delta.h;
+}
+
+
 struct calling_instance *wuser2inst(WUSER_HANDLE wuser)
 {
-	bool found = false;
-	struct calling_instance *inst = NULL;
-	struct le *le;
+	const uint32_t slot = wuser & (WU_SLOTS - 1);
+	struct calling_instance *inst;
 
 	if ((wuser & WU_MAGIC) != WU_MAGIC)
 		return NULL;
-	
-	lock_write_get(calling.lock);
-	for (le = calling.instances.head; le && !found; le = le->next) {
-		inst = le->data;
-		
-		found = inst->wuser == wuser;
-	}
-	lock_rel(calling.lock);
 
-	return found ? inst : NULL;
+	if (__atomic_load_n(&handles.wuserv[slot], __ATOMIC_SEQ_CST) != wuser)
+		return NULL;
+
+	inst = __atomic_load_n(&handles.instv[slot], __ATOMIC_SEQ_CST);
+
+	/* the slot may have been released and reused in between */
+	if (__atomic_load_n(&handles.wuserv[slot], __ATOMIC_SEQ_CST) != wuser)
+		return NULL;
 
+	return inst;
 }
 
 static WUSER_HANDLE inst2wuser(struct calling_instance *inst)
 {
-	struct calling_instance *ci;
-	struct le *le;
-	bool found = false;
+	if (!inst || wuser2inst(inst->wuser) != inst)
+		return (WUSER_HANDLE)0;
 
-	lock_write_get(calling.lock);
-	for (le = calling.instances.head; le && !found; le = le->next) {
-		ci = le->data;
-		found = ci == inst;
-	}
-	lock_rel(calling.lock);
-
-	return found ? ci->wuser : (WUSER_HANDLE)0;
+	return inst->wuser;
 }
 
-static WUSER_HANDLE create_wuser(struct calling_instance *inst)
+/*
+ * Reserve a slot, starting round-robin, which also spreads the
+ * shards. The handle resolves once the instance is published.
+ */
+static WUSER_HANDLE wuser_alloc(void)
 {
-	WUSER_HANDLE wuser = WUSER_INVALID_HANDLE;
+	uint32_t start, slot, old, gen, wuser;
+	unsigned i;
+
+	start = __atomic_fetch_add(&calling.wuser_index, 1, __ATOMIC_RELAXED);
+
+	for (i = 0; i < WU_SLOTS; i++) {
+		slot = (start + i) & (WU_SLOTS - 1);
 
-	if (inst) {
-		wuser = WU_MAGIC + calling.wuser_index;
-		calling.wuser_index++;
-		calling.wuser_index &= 0xFFFF; /* wrap */
+		old = __atomic_load_n(&handles.wuserv[slot], __ATOMIC_SEQ_CST);
+		if ((old & WU_MAGIC) == WU_MAGIC)
+			continue;
+
+		gen = ((old >> WU_SLOT_BITS) + 1) & WU_GEN_MASK;
+		wuser = WU_MAGIC | gen << WU_SLOT_BITS | slot;
 
-		inst->wuser = wuser;
+		if (__atomic_compare_exchange_n(&handles.wuserv[slot],
+						&old, wuser, false,
+						__ATOMIC_SEQ_CST,
+						__ATOMIC_SEQ_CST))
+			return wuser;
 	}
 
-	return wuser;
+	return WUSER_INVALID_HANDLE;
 }
 
-static bool instance_valid(struct calling_instance *inst)
+static void wuser_publish(WUSER_HANDLE wuser, struct calling_instance *inst)
 {
-	bool found = false;
-	struct le *le;
+	__atomic_store_n(&handles.instv[wuser & (WU_SLOTS - 1)], inst,
+			 __ATOMIC_SEQ_CST);
+}
 
-	if (!inst)
-		return false;
+static void wuser_release(WUSER_HANDLE wuser)
+{
+	const uint32_t slot = wuser & (WU_SLOTS - 1);
 
-	lock_write_get(calling.lock);
-	for (le = calling.instances.head; le && !found; le = le->next)
-		found = le->data == inst;
-	lock_rel(calling.lock);
+	if (__atomic_load_n(&handles.wuserv[slot], __ATOMIC_SEQ_CST) != wuser)
+		return;
 
-	return found;
+	__atomic_store_n(&handles.instv[slot], NULL, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&handles.wuserv[slot], wuser & 0xFFFF,
+			 __ATOMIC_SEQ_CST);
 }
 
 static bool wcall_valid(const struct wcall *wcall)
 {
 	struct calling_instance *inst;
-	bool found = false;
-	struct le *le;
-	
+
 	if (!wcall)
 		return false;
 
-	inst = wcall->inst;
-
-	if (!instance_valid(inst)) {
+	/* wcall->inst may be gone, only look at it through the handle */
+	inst = wuser2inst(wcall->wuser);
+	if (!inst || inst != wcall->inst)
 		return false;
-	}
-	
-	lock_write_get(inst->lock);
-	for (le = inst->wcalls.head; le && !found; le = le->next)
-		found = wcall == le->data;
-	lock_rel(inst->lock);
 
-	return found;
+	return cdict_lookup(inst->convd, wcall->convid) == wcall;
 }
 
 
@@ -422,26 +458,10 @@ static int async_cfg_wait(struct calling_instance *inst)
 
 struct wcall *wcall_lookup(struct calling_instance *inst, const char *convid)
 {
-	struct wcall *wcall;
-	bool found = false;
-	struct le *le;
-
 	if (!inst || !convid)
 		return NULL;
-	
-	lock_write_get(inst->lock);
-	for (le = inst->wcalls.head;
-	     le != NULL && !found;
-	     le = le->next) { 
-		wcall = le->data;
 
-		if (streq(convid, wcall->convid)) {
-			found = true;
-		}
-	}
-	lock_rel(inst->lock);
-	
-	return found ? wcall : NULL;
+	return cdict_lookup(inst->convd, convid);
 }
 
 
@@ -638,7 +658,7 @@ static void icall_media_estab_handler(struct icall *icall,
 	}
 
 	if (wcall->conv_type == WCALL_CONV_TYPE_ONEONONE) {
-		if (inst->group.json.chgh) {
+		if (has_group_json_handler(inst)) {
 			call_group_change_json(inst, wcall);
 		}
 	}
@@ -690,9 +710,10 @@ static void icall_media_stopped_handler(struct icall *icall, void *arg)
 }
 
 
-static int members_json(struct wcall *wcall, char **mjson, char **anon_str)
+static int members_json(struct wcall *wcall,
+			const struct wcall_members *members,
+			char **mjson, char **anon_str)
 {
-	struct wcall_members *members = NULL;
 	struct json_object *tmembs = NULL;
 	struct json_object *jmembs = NULL;
 	struct mbuf *pmb = NULL;
@@ -700,16 +721,6 @@ static int members_json(struct wcall *wcall, char **mjson, char **anon_str)
 	char cid_anon[ANON_CLIENT_LEN];
 	size_t i;
 	int err = 0;
-	
-	err = ICALL_CALLE(wcall->icall, get_members, &members);
-	if (err)
-		return EBADF;
-
-	if (!members) {
-		warning("wcall(%p): members_json: members is NULL\n", wcall);
-		err = ENOSYS;
-		goto out;
-	}
 
 	//info("wcall: members_json: %d members\n", members->membc);
 	tmembs = jzon_alloc_object();
@@ -760,25 +771,79 @@ static int members_json(struct wcall *wcall, char **mjson, char **anon_str)
 	jzon_encode(mjson, tmembs);
 
  out:
-	mem_deref(members);
 	mem_deref(tmembs);
 
 	return err;
 }
 
+
+static void call_group_change_delta(struct calling_instance *inst,
+				    struct wcall *wcall,
+				    const struct wcall_members *members)
+{
+	char *djson = NULL;
+	uint64_t now;
+	int err;
+
+	if (!wcall->delta) {
+		err = membdelta_alloc(&wcall->delta,
+				      inst->group.delta.snapshot_interval);
+		if (err)
+			return;
+	}
+
+	err = membdelta_update(wcall->delta, wcall->convid, members, &djson);
+	if (err == ENOENT)
+		return;
+	else if (err) {
+		warning("wcall(%p): membdelta_update failed: %m\n",
+			wcall, err);
+		return;
+	}
+
+	now = tmr_jiffies();
+	info(APITAG "wcall(%p): group_deltah: %H\n",
+	     wcall, membdelta_debug, wcall->delta);
+
+	inst->group.delta.h(wcall->convid, djson, inst->group.delta.arg);
+
+	info(APITAG "wcall(%p): group_deltah took %llu ms\n",
+	     wcall, tmr_jiffies() - now);
+
+	mem_deref(djson);
+}
+
+
 static void call_group_change_json(struct calling_instance *inst,
 				   struct wcall *wcall)
 {
+	struct wcall_members *members = NULL;
 	char *mjson = NULL;
 	char *anon_json = NULL;
 	int err;
-	
-	err = members_json(wcall, &mjson, &anon_json);
+
+	if (!has_group_json_handler(inst))
+		return;
+
+	err = ICALL_CALLE(wcall->icall, get_members, &members);
+	if (err || !members) {
+		warning("wcall(%p): get_members failed: %m\n",
+			wcall, err ? err : ENOSYS);
+		return;
+	}
+
+	if (inst->group.delta.h)
+		call_group_change_delta(inst, wcall, members);
+
+	if (!inst->group.json.chgh)
+		goto out;
+
+	err = members_json(wcall, members, &mjson, &anon_json);
 	if (err) {
 		warning("wcall(%p): members_json failed: %m\n",
 			wcall, err);
 	}
-	else if (inst->group.json.chgh) {
+	else {
 		uint64_t now;
 
 		now = tmr_jiffies();
@@ -794,6 +859,9 @@ static void call_group_change_json(struct calling_instance *inst,
 		     wcall, tmr_jiffies() - now);
 	}
 	mem_deref(mjson);
+
+ out:
+	mem_deref(members);
 }
 
 
@@ -834,7 +902,7 @@ static void icall_audio_estab_handler(struct icall *icall, const char *userid,
 		     wcall, tmr_jiffies() - now);
 	}
 	if (wcall->conv_type == WCALL_CONV_TYPE_ONEONONE) {
-		if (!update && inst->group.json.chgh)
+		if (!update && has_group_json_handler(inst))
 			call_group_change_json(inst, wcall);
 	}
 }
@@ -947,7 +1015,7 @@ static void icall_vstate_handler(struct icall *icall, const char *userid,
 		     wcall, tmr_jiffies() - now);
 	}
 	if (wcall->conv_type != WCALL_CONV_TYPE_CONFERENCE
-	    && inst->group.json.chgh) {
+	    && has_group_json_handler(inst)) {
 		call_group_change_json(inst, wcall);
 	}
 }
@@ -1031,7 +1099,7 @@ static void icall_muted_changed_handler(struct icall *icall,
 	     wcall, icall, anon_id(convid_anon, wcall->convid),
 	     anon_id(userid_anon, userid), mute_state);
 
-	if (inst->group.json.chgh)
+	if (has_group_json_handler(inst))
 		call_group_change_json(inst, wcall);
 }
 
@@ -1088,6 +1156,7 @@ static void icall_close_handler(struct icall *icall, int err,
 {
 	struct wcall *wcall = arg;
 	struct calling_instance *inst = wcall ? wcall->inst : NULL;
+	char *timeline_json = NULL;
 	int reason;
 
 	if (!WCALL_VALID(wcall)) {
@@ -1125,6 +1194,16 @@ static void icall_close_handler(struct icall *icall, int err,
 		     wcall, tmr_jiffies() - now);
 	}
 
+	if (icall) {
+		info("wcall(%p): %H\n", wcall,
+		     icall_timeline_debug, &icall->timeline);
+
+		/* every call reports how its setup went */
+		if (0 == icall_timeline_metrics(&timeline_json, metrics_json,
+						&icall->timeline))
+			metrics_json = timeline_json;
+	}
+
 	info(APITAG "wcall(%p): metricsh(%p) json=%p\n", wcall, inst->metricsh, metrics_json);
 
 	if (inst->metricsh && metrics_json) {
@@ -1134,6 +1213,7 @@ static void icall_close_handler(struct icall *icall, int err,
 		     wcall, tmr_jiffies() - now);
 	}
 out:
+	mem_deref(timeline_json);
 	mem_deref(wcall);
 }
 
@@ -1219,7 +1299,7 @@ static void egcall_group_changed_handler(struct icall *icall, void *arg)
 		     wcall, tmr_jiffies() - now);
 	}
 	
-	if (inst->group.json.chgh) {
+	if (has_group_json_handler(inst)) {
 		call_group_change_json(inst, wcall);
 	}
 }
@@ -1457,6 +1537,8 @@ static void destructor(void *arg)
 	
 	lock_write_get(inst->lock);
 	list_unlink(&wcall->le);
+	if (cdict_lookup(inst->convd, wcall->convid) == wcall)
+		cdict_remove(inst->convd, wcall->convid);
 	has_calls = wcall_has_calls();
 	lock_rel(inst->lock);
 
@@ -1472,6 +1554,7 @@ static void destructor(void *arg)
 
 	mem_deref(wcall->icall);
 	mem_deref(wcall->convid);
+	mem_deref(wcall->delta);
 
 	info("wcall(%p): dtor -- done\n", wcall);
 }
@@ -1623,6 +1706,7 @@ int wcall_add(struct calling_instance *inst,
 		return EINVAL;
 
 	wcall->inst = inst;
+	wcall->wuser = inst->wuser;
 	wcall->conv_type = conv_type;
 
 	info(APITAG "wcall(%p): added for convid=%s inst=%p\n", wcall,
@@ -1806,6 +1890,8 @@ int wcall_add(struct calling_instance *inst,
 	wcall->audio.cbr_state = AUDIO_CBR_STATE_UNSET;
 
 	list_append(&inst->wcalls, &wcall->le, wcall);
+	if (!err)
+		err = cdict_add(inst->convd, convid, wcall);
 
  out:
 	lock_rel(inst->lock);
@@ -2059,6 +2145,68 @@ static int config_req_handler(void *arg)
 }
 
 
+/* Order the servers of the call config by their relay ranking */
+static void relayrank_apply(struct calling_instance *inst)
+{
+	struct zapi_ice_server *srvv;
+	size_t srvc = 0;
+
+	lock_write_get(inst->lock);
+
+	srvv = config_get_iceservers(inst->cfg, &srvc);
+	if (srvv)
+		relayrank_sort(inst->relayrank, srvv, srvc);
+
+	srvc = 0;
+	srvv = config_get_sfticeservers(inst->cfg, &srvc);
+	if (srvv)
+		relayrank_sort(inst->relayrank, srvv, srvc);
+
+	lock_rel(inst->lock);
+}
+
+
+static void relayrank_handler(void *arg)
+{
+	struct calling_instance *inst = arg;
+
+	relayrank_apply(inst);
+}
+
+
+static int relayrank_set_config(struct calling_instance *inst)
+{
+	struct zapi_ice_server *srvv, *turnv, *sftv;
+	size_t turnc = 0, sftc = 0;
+	int err;
+
+	turnv = config_get_iceservers(inst->cfg, &turnc);
+	sftv = config_get_sfticeservers(inst->cfg, &sftc);
+
+	if (!turnc && !sftc)
+		return relayrank_set_servers(inst->relayrank, NULL, 0);
+
+	srvv = mem_alloc((turnc + sftc) * sizeof(*srvv), NULL);
+	if (!srvv)
+		return ENOMEM;
+
+	if (turnc)
+		memcpy(srvv, turnv, turnc * sizeof(*srvv));
+	if (sftc)
+		memcpy(&srvv[turnc], sftv, sftc * sizeof(*srvv));
+
+	err = relayrank_set_servers(inst->relayrank, srvv, turnc + sftc);
+	mem_deref(srvv);
+	if (err)
+		return err;
+
+	/* a fresh config comes in server order, apply what we know */
+	relayrank_apply(inst);
+
+	return 0;
+}
+
+
 static void config_update_handler(struct call_config *cfg, void *arg)
 {
 	struct calling_instance *inst = arg;
@@ -2073,6 +2221,15 @@ static void config_update_handler(struct call_config *cfg, void *arg)
 
 	debug("wcall(%p): call_config: %d ice servers\n",
 	      inst, cfg->iceserverc);
+
+	if (inst->relayrank) {
+		int err = relayrank_set_config(inst);
+
+		if (err) {
+			warning("wcall(%p): relayrank_set_config failed: %m\n",
+				inst, err);
+		}
+	}
 	
 	if (first && inst->readyh) {
 		int ver = WCALL_VERSION_3;
@@ -2193,6 +2350,7 @@ static void instance_destroy(struct calling_instance *inst)
 
 	lock_write_get(inst->lock);
 	list_unlink(&inst->le);
+	wuser_release(inst->wuser);
 	list_flush(&inst->ecalls);
 
 	inst->userid = mem_deref(inst->userid);
@@ -2216,6 +2374,8 @@ static void instance_destroy(struct calling_instance *inst)
 
 	inst->lock = mem_deref(inst->lock);
 	inst->netprobe = mem_deref(inst->netprobe);
+	inst->relayrank = mem_deref(inst->relayrank);
+	inst->convd = mem_deref(inst->convd);
 
 	{
 		struct inst_dtor_entry *ide;
@@ -2280,26 +2440,25 @@ static void msys_mute_handler(bool muted, void *arg)
 }
 
 
-AVS_EXPORT
-WUSER_HANDLE wcall_create_ex(const char *userid,
-			     const char *clientid,
-			     int use_mediamgr,
-			     const char *msys_name,
-			     wcall_ready_h *readyh,
-			     wcall_send_h *sendh,
-			     wcall_sft_req_h *sfth,
-			     wcall_incoming_h *incomingh,
-			     wcall_missed_h *missedh,
-			     wcall_answered_h *answerh,
-			     wcall_estab_h *estabh,
-			     wcall_close_h *closeh,
-			     wcall_metrics_h *metricsh,
-			     wcall_config_req_h *cfg_reqh,
-			     wcall_audio_cbr_change_h *acbrh,
-			     wcall_video_state_change_h *vstateh,
-			     void *arg)
+static WUSER_HANDLE instance_create(WUSER_HANDLE wuser,
+				    const char *userid,
+				    const char *clientid,
+				    int use_mediamgr,
+				    const char *msys_name,
+				    wcall_ready_h *readyh,
+				    wcall_send_h *sendh,
+				    wcall_sft_req_h *sfth,
+				    wcall_incoming_h *incomingh,
+				    wcall_missed_h *missedh,
+				    wcall_answered_h *answerh,
+				    wcall_estab_h *estabh,
+				    wcall_close_h *closeh,
+				    wcall_metrics_h *metricsh,
+				    wcall_config_req_h *cfg_reqh,
+				    wcall_audio_cbr_change_h *acbrh,
+				    wcall_video_state_change_h *vstateh,
+				    void *arg)
 {
-	WUSER_HANDLE wuser = WUSER_INVALID_HANDLE;			
 	char userid_anon[ANON_ID_LEN];
 	char clientid_anon[ANON_CLIENT_LEN];
 	struct calling_instance *inst = NULL;
@@ -2318,7 +2477,7 @@ WUSER_HANDLE wcall_create_ex(const char *userid,
 		goto out;
 	}
 
-	wuser = create_wuser(inst);
+	inst->wuser = wuser;
 
 	err = wcall_marshal_alloc(&inst->marshal);
 	if (err) {
@@ -2370,6 +2529,10 @@ WUSER_HANDLE wcall_create_ex(const char *userid,
 	if (err)
 		goto out;
 
+	err = cdict_alloc(&inst->convd);
+	if (err)
+		goto out;
+
 	uintptr_t vuser = inst->wuser;
 	err = msystem_get(&inst->msys, msys_name, NULL,
 			  msys_mute_handler, (void*)vuser);
@@ -2408,6 +2571,8 @@ WUSER_HANDLE wcall_create_ex(const char *userid,
 	lock_write_get(calling.lock);
 	list_append(&calling.instances, &inst->le, inst);
 	lock_rel(calling.lock);
+
+	wuser_publish(wuser, inst);
 	
 	//err = async_cfg_wait(inst);
 
@@ -2425,6 +2590,102 @@ out:
 	return wuser;
 }
 
+
+struct create_job {
+	WUSER_HANDLE wuser;
+	const char *userid;
+	const char *clientid;
+	int use_mediamgr;
+	const char *msys_name;
+	wcall_ready_h *readyh;
+	wcall_send_h *sendh;
+	wcall_sft_req_h *sfth;
+	wcall_incoming_h *incomingh;
+	wcall_missed_h *missedh;
+	wcall_answered_h *answerh;
+	wcall_estab_h *estabh;
+	wcall_close_h *closeh;
+	wcall_metrics_h *metricsh;
+	wcall_config_req_h *cfg_reqh;
+	wcall_audio_cbr_change_h *acbrh;
+	wcall_video_state_change_h *vstateh;
+	void *arg;
+};
+
+
+static int create_job_handler(void *arg)
+{
+	struct create_job *job = arg;
+
+	job->wuser = instance_create(job->wuser, job->userid, job->clientid,
+				     job->use_mediamgr, job->msys_name,
+				     job->readyh, job->sendh, job->sfth,
+				     job->incomingh, job->missedh,
+				     job->answerh, job->estabh, job->closeh,
+				     job->metricsh, job->cfg_reqh,
+				     job->acbrh, job->vstateh, job->arg);
+
+	return 0;
+}
+
+
+AVS_EXPORT
+WUSER_HANDLE wcall_create_ex(const char *userid,
+			     const char *clientid,
+			     int use_mediamgr,
+			     const char *msys_name,
+			     wcall_ready_h *readyh,
+			     wcall_send_h *sendh,
+			     wcall_sft_req_h *sfth,
+			     wcall_incoming_h *incomingh,
+			     wcall_missed_h *missedh,
+			     wcall_answered_h *answerh,
+			     wcall_estab_h *estabh,
+			     wcall_close_h *closeh,
+			     wcall_metrics_h *metricsh,
+			     wcall_config_req_h *cfg_reqh,
+			     wcall_audio_cbr_change_h *acbrh,
+			     wcall_video_state_change_h *vstateh,
+			     void *arg)
+{
+	struct create_job job = {
+		.wuser = wuser_alloc(),
+		.userid = userid,
+		.clientid = clientid,
+		.use_mediamgr = use_mediamgr,
+		.msys_name = msys_name,
+		.readyh = readyh,
+		.sendh = sendh,
+		.sfth = sfth,
+		.incomingh = incomingh,
+		.missedh = missedh,
+		.answerh = answerh,
+		.estabh = estabh,
+		.closeh = closeh,
+		.metricsh = metricsh,
+		.cfg_reqh = cfg_reqh,
+		.acbrh = acbrh,
+		.vstateh = vstateh,
+		.arg = arg,
+	};
+	const WUSER_HANDLE wuser = job.wuser;
+	int err;
+
+	if (wuser == WUSER_INVALID_HANDLE) {
+		warning("wcall: create: out of handles\n");
+		return WUSER_INVALID_HANDLE;
+	}
+
+	/* the instance lives on its shard, so it is created there */
+	err = wcall_shard_exec(wuser, create_job_handler, &job);
+	if (err || job.wuser == WUSER_INVALID_HANDLE) {
+		wuser_release(wuser);
+		return WUSER_INVALID_HANDLE;
+	}
+
+	return job.wuser;
+}
+
 AVS_EXPORT
 void wcall_set_shutdown_handler(WUSER_HANDLE wuser,
 				wcall_shutdown_h *shuth, void *arg)
@@ -2455,6 +2716,19 @@ void wcall_i_destroy(struct calling_instance *inst)
 }
 
 
+static int destroy_job_handler(void *arg)
+{
+	struct calling_instance *inst = arg;
+
+	if (inst->shuth)
+		wcall_marshal_destroy(inst);
+	else
+		wcall_i_destroy(inst);
+
+	return 0;
+}
+
+
 AVS_EXPORT
 void wcall_destroy(WUSER_HANDLE wuser)	
 {
@@ -2467,10 +2741,8 @@ void wcall_destroy(WUSER_HANDLE wuser)
 		return;
 	}
 
-	if (inst->shuth)
-		wcall_marshal_destroy(inst);
-	else
-		wcall_i_destroy(inst);
+	/* timers and sockets of the instance belong to its shard */
+	wcall_shard_exec(wuser, destroy_job_handler, inst);
 }
 
 AVS_EXPORT
@@ -3002,11 +3274,24 @@ static void tmr_roaming_handler(void *arg)
 #endif
 
 
-void wcall_i_network_changed(void)
+void wcall_i_network_changed(struct calling_instance *inst)
 {
 	/* Reset the previous timer */
 	//tmr_start(&inst->tmr_roam, 500, tmr_roaming_handler, NULL);
 	info(APITAG "wcall: network_changed\n");
+
+	/* the next call should not wait for the backend */
+	if (inst)
+		config_prefetch(inst->cfg);
+}
+
+
+void wcall_i_app_foreground(struct calling_instance *inst)
+{
+	info(APITAG "wcall: app_foreground\n");
+
+	if (inst)
+		config_prefetch(inst->cfg);
 }
 
 
@@ -3165,12 +3450,63 @@ int  wcall_stats(struct re_printf *pf, WUSER_HANDLE wuser)
 			err |= re_hprintf(pf, "%H\n", wcall->icall->stats,
 					  wcall->icall);
 		}
+
+		/* after the stats, which bring the media phases in */
+		if (wcall->icall) {
+			err |= re_hprintf(pf, "%H\n", icall_timeline_debug,
+					  &wcall->icall->timeline);
+		}
 	}
 	
 	return err;	
 }
 
 
+AVS_EXPORT
+int wcall_trace_export(WUSER_HANDLE wuser, const char *convid, int fmt,
+		       wcall_trace_h *traceh, void *arg)
+{
+	struct calling_instance *inst;
+	struct wcall *wcall;
+	struct mbuf *mb;
+	int err;
+
+	if (!convid || !traceh)
+		return EINVAL;
+
+	inst = wuser2inst(wuser);
+	if (!inst) {
+		warning("wcall: trace_export: invalid wuser=0x%08X\n",
+			wuser);
+		return EINVAL;
+	}
+
+	wcall = wcall_lookup(inst, convid);
+	if (!wcall || !wcall->icall)
+		return ENOENT;
+
+	if (!wcall->icall->trace_export)
+		return ENOTSUP;
+
+	mb = mbuf_alloc(1024);
+	if (!mb)
+		return ENOMEM;
+
+	err = wcall->icall->trace_export(mb, wcall->icall, fmt);
+	if (err) {
+		warning("wcall(%p): trace_export failed (%m)\n", wcall, err);
+		goto out;
+	}
+
+	traceh(mb->buf, mb->end, arg);
+
+ out:
+	mem_deref(mb);
+
+	return err;
+}
+
+
 AVS_EXPORT
 void wcall_set_trace(WUSER_HANDLE wuser, int trace)
 {
@@ -3287,6 +3623,32 @@ void wcall_set_participant_changed_handler(WUSER_HANDLE wuser,
 }
 
 
+AVS_EXPORT
+void wcall_set_participant_delta_handler(WUSER_HANDLE wuser,
+					 wcall_participant_delta_h *deltah,
+					 int snapshot_interval,
+					 void *arg)
+{
+	struct calling_instance *inst;
+
+	inst = wuser2inst(wuser);
+	if (!inst) {
+		warning("wcall: set_participant_delta_handler: "
+			"invalid wuser=0x%08X\n",
+			wuser);
+		return;
+	}
+
+	info(APITAG "wcall: set_participant_delta_handler %p inst=%p "
+	     "snapshot_interval=%d\n", deltah, inst, snapshot_interval);
+
+	inst->group.delta.h = deltah;
+	inst->group.delta.snapshot_interval = snapshot_interval > 0
+		? (uint32_t)snapshot_interval : MEMBDELTA_SNAPSHOT_INTERVAL;
+	inst->group.delta.arg = arg;
+}
+
+
 AVS_EXPORT
 struct wcall_members *wcall_get_members(WUSER_HANDLE wuser, const char *convid)
 {
@@ -3345,6 +3707,31 @@ void wcall_enable_privacy(WUSER_HANDLE wuser, int enabled)
 }
 
 
+AVS_EXPORT
+void wcall_set_decode_budget(WUSER_HANDLE wuser, int max_streams)
+{
+	struct calling_instance *inst;
+
+	inst = wuser2inst(wuser);
+	if (!inst) {
+		warning("wcall: set_decode_budget: invalid wuser=0x%08X\n",
+			wuser);
+		return;
+	}
+
+	info(APITAG "wcall: set_decode_budget max_streams=%d inst=%p\n",
+	     max_streams, inst);
+
+	if (!inst->msys) {
+		warning("wcall: set_decode_budget -- no msystem\n");
+		return;
+	}
+
+	msystem_set_decode_budget(inst->msys,
+				  max_streams > 0 ? (uint32_t)max_streams : 0);
+}
+
+
 const char *wcall_reason_name(int reason)
 {
 	switch (reason) {
@@ -3468,21 +3855,33 @@ void wcall_set_log_handler(wcall_log_h *logh, void *arg)
 static void netprobe_handler(int err, const struct netprobe_result *result,
 			     void *arg)
 {
+	static const struct netprobe_result none;
 	struct calling_instance *inst = arg;
 
 	inst->netprobe = mem_deref(inst->netprobe);
 
-	inst->netprobeh(err, result->rtt_avg,
-			result->n_pkt_sent, result->n_pkt_recv,
-			inst->netprobeh_arg);
+	if (err)
+		result = &none;
+
+	if (inst->netprobeh) {
+		inst->netprobeh(err, result->rtt_avg,
+				result->n_pkt_sent, result->n_pkt_recv,
+				inst->netprobeh_arg);
+	}
+
+	if (inst->netprobe_statsh) {
+		inst->netprobe_statsh(err, result->rtt_avg, result->rtt_p99,
+				      result->jitter,
+				      result->n_pkt_sent, result->n_pkt_recv,
+				      result->n_lost, result->loss_burst_max,
+				      inst->netprobeh_arg);
+	}
 }
 
 
-int wcall_netprobe(WUSER_HANDLE wuser,
-		   size_t pkt_count, uint32_t pkt_interval_ms,
-		   wcall_netprobe_h *netprobeh, void *arg)
+static int netprobe_start(struct calling_instance *inst,
+			  size_t pkt_count, uint32_t pkt_interval_ms)
 {
-	struct calling_instance *inst;
 	struct zapi_ice_server *turnv = NULL;
 	struct zapi_ice_server *turn;
 	struct stun_uri uri;
@@ -3491,18 +3890,6 @@ int wcall_netprobe(WUSER_HANDLE wuser,
 	size_t i;
 	int err;
 
-	inst = wuser2inst(wuser);
-	if (!inst) {
-		warning("wcall: netprobe: invalid wuser=0x%08X\n", wuser);
-		return EINVAL;
-	}
-	
-	if (inst->netprobe)
-		return EBUSY;
-
-	inst->netprobeh = netprobeh;
-	inst->netprobeh_arg = arg;
-
 	turnv = config_get_iceservers(inst->cfg, &turnc);
 	if (turnc == 0) {
 		warning("wcall: netprobe: no turn servers\n");
@@ -3538,9 +3925,92 @@ int wcall_netprobe(WUSER_HANDLE wuser,
 
 	return 0;
 }
+
+
+int wcall_netprobe(WUSER_HANDLE wuser,
+		   size_t pkt_count, uint32_t pkt_interval_ms,
+		   wcall_netprobe_h *netprobeh, void *arg)
+{
+	struct calling_instance *inst;
+
+	inst = wuser2inst(wuser);
+	if (!inst) {
+		warning("wcall: netprobe: invalid wuser=0x%08X\n", wuser);
+		return EINVAL;
+	}
+
+	if (inst->netprobe)
+		return EBUSY;
+
+	inst->netprobeh = netprobeh;
+	inst->netprobe_statsh = NULL;
+	inst->netprobeh_arg = arg;
+
+	return netprobe_start(inst, pkt_count, pkt_interval_ms);
+}
+
+
+int wcall_netprobe_stats(WUSER_HANDLE wuser,
+			 size_t pkt_count, uint32_t pkt_interval_ms,
+			 wcall_netprobe_stats_h *statsh, void *arg)
+{
+	struct calling_instance *inst;
+
+	inst = wuser2inst(wuser);
+	if (!inst) {
+		warning("wcall: netprobe_stats: invalid wuser=0x%08X\n",
+			wuser);
+		return EINVAL;
+	}
+
+	if (inst->netprobe)
+		return EBUSY;
+
+	inst->netprobeh = NULL;
+	inst->netprobe_statsh = statsh;
+	inst->netprobeh_arg = arg;
+
+	return netprobe_start(inst, pkt_count, pkt_interval_ms);
+}
 #endif
 
 
+int wcall_i_set_relay_ranking(struct calling_instance *inst, int interval)
+{
+	int err;
+
+	if (!inst)
+		return EINVAL;
+
+	if (interval <= 0) {
+		inst->relayrank = mem_deref(inst->relayrank);
+		return 0;
+	}
+
+	if (!inst->relayrank) {
+		err = relayrank_alloc(&inst->relayrank,
+				      relayrank_handler, inst);
+		if (err)
+			return err;
+
+		err = relayrank_set_config(inst);
+		if (err)
+			goto out;
+	}
+
+	err = relayrank_start(inst->relayrank, (uint32_t)interval);
+
+ out:
+	if (err) {
+		warning("wcall(%p): set_relay_ranking: failed (%m)\n",
+			inst, err);
+		inst->relayrank = mem_deref(inst->relayrank);
+	}
+
+	return err;
+}
+
+
 AVS_EXPORT
 int wcall_set_network_quality_handler(WUSER_HANDLE wuser,
 				      wcall_network_quality_h *netqh,
@@ -3761,6 +4231,22 @@ int wcall_set_proxy(const char *host, int port)
 	return msystem_set_proxy(host, port);
 }
 
+
+AVS_EXPORT
+int wcall_set_voice_effects(const int *effectv, size_t effectc)
+{
+	int err;
+
+	info(APITAG "wcall: set_voice_effects: %zu effects\n", effectc);
+
+	err = iflow_set_voice_effects(effectv, effectc);
+	if (err) {
+		warning("wcall: set_voice_effects failed (%m)\n", err);
+	}
+
+	return err;
+}
+
 /*
 static void *avs_thread(void *arg)
 {
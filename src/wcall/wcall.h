@@ -57,7 +57,8 @@ void wcall_i_set_audio_send_cbr(struct wcall *wcall);
 void wcall_i_mcat_changed(struct calling_instance *inst,
 			  enum mediamgr_state state);
 void wcall_i_audio_route_changed(enum mediamgr_auplay new_route);
-void wcall_i_network_changed(void);
+void wcall_i_network_changed(struct calling_instance *inst);
+void wcall_i_app_foreground(struct calling_instance *inst);
 
 void wcall_i_invoke_incoming_handler(const char *convid,
 				    uint32_t msg_time,
@@ -74,5 +75,13 @@ void wcall_i_set_media_laddr(struct wcall *wcall,const char *laddr);
 void wcall_i_set_clients_for_conv(struct wcall *wcall, const char *json);
 void wcall_i_destroy(struct calling_instance *inst);
 void wcall_i_set_mute(int muted);
+int  wcall_i_set_relay_ranking(struct calling_instance *inst, int interval);
 void wcall_marshal_destroy(struct calling_instance *inst);
 
+/* Shards */
+typedef int (wcall_shard_h)(void *arg);
+
+unsigned wcall_shard_count(void);
+int  wcall_shard_index(WUSER_HANDLE wuser);
+int  wcall_shard_exec(WUSER_HANDLE wuser, wcall_shard_h *h, void *arg);
+
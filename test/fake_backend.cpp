@@ -27,6 +27,7 @@ void FakeBackend::init()
 	int err;
 
 	tmr_init(&tmr_send);
+	tmr_init(&tmr_config);
 
 	err = sa_set_str(&laddr, "127.0.0.1", 0);
 	ASSERT_EQ(0, err);
@@ -61,6 +62,8 @@ FakeBackend::~FakeBackend()
 	mem_deref(mbq);
 	mem_deref(tcq);
 	tmr_cancel(&tmr_send);
+	tmr_cancel(&tmr_config);
+	mem_deref(config_conn);
 
 	mem_deref(httpsock);
 	mem_deref(ws_conn);
@@ -516,6 +519,44 @@ void FakeBackend::handle_post_clients(struct http_conn *conn,
 }
 
 
+void FakeBackend::config_reply_handler(void *arg)
+{
+	FakeBackend *backend = static_cast<FakeBackend *>(arg);
+	static const char fake_config_json[] =
+		"{\"ttl\":3600,"
+		"\"ice_servers\":[{\"urls\":[\"turn:127.0.0.1:3478\"],"
+		"\"username\":\"user\",\"credential\":\"secret\"}],"
+		"\"sft_servers\":[{\"urls\":[\"https://127.0.0.1:8443\"]}]}";
+	struct http_conn *conn = backend->config_conn;
+
+	backend->config_conn = NULL;
+
+	int err = http_reply(conn, 200, "OK",
+			     "Content-Type: application/json\r\n"
+			     "Content-Length: %zu\r\n"
+			     "\r\n"
+			     "%s"
+			     ,
+			     str_len(fake_config_json),
+			     fake_config_json);
+	mem_deref(conn);
+	ASSERT_EQ(0, err);
+}
+
+
+void FakeBackend::handle_calls_config(struct http_conn *conn,
+				      const struct http_msg *msg)
+{
+	++config_reqs;
+
+	/* one request at a time is enough for the tests */
+	mem_deref(config_conn);
+	config_conn = (struct http_conn *)mem_ref(conn);
+
+	tmr_start(&tmr_config, config_delay, config_reply_handler, this);
+}
+
+
 void FakeBackend::handleRequest(struct http_conn *conn,
 				const struct http_msg *msg)
 {
@@ -587,6 +628,11 @@ void FakeBackend::handleRequest(struct http_conn *conn,
 
 		handle_post_clients(conn, msg);
 	}
+	else if (0 == pl_strcasecmp(&msg->met, "GET") &&
+		 0 == pl_strcasecmp(&msg->path, "/calls/config/v2")) {
+
+		handle_calls_config(conn, msg);
+	}
 	else {
 		http_ereply(conn, 401, "Unauthorized");
 	}
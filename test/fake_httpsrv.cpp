@@ -28,7 +28,19 @@ static void http_req_handler(struct http_conn *conn, const struct http_msg *msg,
 
 	++srv->n_req;
 
-	http_reply(conn, 200, "OK", NULL);
+	if (srv->body) {
+		http_reply(conn, 200, "OK",
+			   "Content-Type: application/json\r\n"
+			   "%s"
+			   "Content-Length: %zu\r\n"
+			   "\r\n"
+			   "%b",
+			   srv->body_gzip ? "Content-Encoding: gzip\r\n" : "",
+			   srv->body_len, srv->body, srv->body_len);
+	}
+	else {
+		http_reply(conn, 200, "OK", NULL);
+	}
 
 	if (srv->n_cancel_after && srv->n_req >= srv->n_cancel_after) {
 		re_cancel();
@@ -69,6 +69,9 @@ public:
 				const struct http_msg *msg);
 	void handle_post_clients(struct http_conn *conn,
 				const struct http_msg *msg);
+	void handle_calls_config(struct http_conn *conn,
+				 const struct http_msg *msg);
+	static void config_reply_handler(void *arg);
 
 	int simulate_message(const char *content);
 
@@ -134,6 +137,12 @@ public:
 	unsigned frag_size = 32;
 
 	struct odict *clients = nullptr;
+
+	/* GET /calls/config/v2 */
+	unsigned config_reqs = 0;
+	unsigned config_delay = 0;  /* [ms] before the reply */
+	struct http_conn *config_conn = nullptr;
+	struct tmr tmr_config;
 };
 
 
@@ -185,6 +194,11 @@ public:
 	char url[256] = "";
 	unsigned n_req = 0;
 	unsigned n_cancel_after = 0;
+
+	/* optional JSON body for all replies */
+	const uint8_t *body = nullptr;
+	size_t body_len = 0;
+	bool body_gzip = false;
 };
 
 
@@ -13,18 +13,26 @@ TEST_SRCS	+= test_version.cpp
 #TEST_SRCS	+= test_acm.cpp
 #TEST_SRCS	+= test_apm.cpp
 #TEST_SRCS	+= test_audummy.cpp
+TEST_SRCS	+= test_aufanout.cpp
+TEST_SRCS	+= test_bundle.cpp
 #TEST_SRCS	+= test_bwe.cpp
+TEST_SRCS	+= test_cdict.cpp
 TEST_SRCS	+= test_cert.cpp
 TEST_SRCS	+= test_chunk.cpp
+TEST_SRCS	+= test_config.cpp
 #TEST_SRCS	+= test_confpos.cpp
 TEST_SRCS	+= test_cookie.cpp
 #TEST_SRCS	+= test_dce.cpp
+TEST_SRCS	+= test_decbudget.cpp
 TEST_SRCS	+= test_dict.cpp
 #TEST_SRCS	+= test_dtls.cpp
 #TEST_SRCS	+= test_ecall.cpp
 TEST_SRCS	+= test_econn.cpp
+TEST_SRCS	+= test_econn_fmt.cpp
 TEST_SRCS	+= test_engine.cpp
+TEST_SRCS	+= test_evq.cpp
 TEST_SRCS	+= test_frame_hdr.cpp
+TEST_SRCS	+= test_frame_stats.cpp
 TEST_SRCS	+= test_http.cpp
 TEST_SRCS	+= test_jzon.cpp
 TEST_SRCS	+= test_keystore.cpp
@@ -35,15 +43,19 @@ TEST_SRCS	+= test_login.cpp
 #TEST_SRCS	+= test_media_crypto.cpp
 #TEST_SRCS	+= test_media_dual.cpp
 #TEST_SRCS	+= test_mediastats.cpp
+TEST_SRCS	+= test_membdelta.cpp
 TEST_SRCS	+= test_msystem.cpp
 #TEST_SRCS	+= test_netprobe.cpp
+TEST_SRCS	+= test_netprobe_analyze.cpp
 TEST_SRCS	+= test_network.cpp
 TEST_SRCS	+= test_nevent.cpp
 #TEST_SRCS	+= test_packetqueue.cpp
+TEST_SRCS	+= test_relayrank.cpp
 #TEST_SRCS	+= test_resampler.cpp
 TEST_SRCS	+= test_rest.cpp
 #TEST_SRCS	+= test_srtp.cpp
 TEST_SRCS	+= test_string.cpp
+TEST_SRCS	+= test_timeline.cpp
 #TEST_SRCS	+= test_turn.cpp
 TEST_SRCS	+= test_uuid.cpp
 #TEST_SRCS	+= test_vidcodec.cpp
@@ -61,6 +73,10 @@ else
 TEST_SRCS	+= test_mediamgr.cpp
 endif
 
+ifeq ($(HAVE_WEBRTC),1)
+TEST_SRCS	+= test_aueffect_chain.cpp
+TEST_SRCS	+= test_audio_file.cpp
+endif
 ifneq ($(HAVE_PROTOBUF),)
 TEST_SRCS	+= test_protobuf.cpp
 endif
@@ -0,0 +1,170 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <unistd.h>
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+#define FS_HZ 16000
+#define NUM_SAMPLES (FS_HZ + 123)
+
+
+class AudioFile : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		re_snprintf(in, sizeof(in), "/tmp/ztest_af_%d_in.wav",
+			    (int)getpid());
+		re_snprintf(out, sizeof(out), "/tmp/ztest_af_%d_out.wav",
+			    (int)getpid());
+
+		for (int i = 0; i < NUM_SAMPLES; i++)
+			sampv[i] = (int16_t)(i - NUM_SAMPLES / 2);
+	}
+
+	virtual void TearDown() override
+	{
+		mem_deref(ar);
+		unlink(in);
+		unlink(out);
+	}
+
+	void write_file(const char *path, enum audio_file_fmt fmt)
+	{
+		struct audio_writer *aw = NULL;
+
+		ASSERT_EQ(0, audio_writer_open(&aw, path, fmt, FS_HZ, 1));
+
+		/* in odd pieces, across the write buffer */
+		ASSERT_EQ(0, audio_writer_write(aw, sampv, 1000));
+		ASSERT_EQ(0, audio_writer_write(aw, &sampv[1000],
+						NUM_SAMPLES - 1000));
+		ASSERT_EQ(NUM_SAMPLES, audio_writer_samples(aw));
+		ASSERT_EQ(0, audio_writer_close(aw));
+		ASSERT_EQ(EBADF, audio_writer_write(aw, sampv, 1));
+
+		mem_deref(aw);
+	}
+
+	size_t file_size(const char *path)
+	{
+		FILE *f = fopen(path, "rb");
+		long sz;
+
+		if (!f)
+			return 0;
+
+		fseek(f, 0, SEEK_END);
+		sz = ftell(f);
+		fclose(f);
+
+		return sz;
+	}
+
+protected:
+	char in[64];
+	char out[64];
+	int16_t sampv[NUM_SAMPLES];
+	struct audio_reader *ar = NULL;
+};
+
+
+TEST_F(AudioFile, wav_roundtrip)
+{
+	const int16_t *v;
+	size_t n;
+
+	write_file(in, AUDIO_FILE_WAV);
+	ASSERT_EQ(44 + NUM_SAMPLES * sizeof(int16_t), file_size(in));
+
+	ASSERT_EQ(0, audio_reader_open(&ar, in, AUDIO_FILE_WAV, 0));
+	ASSERT_EQ(FS_HZ, audio_reader_srate(ar));
+	ASSERT_EQ(1, audio_reader_channels(ar));
+
+	v = audio_reader_samples(ar, &n);
+	ASSERT_EQ(NUM_SAMPLES, n);
+	ASSERT_EQ(0, memcmp(sampv, v, sizeof(sampv)));
+}
+
+
+TEST_F(AudioFile, pcm_has_no_header)
+{
+	size_t n;
+
+	write_file(in, AUDIO_FILE_PCM);
+	ASSERT_EQ(NUM_SAMPLES * sizeof(int16_t), file_size(in));
+
+	ASSERT_EQ(0, audio_reader_open(&ar, in, AUDIO_FILE_PCM, FS_HZ));
+	ASSERT_EQ(0, memcmp(sampv, audio_reader_samples(ar, &n),
+			    sizeof(sampv)));
+	ASSERT_EQ(NUM_SAMPLES, n);
+
+	/* and is not taken for a WAV file */
+	mem_deref(ar);
+	ar = NULL;
+	ASSERT_EQ(EPROTO, audio_reader_open(&ar, in, AUDIO_FILE_WAV, 0));
+}
+
+
+TEST_F(AudioFile, float_output)
+{
+	write_file(out, AUDIO_FILE_WAV_FLOAT);
+	ASSERT_EQ(58 + NUM_SAMPLES * sizeof(float), file_size(out));
+
+	/* the effects only read 16-bit input */
+	ASSERT_EQ(ENOTSUP, audio_reader_open(&ar, out, AUDIO_FILE_WAV, 0));
+}
+
+
+TEST_F(AudioFile, reverse_effect)
+{
+	const int16_t *v;
+	size_t n;
+
+	write_file(in, AUDIO_FILE_WAV);
+
+	ASSERT_EQ(0, apply_effect_to_wav(in, out, AUDIO_EFFECT_REVERSE,
+					 false, NULL, NULL));
+
+	ASSERT_EQ(0, audio_reader_open(&ar, out, AUDIO_FILE_WAV, 0));
+	v = audio_reader_samples(ar, &n);
+	ASSERT_EQ(2 * NUM_SAMPLES, n);
+
+	for (int i = 0; i < NUM_SAMPLES; i++) {
+		ASSERT_EQ(sampv[NUM_SAMPLES - 1 - i], v[i]);
+		ASSERT_EQ(sampv[i], v[NUM_SAMPLES + i]);
+	}
+}
+
+
+TEST_F(AudioFile, bad_args)
+{
+	struct audio_writer *aw = NULL;
+
+	ASSERT_EQ(EINVAL, audio_reader_open(NULL, in, AUDIO_FILE_WAV, 0));
+	ASSERT_EQ(EINVAL, audio_reader_open(&ar, in, AUDIO_FILE_PCM, 0));
+	ASSERT_EQ(EINVAL, audio_reader_open(&ar, in, AUDIO_FILE_WAV_FLOAT,
+					    0));
+	ASSERT_EQ(ENOENT, audio_reader_open(&ar, "/nonexistent",
+					    AUDIO_FILE_WAV, 0));
+	ASSERT_EQ(EINVAL, audio_writer_open(&aw, out, AUDIO_FILE_WAV, 0, 1));
+	ASSERT_EQ(EINVAL, audio_writer_write(NULL, sampv, 1));
+}
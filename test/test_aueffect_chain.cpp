@@ -0,0 +1,393 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+#define FS_HZ 48000
+#define FRAME (FS_HZ / 100)
+#define NUM_FRAMES 500
+
+
+/* Voiced-ish test signal, a 150 Hz tone with a couple of harmonics */
+static void make_frame(int16_t *sampv, size_t n, size_t pos)
+{
+	for (size_t i = 0; i < n; i++) {
+		double t = (double)(pos + i) / FS_HZ;
+
+		sampv[i] = (int16_t)(6000 * sin(2 * M_PI * 150 * t)
+				     + 2000 * sin(2 * M_PI * 300 * t)
+				     + 1000 * sin(2 * M_PI * 450 * t));
+	}
+}
+
+
+class AueffectChain : public ::testing::Test {
+
+public:
+	virtual void TearDown() override
+	{
+		mem_deref(chain);
+	}
+
+	/* Run frames through the chain, returns how many came out changed */
+	size_t run(size_t framec)
+	{
+		int16_t in[FRAME], out[FRAME];
+		size_t changed = 0;
+
+		for (size_t f = 0; f < framec; f++) {
+			make_frame(in, FRAME, pos);
+			pos += FRAME;
+
+			memcpy(out, in, sizeof(out));
+			EXPECT_EQ(0, aueffect_chain_process(chain, out, FRAME));
+
+			if (memcmp(in, out, sizeof(out)))
+				++changed;
+		}
+
+		return changed;
+	}
+
+protected:
+	struct aueffect_chain *chain = NULL;
+	size_t pos = 0;
+};
+
+
+/*
+ * Not a pass/fail check on speed, but the harness to see what each
+ * chain costs: worst-case processing time for one 10 ms frame.
+ */
+TEST_F(AueffectChain, worst_case_frame_time)
+{
+	static const struct {
+		const char *name;
+		enum audio_effect effectv[AUEFFECT_CHAIN_MAX];
+		size_t effectc;
+	} chainv[] = {
+		{"normalizer", {AUDIO_EFFECT_NORMALIZER}, 1},
+		{"pitch_up", {AUDIO_EFFECT_PITCH_UP_SHIFT_MED}, 1},
+		{"reverb", {AUDIO_EFFECT_REVERB_MID}, 1},
+		{"vocoder", {AUDIO_EFFECT_VOCODER_MED}, 1},
+		{"harmonizer", {AUDIO_EFFECT_HARMONIZER_MED}, 1},
+		{"norm>pitch>reverb", {AUDIO_EFFECT_NORMALIZER,
+				       AUDIO_EFFECT_PITCH_UP_SHIFT_MED,
+				       AUDIO_EFFECT_REVERB_MID}, 3},
+		{"norm>autotune>chorus>reverb", {AUDIO_EFFECT_NORMALIZER,
+						 AUDIO_EFFECT_AUTO_TUNE_MED,
+						 AUDIO_EFFECT_CHORUS_MED,
+						 AUDIO_EFFECT_REVERB_MID}, 4},
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(chainv); i++) {
+		struct aueffect_chain_stats st;
+
+		/* a whole frame of budget, nothing should bypass */
+		ASSERT_EQ(0, aueffect_chain_alloc(&chain, FS_HZ, 10000));
+		ASSERT_EQ(0, aueffect_chain_set(chain, chainv[i].effectv,
+						chainv[i].effectc));
+
+		ASSERT_GT(run(NUM_FRAMES), 0u);
+
+		aueffect_chain_get_stats(chain, &st);
+		ASSERT_EQ(NUM_FRAMES, st.frames);
+
+		re_printf("  %-28s worst %5u us/frame  overruns %u\n",
+			  chainv[i].name, st.max_us, st.overruns);
+
+		chain = (struct aueffect_chain *)mem_deref(chain);
+	}
+}
+
+
+TEST_F(AueffectChain, empty_chain_passes_through)
+{
+	struct aueffect_chain_stats st;
+
+	ASSERT_EQ(0, aueffect_chain_alloc(&chain, FS_HZ, 0));
+	ASSERT_EQ(0u, run(10));
+
+	aueffect_chain_get_stats(chain, &st);
+	ASSERT_EQ(0u, st.frames);
+	ASSERT_EQ(AUEFFECT_CHAIN_BUDGET, st.budget_us);
+
+	/* and again once effects have been turned off */
+	enum audio_effect fx = AUDIO_EFFECT_REVERB;
+	ASSERT_EQ(0, aueffect_chain_set(chain, &fx, 1));
+	ASSERT_GT(run(10), 0u);
+	ASSERT_EQ(0, aueffect_chain_set(chain, NULL, 0));
+	ASSERT_EQ(0u, run(10));
+}
+
+
+TEST_F(AueffectChain, overruns_bypass)
+{
+	const enum audio_effect fxv[] = {
+		AUDIO_EFFECT_HARMONIZER_MAX,
+		AUDIO_EFFECT_VOCODER_MED,
+		AUDIO_EFFECT_AUTO_TUNE_MAX,
+		AUDIO_EFFECT_REVERB_MAX,
+	};
+	struct aueffect_chain_stats st;
+
+	/* no chain can make a 1 us budget */
+	ASSERT_EQ(0, aueffect_chain_alloc(&chain, FS_HZ, 1));
+	ASSERT_EQ(0, aueffect_chain_set(chain, fxv, ARRAY_SIZE(fxv)));
+
+	ASSERT_EQ(0u, run(20));
+
+	aueffect_chain_get_stats(chain, &st);
+	ASSERT_TRUE(st.overloaded);
+	ASSERT_EQ(20u, st.frames);
+	ASSERT_EQ(20u, st.bypassed);
+	ASSERT_GE(st.overruns, 3u);
+	ASSERT_LT(st.overruns, 20u);
+
+	/* lifting the bypass with a workable budget runs the chain again */
+	aueffect_chain_set_budget(chain, 10000);
+	aueffect_chain_set_bypass(chain, false);
+	ASSERT_GT(run(20), 0u);
+
+	aueffect_chain_get_stats(chain, &st);
+	ASSERT_FALSE(st.overloaded);
+
+	/* an explicit bypass holds until it is lifted */
+	aueffect_chain_set_bypass(chain, true);
+	ASSERT_EQ(0u, run(5));
+	aueffect_chain_set_bypass(chain, false);
+	ASSERT_GT(run(5), 0u);
+}
+
+
+struct updater {
+	struct aueffect_chain *chain;
+	volatile bool run;
+	unsigned setc;
+};
+
+
+static void *updater_thread(void *arg)
+{
+	struct updater *upd = (struct updater *)arg;
+	const enum audio_effect fxv[] = {
+		AUDIO_EFFECT_NORMALIZER,
+		AUDIO_EFFECT_PITCH_DOWN_SHIFT_MIN,
+		AUDIO_EFFECT_CHORUS,
+		AUDIO_EFFECT_REVERB_MIN,
+	};
+
+	while (upd->run) {
+		size_t n = upd->setc % (ARRAY_SIZE(fxv) + 1);
+
+		if (aueffect_chain_set(upd->chain, fxv, n))
+			break;
+
+		++upd->setc;
+		usleep(500);
+	}
+
+	return NULL;
+}
+
+
+/* The app thread swaps chains while the audio thread runs them */
+TEST_F(AueffectChain, update_while_processing)
+{
+	struct updater upd;
+	pthread_t tid;
+
+	ASSERT_EQ(0, aueffect_chain_alloc(&chain, FS_HZ, 10000));
+
+	upd.chain = chain;
+	upd.run = true;
+	upd.setc = 0;
+	ASSERT_EQ(0, pthread_create(&tid, NULL, updater_thread, &upd));
+
+	run(1000);
+
+	upd.run = false;
+	pthread_join(tid, NULL);
+
+	ASSERT_GT(upd.setc, 0u);
+}
+
+
+TEST_F(AueffectChain, srate_change)
+{
+	enum audio_effect fx = AUDIO_EFFECT_PITCH_UP_SHIFT;
+	int16_t sampv[FRAME];
+
+	ASSERT_EQ(0, aueffect_chain_alloc(&chain, FS_HZ, 10000));
+	ASSERT_EQ(0, aueffect_chain_set(chain, &fx, 1));
+
+	make_frame(sampv, FRAME, 0);
+	ASSERT_EQ(0, aueffect_chain_process(chain, sampv, FRAME));
+
+	/* the effects are kept, the frame size follows the rate */
+	ASSERT_EQ(0, aueffect_chain_set_srate(chain, 16000));
+	ASSERT_EQ(EPROTO, aueffect_chain_process(chain, sampv, FRAME));
+	ASSERT_EQ(0, aueffect_chain_process(chain, sampv, 160));
+
+	ASSERT_EQ(0, aueffect_chain_set_srate(chain, 32000));
+	ASSERT_EQ(0, aueffect_chain_process(chain, sampv, 320));
+
+	/* only the rates of the APM have resamplers ready */
+	ASSERT_EQ(EINVAL, aueffect_chain_set_srate(chain, 44100));
+	ASSERT_EQ(0, aueffect_chain_process(chain, sampv, 320));
+
+	/* and back, the effects still apply */
+	ASSERT_EQ(0, aueffect_chain_set_srate(chain, FS_HZ));
+	ASSERT_GT(run(50), 0u);
+}
+
+
+TEST_F(AueffectChain, shared_pitch_analysis)
+{
+	static const struct {
+		enum audio_effect effectv[AUEFFECT_CHAIN_MAX];
+		size_t effectc;
+		uint32_t shared;
+	} chainv[] = {
+		/* all of them see the pitch of the chain input */
+		{{AUDIO_EFFECT_AUTO_TUNE_MED, AUDIO_EFFECT_VOCODER_MED,
+		  AUDIO_EFFECT_HARMONIZER_MED}, 3, 2},
+		{{AUDIO_EFFECT_NORMALIZER, AUDIO_EFFECT_AUTO_TUNE_MED,
+		  AUDIO_EFFECT_REVERB, AUDIO_EFFECT_PITCH_UP_SHIFT_MED}, 4, 2},
+
+		/* the harmonizer changes the pitch for the pitch shift */
+		{{AUDIO_EFFECT_HARMONIZER_MED, AUDIO_EFFECT_PITCH_DOWN_SHIFT},
+		 2, 0},
+
+		/* the vocoder sets a pitch of its own */
+		{{AUDIO_EFFECT_VOCODER_MED, AUDIO_EFFECT_AUTO_TUNE_MED,
+		  AUDIO_EFFECT_HARMONIZER_MED}, 3, 0},
+
+		/* nothing to share */
+		{{AUDIO_EFFECT_NORMALIZER, AUDIO_EFFECT_AUTO_TUNE_MED,
+		  AUDIO_EFFECT_REVERB}, 3, 0},
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(chainv); i++) {
+		struct aueffect_chain_stats st;
+
+		ASSERT_EQ(0, aueffect_chain_alloc(&chain, FS_HZ, 10000));
+		ASSERT_EQ(0, aueffect_chain_set(chain, chainv[i].effectv,
+						chainv[i].effectc));
+
+		ASSERT_GT(run(50), 0u);
+
+		aueffect_chain_get_stats(chain, &st);
+		ASSERT_EQ(chainv[i].shared, st.pitch_shared);
+
+		chain = (struct aueffect_chain *)mem_deref(chain);
+	}
+}
+
+
+/*
+ * Sharing must not change what the effects do. The tone is on a note,
+ * so auto-tune keeps its pitch, and the harmonizer should find about
+ * the same lags on the auto-tune output as on the chain input.
+ */
+TEST_F(AueffectChain, shared_pitch_matches_own_analysis)
+{
+	enum { FS = 32000, N = FS / 100, WARMUP = 10 };
+	const enum audio_effect fxv[] = {
+		AUDIO_EFFECT_AUTO_TUNE_MED, AUDIO_EFFECT_HARMONIZER_MED
+	};
+	struct aueffect *auev[ARRAY_SIZE(fxv)] = {NULL, NULL};
+	struct aueffect_chain_stats st;
+	int16_t in[N], shared[N], tmp[N], own[N];
+	double sig = 0, diff = 0;
+	size_t n;
+
+	ASSERT_EQ(0, aueffect_chain_alloc(&chain, FS, 1000000));
+	ASSERT_EQ(0, aueffect_chain_set(chain, fxv, ARRAY_SIZE(fxv)));
+
+	for (size_t i = 0; i < ARRAY_SIZE(fxv); i++)
+		ASSERT_EQ(0, aueffect_alloc(&auev[i], fxv[i], FS));
+
+	for (size_t f = 0; f < NUM_FRAMES; f++) {
+		for (size_t i = 0; i < N; i++) {
+			double t = (double)(f * N + i) / FS;
+
+			in[i] = (int16_t)(6000 * sin(2 * M_PI * 220 * t)
+					  + 2000 * sin(2 * M_PI * 440 * t));
+		}
+
+		memcpy(shared, in, sizeof(shared));
+		ASSERT_EQ(0, aueffect_chain_process(chain, shared, N));
+
+		ASSERT_EQ(0, aueffect_process(auev[0], in, tmp, N, &n));
+		ASSERT_EQ(0, aueffect_process(auev[1], tmp, own, N, &n));
+
+		if (f < WARMUP)
+			continue;
+
+		for (size_t i = 0; i < N; i++) {
+			double d = (double)shared[i] - own[i];
+
+			sig += (double)own[i] * own[i];
+			diff += d * d;
+		}
+	}
+
+	aueffect_chain_get_stats(chain, &st);
+	ASSERT_EQ(2u, st.pitch_shared);
+	ASSERT_EQ(0u, st.bypassed);
+
+	/* the difference stays 10 dB below the signal */
+	ASSERT_GT(sig, 0.0);
+	ASSERT_LT(diff, sig / 10);
+
+	for (size_t i = 0; i < ARRAY_SIZE(fxv); i++)
+		mem_deref(auev[i]);
+}
+
+
+TEST_F(AueffectChain, bad_args)
+{
+	const enum audio_effect fxv[AUEFFECT_CHAIN_MAX + 1] = {
+		AUDIO_EFFECT_CHORUS,
+	};
+	enum audio_effect fx;
+
+	ASSERT_EQ(EINVAL, aueffect_chain_alloc(NULL, FS_HZ, 0));
+	ASSERT_EQ(EINVAL, aueffect_chain_alloc(&chain, 44100 + 1, 0));
+	ASSERT_EQ(EINVAL, aueffect_chain_alloc(&chain, 96000, 0));
+	ASSERT_EQ(0, aueffect_chain_alloc(&chain, FS_HZ, 0));
+
+	ASSERT_EQ(EINVAL, aueffect_chain_set(chain, NULL, 1));
+	ASSERT_EQ(EINVAL, aueffect_chain_set(chain, fxv,
+					     AUEFFECT_CHAIN_MAX + 1));
+	ASSERT_EQ(EINVAL, aueffect_chain_set_srate(chain, 0));
+	ASSERT_EQ(EINVAL, aueffect_chain_process(chain, NULL, FRAME));
+
+	/* these change the length of the signal */
+	fx = AUDIO_EFFECT_PACE_UP_SHIFT_MED;
+	ASSERT_EQ(ENOTSUP, aueffect_chain_set(chain, &fx, 1));
+	fx = AUDIO_EFFECT_REVERSE;
+	ASSERT_EQ(ENOTSUP, aueffect_chain_set(chain, &fx, 1));
+}
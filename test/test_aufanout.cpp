@@ -0,0 +1,362 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+#define SAMPC      480   /* 10ms @ 48kHz */
+#define PTIME_CHUNKS 4   /* 40ms packets, as in group calls */
+
+
+/*
+ * A stand-in for Opus: buffers PTIME_CHUNKS chunks and puts their
+ * autocorrelation into the packet. bench_aufanout measures the real
+ * encoder.
+ */
+struct fake_enc {
+	int16_t buf[SAMPC * PTIME_CHUNKS];
+	unsigned nchunks;
+	unsigned npackets;
+	unsigned ncalls;
+};
+
+
+static int fake_encode(uint8_t *dst, size_t *lenp,
+		       struct aufanout_meta *meta,
+		       const int16_t *sampv, size_t sampc, void *arg)
+{
+	struct fake_enc *enc = (struct fake_enc *)arg;
+	int64_t acf[17];
+	size_t i, k, n;
+
+	++enc->ncalls;
+
+	memcpy(&enc->buf[enc->nchunks * SAMPC], sampv,
+	       sampc * sizeof(*sampv));
+	if (++enc->nchunks < PTIME_CHUNKS) {
+		*lenp = 0;
+		return 0;
+	}
+
+	n = SAMPC * PTIME_CHUNKS;
+	for (k = 0; k < 17; k++) {
+		acf[k] = 0;
+		for (i = k; i < n; i++)
+			acf[k] += (int32_t)enc->buf[i] * enc->buf[i - k];
+	}
+
+	if (*lenp < sizeof(acf))
+		return ENOMEM;
+
+	memcpy(dst, acf, sizeof(acf));
+	*lenp = sizeof(acf);
+	meta->speech = acf[0] != 0;
+	meta->codec = 42;
+
+	enc->nchunks = 0;
+	++enc->npackets;
+
+	return 0;
+}
+
+
+static void make_chunk(int16_t *sampv, unsigned seq)
+{
+	for (size_t i = 0; i < SAMPC; i++)
+		sampv[i] = (int16_t)(((seq * SAMPC + i) * 2654435761u) >> 20);
+}
+
+
+class AufanoutTest : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		memset(&enc, 0, sizeof(enc));
+		ASSERT_EQ(0, aufanout_alloc(&af, SAMPC, 512,
+					    fake_encode, &enc));
+	}
+
+	virtual void TearDown() override
+	{
+		mem_deref(af);
+	}
+
+protected:
+	struct fake_enc enc;
+	struct aufanout *af = NULL;
+};
+
+
+TEST_F(AufanoutTest, single_sink)
+{
+	struct aufanout_sink *sink;
+	int16_t sampv[SAMPC];
+	uint8_t pkt[512];
+	unsigned npkt = 0;
+
+	ASSERT_EQ(0, aufanout_sink_alloc(&sink, af));
+	ASSERT_EQ(1, aufanout_sink_count(af));
+
+	for (unsigned i = 0; i < 40; i++) {
+		struct aufanout_meta meta;
+		size_t len = sizeof(pkt);
+
+		make_chunk(sampv, i);
+		ASSERT_EQ(0, aufanout_encode(sink, pkt, &len, &meta,
+					     sampv, SAMPC));
+		if (len) {
+			ASSERT_EQ(PTIME_CHUNKS, meta.span);
+			ASSERT_TRUE(meta.speech);
+			ASSERT_EQ(42, meta.codec);
+			++npkt;
+		}
+	}
+
+	ASSERT_EQ(10, npkt);
+	ASSERT_EQ(40, enc.ncalls);
+
+	mem_deref(sink);
+	ASSERT_EQ(0, aufanout_sink_count(af));
+}
+
+
+TEST_F(AufanoutTest, shared_between_sinks)
+{
+	struct aufanout_sink *sinkv[4];
+	struct aufanout_stats stats;
+	int16_t sampv[SAMPC];
+
+	for (auto &sink : sinkv)
+		ASSERT_EQ(0, aufanout_sink_alloc(&sink, af));
+
+	for (unsigned i = 0; i < 40; i++) {
+		uint8_t ref[512];
+		size_t reflen = 0;
+
+		make_chunk(sampv, i);
+
+		/* deliver in a different order every time */
+		for (unsigned j = 0; j < 4; j++) {
+			struct aufanout_sink *sink = sinkv[(i + j) % 4];
+			uint8_t pkt[512];
+			size_t len = sizeof(pkt);
+
+			ASSERT_EQ(0, aufanout_encode(sink, pkt, &len, NULL,
+						     sampv, SAMPC));
+			if (j == 0) {
+				memcpy(ref, pkt, len);
+				reflen = len;
+			}
+			else {
+				ASSERT_EQ(reflen, len);
+				ASSERT_EQ(0, memcmp(ref, pkt, len));
+			}
+		}
+	}
+
+	/* every chunk went through the encoder exactly once */
+	ASSERT_EQ(40, enc.ncalls);
+	ASSERT_EQ(10, enc.npackets);
+
+	aufanout_get_stats(af, &stats);
+	ASSERT_EQ(40, stats.encoded);
+	ASSERT_EQ(120, stats.shared);
+	ASSERT_EQ(0, stats.resync);
+
+	for (auto &sink : sinkv)
+		mem_deref(sink);
+}
+
+
+TEST_F(AufanoutTest, late_and_lagging_sinks)
+{
+	struct aufanout_sink *a, *b;
+	int16_t sampv[AUFANOUT_RING + 8][SAMPC];
+	uint8_t pkt[512];
+	size_t len;
+
+	for (unsigned i = 0; i < AUFANOUT_RING + 8; i++)
+		make_chunk(sampv[i], i);
+
+	ASSERT_EQ(0, aufanout_sink_alloc(&a, af));
+	ASSERT_EQ(0, aufanout_sink_alloc(&b, af));
+
+	/* a runs 6 chunks ahead, b joins late and catches up */
+	for (unsigned i = 0; i < 6; i++) {
+		len = sizeof(pkt);
+		ASSERT_EQ(0, aufanout_encode(a, pkt, &len, NULL,
+					     sampv[i], SAMPC));
+	}
+	for (unsigned i = 6; i < AUFANOUT_RING + 8; i++) {
+		len = sizeof(pkt);
+		ASSERT_EQ(0, aufanout_encode(a, pkt, &len, NULL,
+					     sampv[i], SAMPC));
+		len = sizeof(pkt);
+		ASSERT_EQ(0, aufanout_encode(b, pkt, &len, NULL,
+					     sampv[i - 3], SAMPC));
+	}
+	ASSERT_EQ(AUFANOUT_RING + 8, enc.ncalls);
+
+	/* b drops a chunk, it must not be encoded twice */
+	len = sizeof(pkt);
+	ASSERT_EQ(0, aufanout_encode(b, pkt, &len, NULL,
+				     sampv[AUFANOUT_RING + 6], SAMPC));
+	ASSERT_EQ(AUFANOUT_RING + 8, enc.ncalls);
+
+	/* a at the head delivers a new chunk: encoded once more */
+	make_chunk(sampv[0], 1000);
+	len = sizeof(pkt);
+	ASSERT_EQ(0, aufanout_encode(a, pkt, &len, NULL, sampv[0], SAMPC));
+	ASSERT_EQ(AUFANOUT_RING + 9, enc.ncalls);
+
+	mem_deref(b);
+	mem_deref(a);
+}
+
+
+TEST_F(AufanoutTest, diverged_sink)
+{
+	struct aufanout_sink *a, *b;
+	struct aufanout_stats stats;
+	int16_t sampv[3][SAMPC];
+	uint8_t pkt[512];
+	size_t len;
+
+	for (unsigned i = 0; i < 3; i++)
+		make_chunk(sampv[i], i);
+
+	ASSERT_EQ(0, aufanout_sink_alloc(&a, af));
+	ASSERT_EQ(0, aufanout_sink_alloc(&b, af));
+
+	/* both start out with the same chunk */
+	len = sizeof(pkt);
+	ASSERT_EQ(0, aufanout_encode(a, pkt, &len, NULL, sampv[0], SAMPC));
+	len = sizeof(pkt);
+	ASSERT_EQ(0, aufanout_encode(b, pkt, &len, NULL, sampv[0], SAMPC));
+
+	len = sizeof(pkt);
+	ASSERT_EQ(0, aufanout_encode(a, pkt, &len, NULL, sampv[1], SAMPC));
+	ASSERT_EQ(2, enc.ncalls);
+
+	/* b's next chunk differs from what the encoder got from a */
+	len = sizeof(pkt);
+	ASSERT_EQ(EPROTO, aufanout_encode(b, pkt, &len, NULL,
+					  sampv[2], SAMPC));
+	ASSERT_EQ(2, enc.ncalls);
+
+	/* b stays cut off, even with a matching chunk */
+	len = sizeof(pkt);
+	ASSERT_EQ(EPROTO, aufanout_encode(b, pkt, &len, NULL,
+					  sampv[1], SAMPC));
+
+	/* a is not affected */
+	len = sizeof(pkt);
+	ASSERT_EQ(0, aufanout_encode(a, pkt, &len, NULL, sampv[2], SAMPC));
+	ASSERT_EQ(3, enc.ncalls);
+
+	aufanout_get_stats(af, &stats);
+	ASSERT_EQ(1, stats.diverged);
+
+	mem_deref(b);
+	mem_deref(a);
+}
+
+
+TEST_F(AufanoutTest, content_not_hash)
+{
+	struct aufanout_sink *a, *b;
+	int16_t x[SAMPC], y[SAMPC];
+	uint8_t pkt[512];
+	size_t len;
+
+	/* y differs from x in one sample only */
+	make_chunk(x, 7);
+	memcpy(y, x, sizeof(y));
+	y[SAMPC / 2] ^= 1;
+
+	ASSERT_EQ(0, aufanout_sink_alloc(&a, af));
+	ASSERT_EQ(0, aufanout_sink_alloc(&b, af));
+
+	len = sizeof(pkt);
+	ASSERT_EQ(0, aufanout_encode(a, pkt, &len, NULL, x, SAMPC));
+
+	/* a new sink with other audio does not get x's packet */
+	len = sizeof(pkt);
+	ASSERT_EQ(0, aufanout_encode(b, pkt, &len, NULL, y, SAMPC));
+	ASSERT_EQ(2, enc.ncalls);
+
+	mem_deref(b);
+	mem_deref(a);
+}
+
+
+TEST_F(AufanoutTest, silence)
+{
+	struct aufanout_sink *a, *b;
+	int16_t sampv[SAMPC];
+	uint8_t pkt[512];
+	size_t len;
+
+	memset(sampv, 0, sizeof(sampv));
+
+	ASSERT_EQ(0, aufanout_sink_alloc(&a, af));
+	ASSERT_EQ(0, aufanout_sink_alloc(&b, af));
+
+	/* identical chunks are still encoded once per chunk, not once */
+	for (unsigned i = 0; i < 8; i++) {
+		len = sizeof(pkt);
+		ASSERT_EQ(0, aufanout_encode(a, pkt, &len, NULL,
+					     sampv, SAMPC));
+		len = sizeof(pkt);
+		ASSERT_EQ(0, aufanout_encode(b, pkt, &len, NULL,
+					     sampv, SAMPC));
+	}
+	ASSERT_EQ(8, enc.ncalls);
+	ASSERT_EQ(2, enc.npackets);
+
+	mem_deref(b);
+	mem_deref(a);
+}
+
+
+TEST(aufanout, bad_args)
+{
+	struct fake_enc enc;
+	struct aufanout *af;
+	struct aufanout_sink *sink;
+	int16_t sampv[SAMPC] = {0};
+	uint8_t pkt[16];
+	size_t len = sizeof(pkt);
+
+	ASSERT_EQ(EINVAL, aufanout_alloc(NULL, SAMPC, 512, fake_encode, &enc));
+	ASSERT_EQ(EINVAL, aufanout_alloc(&af, 0, 512, fake_encode, &enc));
+	ASSERT_EQ(EINVAL, aufanout_alloc(&af, SAMPC, 512, NULL, &enc));
+
+	memset(&enc, 0, sizeof(enc));
+	ASSERT_EQ(0, aufanout_alloc(&af, SAMPC, 512, fake_encode, &enc));
+	ASSERT_EQ(0, aufanout_sink_alloc(&sink, af));
+
+	ASSERT_EQ(EINVAL, aufanout_encode(sink, pkt, &len, NULL,
+					  sampv, SAMPC / 2));
+
+	mem_deref(sink);
+	mem_deref(af);
+}
@@ -0,0 +1,449 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+/* The answer from the SFT, that the member sections are based on */
+static const char sft_sdp[] =
+	"v=0\r\n"
+	"o=- 1602763412 1 IN IP4 127.0.0.1\r\n"
+	"s=-\r\n"
+	"t=0 0\r\n"
+	"a=group:BUNDLE audio video data\r\n"
+	"a=tool:sftd 2.0.127\r\n"
+	"m=audio 9 UDP/TLS/RTP/SAVPF 111\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"b=AS:50\r\n"
+	"a=rtpmap:111 opus/48000/2\r\n"
+	"a=fmtp:111 minptime=10;useinbandfec=1\r\n"
+	"a=ice-ufrag:SFTufrag\r\n"
+	"a=ice-pwd:SFTpassword0123456789ab\r\n"
+	"a=fingerprint:sha-256 7B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:"
+	"1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n"
+	"a=setup:passive\r\n"
+	"a=mid:audio\r\n"
+	"a=extmap:1 urn:ietf:params:rtp-hdrext:ssrc-audio-level\r\n"
+	"a=sendrecv\r\n"
+	"a=rtcp-mux\r\n"
+	"m=video 9 UDP/TLS/RTP/SAVPF 100\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"b=AS:800\r\n"
+	"a=rtpmap:100 VP8/90000\r\n"
+	"a=rtcp-fb:100 nack pli\r\n"
+	"a=ice-ufrag:SFTufrag\r\n"
+	"a=ice-pwd:SFTpassword0123456789ab\r\n"
+	"a=fingerprint:sha-256 7B:8B:F0:65:5F:78:E2:51:3B:AC:6F:F3:3F:46:"
+	"1B:35:DC:B8:5F:64:1A:24:C2:43:F0:A1:58:D0:A1:2C:19:08\r\n"
+	"a=setup:passive\r\n"
+	"a=mid:video\r\n"
+	"a=sendrecv\r\n"
+	"a=rtcp-mux\r\n"
+	"m=application 9 DTLS/SCTP 5000\r\n"
+	"c=IN IP4 0.0.0.0\r\n"
+	"a=ice-ufrag:SFTufrag\r\n"
+	"a=ice-pwd:SFTpassword0123456789ab\r\n"
+	"a=setup:passive\r\n"
+	"a=mid:data\r\n"
+	"a=sctpmap:5000 webrtc-datachannel 1024\r\n";
+
+
+/*
+ * The encoder bundle_update used before it cached sections: every
+ * member section is added to a copy of the remote session, which is
+ * then encoded as a whole. The output of bundle_generate must match
+ * it, except for the origin. Members must have their mids already.
+ */
+static bool ref_fmt_handler(struct sdp_format *fmt, void *arg)
+{
+	struct sdp_media *sdpm = (struct sdp_media *)arg;
+
+	if (streq(sdp_media_name(sdpm), "audio")) {
+		if (streq(fmt->name, "opus")) {
+			sdp_format_add(NULL, sdpm, false,
+				       fmt->id, fmt->name, fmt->srate, fmt->ch,
+				       NULL, NULL, NULL, false, "%s", fmt->params);
+		}
+	}
+	else if (streq(sdp_media_name(sdpm), "video")) {
+		if (strcaseeq(fmt->name, "vp8")) {
+			sdp_format_add(NULL, sdpm, false,
+				       fmt->id, fmt->name, fmt->srate, fmt->ch,
+				       NULL, NULL, NULL, false, "%s", fmt->params);
+		}
+	}
+
+	return false;
+}
+
+
+static bool ref_rattr_handler(const char *name, const char *value, void *arg)
+{
+	struct sdp_media *sdpm = (struct sdp_media *)arg;
+
+	if (streq(name, "fingerprint")
+	    || streq(name, "ice-ufrag")
+	    || streq(name, "ice-pwd")
+	    || streq(name, "rtcp-mux")
+	    || streq(name, "extmap"))
+		sdp_safe_media_set_lattr(sdpm, false, name, value);
+
+	return false;
+}
+
+
+static struct sdp_media *ref_find_media(struct sdp_session *sess,
+					const char *type)
+{
+	struct le *le;
+
+	LIST_FOREACH(sdp_session_medial(sess, false), le) {
+		struct sdp_media *sdpm = (struct sdp_media *)le->data;
+
+		if (streq(type, sdp_media_name(sdpm)))
+			return sdpm;
+	}
+
+	return NULL;
+}
+
+
+static int ref_section(struct sdp_session *sess, struct sdp_media *sdpm,
+		       const char *mtype, uint32_t ssrc, uint32_t mid,
+		       const struct conf_member *cm)
+{
+	struct sdp_media *newm;
+	bool disabled = ssrc == 0 || !cm->active;
+	int err;
+
+	err = sdp_media_add(&newm, sess, mtype, 9, sdp_media_proto(sdpm));
+	if (err)
+		return err;
+
+	sdp_media_set_disabled(newm, false);
+	sdp_media_set_laddr(newm, sdp_media_raddr(sdpm));
+	sdp_media_set_lport(newm, 9);
+	sdp_media_set_lattr(newm, false, "mid", "%u", mid);
+	if (!disabled) {
+		sdp_media_set_lattr(newm, false, "ssrc", "%u cname:%s",
+				    ssrc, cm->cname);
+		sdp_media_set_lattr(newm, false, "ssrc", "%u msid:%s %s",
+				    ssrc, cm->msid, cm->label);
+		sdp_media_set_lattr(newm, false, "ssrc", "%u mslabel:%s",
+				    ssrc, cm->msid);
+		sdp_media_set_lattr(newm, false, "ssrc", "%u label:%s",
+				    ssrc, cm->label);
+	}
+
+	sdp_media_format_apply(sdpm, false, NULL, -1, NULL,
+			       -1, -1, ref_fmt_handler, newm);
+	sdp_media_rattr_apply(sdpm, NULL, ref_rattr_handler, newm);
+
+	sdp_media_set_ldir(newm, disabled ? SDP_INACTIVE : SDP_SENDONLY);
+	sdp_media_set_lbandwidth(newm, SDP_BANDWIDTH_AS,
+				 sdp_media_rbandwidth(sdpm, SDP_BANDWIDTH_AS));
+
+	return 0;
+}
+
+
+static int ref_bundle(char **sdpp, bool include_audio,
+		      const char *remote, struct list *membl)
+{
+	struct sdp_session *sess = NULL;
+	struct sdp_media *sdpa, *sdpv;
+	struct mbuf *grp = NULL, *mb = NULL;
+	char *grpstr = NULL;
+	struct le *le;
+	int err;
+
+	err = sdp_dup(&sess, ICALL_CONV_TYPE_CONFERENCE, remote, false);
+	if (err)
+		return err;
+
+	sdpa = ref_find_media(sess, "audio");
+	sdpv = ref_find_media(sess, "video");
+
+	grp = mbuf_alloc(128);
+	if (!grp) {
+		err = ENOMEM;
+		goto out;
+	}
+	mbuf_write_str(grp, sdp_session_rattr(sess, "group"));
+
+	list_flush((struct list *)sdp_session_medial(sess, true));
+
+	LIST_FOREACH(membl, le) {
+		const struct conf_member *cm =
+			(const struct conf_member *)le->data;
+
+		if (include_audio && sdpa) {
+			err = ref_section(sess, sdpa, sdp_media_audio,
+					  cm->ssrca, cm->mida, cm);
+			if (err)
+				goto out;
+			mbuf_printf(grp, " %u", cm->mida);
+		}
+		if (sdpv && cm->ssrcv) {
+			err = ref_section(sess, sdpv, sdp_media_video,
+					  cm->ssrcv, cm->midv, cm);
+			if (err)
+				goto out;
+			mbuf_printf(grp, " %u", cm->midv);
+		}
+	}
+
+	grp->pos = 0;
+	err = mbuf_strdup(grp, &grpstr, mbuf_get_left(grp));
+	if (err)
+		goto out;
+	sdp_safe_session_set_lattr(sess, true, "group", grpstr);
+
+	err = sdp_encode(&mb, sess, true);
+	if (err)
+		goto out;
+
+	err = mbuf_strdup(mb, sdpp, mb->end);
+
+ out:
+	mem_deref(mb);
+	mem_deref(grpstr);
+	mem_deref(grp);
+	mem_deref(sess);
+
+	return err;
+}
+
+
+#define NUM_MEMBERS 20
+
+
+class Bundle : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		list_init(&membl);
+
+		for (unsigned i = 0; i < NUM_MEMBERS; i++)
+			ASSERT_EQ(0, add_member(i));
+
+		ASSERT_EQ(0, bundle_cache_alloc(&bc));
+	}
+
+	virtual void TearDown() override
+	{
+		mem_deref(sdp);
+		mem_deref(bc);
+		list_flush(&membl);
+	}
+
+	int add_member(unsigned i)
+	{
+		struct conf_member *cm;
+		char userid[64], label[64];
+
+		re_snprintf(userid, sizeof(userid), "user-%u", i);
+		re_snprintf(label, sizeof(label), "label-%u", i);
+
+		/* every other member sends video */
+		return conf_member_alloc(&cm, &membl, NULL, userid,
+					 "client", "hash",
+					 0x1000 + i, i % 2 ? 0x2000 + i : 0,
+					 label);
+	}
+
+	struct conf_member *member(unsigned i)
+	{
+		return (struct conf_member *)list_ledata(
+			list_apply(&membl, true, nth_handler, &i));
+	}
+
+	/* the origin version changes with every encode */
+	static void strip_origin(char *sdp)
+	{
+		char *o = strstr(sdp, "\r\no=");
+		char *e;
+
+		if (!o)
+			return;
+
+		e = strstr(o + 2, "\r\n");
+		memmove(o, e, strlen(e) + 1);
+	}
+
+	/*
+	 * The cached SDP must be identical to one made from scratch,
+	 * and to the one the full-session encoder makes
+	 */
+	void generate_and_compare(const char *remote = sft_sdp,
+				  bool include_audio = true)
+	{
+		char *cached = NULL, *fresh = NULL, *ref = NULL;
+
+		ASSERT_EQ(0, bundle_generate(bc, &cached,
+					     ICALL_CONV_TYPE_CONFERENCE,
+					     include_audio, remote, &membl));
+		ASSERT_EQ(0, bundle_generate(NULL, &fresh,
+					     ICALL_CONV_TYPE_CONFERENCE,
+					     include_audio, remote, &membl));
+		ASSERT_EQ(0, ref_bundle(&ref, include_audio, remote, &membl));
+
+		strip_origin(cached);
+		strip_origin(fresh);
+		strip_origin(ref);
+		ASSERT_STREQ(fresh, cached);
+		ASSERT_STREQ(ref, cached);
+
+		mem_deref(sdp);
+		sdp = cached;
+		mem_deref(fresh);
+		mem_deref(ref);
+	}
+
+	size_t count(const char *needle)
+	{
+		size_t n = 0;
+		const char *p = sdp;
+
+		while ((p = strstr(p, needle))) {
+			++n;
+			p += strlen(needle);
+		}
+
+		return n;
+	}
+
+private:
+	static bool nth_handler(struct le *le, void *arg)
+	{
+		unsigned *i = (unsigned *)arg;
+
+		return (*i)-- == 0;
+	}
+
+protected:
+	struct bundle_cache *bc = NULL;
+	struct list membl;
+	char *sdp = NULL;
+};
+
+
+TEST_F(Bundle, one_section_per_member_and_type)
+{
+	generate_and_compare();
+
+	ASSERT_EQ(NUM_MEMBERS, count("m=audio "));
+	ASSERT_EQ(NUM_MEMBERS / 2, count("m=video "));
+	ASSERT_EQ(0, count("m=application "));
+	ASSERT_EQ(NUM_MEMBERS + NUM_MEMBERS / 2, count("a=sendonly"));
+	ASSERT_EQ(1, count("a=group:BUNDLE audio video data "));
+}
+
+
+TEST_F(Bundle, unchanged_roster)
+{
+	char *first;
+
+	generate_and_compare();
+	first = sdp;
+	sdp = NULL;
+
+	generate_and_compare();
+
+	strip_origin(first);
+	ASSERT_STREQ(first, sdp);
+	mem_deref(first);
+}
+
+
+TEST_F(Bundle, member_changes)
+{
+	generate_and_compare();
+
+	/* go inactive, new ssrc, a leave and a join */
+	member(5)->active = false;
+	member(7)->ssrcv = 0x3007;
+	mem_deref(member(3));
+	ASSERT_EQ(0, add_member(NUM_MEMBERS));
+
+	generate_and_compare();
+
+	ASSERT_EQ(NUM_MEMBERS, count("m=audio "));
+	ASSERT_EQ(2, count("a=inactive"));
+	ASSERT_EQ(1, count("a=ssrc:12295 cname:label-7"));
+	ASSERT_EQ(0, count("label-3"));
+	ASSERT_NE(nullptr, strstr(sdp, "label-20"));
+}
+
+
+TEST_F(Bundle, video_stops)
+{
+	generate_and_compare();
+	ASSERT_EQ(NUM_MEMBERS / 2, count("m=video "));
+
+	member(1)->ssrcv = 0;
+
+	generate_and_compare();
+	ASSERT_EQ(NUM_MEMBERS / 2 - 1, count("m=video "));
+}
+
+
+TEST_F(Bundle, remote_sdp_changes)
+{
+	char *remote;
+
+	generate_and_compare();
+	ASSERT_NE(0, count("SFTufrag"));
+
+	/* an ICE restart on the SFT side */
+	ASSERT_EQ(0, re_sdprintf(&remote, "%s", sft_sdp));
+	memcpy(strstr(remote, "SFTufrag"), "NEWufrag", 8);
+	memcpy(strstr(remote, "SFTufrag"), "NEWufrag", 8);
+
+	generate_and_compare(remote);
+	ASSERT_EQ(0, count("SFTufrag"));
+	ASSERT_EQ(NUM_MEMBERS + NUM_MEMBERS / 2, count("a=ice-ufrag:NEWufrag"));
+
+	mem_deref(remote);
+}
+
+
+TEST_F(Bundle, selective_audio)
+{
+	generate_and_compare(sft_sdp, false);
+
+	ASSERT_EQ(0, count("m=audio "));
+	ASSERT_EQ(NUM_MEMBERS / 2, count("m=video "));
+}
+
+
+TEST_F(Bundle, bad_args)
+{
+	char *str = NULL;
+
+	ASSERT_EQ(EINVAL, bundle_cache_alloc(NULL));
+	ASSERT_EQ(EINVAL, bundle_generate(bc, NULL,
+					  ICALL_CONV_TYPE_CONFERENCE,
+					  true, sft_sdp, &membl));
+	ASSERT_EQ(EINVAL, bundle_generate(bc, &str,
+					  ICALL_CONV_TYPE_CONFERENCE,
+					  true, NULL, &membl));
+}
@@ -0,0 +1,187 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+class CDictTest : public ::testing::Test {
+
+public:
+
+	virtual void SetUp() override
+	{
+		ASSERT_EQ(0, cdict_alloc(&cd));
+	}
+
+	virtual void TearDown() override
+	{
+		mem_deref(cd);
+	}
+
+protected:
+	struct cdict *cd = NULL;
+};
+
+
+TEST_F(CDictTest, lookup_not_found)
+{
+	ASSERT_TRUE(NULL == cdict_lookup(cd, "conv"));
+	ASSERT_EQ(0, cdict_count(cd));
+}
+
+
+TEST_F(CDictTest, add_lookup_remove)
+{
+	int a, b;
+
+	ASSERT_EQ(0, cdict_add(cd, "conv-a", &a));
+	ASSERT_EQ(0, cdict_add(cd, "conv-b", &b));
+	ASSERT_EQ(EADDRINUSE, cdict_add(cd, "conv-a", &b));
+	ASSERT_EQ(2, cdict_count(cd));
+
+	ASSERT_EQ(&a, cdict_lookup(cd, "conv-a"));
+	ASSERT_EQ(&b, cdict_lookup(cd, "conv-b"));
+
+	cdict_remove(cd, "conv-a");
+	ASSERT_TRUE(NULL == cdict_lookup(cd, "conv-a"));
+	ASSERT_EQ(&b, cdict_lookup(cd, "conv-b"));
+	ASSERT_EQ(1, cdict_count(cd));
+
+	/* removing twice is harmless */
+	cdict_remove(cd, "conv-a");
+	ASSERT_EQ(1, cdict_count(cd));
+}
+
+
+TEST_F(CDictTest, grow_and_churn)
+{
+	static int valv[1000];
+	char key[32];
+	int i, round;
+
+	for (i = 0; i < 1000; i++) {
+		re_snprintf(key, sizeof(key), "conv-%d", i);
+		ASSERT_EQ(0, cdict_add(cd, key, &valv[i]));
+	}
+	ASSERT_EQ(1000, cdict_count(cd));
+
+	/* calls come and go, the removed slots must be recycled */
+	for (round = 0; round < 20; round++) {
+		for (i = 0; i < 1000; i += 2) {
+			re_snprintf(key, sizeof(key), "conv-%d", i);
+			cdict_remove(cd, key);
+		}
+		for (i = 0; i < 1000; i += 2) {
+			re_snprintf(key, sizeof(key), "conv-%d", i);
+			ASSERT_EQ(0, cdict_add(cd, key, &valv[i]));
+		}
+	}
+
+	for (i = 0; i < 1000; i++) {
+		re_snprintf(key, sizeof(key), "conv-%d", i);
+		ASSERT_EQ(&valv[i], cdict_lookup(cd, key));
+	}
+}
+
+
+struct reader {
+	struct cdict *cd;
+	int *valv;
+	bool *stop;
+	int errors;
+};
+
+
+static void *reader_thread(void *arg)
+{
+	struct reader *rd = (struct reader *)arg;
+	char key[32];
+	int i = 0;
+
+	while (!__atomic_load_n(rd->stop, __ATOMIC_RELAXED)) {
+		void *val;
+
+		i = (i + 1) % 64;
+		re_snprintf(key, sizeof(key), "conv-%d", i);
+
+		/* a value is either absent or the one for its key */
+		val = cdict_lookup(rd->cd, key);
+		if (val && val != &rd->valv[i])
+			++rd->errors;
+
+		/* the first half is never removed */
+		if (i < 32 && !val)
+			++rd->errors;
+	}
+
+	return NULL;
+}
+
+
+TEST_F(CDictTest, concurrent_readers)
+{
+	static int valv[64];
+	struct reader rdv[4];
+	pthread_t tidv[4];
+	bool stop = false;
+	char key[32];
+	int i, round;
+
+	for (i = 0; i < 64; i++) {
+		re_snprintf(key, sizeof(key), "conv-%d", i);
+		ASSERT_EQ(0, cdict_add(cd, key, &valv[i]));
+	}
+
+	for (i = 0; i < 4; i++) {
+		rdv[i].cd = cd;
+		rdv[i].valv = valv;
+		rdv[i].stop = &stop;
+		rdv[i].errors = 0;
+		ASSERT_EQ(0, pthread_create(&tidv[i], NULL,
+					    reader_thread, &rdv[i]));
+	}
+
+	/* churn the second half and force rehashes under the readers */
+	for (round = 0; round < 2000; round++) {
+		for (i = 32; i < 64; i++) {
+			re_snprintf(key, sizeof(key), "conv-%d", i);
+			if (round & 1)
+				ASSERT_EQ(0, cdict_add(cd, key, &valv[i]));
+			else
+				cdict_remove(cd, key);
+		}
+	}
+
+	__atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+	for (i = 0; i < 4; i++) {
+		pthread_join(tidv[i], NULL);
+		ASSERT_EQ(0, rdv[i].errors);
+	}
+}
+
+
+TEST(cdict, bad_args)
+{
+	ASSERT_EQ(EINVAL, cdict_alloc(NULL));
+	ASSERT_EQ(EINVAL, cdict_add(NULL, "key", NULL));
+	ASSERT_TRUE(NULL == cdict_lookup(NULL, "key"));
+	ASSERT_EQ(0, cdict_count(NULL));
+}
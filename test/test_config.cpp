@@ -0,0 +1,180 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+#include "fakes.hpp"
+#include "fixture.h"
+
+
+#define BACKEND_DELAY 200  /* [ms] */
+
+
+class CallConfig : public RestTest {
+
+public:
+	virtual void SetUp() override
+	{
+		RestTest::SetUp();
+
+		backend->config_delay = BACKEND_DELAY;
+		memset(&upe, 0, sizeof(upe));
+
+		err = config_alloc(&cfg, req_handler, NULL, this);
+		ASSERT_EQ(0, err);
+	}
+
+	virtual void TearDown() override
+	{
+		config_unregister_update_handler(&upe);
+		mem_deref(cfg);
+
+		RestTest::TearDown();
+	}
+
+	static int req_handler(void *arg)
+	{
+		CallConfig *test = static_cast<CallConfig *>(arg);
+
+		return rest_request(NULL, test->rest_cli, 0, "GET",
+				    resp_handler, test,
+				    "/calls/config/v2", NULL);
+	}
+
+	static void resp_handler(int err, const struct http_msg *msg,
+				 struct mbuf *mb, struct json_object *jobj,
+				 void *arg)
+	{
+		CallConfig *test = static_cast<CallConfig *>(arg);
+
+		if (!err && msg && msg->scode >= 300)
+			err = EPROTO;
+
+		config_update(test->cfg, err,
+			      mb ? (char *)mbuf_buf(mb) : "",
+			      mb ? mbuf_get_left(mb) : 0);
+	}
+
+	static void update_handler(struct call_config *conf, void *arg)
+	{
+		CallConfig *test = static_cast<CallConfig *>(arg);
+
+		test->conf = conf;
+		test->ts_update = tmr_jiffies();
+		++test->n_update;
+
+		re_cancel();
+	}
+
+	/* What a call start does, returns the latency in [ms] */
+	uint64_t call_start()
+	{
+		uint64_t ts;
+
+		config_unregister_update_handler(&upe);
+
+		memset(&upe, 0, sizeof(upe));
+		upe.updh = update_handler;
+		upe.arg = this;
+
+		ts = tmr_jiffies();
+
+		err = config_request_cached(cfg, &upe);
+		EXPECT_EQ(0, err);
+
+		wait();
+
+		return ts_update - ts;
+	}
+
+protected:
+	struct config *cfg = nullptr;
+	struct config_update_elem upe;
+	struct call_config *conf = nullptr;
+	uint64_t ts_update = 0;
+	unsigned n_update = 0;
+};
+
+
+TEST_F(CallConfig, cold_start_waits_for_backend)
+{
+	ASSERT_FALSE(config_is_valid(cfg));
+
+	uint64_t latency = call_start();
+
+	ASSERT_EQ(1, n_update);
+	ASSERT_EQ(1, backend->config_reqs);
+	ASSERT_GE(latency, BACKEND_DELAY);
+	ASSERT_TRUE(config_is_valid(cfg));
+
+	ASSERT_TRUE(conf != NULL);
+	ASSERT_EQ(1, conf->iceserverc);
+	ASSERT_EQ(1, conf->sftserverc);
+	ASSERT_STREQ("turn:127.0.0.1:3478", conf->iceserverv[0].url);
+}
+
+
+TEST_F(CallConfig, warm_start_is_served_from_cache)
+{
+	uint64_t cold = call_start();
+	uint64_t warm = call_start();
+
+	ASSERT_EQ(2, n_update);
+
+	/* no backend round trip on the second call */
+	ASSERT_EQ(1, backend->config_reqs);
+	ASSERT_LT(warm, BACKEND_DELAY / 4);
+	ASSERT_LT(warm, cold);
+
+	ASSERT_EQ(1, conf->sftserverc);
+}
+
+
+TEST_F(CallConfig, prefetch)
+{
+	/* nothing cached, so a prefetch goes to the backend */
+	ASSERT_EQ(0, config_prefetch(cfg));
+	ASSERT_EQ(0, config_prefetch(cfg));
+
+	memset(&upe, 0, sizeof(upe));
+	upe.updh = update_handler;
+	upe.arg = this;
+	ASSERT_EQ(0, config_register_update_handler(&upe, cfg));
+	wait();
+
+	/* the second prefetch found the first one pending */
+	ASSERT_EQ(1, backend->config_reqs);
+	ASSERT_EQ(1, n_update);
+
+	/* a fresh config is not refetched */
+	ASSERT_EQ(0, config_prefetch(cfg));
+	ASSERT_EQ(1, backend->config_reqs);
+
+	/* and it makes the next call start immediately */
+	ASSERT_LT(call_start(), BACKEND_DELAY / 4);
+	ASSERT_EQ(1, backend->config_reqs);
+}
+
+
+TEST_F(CallConfig, bad_args)
+{
+	ASSERT_EQ(EINVAL, config_prefetch(NULL));
+	ASSERT_FALSE(config_is_valid(NULL));
+	ASSERT_EQ(EINVAL, config_request_cached(NULL, &upe));
+}
@@ -46,7 +46,7 @@ static const char *resp =
 	"Set-Cookie:"
 	  " zuid=cfZKGJ3iVeCOKjJgUxp-ppErmRTmeeckuMbIrKMs8_T6NV1avEMtB_z7AoDEU8TIeQIJM0JIibKeVEDUNp6WAA==.v=1.k=1.d=1445004205.t=u.l=.u=6f03a2d4-d7b7-435b-bf29-84570d69a52b.r=eb02920b; "
 	  "Path=/access; "
-	  "Expires=Fri, 16-Oct-2015 14:03:25 GMT; "
+	  "Expires=Fri, 16-Oct-2037 14:03:25 GMT; "
 	  "Domain=.zinfra.io; "
 	  "HttpOnly;"
 	  " Secure\r\n"
@@ -54,7 +54,7 @@ static const char *resp =
 	"Set-Cookie:"
 	  " zuid=cfZKGJ3iVeCOKjJgUxp-ppErmRTmeeckuMbIrKMs8_T6NV1avEMtB_z7AoDEU8TIeQIJM0JIibKeVEDUNp6WAA==.v=1.k=1.d=1445004205.t=u.l=.u=6f03a2d4-d7b7-435b-bf29-84570d69a52b.r=eb02920b; "
 	  "Path=/access; "
-	  "Expires=Fri, 16-Oct-2015 14:03:25 GMT; "
+	  "Expires=Fri, 16-Oct-2037 14:03:25 GMT; "
 	  "Domain=.zinfra.io; "
 	  "HttpOnly;"
 	  " Secure\r\n"
@@ -90,3 +90,182 @@ TEST(cookie, 1)
 	mem_deref(msg);
 	mem_deref(jar);
 }
+
+
+static const char *resp_paths =
+	"HTTP/1.1 200 OK\r\n"
+	"Set-Cookie: zuid=abc; Path=/access; Max-Age=3600;"
+	  " Domain=.zinfra.io; HttpOnly; Secure\r\n"
+	"Set-Cookie: root=123; Path=/; Max-Age=3600; Domain=.zinfra.io\r\n"
+	"Set-Cookie: host=xyz; Path=/; Max-Age=3600\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n"
+	;
+
+static const char *resp_renew =
+	"HTTP/1.1 200 OK\r\n"
+	"Set-Cookie: zuid=def; Path=/access; Max-Age=3600;"
+	  " Domain=.zinfra.io; HttpOnly; Secure\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n"
+	;
+
+
+struct cookie_req {
+	struct cookie_jar *jar;
+	const char *uri;
+};
+
+
+static int uri_cookie_print(struct re_printf *pf, void *arg)
+{
+	struct cookie_req *req = (struct cookie_req *)arg;
+
+	return cookie_jar_print_to_request(req->jar, pf, req->uri);
+}
+
+
+static std::string cookies_for(struct cookie_jar *jar, const char *uri)
+{
+	struct cookie_req creq = {jar, uri};
+	char req[256] = "";
+
+	re_snprintf(req, sizeof(req), "%H", uri_cookie_print, &creq);
+
+	return req;
+}
+
+
+static void handle(struct cookie_jar *jar, const char *uri, const char *str)
+{
+	struct http_msg *msg;
+
+	ASSERT_EQ(0, create_http_resp(&msg, str));
+	ASSERT_EQ(0, cookie_jar_handle_response(jar, uri, msg));
+
+	mem_deref(msg);
+}
+
+
+TEST(cookie, path_domain_and_scheme)
+{
+	struct cookie_jar *jar;
+
+	ASSERT_EQ(0, cookie_jar_alloc(&jar, NULL));
+
+	handle(jar, "https://a.zinfra.io/access", resp_paths);
+	ASSERT_EQ(3, list_count(cookie_jar_list(jar)));
+
+	/* longer paths first */
+	ASSERT_EQ("Cookie: zuid=abc; root=123; host=xyz\r\n",
+		  cookies_for(jar, "https://a.zinfra.io/access"));
+	ASSERT_EQ("Cookie: zuid=abc; root=123; host=xyz\r\n",
+		  cookies_for(jar, "https://a.zinfra.io/access/logout?x=1"));
+	ASSERT_EQ("Cookie: root=123; host=xyz\r\n",
+		  cookies_for(jar, "https://a.zinfra.io/accessory"));
+
+	/* host-only, and secure */
+	ASSERT_EQ("Cookie: zuid=abc; root=123\r\n",
+		  cookies_for(jar, "https://b.zinfra.io/access"));
+	ASSERT_EQ("Cookie: root=123\r\n",
+		  cookies_for(jar, "http://b.zinfra.io/access"));
+	ASSERT_EQ("", cookies_for(jar, "https://zinfra.com/access"));
+
+	mem_deref(jar);
+}
+
+
+TEST(cookie, set_cookie_updates_cached_header)
+{
+	struct cookie_jar *jar;
+
+	ASSERT_EQ(0, cookie_jar_alloc(&jar, NULL));
+
+	handle(jar, "https://a.zinfra.io/access", resp_paths);
+	ASSERT_EQ("Cookie: zuid=abc; root=123; host=xyz\r\n",
+		  cookies_for(jar, "https://a.zinfra.io/access"));
+
+	handle(jar, "https://a.zinfra.io/access", resp_renew);
+	ASSERT_EQ(3, list_count(cookie_jar_list(jar)));
+	ASSERT_EQ("Cookie: zuid=def; root=123; host=xyz\r\n",
+		  cookies_for(jar, "https://a.zinfra.io/access"));
+
+	mem_deref(jar);
+}
+
+
+static const char *resp_expiry =
+	"HTTP/1.1 200 OK\r\n"
+	"Set-Cookie: short=1; Path=/; Max-Age=1\r\n"
+	"Set-Cookie: long=2; Path=/; Max-Age=3600\r\n"
+	"Set-Cookie: session=3; Path=/\r\n"
+	"Content-Length: 0\r\n"
+	"\r\n"
+	;
+
+
+TEST(cookie, expiry_updates_cached_header)
+{
+	struct cookie_jar *jar;
+
+	ASSERT_EQ(0, cookie_jar_alloc(&jar, NULL));
+
+	handle(jar, "https://a.zinfra.io/", resp_expiry);
+	ASSERT_EQ(3, list_count(cookie_jar_list(jar)));
+	ASSERT_EQ("Cookie: short=1; long=2; session=3\r\n",
+		  cookies_for(jar, "https://a.zinfra.io/access"));
+
+	/* past the expiry of short, without a Set-Cookie in between */
+	(void)re_main_wait(2100);
+
+	/* a site that was not cached before */
+	ASSERT_EQ("Cookie: long=2; session=3\r\n",
+		  cookies_for(jar, "http://a.zinfra.io/access"));
+
+	/* the cached one, which drops the expired cookie */
+	ASSERT_EQ("Cookie: long=2; session=3\r\n",
+		  cookies_for(jar, "https://a.zinfra.io/access"));
+	ASSERT_EQ(2, list_count(cookie_jar_list(jar)));
+
+	mem_deref(jar);
+}
+
+
+TEST(cookie, saves_are_batched)
+{
+	char dir[256];
+	struct store *store;
+	struct cookie_jar *jar, *jar2;
+
+	re_snprintf(dir, sizeof(dir), "/tmp/ztest_cookie_%u", rand_u32());
+
+	ASSERT_EQ(0, store_alloc(&store, dir));
+	ASSERT_EQ(0, store_set_user(store, "user"));
+
+	ASSERT_EQ(0, cookie_jar_alloc(&jar, store));
+	handle(jar, "https://a.zinfra.io/access", resp_paths);
+
+	/* nothing written on the request path */
+	ASSERT_EQ(0, cookie_jar_alloc(&jar2, store));
+	ASSERT_EQ(0, list_count(cookie_jar_list(jar2)));
+	mem_deref(jar2);
+
+	/* written once the burst is over */
+	(void)re_main_wait(1500);
+
+	ASSERT_EQ(0, cookie_jar_alloc(&jar2, store));
+	ASSERT_EQ(3, list_count(cookie_jar_list(jar2)));
+	mem_deref(jar2);
+
+	/* and a pending save is written on close */
+	handle(jar, "https://a.zinfra.io/access", resp_renew);
+	mem_deref(jar);
+
+	ASSERT_EQ(0, cookie_jar_alloc(&jar2, store));
+	ASSERT_EQ("Cookie: zuid=def; root=123; host=xyz\r\n",
+		  cookies_for(jar2, "https://a.zinfra.io/access"));
+	mem_deref(jar2);
+
+	store_flush_user(store);
+	mem_deref(store);
+}
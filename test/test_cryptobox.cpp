@@ -26,6 +26,7 @@
 #include <avs.h>
 #include <cbox.h>
 #include <gtest/gtest.h>
+#include "ztest.h"
 
 
 struct peer {
@@ -492,3 +493,216 @@ TEST_F(cryptoboxtest, add_send_then_add_send)
 
 	verify_devices();
 }
+
+
+#define NUM_PEERS 3
+
+
+static void box_alloc(struct cryptobox **cbp, char *path, size_t sz,
+		      const char *name)
+{
+	char tmp[256], *dir;
+
+	re_snprintf(tmp, sizeof(tmp), "/tmp/ztest_cbox_%s_XXXXXX", name);
+	dir = mkdtemp(tmp);
+	ASSERT_TRUE(dir != NULL);
+	str_ncpy(path, dir, sz);
+
+	ASSERT_EQ(0, cryptobox_alloc(cbp, path));
+}
+
+
+static void preload_handler(int err, size_t loaded, void *arg)
+{
+	size_t *loadedp = (size_t *)arg;
+
+	ASSERT_EQ(0, err);
+	*loadedp = loaded;
+
+	re_cancel();
+}
+
+
+/*
+ * Alice talks to more peers than her session cache holds, so every
+ * round loads evicted sessions back from disk. The ratchet state
+ * saved on eviction must be the latest one, or Bob can not decrypt.
+ */
+TEST(cryptobox, session_cache)
+{
+	struct cryptobox *alice = NULL, *bobv[NUM_PEERS] = {NULL};
+	char alice_path[256], bob_path[NUM_PEERS][256];
+	struct cryptobox_peer peerv[NUM_PEERS];
+	char clientid[NUM_PEERS][8];
+	size_t loaded = 0;
+	int i, round;
+
+	box_alloc(&alice, alice_path, sizeof(alice_path), "alice");
+	ASSERT_EQ(0, cryptobox_set_cache_size(alice, 2));
+
+	for (i = 0; i < NUM_PEERS; i++) {
+		uint8_t key[1024];
+		size_t key_len = sizeof(key);
+
+		re_snprintf(clientid[i], sizeof(clientid[i]), "bob%d", i);
+		peerv[i].userid = "bob";
+		peerv[i].clientid = clientid[i];
+
+		box_alloc(&bobv[i], bob_path[i], sizeof(bob_path[i]),
+			  clientid[i]);
+		ASSERT_EQ(0, cryptobox_generate_prekey(bobv[i], key,
+						       &key_len, 1));
+		ASSERT_EQ(0, cryptobox_session_add_send(alice, "bob",
+							clientid[i], "alice",
+							key, key_len));
+	}
+
+	for (round = 0; round < 3; round++) {
+
+		for (i = 0; i < NUM_PEERS; i++) {
+			struct session *sess;
+			uint8_t cipher[1024], plain[256];
+			size_t cipher_len = sizeof(cipher);
+			size_t plain_len = sizeof(plain);
+
+			sess = cryptobox_session_find(alice, "bob",
+						      clientid[i], "alice");
+			ASSERT_TRUE(sess != NULL);
+			ASSERT_EQ(0, cryptobox_session_encrypt(alice, sess,
+					cipher, &cipher_len,
+					hello_msg, sizeof(hello_msg)));
+
+			sess = cryptobox_session_find(bobv[i], "alice",
+						      "alice", clientid[i]);
+			if (sess) {
+				ASSERT_EQ(0, cryptobox_session_decrypt(bobv[i],
+						sess, plain, &plain_len,
+						cipher, cipher_len));
+			}
+			else {
+				ASSERT_EQ(0, round);
+				ASSERT_EQ(0, cryptobox_session_add_recv(bobv[i],
+						"alice", "alice", clientid[i],
+						plain, &plain_len,
+						cipher, cipher_len));
+			}
+
+			ASSERT_EQ(sizeof(hello_msg), plain_len);
+			ASSERT_EQ(0, memcmp(hello_msg, plain, plain_len));
+		}
+	}
+
+	/* one session is open, the other two come from disk */
+	ASSERT_EQ(0, cryptobox_set_cache_size(alice, 1));
+	ASSERT_EQ(0, cryptobox_set_cache_size(alice, NUM_PEERS));
+	ASSERT_EQ(0, cryptobox_session_preload(alice, "alice",
+					       peerv, NUM_PEERS,
+					       preload_handler, &loaded));
+	ASSERT_EQ(0, re_main_wait(5000));
+	ASSERT_EQ(NUM_PEERS - 1, loaded);
+
+	cryptobox_flush(alice);
+
+	ASSERT_EQ(EINVAL, cryptobox_set_cache_size(alice, 0));
+	ASSERT_EQ(EINVAL, cryptobox_session_preload(alice, NULL, peerv, 1,
+						    NULL, NULL));
+
+	mem_deref(alice);
+	store_remove_pathf(alice_path);
+	for (i = 0; i < NUM_PEERS; i++) {
+		mem_deref(bobv[i]);
+		store_remove_pathf(bob_path[i]);
+	}
+}
+
+
+static void send_hello(struct cryptobox *alice, struct cryptobox *bob,
+		       const char *clientid, bool first)
+{
+	struct session *sess;
+	uint8_t cipher[1024], plain[256];
+	size_t cipher_len = sizeof(cipher);
+	size_t plain_len = sizeof(plain);
+
+	sess = cryptobox_session_find(alice, "bob", clientid, "alice");
+	ASSERT_TRUE(sess != NULL);
+	ASSERT_EQ(0, cryptobox_session_encrypt(alice, sess,
+					       cipher, &cipher_len,
+					       hello_msg, sizeof(hello_msg)));
+
+	if (first) {
+		ASSERT_EQ(0, cryptobox_session_add_recv(bob, "alice", "alice",
+							clientid,
+							plain, &plain_len,
+							cipher, cipher_len));
+	}
+	else {
+		sess = cryptobox_session_find(bob, "alice", "alice", clientid);
+		ASSERT_TRUE(sess != NULL);
+		ASSERT_EQ(0, cryptobox_session_decrypt(bob, sess,
+						       plain, &plain_len,
+						       cipher, cipher_len));
+	}
+
+	ASSERT_EQ(sizeof(hello_msg), plain_len);
+	ASSERT_EQ(0, memcmp(hello_msg, plain, plain_len));
+}
+
+
+/*
+ * A session is used and evicted on the main thread while it is being
+ * preloaded. The preloaded state is older than the one saved on
+ * eviction, and must not replace it.
+ */
+TEST(cryptobox, preload_drops_stale_sessions)
+{
+	struct cryptobox *alice = NULL, *bobv[2] = {NULL};
+	char alice_path[256], bob_path[2][256];
+	struct cryptobox_peer peer;
+	char clientid[2][8];
+	size_t loaded = 1;
+	int i;
+
+	box_alloc(&alice, alice_path, sizeof(alice_path), "alice");
+	ASSERT_EQ(0, cryptobox_set_cache_size(alice, 1));
+
+	for (i = 0; i < 2; i++) {
+		uint8_t key[1024];
+		size_t key_len = sizeof(key);
+
+		re_snprintf(clientid[i], sizeof(clientid[i]), "bob%d", i);
+
+		box_alloc(&bobv[i], bob_path[i], sizeof(bob_path[i]),
+			  clientid[i]);
+		ASSERT_EQ(0, cryptobox_generate_prekey(bobv[i], key,
+						       &key_len, 1));
+		ASSERT_EQ(0, cryptobox_session_add_send(alice, "bob",
+							clientid[i], "alice",
+							key, key_len));
+		send_hello(alice, bobv[i], clientid[i], true);
+	}
+
+	/* bob0 is on disk, bob1 is open */
+	peer.userid = "bob";
+	peer.clientid = clientid[0];
+	ASSERT_EQ(0, cryptobox_session_preload(alice, "alice", &peer, 1,
+					       preload_handler, &loaded));
+
+	/* while the preload runs: use bob0, then evict it again */
+	send_hello(alice, bobv[0], clientid[0], false);
+	send_hello(alice, bobv[1], clientid[1], false);
+
+	ASSERT_EQ(0, re_main_wait(5000));
+	ASSERT_EQ(0, loaded);
+
+	/* the latest state comes from disk */
+	send_hello(alice, bobv[0], clientid[0], false);
+	send_hello(alice, bobv[0], clientid[0], false);
+
+	mem_deref(alice);
+	store_remove_pathf(alice_path);
+	for (i = 0; i < 2; i++) {
+		mem_deref(bobv[i]);
+		store_remove_pathf(bob_path[i]);
+	}
+}
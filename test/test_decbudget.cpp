@@ -0,0 +1,223 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+class DecBudgetTest : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		ASSERT_EQ(0, decbudget_alloc(&db, 2));
+		for (unsigned i = 0; i < ARRAY_SIZE(entv); i++)
+			ASSERT_EQ(0, decbudget_ent_alloc(&entv[i], db, NULL));
+	}
+
+	virtual void TearDown() override
+	{
+		for (unsigned i = 0; i < ARRAY_SIZE(entv); i++)
+			mem_deref(entv[i]);
+		mem_deref(db);
+	}
+
+	void set_levels(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+	{
+		decbudget_ent_set_level(entv[0], a);
+		decbudget_ent_set_level(entv[1], b);
+		decbudget_ent_set_level(entv[2], c);
+		decbudget_ent_set_level(entv[3], d);
+	}
+
+	unsigned decoding_mask()
+	{
+		unsigned mask = 0;
+
+		for (unsigned i = 0; i < ARRAY_SIZE(entv); i++) {
+			if (decbudget_ent_decoding(entv[i]))
+				mask |= 1 << i;
+		}
+
+		return mask;
+	}
+
+protected:
+	struct decbudget *db = NULL;
+	struct decbudget_ent *entv[4];
+};
+
+
+TEST_F(DecBudgetTest, first_streams_fill_the_budget)
+{
+	ASSERT_EQ(4, decbudget_count(db));
+	ASSERT_EQ(0x3, decoding_mask());
+}
+
+
+TEST_F(DecBudgetTest, loudest_are_decoded)
+{
+	uint64_t now = 10000;
+
+	set_levels(0, 0, 100, 80);
+	decbudget_update(db, now);
+	ASSERT_EQ(0xc, decoding_mask());
+}
+
+
+TEST_F(DecBudgetTest, hysteresis)
+{
+	uint64_t now = 10000;
+
+	set_levels(0, 0, 100, 80);
+	decbudget_update(db, now);
+	ASSERT_EQ(0xc, decoding_mask());
+
+	/* a speaker pausing is not replaced straight away */
+	now += 200;
+	set_levels(90, 0, 100, 0);
+	ASSERT_EQ(0, decbudget_update(db, now));
+	ASSERT_EQ(0xc, decoding_mask());
+
+	/* a slightly louder stream does not cause flapping */
+	now += DECBUDGET_HOLD_MS;
+	set_levels(90, 0, 100, 80);
+	ASSERT_EQ(0, decbudget_update(db, now));
+	ASSERT_EQ(0xc, decoding_mask());
+
+	/* after the hold time a clearly louder one takes over */
+	now += DECBUDGET_HOLD_MS;
+	set_levels(90, 0, 100, 0);
+	ASSERT_EQ(2, decbudget_update(db, now));
+	ASSERT_EQ(0x5, decoding_mask());
+}
+
+
+TEST_F(DecBudgetTest, change_budget)
+{
+	uint64_t now = 10000;
+
+	set_levels(10, 20, 30, 40);
+
+	decbudget_set_max(db, 0);
+	decbudget_update(db, now);
+	ASSERT_EQ(0xf, decoding_mask());
+
+	decbudget_set_max(db, 1);
+	decbudget_update(db, now);
+	ASSERT_EQ(0x8, decoding_mask());
+
+	decbudget_set_max(db, 3);
+	decbudget_update(db, now);
+	ASSERT_EQ(0xe, decoding_mask());
+}
+
+
+TEST_F(DecBudgetTest, removed_stream_frees_slot)
+{
+	uint64_t now = 10000;
+
+	set_levels(0, 0, 100, 80);
+	decbudget_update(db, now);
+	ASSERT_EQ(0xc, decoding_mask());
+
+	entv[2] = (struct decbudget_ent *)mem_deref(entv[2]);
+	decbudget_ent_set_level(entv[0], 50);
+	decbudget_update(db, now);
+
+	ASSERT_TRUE(decbudget_ent_decoding(entv[0]));
+	ASSERT_TRUE(decbudget_ent_decoding(entv[3]));
+	ASSERT_FALSE(decbudget_ent_decoding(entv[1]));
+}
+
+
+TEST_F(DecBudgetTest, level_only_speaker_is_readmitted)
+{
+	uint64_t now = 10000;
+
+	set_levels(100, 80, 0, 0);
+	decbudget_update(db, now);
+	ASSERT_EQ(0x3, decoding_mask());
+
+	/* stream 2 starts talking while on the level-only path,
+	 * its level keeps arriving with the level-only frames
+	 */
+	for (unsigned i = 0; i < 10; i++) {
+		now += 200;
+		set_levels(0, 0, 110, 0);
+		decbudget_update(db, now);
+	}
+
+	ASSERT_TRUE(decbudget_ent_decoding(entv[2]));
+	ASSERT_EQ(2, __builtin_popcount(decoding_mask()));
+}
+
+
+TEST(decbudget, level_frame)
+{
+	uint8_t buf[8];
+	size_t len;
+
+	/* code 0, SILK WB 20ms: a lone TOC */
+	const uint8_t c0[] = {0x48, 0x11, 0x22, 0x33};
+	len = sizeof(buf);
+	ASSERT_EQ(0, decbudget_level_frame(buf, &len, c0, sizeof(c0)));
+	ASSERT_EQ(1, len);
+	ASSERT_EQ(0x48, buf[0]);
+
+	/* code 1: two empty frames */
+	const uint8_t c1[] = {0x49, 0x11, 0x22};
+	len = sizeof(buf);
+	ASSERT_EQ(0, decbudget_level_frame(buf, &len, c1, sizeof(c1)));
+	ASSERT_EQ(1, len);
+	ASSERT_EQ(0x49, buf[0]);
+
+	/* code 2: first frame size 0 */
+	const uint8_t c2[] = {0x4a, 0x02, 0x11, 0x22, 0x33};
+	len = sizeof(buf);
+	ASSERT_EQ(0, decbudget_level_frame(buf, &len, c2, sizeof(c2)));
+	ASSERT_EQ(2, len);
+	ASSERT_EQ(0x4a, buf[0]);
+	ASSERT_EQ(0x00, buf[1]);
+
+	/* code 3: same frame count, CBR, no padding */
+	const uint8_t c3[] = {0x4b, 0xc2, 0x01, 0x05, 0x11};
+	len = sizeof(buf);
+	ASSERT_EQ(0, decbudget_level_frame(buf, &len, c3, sizeof(c3)));
+	ASSERT_EQ(2, len);
+	ASSERT_EQ(0x4b, buf[0]);
+	ASSERT_EQ(0x02, buf[1]);
+
+	/* in place */
+	memcpy(buf, c3, sizeof(c3));
+	len = sizeof(buf);
+	ASSERT_EQ(0, decbudget_level_frame(buf, &len, buf, sizeof(c3)));
+	ASSERT_EQ(2, len);
+	ASSERT_EQ(0x02, buf[1]);
+
+	/* empty stays empty */
+	len = sizeof(buf);
+	ASSERT_EQ(0, decbudget_level_frame(buf, &len, NULL, 0));
+	ASSERT_EQ(0, len);
+
+	/* truncated */
+	len = sizeof(buf);
+	ASSERT_EQ(EPROTO, decbudget_level_frame(buf, &len, c3, 1));
+	ASSERT_EQ(EINVAL, decbudget_level_frame(NULL, &len, c0, 1));
+}
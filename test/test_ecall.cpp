@@ -2451,3 +2451,68 @@ TEST_F(Ecall, restart)
 	ASSERT_EQ(2, b2->n_datachan_estab);
 }
 
+
+
+/*
+ * Fill the trace ring past its size, export it and read it back. The
+ * oldest records are dropped, the rest come back in order.
+ */
+TEST_F(Ecall, trace_export_wraps)
+{
+	enum { NUM_MSGS = 1000 };
+	struct ecall_conf conf;
+	struct ecall *ecall = NULL;
+	struct econn_message msg;
+	struct ecall_trace_hdr hdr;
+	struct ecall_trace_rec rec;
+	char userid_anon[ANON_ID_LEN];
+	char clientid_anon[ANON_CLIENT_LEN];
+	struct mbuf *mb;
+	uint32_t first;
+
+	memset(&conf, 0, sizeof(conf));
+	err = ecall_alloc(&ecall, &lst, ICALL_CONV_TYPE_ONEONONE, &conf,
+			  msys, "conv-trace", "A", "1");
+	ASSERT_EQ(0, err);
+
+	econn_message_init(&msg, ECONN_SETUP, "sess");
+
+	for (uint32_t i = 0; i < NUM_MSGS; i++) {
+		msg.age = i;
+		msg.resp = i & 1;
+		ecall_trace(ecall, &msg, i & 1, ECONN_TRANSP_BACKEND, "");
+	}
+
+	mb = mbuf_alloc(1024);
+	ASSERT_TRUE(mb != NULL);
+	ASSERT_EQ(0, ecall_trace_export(mb, ecall, ECALL_TRACE_FMT_BINARY));
+	mb->pos = 0;
+
+	ASSERT_EQ(0, ecall_trace_decode_hdr(mb, &hdr));
+	ASSERT_STREQ(anon_id(userid_anon, "A"), hdr.userid);
+	ASSERT_STREQ(anon_client(clientid_anon, "1"), hdr.clientid);
+	ASSERT_GT(hdr.count, 0);
+	ASSERT_LT(hdr.count, NUM_MSGS);
+	ASSERT_EQ((uint32_t)NUM_MSGS, hdr.count + hdr.dropped);
+
+	first = hdr.dropped;
+	for (uint32_t i = 0; i < hdr.count; i++) {
+		ASSERT_EQ(0, ecall_trace_decode_rec(mb, &rec));
+
+		ASSERT_EQ(first + i, rec.age);
+		ASSERT_EQ(ECONN_SETUP, rec.msg_type);
+		ASSERT_EQ(ECONN_TRANSP_BACKEND, rec.tp);
+		ASSERT_EQ(((first + i) & 1) ?
+			  ECALL_TRACE_TX | ECALL_TRACE_RESP : 0, rec.flags);
+	}
+	ASSERT_EQ(0u, mbuf_get_left(mb));
+	ASSERT_EQ(EBADMSG, ecall_trace_decode_rec(mb, &rec));
+
+	/* a truncated header is refused, not read past */
+	mb->pos = 0;
+	mb->end = 20;
+	ASSERT_EQ(EBADMSG, ecall_trace_decode_hdr(mb, &hdr));
+
+	mem_deref(mb);
+	mem_deref(ecall);
+}
@@ -0,0 +1,496 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/time.h>
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+#define NUM_FUZZ_ITERATIONS  20000
+#define NUM_BENCH_ITERATIONS  1000
+
+
+static const char sdp_str[] =
+	"v=0\r\n"
+	"o=- 12345 2 IN IP4 127.0.0.1\r\n"
+	"s=-\r\n"
+	"a=tool:\"avs\" \\ \xc3\xa9\r\n";
+
+
+static struct econn_message *msg_new(enum econn_msg type)
+{
+	struct econn_message *msg;
+
+	msg = econn_message_alloc();
+	if (!msg)
+		return NULL;
+
+	econn_message_init(msg, type, "sess-A");
+	str_ncpy(msg->src_userid, "9a7b2f4e-user", sizeof(msg->src_userid));
+	str_ncpy(msg->src_clientid, "c1a2b3", sizeof(msg->src_clientid));
+
+	return msg;
+}
+
+
+static struct econn_message *msg_setup(void)
+{
+	struct econn_message *msg = msg_new(ECONN_SETUP);
+
+	str_dup(&msg->u.setup.sdp_msg, sdp_str);
+	str_dup(&msg->u.setup.url, "https://sft.example.com/sft/");
+	econn_props_alloc(&msg->u.setup.props, NULL);
+	econn_props_add(msg->u.setup.props, "videosend", "true");
+	econn_props_add(msg->u.setup.props, "screensend", "false");
+
+	return msg;
+}
+
+
+static struct econn_message *msg_confconn(void)
+{
+	struct econn_message *msg = msg_new(ECONN_CONF_CONN);
+	struct zapi_ice_server *turnv;
+
+	turnv = (struct zapi_ice_server *)mem_zalloc(2 * sizeof(*turnv),
+						     NULL);
+	str_ncpy(turnv[0].url, "turn:1.2.3.4:3478", sizeof(turnv[0].url));
+	str_ncpy(turnv[0].username, "user", sizeof(turnv[0].username));
+	str_ncpy(turnv[0].credential, "secret",
+		 sizeof(turnv[0].credential));
+	str_ncpy(turnv[1].url, "turns:turn.example.com:443?transport=tcp",
+		 sizeof(turnv[1].url));
+
+	msg->u.confconn.turnv = turnv;
+	msg->u.confconn.turnc = 2;
+	msg->u.confconn.update = true;
+	str_dup(&msg->u.confconn.tool, "avs");
+	str_dup(&msg->u.confconn.toolver, "7.1.local");
+	msg->u.confconn.status = ECONN_CONFCONN_OK;
+	msg->u.confconn.selective_audio = true;
+	msg->u.confconn.vstreams = 9;
+
+	return msg;
+}
+
+
+static struct econn_message *msg_confstart(void)
+{
+	struct econn_message *msg = msg_new(ECONN_CONF_START);
+	static const uint8_t secret[16] = {1, 2, 3, 4, 5, 6, 7, 8,
+					   9, 10, 11, 12, 13, 14, 15, 16};
+
+	str_dup(&msg->u.confstart.sft_url, "https://sft.example.com/");
+	msg->u.confstart.secret = (uint8_t *)mem_alloc(sizeof(secret), NULL);
+	memcpy(msg->u.confstart.secret, secret, sizeof(secret));
+	msg->u.confstart.secretlen = sizeof(secret);
+	msg->u.confstart.timestamp = 1601023456789ULL;
+	msg->u.confstart.seqno = 42;
+	econn_props_alloc(&msg->u.confstart.props, NULL);
+	econn_props_add(msg->u.confstart.props, "videosend", "true");
+
+	return msg;
+}
+
+
+static struct econn_message *msg_confpart(unsigned nparts)
+{
+	struct econn_message *msg = msg_new(ECONN_CONF_PART);
+	uint8_t entropy[32];
+	unsigned i;
+
+	msg->u.confpart.should_start = true;
+	msg->u.confpart.timestamp = 1601023456789ULL;
+	msg->u.confpart.seqno = 7;
+
+	for (i = 0; i < sizeof(entropy); i++)
+		entropy[i] = (uint8_t)(i * 7);
+	msg->u.confpart.entropy = (uint8_t *)mem_alloc(sizeof(entropy), NULL);
+	memcpy(msg->u.confpart.entropy, entropy, sizeof(entropy));
+	msg->u.confpart.entropylen = sizeof(entropy);
+
+	for (i = 0; i < nparts; i++) {
+		struct econn_group_part *part;
+		char userid[64], clientid[32];
+
+		re_snprintf(userid, sizeof(userid),
+			    "3f0e7b62-0c4a-4b43-8c3e-%012u", i);
+		re_snprintf(clientid, sizeof(clientid), "%08x", i * 31);
+
+		part = econn_part_alloc(userid, clientid);
+		part->authorized = (i % 2) == 0;
+		part->ssrca = 1000000 + i;
+		part->ssrcv = 2000000 + i;
+
+		list_append(&msg->u.confpart.partl, &part->le, part);
+	}
+
+	return msg;
+}
+
+
+static struct econn_message *msg_confkey(void)
+{
+	struct econn_message *msg = msg_new(ECONN_CONF_KEY);
+	unsigned i, j;
+
+	for (i = 0; i < 2; i++) {
+		struct econn_key_info *key;
+
+		key = econn_key_info_alloc(32);
+		key->idx = i + 1;
+		for (j = 0; j < key->dlen; j++)
+			key->data[j] = (uint8_t)(i + j);
+
+		list_append(&msg->u.confkey.keyl, &key->le, key);
+	}
+
+	return msg;
+}
+
+
+static struct econn_message *msg_alert(void)
+{
+	struct econn_message *msg = msg_new(ECONN_ALERT);
+
+	msg->u.alert.level = 2;
+	str_dup(&msg->u.alert.descr, "unsupported \"feature\"");
+
+	return msg;
+}
+
+
+static void msg_roundtrip(struct econn_message *msg)
+{
+	struct econn_message *msg_pull = NULL, *msg_jzon = NULL;
+	char *str = NULL, *str_pull = NULL, *str_jzon = NULL;
+	int err;
+
+	ASSERT_TRUE(msg != NULL);
+
+	err = econn_message_encode(&str, msg);
+	ASSERT_EQ(0, err);
+
+	err = econn_message_decode(&msg_pull, 0, 0, str, str_len(str));
+	ASSERT_EQ(0, err);
+	err = econn_message_decode_jzon(&msg_jzon, 0, 0, str, str_len(str));
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(msg->msg_type, msg_pull->msg_type);
+	ASSERT_EQ(msg_jzon->msg_type, msg_pull->msg_type);
+	ASSERT_STREQ(msg_jzon->sessid_sender, msg_pull->sessid_sender);
+	ASSERT_STREQ(msg_jzon->src_userid, msg_pull->src_userid);
+	ASSERT_STREQ(msg_jzon->src_clientid, msg_pull->src_clientid);
+	ASSERT_EQ(msg_jzon->resp, msg_pull->resp);
+
+	err = econn_message_encode(&str_pull, msg_pull);
+	ASSERT_EQ(0, err);
+	err = econn_message_encode(&str_jzon, msg_jzon);
+	ASSERT_EQ(0, err);
+
+	ASSERT_STREQ(str, str_pull);
+	ASSERT_STREQ(str_jzon, str_pull);
+
+	mem_deref(str_jzon);
+	mem_deref(str_pull);
+	mem_deref(str);
+	mem_deref(msg_jzon);
+	mem_deref(msg_pull);
+	mem_deref(msg);
+}
+
+
+TEST(econn_fmt, roundtrip_setup)
+{
+	msg_roundtrip(msg_setup());
+}
+
+
+TEST(econn_fmt, roundtrip_simple_types)
+{
+	msg_roundtrip(msg_new(ECONN_HANGUP));
+	msg_roundtrip(msg_new(ECONN_CANCEL));
+	msg_roundtrip(msg_new(ECONN_REJECT));
+	msg_roundtrip(msg_new(ECONN_GROUP_LEAVE));
+	msg_roundtrip(msg_new(ECONN_CONF_END));
+	msg_roundtrip(msg_new(ECONN_PING));
+}
+
+
+TEST(econn_fmt, roundtrip_confconn)
+{
+	msg_roundtrip(msg_confconn());
+}
+
+
+TEST(econn_fmt, roundtrip_confstart)
+{
+	msg_roundtrip(msg_confstart());
+}
+
+
+TEST(econn_fmt, roundtrip_confpart)
+{
+	msg_roundtrip(msg_confpart(0));
+	msg_roundtrip(msg_confpart(1));
+	msg_roundtrip(msg_confpart(100));
+}
+
+
+TEST(econn_fmt, roundtrip_confkey)
+{
+	msg_roundtrip(msg_confkey());
+}
+
+
+TEST(econn_fmt, roundtrip_alert)
+{
+	msg_roundtrip(msg_alert());
+}
+
+
+TEST(econn_fmt, decode_fields)
+{
+	struct econn_message *msg = NULL;
+	struct econn_group_part *part;
+	static const char str[] =
+		" {\"version\":\"3.0\",\"type\":\"CONFPART\","
+		"\"sessid\":\"s\\u0031\",\"resp\":false,"
+		"\"unknown\":{\"a\":[1,2,{\"b\":null}]},"
+		"\"timestamp\":\"123\",\"seqno\":\"9\","
+		"\"participants\":[{\"userid\":\"u\\/1\",\"clientid\":null,"
+		"\"authorized\":true,\"ssrc_audio\":\"11\","
+		"\"ssrc_video\":\"22\"},"
+		"{\"userid\":\"bad\"}]} \n";
+	int err;
+
+	err = econn_message_decode(&msg, 10, 4, str, strlen(str));
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(ECONN_CONF_PART, msg->msg_type);
+	ASSERT_STREQ("s1", msg->sessid_sender);
+	ASSERT_EQ(123u, msg->u.confpart.timestamp);
+	ASSERT_EQ(9u, msg->u.confpart.seqno);
+	ASSERT_EQ(6u, msg->age);
+
+	ASSERT_EQ(1u, list_count(&msg->u.confpart.partl));
+	part = (struct econn_group_part *)
+		list_ledata(list_head(&msg->u.confpart.partl));
+	ASSERT_STREQ("u/1", part->userid);
+	ASSERT_TRUE(part->clientid == NULL);
+	ASSERT_TRUE(part->authorized);
+	ASSERT_EQ(11u, part->ssrca);
+	ASSERT_EQ(22u, part->ssrcv);
+
+	mem_deref(msg);
+}
+
+
+TEST(econn_fmt, decode_errors)
+{
+	struct econn_message *msg = NULL;
+	static const struct {
+		const char *str;
+		int err;
+	} testv[] = {
+		{"{\"type\":\"HANGUP\",\"sessid\":\"s\",\"resp\":false}",
+		 EBADMSG},
+		{"{\"version\":\"2.0\",\"type\":\"HANGUP\",\"sessid\":\"s\","
+		 "\"resp\":false}", EPROTO},
+		{"{\"version\":\"3.0\",\"type\":\"FOO\",\"sessid\":\"s\","
+		 "\"resp\":false}", EPROTONOSUPPORT},
+		{"{\"version\":\"3.0\",\"type\":\"HANGUP\",\"sessid\":\"s\"}",
+		 ENOENT},
+		{"{\"version\":\"3.0\",\"type\":\"SETUP\",\"sessid\":\"s\","
+		 "\"resp\":false,\"props\":{}}", EBADMSG},
+		{"{\"version\":\"3.0\",\"type\":\"HANGUP\",\"sessid\":\"s\","
+		 "\"resp\":false", EBADMSG},
+		{"{\"version\":\"3.0\",\"type\":\"HANGUP\",\"sessid\":\"s\","
+		 "\"resp\":false}x", EBADMSG},
+		{"[]", EPROTO},
+		{"", EPROTO},
+	};
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(testv); i++) {
+		int err = econn_message_decode(&msg, 0, 0, testv[i].str,
+					       strlen(testv[i].str));
+		ASSERT_EQ(testv[i].err, err) << testv[i].str;
+	}
+}
+
+
+/*
+ * Mutate valid messages and feed them to the decoder. It may not crash
+ * or leak, and everything it accepts must survive an encode/decode
+ * cycle unchanged.
+ */
+TEST(econn_fmt, fuzz_decode)
+{
+	static const char tokv[] = "{}[]\":,\\ 0-tfnu";
+	struct econn_message *(*genv[])(void) = {
+		msg_setup, msg_confconn, msg_confstart, msg_confkey, msg_alert
+	};
+	char *corpusv[ARRAY_SIZE(genv) + 1];
+	uint32_t seed = 0x5eed;
+	size_t ncorpus = 0;
+	size_t i, j;
+	int accepted = 0;
+	int err;
+
+	for (i = 0; i < ARRAY_SIZE(genv); i++) {
+		struct econn_message *msg = genv[i]();
+
+		err = econn_message_encode(&corpusv[ncorpus++], msg);
+		ASSERT_EQ(0, err);
+		mem_deref(msg);
+	}
+	{
+		struct econn_message *msg = msg_confpart(3);
+
+		err = econn_message_encode(&corpusv[ncorpus++], msg);
+		ASSERT_EQ(0, err);
+		mem_deref(msg);
+	}
+
+	for (i = 0; i < NUM_FUZZ_ITERATIONS; i++) {
+		struct econn_message *msg = NULL, *msg2 = NULL;
+		const char *src;
+		char *buf, *str = NULL, *str2 = NULL;
+		size_t len, nmut;
+
+		seed = seed * 1103515245 + 12345;
+		src = corpusv[(seed >> 8) % ncorpus];
+		len = strlen(src);
+
+		buf = (char *)mem_alloc(len, NULL);
+		memcpy(buf, src, len);
+
+		seed = seed * 1103515245 + 12345;
+		nmut = 1 + (seed >> 8) % 4;
+		for (j = 0; j < nmut; j++) {
+			size_t pos;
+
+			seed = seed * 1103515245 + 12345;
+			pos = (seed >> 8) % len;
+
+			seed = seed * 1103515245 + 12345;
+			switch ((seed >> 8) % 4) {
+
+			case 0:
+				len = pos;
+				break;
+
+			case 1:
+				buf[pos] = (char)(seed >> 16);
+				break;
+
+			default:
+				buf[pos] = tokv[(seed >> 16) %
+						(sizeof(tokv) - 1)];
+				break;
+			}
+
+			if (len == 0)
+				break;
+		}
+
+		err = econn_message_decode(&msg, 0, 0, buf, len);
+		if (err)
+			goto next;
+
+		++accepted;
+
+		if (econn_message_encode(&str, msg))
+			goto next;
+
+		err = econn_message_decode(&msg2, 0, 0, str, strlen(str));
+		ASSERT_EQ(0, err) << str;
+
+		err = econn_message_encode(&str2, msg2);
+		ASSERT_EQ(0, err);
+		ASSERT_STREQ(str, str2);
+
+	next:
+		mem_deref(str2);
+		mem_deref(str);
+		mem_deref(msg2);
+		mem_deref(msg);
+		mem_deref(buf);
+	}
+
+	ASSERT_GT(accepted, 0);
+
+	for (i = 0; i < ncorpus; i++)
+		mem_deref(corpusv[i]);
+}
+
+
+static uint64_t bench_decode(int (*dech)(struct econn_message **,
+					 uint64_t, uint64_t,
+					 const char *, size_t),
+			     const char *str)
+{
+	struct timeval start, now, res;
+	int i;
+
+	gettimeofday(&start, NULL);
+
+	for (i = 0; i < NUM_BENCH_ITERATIONS; i++) {
+		struct econn_message *msg = NULL;
+
+		if (dech(&msg, 0, 0, str, strlen(str)))
+			return 0;
+		mem_deref(msg);
+	}
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &start, &res);
+
+	return res.tv_sec * 1000000ULL + res.tv_usec;
+}
+
+
+TEST(econn_fmt, decode_benchmark)
+{
+	static const unsigned partv[] = {1, 10, 100, 500};
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(partv); i++) {
+		struct econn_message *msg = msg_confpart(partv[i]);
+		uint64_t t_pull, t_jzon;
+		char *str = NULL;
+
+		ASSERT_EQ(0, econn_message_encode(&str, msg));
+
+		t_pull = bench_decode(econn_message_decode, str);
+		t_jzon = bench_decode(econn_message_decode_jzon, str);
+		ASSERT_NE(0u, t_pull);
+		ASSERT_NE(0u, t_jzon);
+
+		printf("econn_fmt: CONFPART %3u parts (%6zu bytes):"
+		       " pull %8.2f us/msg, jzon %8.2f us/msg\n",
+		       partv[i], strlen(str),
+		       (double)t_pull / NUM_BENCH_ITERATIONS,
+		       (double)t_jzon / NUM_BENCH_ITERATIONS);
+
+		mem_deref(str);
+		mem_deref(msg);
+	}
+}
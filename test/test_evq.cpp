@@ -0,0 +1,187 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <pthread.h>
+#include <unistd.h>
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+#define NUM_EVENTS 1000
+
+
+enum {
+	EV_COUNT = 1,
+	EV_STOP,
+};
+
+
+/* An AVS thread with its own main loop, as a wcall shard */
+struct owner {
+	pthread_t tid;
+	struct avs_evq *evq;
+	unsigned count;
+	unsigned foreign;
+	int ready;
+};
+
+
+static void evq_handler(int id, void *data, void *arg)
+{
+	struct owner *ow = (struct owner *)data;
+
+	(void)arg;
+
+	if (!pthread_equal(pthread_self(), ow->tid))
+		++ow->foreign;
+
+	switch (id) {
+
+	case EV_COUNT:
+		++ow->count;
+		break;
+
+	case EV_STOP:
+		re_cancel();
+		break;
+	}
+}
+
+
+static void *owner_thread(void *arg)
+{
+	struct owner *ow = (struct owner *)arg;
+	int err;
+
+	err = re_thread_init();
+	if (err)
+		goto out;
+
+	err = avs_evq_get(&ow->evq, evq_handler);
+	if (err) {
+		re_thread_close();
+		goto out;
+	}
+
+	__atomic_store_n(&ow->ready, 1, __ATOMIC_RELEASE);
+
+	re_main(NULL);
+
+	ow->evq = (struct avs_evq *)mem_deref(ow->evq);
+	re_thread_close();
+
+ out:
+	if (err)
+		__atomic_store_n(&ow->ready, -1, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+
+static int owner_start(struct owner *ow)
+{
+	int ready;
+	int err;
+
+	memset(ow, 0, sizeof(*ow));
+
+	err = pthread_create(&ow->tid, NULL, owner_thread, ow);
+	if (err)
+		return err;
+
+	while (!(ready = __atomic_load_n(&ow->ready, __ATOMIC_ACQUIRE)))
+		usleep(1000);
+
+	return ready < 0 ? ENOMEM : 0;
+}
+
+
+static void owner_stop(struct owner *ow)
+{
+	avs_evq_push(ow->evq, EV_STOP, ow);
+	pthread_join(ow->tid, NULL);
+}
+
+
+/*
+ * Two owners run at the same time and get events from a third
+ * thread, interleaved. Each event must be handled on its owner.
+ */
+TEST(evq, events_reach_owner_thread)
+{
+	struct owner ow1, ow2;
+
+	ASSERT_EQ(0, owner_start(&ow1));
+	ASSERT_EQ(0, owner_start(&ow2));
+
+	for (unsigned i = 0; i < NUM_EVENTS; i++) {
+		ASSERT_EQ(0, avs_evq_push(ow1.evq, EV_COUNT, &ow1));
+		ASSERT_EQ(0, avs_evq_push(ow2.evq, EV_COUNT, &ow2));
+	}
+
+	/* the stop event is queued after all counted ones */
+	owner_stop(&ow1);
+	owner_stop(&ow2);
+
+	ASSERT_EQ(NUM_EVENTS, ow1.count);
+	ASSERT_EQ(NUM_EVENTS, ow2.count);
+	ASSERT_EQ(0, ow1.foreign);
+	ASSERT_EQ(0, ow2.foreign);
+}
+
+
+static void other_handler(int id, void *data, void *arg)
+{
+	(void)id;
+	(void)data;
+	(void)arg;
+}
+
+
+TEST(evq, shared_per_thread_and_handler)
+{
+	struct avs_evq *a, *b, *c;
+
+	ASSERT_EQ(0, avs_evq_get(&a, evq_handler));
+	ASSERT_TRUE(avs_evq_is_last(a));
+
+	ASSERT_EQ(0, avs_evq_get(&b, evq_handler));
+	ASSERT_TRUE(a == b);
+	ASSERT_FALSE(avs_evq_is_last(a));
+
+	ASSERT_EQ(0, avs_evq_get(&c, other_handler));
+	ASSERT_TRUE(a != c);
+
+	mem_deref(b);
+	ASSERT_TRUE(avs_evq_is_last(a));
+
+	mem_deref(a);
+	mem_deref(c);
+}
+
+
+TEST(evq, bad_args)
+{
+	struct avs_evq *evq;
+
+	ASSERT_EQ(EINVAL, avs_evq_get(NULL, evq_handler));
+	ASSERT_EQ(EINVAL, avs_evq_get(&evq, NULL));
+	ASSERT_EQ(EINVAL, avs_evq_push(NULL, EV_COUNT, NULL));
+	ASSERT_FALSE(avs_evq_is_last(NULL));
+}
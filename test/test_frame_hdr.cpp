@@ -158,3 +158,231 @@ TEST_F(FrameHdrTest, write_read_csrc)
 	ASSERT_EQ(c, 0x12345678);
 }
 
+
+
+/*
+ * The original byte-by-byte implementation, to check the fast path
+ * against, bit by bit.
+ */
+
+static uint8_t ref_calc_len(uint32_t val)
+{
+	uint8_t l = 0;
+
+	if (val == 0)
+		return 1;
+
+	while (val != 0) {
+		l++;
+		val >>= 8;
+	}
+	return l;
+}
+
+static size_t ref_write_bytes(uint8_t *buf, uint8_t len, uint64_t val)
+{
+	for (uint8_t l = len; l > 0; l--)
+		*buf++ = (val >> (8 * (l - 1))) & 0xff;
+
+	return len;
+}
+
+static size_t ref_read_bytes(const uint8_t *buf, uint8_t len, uint64_t *val)
+{
+	uint64_t v = 0;
+
+	for (uint8_t l = 0; l < len; l++)
+		v = v << 8 | buf[l];
+
+	*val = v;
+	return len;
+}
+
+static size_t ref_write(uint8_t *buf, size_t bsz,
+			uint64_t frame, uint64_t key, uint32_t csrc)
+{
+	uint8_t x = 0, klen, flen;
+	uint8_t ext = csrc ? 1 : 0;
+	size_t xsz = csrc ? 5 : 0;
+	size_t p = 2, ksz;
+
+	if (key > 7) {
+		x = 1;
+		ksz = ref_calc_len(key);
+		klen = ksz - 1;
+	}
+	else {
+		ksz = 0;
+		klen = key;
+	}
+
+	flen = ref_calc_len(frame);
+
+	if (bsz < 2 + ksz + flen + xsz)
+		return 0;
+
+	buf[0] = ext << 4;
+	buf[1] = (flen-1) << 4 | x << 3 | klen;
+	if (x)
+		p += ref_write_bytes(buf + p, klen+1, key);
+	p += ref_write_bytes(buf + p, flen, frame);
+
+	if (csrc) {
+		buf[p++] = 0x31;
+		ref_write_bytes(buf + p, 4, csrc);
+		p += 4;
+	}
+
+	return p;
+}
+
+static size_t ref_read(const uint8_t *buf, size_t bsz,
+		       uint64_t *frameid, uint64_t *key, uint32_t *csrc)
+{
+	uint8_t ext = buf[0] & 0x10;
+	uint8_t flen = ((buf[1] >> 4) & 7) + 1;
+	uint8_t x = (buf[1] >> 3) & 1;
+	uint8_t klen = buf[1] & 7;
+	uint64_t csrc64;
+	size_t p = 2;
+	uint32_t i = 0;
+
+	if (x)
+		p += ref_read_bytes(buf + p, klen+1, key);
+	else
+		*key = klen;
+
+	p += ref_read_bytes(buf + p, flen, frameid);
+
+	while (ext && p < bsz && i < 16) {
+		uint8_t b = buf[p];
+		uint8_t elen = ((b >> 4) & 7) + 1;
+
+		ext = b & 0x80;
+		if (p + elen + 1 >= bsz)
+			break;
+
+		if ((b & 0x0f) == 0x01 && elen == 4) {
+			ref_read_bytes(buf + p + 1, 4, &csrc64);
+			*csrc = csrc64;
+		}
+		p += elen + 1;
+		i++;
+	}
+
+	return p;
+}
+
+
+/* xorshift64, so that a failure can be reproduced */
+static uint64_t fuzz_rand(uint64_t *s)
+{
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return *s;
+}
+
+/* A value of 1..8 random bytes, so that all lengths are covered */
+static uint64_t fuzz_value(uint64_t *s)
+{
+	const unsigned bytes = fuzz_rand(s) % 8 + 1;
+	const uint64_t v = fuzz_rand(s);
+
+	return bytes == 8 ? v : v & ((1ULL << (8 * bytes)) - 1);
+}
+
+
+TEST_F(FrameHdrTest, write_matches_reference)
+{
+	uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+	for (int i = 0; i < 200000; i++) {
+		uint8_t ref[BUFSZ], out[BUFSZ];
+		uint64_t frame = fuzz_value(&seed);
+		uint64_t key = (i & 1) ? fuzz_value(&seed) : i % 16;
+		uint32_t csrc = (i & 2) ? (uint32_t)fuzz_value(&seed) : 0;
+		size_t bsz = fuzz_rand(&seed) % 24;
+		size_t rn, on;
+
+		memset(ref, 0xa5, sizeof(ref));
+		memset(out, 0xa5, sizeof(out));
+
+		rn = ref_write(ref, bsz, frame, key, csrc);
+		on = frame_hdr_write(out, bsz, frame, key, csrc);
+
+		ASSERT_EQ(rn, on) << "frame=" << frame << " key=" << key
+				  << " csrc=" << csrc << " bsz=" << bsz;
+		ASSERT_EQ(0, memcmp(ref, out, rn))
+			<< "frame=" << frame << " key=" << key
+			<< " csrc=" << csrc;
+
+		/* at most 8 bytes of payload space are used as scratch */
+		for (size_t b = rn; b < BUFSZ; b++) {
+			if (b >= bsz || b >= rn + 8 || !rn)
+				ASSERT_EQ(0xa5, out[b]) << "bsz=" << bsz;
+		}
+	}
+}
+
+
+TEST_F(FrameHdrTest, read_matches_reference)
+{
+	uint64_t seed = 0x2545f4914f6cdd1dULL;
+
+	/* every combination of the two fixed header bytes */
+	for (unsigned h = 0; h < 0x10000; h++) {
+		for (int j = 0; j < 4; j++) {
+			uint64_t rf = 0, rk = 0, of = 0, ok = 0;
+			uint32_t rc = 0, oc = 0;
+			size_t bsz, rn, on;
+
+			for (size_t b = 0; b < BUFSZ; b++)
+				buffer[b] = fuzz_rand(&seed);
+			buffer[0] = h >> 8;
+			buffer[1] = h & 0xff;
+
+			/* mostly extension bytes with the M bit set */
+			if (j & 1) {
+				for (size_t b = 2; b < BUFSZ; b += 5)
+					buffer[b] |= 0x80;
+			}
+
+			/* the reader trusts the lengths in the header,
+			   keep the buffer behind them valid */
+			bsz = 2 + fuzz_rand(&seed) % (BUFSZ - 2 - 16);
+
+			rn = ref_read(buffer, bsz, &rf, &rk, &rc);
+			on = frame_hdr_read(buffer, bsz, &of, &ok, &oc);
+
+			ASSERT_EQ(rn, on) << "hdr=" << h << " bsz=" << bsz;
+			ASSERT_EQ(rf, of) << "hdr=" << h << " bsz=" << bsz;
+			ASSERT_EQ(rk, ok) << "hdr=" << h << " bsz=" << bsz;
+			ASSERT_EQ(rc, oc) << "hdr=" << h << " bsz=" << bsz;
+		}
+	}
+}
+
+
+TEST_F(FrameHdrTest, write_read_all_lengths)
+{
+	for (unsigned fb = 1; fb <= 4; fb++) {
+		for (unsigned kb = 0; kb <= 4; kb++) {
+			uint64_t frame = (1ULL << (8 * fb - 1)) | 0x5a;
+			uint64_t key = kb ? (1ULL << (8 * kb - 1)) | 0x0f : 5;
+			uint64_t f, k;
+			uint32_t c = 0;
+			size_t bw, br;
+
+			bw = frame_hdr_write(buffer, BUFSZ, frame, key,
+					     0xcafebabe);
+			ASSERT_EQ(2 + fb + (kb ? kb : 0) + 5, bw);
+
+			br = frame_hdr_read(buffer, BUFSZ, &f, &k, &c);
+			ASSERT_EQ(bw, br);
+			ASSERT_EQ(frame, f);
+			ASSERT_EQ(key, k);
+			ASSERT_EQ(0xcafebabe, c);
+		}
+	}
+}
@@ -0,0 +1,277 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+#define KEYSZ 32
+#define USERID_HASH "4f2a63c5e1b27a9d"
+#define FRAMESZ 100
+
+
+class FrameStats : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		const uint8_t salt[] = "CALL_ID";
+
+		memset(key, 0xa5, sizeof(key));
+		for (size_t i = 0; i < sizeof(frame); i++)
+			frame[i] = (uint8_t)i;
+
+		ASSERT_EQ(0, frame_stats_group_alloc(&grp));
+
+		ASSERT_EQ(0, keystore_alloc(&ks));
+		ASSERT_EQ(0, keystore_set_salt(ks, salt, sizeof(salt) - 1));
+
+		ASSERT_EQ(0, frame_encryptor_alloc(&enc, USERID_HASH,
+						   FRAME_MEDIA_AUDIO));
+		ASSERT_EQ(0, frame_encryptor_set_stats(enc, grp));
+
+		ASSERT_EQ(0, frame_decryptor_alloc(&dec, FRAME_MEDIA_AUDIO));
+		ASSERT_EQ(0, frame_decryptor_set_keystore(dec, ks));
+		ASSERT_EQ(0, frame_decryptor_set_uid(dec, USERID_HASH));
+		ASSERT_EQ(0, frame_decryptor_set_stats(dec, grp));
+	}
+
+	virtual void TearDown() override
+	{
+		mem_deref(dec);
+		mem_deref(enc);
+		mem_deref(ks);
+		mem_deref(grp);
+	}
+
+	void add_key(uint32_t idx)
+	{
+		key[0] = idx;
+		ASSERT_EQ(0, keystore_set_session_key(ks, idx, key,
+						      sizeof(key)));
+		ASSERT_EQ(0, frame_encryptor_set_keystore(enc, ks));
+	}
+
+	int encrypt()
+	{
+		return frame_encryptor_encrypt(enc, 0, frame, sizeof(frame),
+					       cipher, &csize);
+	}
+
+	int decrypt()
+	{
+		size_t psize = 0;
+
+		return frame_decryptor_decrypt(dec, 0, cipher, csize,
+					       plain, &psize);
+	}
+
+	struct frame_stats get(bool tx)
+	{
+		struct frame_stats st;
+
+		EXPECT_EQ(0, frame_stats_group_get(grp, FRAME_MEDIA_AUDIO,
+						   tx, &st));
+		return st;
+	}
+
+protected:
+	struct frame_stats_group *grp = NULL;
+	struct keystore *ks = NULL;
+	struct frame_encryptor *enc = NULL;
+	struct frame_decryptor *dec = NULL;
+	uint8_t key[KEYSZ];
+	uint8_t frame[FRAMESZ];
+	uint8_t cipher[FRAMESZ + 128];
+	uint8_t plain[FRAMESZ + 128];
+	size_t csize = 0;
+};
+
+
+TEST_F(FrameStats, frames_and_bytes)
+{
+	add_key(0);
+
+	for (int i = 0; i < 10; i++) {
+		ASSERT_EQ(0, encrypt());
+		ASSERT_EQ(0, decrypt());
+	}
+
+	struct frame_stats tx = get(true);
+	struct frame_stats rx = get(false);
+
+	ASSERT_EQ(10, tx.frames);
+	ASSERT_EQ(10 * FRAMESZ, tx.bytes_in);
+	ASSERT_EQ(10 * csize, tx.bytes_out);
+	ASSERT_EQ(0, frame_stats_drops(&tx));
+
+	ASSERT_EQ(10, rx.frames);
+	ASSERT_EQ(10 * csize, rx.bytes_in);
+	ASSERT_EQ(10 * FRAMESZ, rx.bytes_out);
+	ASSERT_EQ(0, frame_stats_drops(&rx));
+
+	/* every frame lands in the histogram */
+	uint64_t n = 0;
+	for (int i = 0; i < FRAME_STATS_BUCKETS; i++)
+		n += tx.histv[i];
+	ASSERT_EQ(10, n);
+	ASSERT_GT(tx.ns_total, 0);
+	ASSERT_GE(frame_stats_percentile(&tx, 99),
+		  frame_stats_percentile(&tx, 50));
+
+	/* video has its own counters */
+	struct frame_stats vid;
+	ASSERT_EQ(0, frame_stats_group_get(grp, FRAME_MEDIA_VIDEO, true,
+					   &vid));
+	ASSERT_EQ(0, vid.frames);
+}
+
+
+TEST_F(FrameStats, drop_reasons)
+{
+	/* no key in the keystore yet */
+	ASSERT_EQ(0, frame_encryptor_set_keystore(enc, ks));
+	ASSERT_EQ(EAGAIN, encrypt());
+	ASSERT_EQ(1, get(true).dropv[FRAME_DROP_NO_KEY]);
+
+	add_key(0);
+	ASSERT_EQ(0, encrypt());
+
+	/* tampered payload fails the tag check */
+	cipher[csize - 20] ^= 0x01;
+	ASSERT_EQ(EIO, decrypt());
+	cipher[csize - 20] ^= 0x01;
+	ASSERT_EQ(0, decrypt());
+
+	/* truncated frame */
+	size_t full = csize;
+	csize = 8;
+	ASSERT_EQ(EBADMSG, decrypt());
+	csize = full;
+
+	struct frame_stats rx = get(false);
+	ASSERT_EQ(1, rx.dropv[FRAME_DROP_AUTH]);
+	ASSERT_EQ(1, rx.dropv[FRAME_DROP_SHORT]);
+	ASSERT_EQ(2, frame_stats_drops(&rx));
+	ASSERT_EQ(1, rx.frames);
+}
+
+
+TEST_F(FrameStats, key_switch)
+{
+	add_key(0);
+	ASSERT_EQ(0, encrypt());
+	ASSERT_EQ(0, decrypt());
+
+	add_key(1);
+	ASSERT_EQ(0, keystore_rotate(ks));
+	ASSERT_EQ(0, encrypt());
+	ASSERT_EQ(0, decrypt());
+
+	ASSERT_EQ(1, get(true).key_switches);
+	ASSERT_EQ(1, get(false).key_switches);
+}
+
+
+TEST_F(FrameStats, released_streams_are_kept)
+{
+	add_key(0);
+	ASSERT_EQ(0, encrypt());
+	ASSERT_EQ(0, decrypt());
+
+	/* a decryptor replaced during the call */
+	dec = (struct frame_decryptor *)mem_deref(dec);
+	ASSERT_EQ(1, get(false).frames);
+
+	ASSERT_EQ(0, frame_decryptor_alloc(&dec, FRAME_MEDIA_AUDIO));
+	ASSERT_EQ(0, frame_decryptor_set_keystore(dec, ks));
+	ASSERT_EQ(0, frame_decryptor_set_uid(dec, USERID_HASH));
+	ASSERT_EQ(0, frame_decryptor_set_stats(dec, grp));
+	ASSERT_EQ(0, decrypt());
+
+	ASSERT_EQ(2, get(false).frames);
+}
+
+
+TEST_F(FrameStats, first_frame_times)
+{
+	uint64_t t0 = frame_stats_now();
+
+	ASSERT_EQ(0, get(true).first_ns);
+	ASSERT_EQ(0, get(false).first_ns);
+
+	/* a dropped frame was seen, but not processed */
+	ASSERT_EQ(0, frame_encryptor_set_keystore(enc, ks));
+	ASSERT_EQ(EAGAIN, encrypt());
+	uint64_t first_seen = get(true).first_ns;
+	ASSERT_GE(first_seen, t0);
+	ASSERT_EQ(0, get(true).first_ok_ns);
+
+	add_key(0);
+	ASSERT_EQ(0, encrypt());
+	ASSERT_EQ(0, decrypt());
+
+	struct frame_stats tx = get(true);
+	struct frame_stats rx = get(false);
+	ASSERT_EQ(first_seen, tx.first_ns);
+	ASSERT_GE(tx.first_ok_ns, first_seen);
+	ASSERT_GE(rx.first_ok_ns, tx.first_ok_ns);
+	ASSERT_EQ(rx.first_ns, rx.first_ok_ns);
+
+	/* later frames do not move them */
+	ASSERT_EQ(0, encrypt());
+	ASSERT_EQ(tx.first_ok_ns, get(true).first_ok_ns);
+}
+
+
+TEST_F(FrameStats, percentile)
+{
+	struct frame_stats st;
+
+	memset(&st, 0, sizeof(st));
+	ASSERT_EQ(0, frame_stats_percentile(&st, 50));
+
+	st.frames = 100;
+	st.histv[2] = 90;     /* < 1024ns */
+	st.histv[6] = 10;     /* < 16384ns */
+
+	ASSERT_EQ(1024, frame_stats_percentile(&st, 50));
+	ASSERT_EQ(1024, frame_stats_percentile(&st, 90));
+	ASSERT_EQ(16384, frame_stats_percentile(&st, 91));
+	ASSERT_EQ(16384, frame_stats_percentile(&st, 100));
+}
+
+
+TEST_F(FrameStats, bad_args)
+{
+	struct frame_stats st;
+	struct frame_stats_stream *fs;
+
+	ASSERT_EQ(EINVAL, frame_stats_group_alloc(NULL));
+	ASSERT_EQ(EINVAL, frame_stats_stream_alloc(&fs, NULL,
+						   FRAME_MEDIA_AUDIO, true));
+	ASSERT_EQ(EINVAL, frame_stats_group_get(NULL, FRAME_MEDIA_AUDIO,
+						true, &st));
+	ASSERT_EQ(EINVAL, frame_encryptor_set_stats(enc, NULL));
+	ASSERT_EQ(EINVAL, frame_decryptor_set_stats(NULL, grp));
+
+	/* no stream, no counting */
+	frame_stats_drop(NULL, FRAME_DROP_AUTH);
+	frame_stats_key_switch(NULL);
+}
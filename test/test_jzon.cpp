@@ -354,3 +354,182 @@ TEST(jzon, add_base64)
 
 	mem_deref(jobj);
 }
+
+
+TEST(jzon, array_index)
+{
+	struct json_object *jarr, *jnested;
+	const int n = 1000;
+
+	jarr = json_object_new_array();
+	ASSERT_TRUE(jarr != NULL);
+	ASSERT_EQ(0, json_object_array_length(jarr));
+	ASSERT_TRUE(json_object_array_get_idx(jarr, 0) == NULL);
+
+	for (int i = 0; i < n; i++) {
+		ASSERT_EQ(0, json_object_array_add(jarr,
+						   json_object_new_int(i)));
+	}
+
+	jnested = json_object_new_array();
+	json_object_array_add(jnested, json_object_new_string("x"));
+	json_object_array_add(jnested, NULL);
+	ASSERT_EQ(0, json_object_array_add(jarr, jnested));
+
+	ASSERT_EQ(n + 1, json_object_array_length(jarr));
+
+	for (int i = 0; i < n; i++) {
+		struct json_object *jint = json_object_array_get_idx(jarr, i);
+
+		ASSERT_TRUE(jint != NULL);
+		ASSERT_EQ(i, json_object_get_int(jint));
+	}
+
+	jnested = json_object_array_get_idx(jarr, n);
+	ASSERT_TRUE(jzon_is_array(jnested));
+	ASSERT_EQ(2, json_object_array_length(jnested));
+	ASSERT_STREQ("x", json_object_get_string(
+			     json_object_array_get_idx(jnested, 0)));
+	ASSERT_TRUE(json_object_array_get_idx(jnested, 1) != NULL);
+	ASSERT_TRUE(json_object_get_string(
+			    json_object_array_get_idx(jnested, 1)) == NULL);
+
+	ASSERT_TRUE(json_object_array_get_idx(jarr, n + 1) == NULL);
+	ASSERT_TRUE(json_object_array_get_idx(jarr, -1) == NULL);
+
+	mem_deref(jarr);
+}
+
+
+TEST(jzon, array_decode)
+{
+	static const char str[] =
+		"{\"members\":[{\"userid\":\"a\"},{\"userid\":\"b\"}],"
+		" \"levels\":[1, 2, [3, 4], []]}";
+	struct json_object *jobj, *jarr, *jinner;
+	int err;
+
+	err = jzon_decode(&jobj, str, strlen(str));
+	ASSERT_EQ(0, err);
+
+	err = jzon_array(&jarr, jobj, "members");
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(2, json_object_array_length(jarr));
+	ASSERT_STREQ("b", jzon_str(json_object_array_get_idx(jarr, 1),
+				   "userid"));
+
+	err = jzon_array(&jarr, jobj, "levels");
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(4, json_object_array_length(jarr));
+	ASSERT_EQ(2, json_object_get_int(json_object_array_get_idx(jarr, 1)));
+
+	jinner = json_object_array_get_idx(jarr, 2);
+	ASSERT_EQ(2, json_object_array_length(jinner));
+	ASSERT_EQ(4, json_object_get_int(
+			     json_object_array_get_idx(jinner, 1)));
+
+	jinner = json_object_array_get_idx(jarr, 3);
+	ASSERT_EQ(0, json_object_array_length(jinner));
+
+	mem_deref(jobj);
+}
+
+
+TEST(jzon, array_add_after_decode)
+{
+	struct json_object *jarr;
+	int err;
+
+	err = jzon_decode(&jarr, "[\"a\", \"b\", \"c\"]", 15);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(0, json_object_array_add(jarr, json_object_new_string("d")));
+	ASSERT_EQ(4, json_object_array_length(jarr));
+	ASSERT_STREQ("c", json_object_get_string(
+			     json_object_array_get_idx(jarr, 2)));
+	ASSERT_STREQ("d", json_object_get_string(
+			     json_object_array_get_idx(jarr, 3)));
+
+	mem_deref(jarr);
+}
+
+
+TEST(jzon, array_decode_index)
+{
+	struct json_object *jobj, *ja, *jarr;
+	struct mbuf *mb;
+	const int n = 1000;
+	int err;
+
+	mb = mbuf_alloc(8192);
+	ASSERT_TRUE(mb != NULL);
+
+	mbuf_printf(mb, "{\"a\":{\"v\":[");
+	for (int i = 0; i < n; i++)
+		mbuf_printf(mb, "%s%d", i ? "," : "", i);
+	mbuf_printf(mb, "]}}");
+
+	err = jzon_decode(&jobj, (char *)mb->buf, mb->end);
+	ASSERT_EQ(0, err);
+
+	err = jzon_object(&ja, jobj, "a");
+	ASSERT_EQ(0, err);
+	err = jzon_array(&jarr, ja, "v");
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(n, json_object_array_length(jarr));
+
+	for (int i = n - 1; i >= 0; i--) {
+		ASSERT_EQ(i, json_object_get_int(
+				     json_object_array_get_idx(jarr, i)));
+	}
+
+	ASSERT_EQ(0, json_object_array_add(jarr, json_object_new_int(n)));
+	ASSERT_EQ(n + 1, json_object_array_length(jarr));
+	ASSERT_EQ(n, json_object_get_int(json_object_array_get_idx(jarr, n)));
+
+	/* appended through the odict, picked up by the index */
+	err = odict_entry_add(jzon_get_odict(jarr), "1001", ODICT_INT,
+			      (int64_t)1001);
+	ASSERT_EQ(0, err);
+	ASSERT_EQ(n + 2, json_object_array_length(jarr));
+	ASSERT_EQ(n + 1, json_object_get_int(
+				 json_object_array_get_idx(jarr, n + 1)));
+
+	mem_deref(jobj);
+	mem_deref(mb);
+}
+
+
+TEST(jzon, decode_invalid)
+{
+	static const char *docv[] = {
+		"",
+		"x",
+		"{",
+		"[1, 2",
+		"{\"a\" 1}",
+		"{\"a\": \"abc}",
+	};
+	struct json_object *jobj;
+
+	for (size_t i = 0; i < ARRAY_SIZE(docv); i++) {
+		jobj = NULL;
+		ASSERT_NE(0, jzon_decode(&jobj, docv[i], strlen(docv[i])))
+			<< "accepted: " << docv[i];
+		ASSERT_TRUE(jobj == NULL);
+	}
+}
+
+
+TEST(jzon, pull_rejects_control_chars)
+{
+	static const char doc[] = "{\"name\": \"a\tb\"}";
+	static const char esc[] = "{\"name\": \"a\\tb\"}";
+	struct jzon_pull jp;
+
+	jzon_pull_init(&jp, doc, strlen(doc));
+	ASSERT_EQ(EBADMSG, jzon_pull_skip(&jp));
+
+	jzon_pull_init(&jp, esc, strlen(esc));
+	ASSERT_EQ(0, jzon_pull_skip(&jp));
+}
@@ -281,3 +281,118 @@ TEST(mediamgr, alloc_and_free)
 	mem_deref(mm);
 }
 #endif
+
+
+TEST(mediamgr, audio_stats_bad_args)
+{
+	struct mediamgr_audio_stats st;
+
+	ASSERT_EQ(EINVAL, mediamgr_get_audio_stats(NULL, &st));
+
+	/* ignored without a mediamgr */
+	mediamgr_set_audio_prewarm(NULL, true);
+}
+
+
+#define T0 1000  /* [ms] */
+
+
+TEST(mediamgr, prewarm_handover)
+{
+	struct mediamgr_prewarm pw;
+
+	memset(&pw, 0, sizeof(pw));
+
+	/* opened while ringing, answered, handed over */
+	mediamgr_prewarm_opened(&pw, T0);
+	mediamgr_prewarm_answered(&pw, T0 + 5000);
+	ASSERT_EQ(12, mediamgr_prewarm_handover(&pw, true, T0 + 5012));
+
+	ASSERT_EQ(1, pw.stats.warm);
+	ASSERT_EQ(12, pw.stats.warm_ready_ms);
+	ASSERT_EQ(0, pw.stats.cold);
+	ASSERT_FALSE(pw.warm);
+
+	/* the used device is not counted when the call ends */
+	mediamgr_prewarm_release(&pw);
+	ASSERT_EQ(0, pw.stats.unused);
+
+	/* next call is answered without pre-warming */
+	mediamgr_prewarm_answered(&pw, T0 + 60000);
+	ASSERT_EQ(250, mediamgr_prewarm_handover(&pw, false, T0 + 60250));
+
+	ASSERT_EQ(1, pw.stats.warm);
+	ASSERT_EQ(1, pw.stats.cold);
+	ASSERT_EQ(250, pw.stats.cold_ready_ms);
+
+	/* an open device, but not a pre-warmed one */
+	mediamgr_prewarm_answered(&pw, T0 + 90000);
+	ASSERT_EQ(3, mediamgr_prewarm_handover(&pw, true, T0 + 90003));
+	ASSERT_EQ(1, pw.stats.warm);
+	ASSERT_EQ(1, pw.stats.cold);
+
+	/* not answered, nothing to measure */
+	ASSERT_EQ(-1, mediamgr_prewarm_handover(&pw, false, T0 + 99000));
+}
+
+
+TEST(mediamgr, prewarm_timeout)
+{
+	struct mediamgr_prewarm pw;
+
+	memset(&pw, 0, sizeof(pw));
+
+	ASSERT_FALSE(mediamgr_prewarm_expired(&pw, T0));
+
+	mediamgr_prewarm_opened(&pw, T0);
+	ASSERT_FALSE(mediamgr_prewarm_expired(&pw, T0));
+	ASSERT_FALSE(mediamgr_prewarm_expired(&pw,
+					      T0 + MEDIAMGR_PREWARM_TIMEOUT - 1));
+	ASSERT_TRUE(mediamgr_prewarm_expired(&pw,
+					     T0 + MEDIAMGR_PREWARM_TIMEOUT));
+
+	/* released by the timeout, counted as unused */
+	mediamgr_prewarm_release(&pw);
+	ASSERT_EQ(1, pw.stats.unused);
+	ASSERT_FALSE(mediamgr_prewarm_expired(&pw,
+					      T0 + MEDIAMGR_PREWARM_TIMEOUT));
+
+	/* a handed over device does not expire */
+	mediamgr_prewarm_opened(&pw, T0);
+	mediamgr_prewarm_answered(&pw, T0 + 1000);
+	mediamgr_prewarm_handover(&pw, true, T0 + 1010);
+	ASSERT_FALSE(mediamgr_prewarm_expired(&pw,
+					      T0 + MEDIAMGR_PREWARM_TIMEOUT));
+}
+
+
+TEST(mediamgr, prewarm_release_unused)
+{
+	struct mediamgr_prewarm pw;
+
+	memset(&pw, 0, sizeof(pw));
+
+	/* rejected while ringing */
+	mediamgr_prewarm_opened(&pw, T0);
+	mediamgr_prewarm_release(&pw);
+	ASSERT_EQ(1, pw.stats.unused);
+	ASSERT_FALSE(pw.warm);
+
+	/* released twice, counted once */
+	mediamgr_prewarm_release(&pw);
+	ASSERT_EQ(1, pw.stats.unused);
+
+	/* answered, but released before the device was handed over */
+	mediamgr_prewarm_opened(&pw, T0);
+	mediamgr_prewarm_answered(&pw, T0 + 100);
+	mediamgr_prewarm_release(&pw);
+	ASSERT_EQ(2, pw.stats.unused);
+	ASSERT_EQ(-1, mediamgr_prewarm_handover(&pw, true, T0 + 200));
+	ASSERT_EQ(0, pw.stats.warm);
+
+	/* ignored without state */
+	mediamgr_prewarm_opened(NULL, T0);
+	mediamgr_prewarm_release(NULL);
+	ASSERT_EQ(-1, mediamgr_prewarm_handover(NULL, true, T0));
+	ASSERT_FALSE(mediamgr_prewarm_expired(NULL, T0));
+}
@@ -0,0 +1,222 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <avs_wcall.h>
+#include <gtest/gtest.h>
+
+
+#define MAX_MEMBERS 256
+
+
+class Roster {
+
+public:
+	Roster(size_t n)
+	{
+		membs.membv = membv;
+		membs.membc = n;
+
+		for (size_t i = 0; i < MAX_MEMBERS; i++) {
+			snprintf(userv[i], sizeof(userv[i]),
+				 "user-%04zu", i);
+			snprintf(clientv[i], sizeof(clientv[i]),
+				 "client-%zu", i % 3);
+
+			membv[i].userid = userv[i];
+			membv[i].clientid = clientv[i];
+			membv[i].audio_state = 1;
+			membv[i].video_recv = 0;
+			membv[i].muted = 0;
+		}
+	}
+
+	struct wcall_members membs;
+	struct wcall_member membv[MAX_MEMBERS];
+
+private:
+	char userv[MAX_MEMBERS][16];
+	char clientv[MAX_MEMBERS][16];
+};
+
+
+static int array_length(struct json_object *jobj, const char *key)
+{
+	struct json_object *jarr;
+
+	if (jzon_array(&jarr, jobj, key))
+		return -1;
+
+	return json_object_array_length(jarr);
+}
+
+
+class MembDeltaTest : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		ASSERT_EQ(0, membdelta_alloc(&md, 0));
+	}
+
+	virtual void TearDown() override
+	{
+		mem_deref(jobj);
+		mem_deref(md);
+	}
+
+	int update(Roster &roster)
+	{
+		char *json = NULL;
+		int err;
+
+		jobj = (struct json_object *)mem_deref(jobj);
+
+		err = membdelta_update(md, "conv", &roster.membs, &json);
+		if (err)
+			return err;
+
+		err = jzon_decode(&jobj, json, strlen(json));
+		mem_deref(json);
+
+		return err;
+	}
+
+protected:
+	struct membdelta *md = NULL;
+	struct json_object *jobj = NULL;
+};
+
+
+TEST_F(MembDeltaTest, first_is_full)
+{
+	Roster roster(5);
+
+	ASSERT_EQ(0, update(roster));
+	ASSERT_STREQ("full", jzon_str(jobj, "type"));
+	ASSERT_EQ(5, array_length(jobj, "members"));
+	ASSERT_EQ(-1, array_length(jobj, "joined"));
+	ASSERT_EQ(1, membdelta_seq(md));
+}
+
+
+TEST_F(MembDeltaTest, join_change_leave)
+{
+	Roster roster(5);
+	struct json_object *jarr;
+	int seq;
+
+	ASSERT_EQ(0, update(roster));
+
+	/* nothing changed, nothing to send */
+	ASSERT_EQ(ENOENT, update(roster));
+	ASSERT_EQ(1, membdelta_seq(md));
+
+	/* one joins, one unmutes */
+	roster.membs.membc = 6;
+	roster.membv[2].muted = 1;
+	ASSERT_EQ(0, update(roster));
+	ASSERT_STREQ("delta", jzon_str(jobj, "type"));
+	ASSERT_EQ(1, array_length(jobj, "joined"));
+	ASSERT_EQ(1, array_length(jobj, "changed"));
+	ASSERT_EQ(-1, array_length(jobj, "left"));
+	ASSERT_EQ(0, jzon_int(&seq, jobj, "seq"));
+	ASSERT_EQ(2, seq);
+
+	ASSERT_EQ(0, jzon_array(&jarr, jobj, "changed"));
+	ASSERT_STREQ("user-0002",
+		     jzon_str(json_object_array_get_idx(jarr, 0), "userid"));
+
+	/* one leaves from the middle */
+	roster.membv[1] = roster.membv[5];
+	roster.membs.membc = 5;
+	ASSERT_EQ(0, update(roster));
+	ASSERT_EQ(-1, array_length(jobj, "joined"));
+	ASSERT_EQ(1, array_length(jobj, "left"));
+
+	ASSERT_EQ(0, jzon_array(&jarr, jobj, "left"));
+	ASSERT_STREQ("user-0001",
+		     jzon_str(json_object_array_get_idx(jarr, 0), "userid"));
+}
+
+
+TEST_F(MembDeltaTest, duplicate_entries)
+{
+	Roster roster(3);
+
+	roster.membv[2] = roster.membv[0];
+
+	ASSERT_EQ(0, update(roster));
+	ASSERT_EQ(2, array_length(jobj, "members"));
+	ASSERT_EQ(ENOENT, update(roster));
+}
+
+
+TEST(membdelta, periodic_snapshot)
+{
+	struct membdelta *md;
+	Roster roster(4);
+	char *json;
+
+	ASSERT_EQ(0, membdelta_alloc(&md, 3));
+
+	for (int i = 0; i < 9; i++) {
+		struct json_object *jobj;
+		const char *type;
+
+		roster.membv[0].muted = i & 1;
+
+		ASSERT_EQ(0, membdelta_update(md, "conv", &roster.membs,
+					      &json));
+		ASSERT_EQ(0, jzon_decode(&jobj, json, strlen(json)));
+
+		type = jzon_str(jobj, "type");
+		if (i % 4 == 0)
+			ASSERT_STREQ("full", type);
+		else
+			ASSERT_STREQ("delta", type);
+
+		mem_deref(jobj);
+		mem_deref(json);
+	}
+
+	/* the app asked for a resync */
+	membdelta_resync(md);
+	roster.membv[1].muted = 1;
+	ASSERT_EQ(0, membdelta_update(md, "conv", &roster.membs, &json));
+	ASSERT_TRUE(strstr(json, "\"full\"") != NULL);
+	mem_deref(json);
+
+	mem_deref(md);
+}
+
+
+TEST(membdelta, bad_args)
+{
+	struct membdelta *md;
+	Roster roster(1);
+	char *json;
+
+	ASSERT_EQ(EINVAL, membdelta_alloc(NULL, 0));
+	ASSERT_EQ(0, membdelta_alloc(&md, 0));
+	ASSERT_EQ(EINVAL, membdelta_update(md, "conv", NULL, &json));
+	ASSERT_EQ(EINVAL, membdelta_update(md, "conv", &roster.membs, NULL));
+	ASSERT_EQ(EINVAL, membdelta_update(NULL, "conv", &roster.membs, &json));
+	mem_deref(md);
+}
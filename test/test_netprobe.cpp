@@ -119,3 +119,25 @@ TEST_F(Netprobe, tls)
 	ASSERT_EQ(NUM_PACKETS, result.n_pkt_sent);
 	ASSERT_EQ(NUM_PACKETS, result.n_pkt_recv);
 }
+
+
+TEST_F(Netprobe, udp_bwprobe)
+{
+	int err;
+
+	err = netprobe_alloc(&np, &srv.addr, IPPROTO_UDP, false,
+			     "", "", NUM_PACKETS, INTERVAL_MS,
+			     netprobe_handler, this);
+	ASSERT_EQ(0, err);
+
+	err = netprobe_set_bwprobe(np, 3, 10, 1200);
+	ASSERT_EQ(0, err);
+
+	err = re_main_wait(5000);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(0, np_err);
+	ASSERT_EQ(NUM_PACKETS, result.n_pkt_sent);
+	ASSERT_EQ(NUM_PACKETS, result.n_pkt_recv);
+	ASSERT_GT(result.bw_kbps, 0);
+}
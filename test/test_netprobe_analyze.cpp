@@ -0,0 +1,189 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+#define NUM_SAMPLES 100
+
+
+class NetprobeAnalyze : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		memset(sampv, 0, sizeof(sampv));
+		memset(&result, 0, sizeof(result));
+
+		/* 20ms interval, RTT of 40ms + i us */
+		for (unsigned i = 0; i < NUM_SAMPLES; i++) {
+			sampv[i].ts_tx = 1000000 + i * 20000;
+			sampv[i].ts_rx = sampv[i].ts_tx + 40000 + i;
+			sampv[i].size = 180;
+		}
+	}
+
+	void lose(unsigned i)
+	{
+		sampv[i].ts_rx = 0;
+	}
+
+	int analyze(size_t n = NUM_SAMPLES)
+	{
+		return netprobe_analyze(&result, sampv, n);
+	}
+
+protected:
+	struct netprobe_sample sampv[NUM_SAMPLES];
+	struct netprobe_result result;
+};
+
+
+TEST_F(NetprobeAnalyze, no_loss)
+{
+	ASSERT_EQ(0, analyze());
+
+	ASSERT_EQ(NUM_SAMPLES, result.n_pkt_sent);
+	ASSERT_EQ(NUM_SAMPLES, result.n_pkt_recv);
+	ASSERT_EQ(0, result.n_lost);
+	ASSERT_EQ(0, result.n_loss_bursts);
+	ASSERT_EQ(0, result.n_reordered);
+	ASSERT_EQ(0, result.n_dup);
+	ASSERT_EQ(0, result.bw_kbps);
+
+	ASSERT_EQ(40000, result.rtt_min);
+	ASSERT_EQ(40049, result.rtt_p50);
+	ASSERT_EQ(40089, result.rtt_p90);
+	ASSERT_EQ(40098, result.rtt_p99);
+	ASSERT_EQ(40099, result.rtt_max);
+	ASSERT_EQ(40049, result.rtt_avg);
+
+	/* transit time grows by 1us per packet */
+	ASSERT_LE(result.jitter, 1);
+}
+
+
+TEST_F(NetprobeAnalyze, loss_bursts)
+{
+	lose(2);
+	lose(3);
+	lose(4);
+	lose(7);
+	lose(99);
+
+	ASSERT_EQ(0, analyze());
+
+	ASSERT_EQ(NUM_SAMPLES, result.n_pkt_sent);
+	ASSERT_EQ(NUM_SAMPLES - 5, result.n_pkt_recv);
+	ASSERT_EQ(5, result.n_lost);
+	ASSERT_EQ(3, result.n_loss_bursts);
+	ASSERT_EQ(3, result.loss_burst_max);
+}
+
+
+TEST_F(NetprobeAnalyze, reordering)
+{
+	/* 5 overtakes 3 and 4 */
+	sampv[5].ts_rx = sampv[3].ts_rx - 1;
+
+	ASSERT_EQ(0, analyze());
+	ASSERT_EQ(2, result.n_reordered);
+}
+
+
+TEST_F(NetprobeAnalyze, jitter)
+{
+	/* every other packet is delayed by 10ms */
+	for (unsigned i = 1; i < NUM_SAMPLES; i += 2)
+		sampv[i].ts_rx += 10000;
+
+	ASSERT_EQ(0, analyze());
+
+	/* the RFC 3550 estimator converges to the delay variation */
+	ASSERT_GT(result.jitter, 9000);
+	ASSERT_LE(result.jitter, 10100);
+	ASSERT_EQ(40000, result.rtt_min);
+	ASSERT_GE(result.rtt_p90, 50000);
+}
+
+
+TEST_F(NetprobeAnalyze, duplicates)
+{
+	sampv[10].dup = 2;
+	sampv[20].dup = 1;
+
+	ASSERT_EQ(0, analyze());
+	ASSERT_EQ(3, result.n_dup);
+	ASSERT_EQ(NUM_SAMPLES, result.n_pkt_recv);
+}
+
+
+TEST_F(NetprobeAnalyze, bandwidth)
+{
+	const unsigned probec = 40;
+
+	/* 3 trains of 20 packets, 1000 bytes spaced by 1ms: 8 Mbit/s */
+	for (unsigned i = probec; i < NUM_SAMPLES; i++) {
+		const unsigned t = (i - probec) / 20;
+		const unsigned k = (i - probec) % 20;
+
+		sampv[i].train = t + 1;
+		sampv[i].size = 1000;
+		sampv[i].ts_tx = 5000000 + t * 100000;
+		sampv[i].ts_rx = sampv[i].ts_tx + 40000 + k * 1000;
+	}
+
+	/* one train is slowed down, and the first packet of one is lost */
+	for (unsigned i = probec + 20; i < probec + 40; i++)
+		sampv[i].ts_rx += (i - probec - 20) * 1000;
+	sampv[probec + 40].ts_rx = 0;
+
+	ASSERT_EQ(0, analyze());
+
+	/* the trains do not count as probe packets */
+	ASSERT_EQ(probec, result.n_pkt_sent);
+	ASSERT_EQ(probec, result.n_pkt_recv);
+	ASSERT_EQ(0, result.n_lost);
+
+	ASSERT_EQ(8000, result.bw_kbps);
+}
+
+
+TEST_F(NetprobeAnalyze, all_lost)
+{
+	for (unsigned i = 0; i < NUM_SAMPLES; i++)
+		lose(i);
+
+	ASSERT_EQ(0, analyze());
+	ASSERT_EQ(0, result.n_pkt_recv);
+	ASSERT_EQ(NUM_SAMPLES, result.n_lost);
+	ASSERT_EQ(1, result.n_loss_bursts);
+	ASSERT_EQ(NUM_SAMPLES, result.loss_burst_max);
+	ASSERT_EQ(0, result.rtt_p99);
+}
+
+
+TEST_F(NetprobeAnalyze, bad_args)
+{
+	ASSERT_EQ(EINVAL, netprobe_analyze(NULL, sampv, NUM_SAMPLES));
+	ASSERT_EQ(EINVAL, netprobe_analyze(&result, NULL, NUM_SAMPLES));
+	ASSERT_EQ(0, netprobe_analyze(&result, NULL, 0));
+	ASSERT_EQ(0, result.n_pkt_sent);
+}
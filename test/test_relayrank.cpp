@@ -0,0 +1,177 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+#define NUM_SERVERS 4
+
+
+static const char *urlv[NUM_SERVERS] = {
+	"turn:10.0.0.1:3478",
+	"turn:10.0.0.2:3478",
+	"turn:10.0.0.3:3478?transport=tcp",
+	"turns:10.0.0.4:443?transport=tcp",
+};
+
+
+class RelayRank : public ::testing::Test {
+
+public:
+	virtual void SetUp() override
+	{
+		memset(srvv, 0, sizeof(srvv));
+		for (unsigned i = 0; i < NUM_SERVERS; i++) {
+			str_ncpy(srvv[i].url, urlv[i], sizeof(srvv[i].url));
+			str_ncpy(srvv[i].username, "user",
+				 sizeof(srvv[i].username));
+		}
+
+		ASSERT_EQ(0, relayrank_alloc(&rr, NULL, NULL));
+		ASSERT_EQ(0, relayrank_set_servers(rr, srvv, NUM_SERVERS));
+	}
+
+	virtual void TearDown() override
+	{
+		mem_deref(rr);
+	}
+
+	int probe(unsigned i, uint32_t rtt_ms, size_t lost)
+	{
+		struct netprobe_result res;
+
+		memset(&res, 0, sizeof(res));
+		res.n_pkt_sent = 10;
+		res.n_pkt_recv = 10 - lost;
+		res.rtt_p50 = rtt_ms * 1000;
+
+		return relayrank_update(rr, urlv[i], 0, &res);
+	}
+
+	unsigned rank_of(unsigned i)
+	{
+		struct zapi_ice_server sortv[NUM_SERVERS];
+
+		memcpy(sortv, srvv, sizeof(sortv));
+		EXPECT_EQ(0, relayrank_sort(rr, sortv, NUM_SERVERS));
+
+		for (unsigned r = 0; r < NUM_SERVERS; r++) {
+			if (0 == strcmp(sortv[r].url, urlv[i]))
+				return r;
+		}
+
+		return NUM_SERVERS;
+	}
+
+protected:
+	struct relayrank *rr = NULL;
+	struct zapi_ice_server srvv[NUM_SERVERS];
+};
+
+
+TEST_F(RelayRank, unprobed_keeps_config_order)
+{
+	for (unsigned i = 0; i < NUM_SERVERS; i++)
+		ASSERT_EQ(i, rank_of(i));
+}
+
+
+TEST_F(RelayRank, fastest_first)
+{
+	ASSERT_EQ(0, probe(0, 120, 0));
+	ASSERT_EQ(0, probe(1, 80, 0));
+	ASSERT_EQ(0, probe(2, 30, 0));
+	ASSERT_EQ(0, probe(3, 60, 0));
+
+	ASSERT_EQ(0, rank_of(2));
+	ASSERT_EQ(1, rank_of(3));
+	ASSERT_EQ(2, rank_of(1));
+	ASSERT_EQ(3, rank_of(0));
+
+	/* the sorted servers keep their credentials */
+	struct zapi_ice_server sortv[NUM_SERVERS];
+	memcpy(sortv, srvv, sizeof(sortv));
+	ASSERT_EQ(0, relayrank_sort(rr, sortv, NUM_SERVERS));
+	ASSERT_STREQ("user", sortv[0].username);
+}
+
+
+TEST_F(RelayRank, loss_is_penalized)
+{
+	/* 30% loss on a fast relay is worse than a slower clean one */
+	ASSERT_EQ(0, probe(0, 20, 3));
+	ASSERT_EQ(0, probe(1, 90, 0));
+
+	ASSERT_LT(rank_of(1), rank_of(0));
+}
+
+
+TEST_F(RelayRank, failed_probe_ranks_last)
+{
+	ASSERT_EQ(0, relayrank_update(rr, urlv[0], ETIMEDOUT, NULL));
+	ASSERT_EQ(0, probe(1, 200, 0));
+
+	/* unprobed servers go before a failing one */
+	ASSERT_EQ(NUM_SERVERS - 1, rank_of(0));
+	ASSERT_EQ(0, rank_of(1));
+}
+
+
+TEST_F(RelayRank, decayed_score)
+{
+	ASSERT_EQ(0, probe(0, 40, 0));
+	ASSERT_EQ(40000, relayrank_cost(rr, urlv[0]));
+
+	/* one bad round moves the score, but does not replace it */
+	ASSERT_EQ(0, probe(0, 200, 0));
+	ASSERT_EQ(80000, relayrank_cost(rr, urlv[0]));
+
+	/* and it recovers over a few good rounds */
+	for (int i = 0; i < 10; i++)
+		ASSERT_EQ(0, probe(0, 40, 0));
+	ASSERT_LT(relayrank_cost(rr, urlv[0]), 45000);
+}
+
+
+TEST_F(RelayRank, config_refresh_keeps_scores)
+{
+	ASSERT_EQ(0, probe(3, 10, 0));
+	ASSERT_EQ(0, rank_of(3));
+
+	/* server 0 is dropped from the config, new credentials */
+	for (unsigned i = 0; i < NUM_SERVERS; i++)
+		str_ncpy(srvv[i].credential, "renewed",
+			 sizeof(srvv[i].credential));
+	ASSERT_EQ(0, relayrank_set_servers(rr, &srvv[1], NUM_SERVERS - 1));
+
+	ASSERT_EQ(10000, relayrank_cost(rr, urlv[3]));
+	ASSERT_EQ(ENOENT, probe(0, 10, 0));
+}
+
+
+TEST_F(RelayRank, bad_args)
+{
+	ASSERT_EQ(EINVAL, relayrank_alloc(NULL, NULL, NULL));
+	ASSERT_EQ(EINVAL, relayrank_update(rr, urlv[0], 0, NULL));
+	ASSERT_EQ(EINVAL, relayrank_update(NULL, urlv[0], EIO, NULL));
+	ASSERT_EQ(EINVAL, relayrank_sort(rr, NULL, 2));
+	ASSERT_EQ(ENOENT, relayrank_update(rr, "turn:1.2.3.4", EIO, NULL));
+	ASSERT_EQ(EINVAL, relayrank_start(rr, 0));
+}
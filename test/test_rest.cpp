@@ -18,6 +18,9 @@
 #include <re.h>
 #include <avs.h>
 #include <gtest/gtest.h>
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
 #include "fakes.hpp"
 #include "fixture.h"
 
@@ -49,3 +52,424 @@ TEST_F(RestTest, http_fragmented_response)
 	ASSERT_STREQ("yes", jzon_str(jobj, "fragmented"));
 	ASSERT_STREQ("no",  jzon_str(jobj, "is_this_a_cool_test"));
 }
+
+
+struct prio_req {
+	char id;
+	std::string *order;
+	size_t expected;
+};
+
+
+static void prio_resp_handler(int err, const struct http_msg *msg,
+			      struct mbuf *mb, struct json_object *jobj,
+			      void *arg)
+{
+	struct prio_req *pr = (struct prio_req *)arg;
+
+	ASSERT_EQ(0, err);
+
+	pr->order->push_back(pr->id);
+
+	if (pr->order->size() == pr->expected)
+		re_cancel();
+}
+
+
+TEST_F(RestTest, priority_order)
+{
+	static const int priov[] = {3, 2, 0, 2, 1, 0};
+	struct prio_req prv[6];
+	struct rest_cli *cli = NULL;
+	struct rest_req *cancelled = NULL;
+	struct rest_stats stats;
+	std::string order;
+
+	/* one slot, so that the queue order is the completion order */
+	err = rest_client_alloc(&cli, http_cli, backend->uri, NULL, 1, NULL);
+	ASSERT_EQ(0, err);
+
+	for (int i = 0; i < 6; i++) {
+		prv[i].id = 'a' + i;
+		prv[i].order = &order;
+		prv[i].expected = 5;
+
+		err = rest_get(i == 5 ? &cancelled : NULL, cli, priov[i],
+			       prio_resp_handler, &prv[i], "/invalidresource");
+		ASSERT_EQ(0, err);
+	}
+
+	ASSERT_EQ(0, rest_client_get_stats(cli, &stats));
+	ASSERT_EQ(5, stats.queued);
+	ASSERT_EQ(1, stats.inflight);
+
+	/* a queued request can be dropped before it is sent */
+	ASSERT_TRUE(cancelled != NULL);
+	mem_deref(cancelled);
+
+	wait();
+
+	/* the first one was sent right away, then by prio, FIFO within */
+	ASSERT_EQ("acebd", order);
+
+	ASSERT_EQ(0, rest_client_get_stats(cli, &stats));
+	ASSERT_EQ(0, stats.queued);
+	ASSERT_EQ(0, stats.inflight);
+	ASSERT_EQ(1, stats.inflight_max);
+	ASSERT_EQ(5, stats.nreq);
+
+	ASSERT_EQ(EINVAL, rest_client_get_stats(NULL, &stats));
+	ASSERT_EQ(EINVAL, rest_client_get_stats(cli, NULL));
+
+	mem_deref(cli);
+}
+
+
+#define MAX_HIGH 1000
+
+
+struct starve_state {
+	struct rest_cli *cli;
+	unsigned high;
+	unsigned high_before_low;
+	unsigned pending;
+	bool low_done;
+	int err;
+};
+
+
+static void starve_done(struct starve_state *st)
+{
+	if (--st->pending == 0)
+		re_cancel();
+}
+
+
+static void high_resp_handler(int err, const struct http_msg *msg,
+			      struct mbuf *mb, struct json_object *jobj,
+			      void *arg)
+{
+	struct starve_state *st = (struct starve_state *)arg;
+
+	++st->high;
+
+	/* keep a high prio request queued all the time */
+	if (!st->low_done && st->high < MAX_HIGH) {
+		st->err |= rest_get(NULL, st->cli, 0, high_resp_handler, st,
+				    "/invalidresource");
+		++st->pending;
+	}
+
+	starve_done(st);
+}
+
+
+static void low_resp_handler(int err, const struct http_msg *msg,
+			     struct mbuf *mb, struct json_object *jobj,
+			     void *arg)
+{
+	struct starve_state *st = (struct starve_state *)arg;
+
+	st->low_done = true;
+	st->high_before_low = st->high;
+
+	starve_done(st);
+}
+
+
+TEST_F(RestTest, low_prio_not_starved)
+{
+	struct starve_state st;
+
+	memset(&st, 0, sizeof(st));
+
+	err = rest_client_alloc(&st.cli, http_cli, backend->uri, NULL, 1,
+				NULL);
+	ASSERT_EQ(0, err);
+
+	/* due 20 ms after it was queued */
+	rest_client_set_prio_age(st.cli, 10);
+
+	/* the first one takes the only slot */
+	err  = rest_get(NULL, st.cli, 0, high_resp_handler, &st,
+			"/invalidresource");
+	err |= rest_get(NULL, st.cli, 2, low_resp_handler, &st,
+			"/invalidresource");
+	err |= rest_get(NULL, st.cli, 0, high_resp_handler, &st,
+			"/invalidresource");
+	ASSERT_EQ(0, err);
+	st.pending = 3;
+
+	wait();
+
+	ASSERT_EQ(0, st.err);
+	ASSERT_TRUE(st.low_done);
+
+	/* overtaken by high prio first, but only for a while */
+	ASSERT_GE(st.high_before_low, 2);
+	ASSERT_LT(st.high_before_low, MAX_HIGH);
+
+	rest_client_set_prio_age(NULL, 10);
+
+	mem_deref(st.cli);
+}
+
+
+#define NUM_CONVS 2000
+
+
+struct stream_run {
+	size_t items;
+	uint64_t ts_start;
+	uint64_t ts_first;
+	uint64_t ts_resp;
+	bool has_more;
+	struct rest_stats stats;
+};
+
+
+static void stream_item_handler(struct json_object *jobj, void *arg)
+{
+	struct stream_run *run = (struct stream_run *)arg;
+
+	if (!run->items++)
+		run->ts_first = tmr_jiffies_usec();
+}
+
+
+static void stream_resp_handler(int err, const struct http_msg *msg,
+				struct mbuf *mb, struct json_object *jobj,
+				void *arg)
+{
+	struct stream_run *run = (struct stream_run *)arg;
+	struct json_object *jconvs;
+
+	run->ts_resp = tmr_jiffies_usec();
+
+	ASSERT_EQ(0, err);
+	ASSERT_TRUE(jobj != NULL);
+
+	/* the body is still there, without the streamed array */
+	ASSERT_EQ(0, jzon_bool(&run->has_more, jobj, "has_more"));
+	ASSERT_EQ(0, jzon_array(&jconvs, jobj, "conversations"));
+	if (!run->items)
+		run->items = json_object_array_length(jconvs);
+
+	re_cancel();
+}
+
+
+static std::string conversation_list(size_t count)
+{
+	std::string body = "{\"conversations\":[";
+	char conv[256];
+
+	for (size_t i = 0; i < count; i++) {
+		re_snprintf(conv, sizeof(conv),
+			    "%s{\"id\":\"%08zx-0000-4000-8000-000000000000\","
+			    "\"name\":\"conversation %zu\",\"type\":0,"
+			    "\"members\":{\"others\":[]}}",
+			    i ? "," : "", i, i);
+		body += conv;
+	}
+
+	body += "],\"has_more\":true}";
+
+	return body;
+}
+
+
+#ifdef USE_ZLIB
+static std::string gzip(const std::string &in)
+{
+	std::string out;
+	z_stream zs;
+	char buf[4096];
+	int ret;
+
+	memset(&zs, 0, sizeof(zs));
+	if (Z_OK != deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+				 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY))
+		return out;
+
+	zs.next_in = (Bytef *)in.data();
+	zs.avail_in = in.size();
+
+	do {
+		zs.next_out = (Bytef *)buf;
+		zs.avail_out = sizeof(buf);
+
+		ret = deflate(&zs, Z_FINISH);
+		out.append(buf, sizeof(buf) - zs.avail_out);
+	} while (ret == Z_OK);
+
+	deflateEnd(&zs);
+
+	return out;
+}
+#endif
+
+
+class RestStream : public RestTest {
+
+public:
+	void run(struct stream_run *run, const std::string &body,
+		 bool gzipped, bool items)
+	{
+		HttpServer srv;
+		struct rest_cli *cli = NULL;
+		struct rest_req *rr = NULL;
+
+		srv.body = (const uint8_t *)body.data();
+		srv.body_len = body.size();
+		srv.body_gzip = gzipped;
+
+		memset(run, 0, sizeof(*run));
+
+		err = rest_client_alloc(&cli, http_cli, srv.url, NULL, 1, NULL);
+		ASSERT_EQ(0, err);
+
+		err = rest_req_alloc(&rr, stream_resp_handler, run,
+				     "GET", "/conversations");
+		ASSERT_EQ(0, err);
+
+		if (items) {
+			err = rest_req_set_items(rr, "conversations",
+						 stream_item_handler);
+			ASSERT_EQ(0, err);
+		}
+
+		run->ts_start = tmr_jiffies_usec();
+
+		err = rest_req_start(NULL, rr, cli, 0);
+		ASSERT_EQ(0, err);
+
+		wait();
+
+		ASSERT_EQ(0, rest_client_get_stats(cli, &run->stats));
+
+		re_printf("rest: %s%s: %zu items, first after %lluus,"
+			  " response after %lluus, %zu of %zu bytes buffered\n",
+			  items ? "streamed" : "buffered",
+			  gzipped ? " gzip" : "",
+			  run->items,
+			  run->items && items ? run->ts_first - run->ts_start
+			  : run->ts_resp - run->ts_start,
+			  run->ts_resp - run->ts_start,
+			  run->stats.body_max, body.size());
+
+		mem_deref(cli);
+	}
+};
+
+
+TEST_F(RestStream, items_are_streamed)
+{
+	const std::string body = conversation_list(NUM_CONVS);
+	struct stream_run buffered, streamed;
+
+	run(&buffered, body, false, false);
+	ASSERT_EQ(NUM_CONVS, buffered.items);
+	ASSERT_TRUE(buffered.has_more);
+	ASSERT_GE(buffered.stats.body_max, body.size());
+
+	run(&streamed, body, false, true);
+	ASSERT_EQ(NUM_CONVS, streamed.items);
+	ASSERT_TRUE(streamed.has_more);
+	ASSERT_LE(streamed.ts_first, streamed.ts_resp);
+
+	/* only the envelope and one item are held at a time */
+	ASSERT_LT(streamed.stats.body_max, body.size() / 10);
+}
+
+
+#ifdef USE_ZLIB
+TEST_F(RestStream, gzip_items_are_streamed)
+{
+	const std::string body = conversation_list(NUM_CONVS);
+	const std::string gz = gzip(body);
+	struct stream_run buffered, streamed;
+
+	ASSERT_LT(gz.size(), body.size());
+
+	run(&buffered, gz, true, false);
+	ASSERT_EQ(NUM_CONVS, buffered.items);
+	ASSERT_TRUE(buffered.has_more);
+
+	run(&streamed, gz, true, true);
+	ASSERT_EQ(NUM_CONVS, streamed.items);
+	ASSERT_TRUE(streamed.has_more);
+	ASSERT_LT(streamed.stats.body_max, body.size() / 10);
+}
+#endif
+
+
+TEST(jstream, split_anywhere)
+{
+	static const char body[] =
+		"{\"conversations\": [{\"id\":\"a\","
+		"\"x\":[1,{\"y\":\"]}\\\"\"}]},"
+		" {\"id\":\"b\"} ,{\"id\":\"c\"}], \"has_more\":true}";
+	static const char env[] = "{\"conversations\": [], \"has_more\":true}";
+	const size_t len = str_len(body);
+
+	for (size_t step = 1; step <= len; step++) {
+		struct jstream *js;
+		struct mbuf *mb;
+		size_t n = 0;
+
+		ASSERT_EQ(0, jstream_alloc(&js, "conversations",
+					   [](struct json_object *jobj,
+					      void *arg) {
+						   ++*(size_t *)arg;
+					   }, &n));
+
+		for (size_t i = 0; i < len; i += step) {
+			ASSERT_EQ(0, jstream_write(js, (uint8_t *)&body[i],
+						   std::min(step, len - i)));
+		}
+
+		mb = jstream_envelope(js);
+		ASSERT_EQ(3, n);
+		ASSERT_EQ(3, jstream_count(js));
+		ASSERT_EQ(str_len(env), mb->end);
+		ASSERT_EQ(0, memcmp(env, mb->buf, mb->end));
+
+		mem_deref(js);
+	}
+}
+
+
+TEST(jstream, top_level_array)
+{
+	static const char body[] = "[{\"id\":1}, [2], {}]";
+	struct jstream *js;
+	size_t n = 0;
+
+	ASSERT_EQ(0, jstream_alloc(&js, NULL,
+				   [](struct json_object *jobj, void *arg) {
+					   ++*(size_t *)arg;
+				   }, &n));
+	ASSERT_EQ(0, jstream_write(js, (uint8_t *)body, str_len(body)));
+	ASSERT_EQ(3, n);
+	ASSERT_EQ(2, jstream_envelope(js)->end);
+	mem_deref(js);
+
+	/* scalar elements can not be handed out as objects */
+	ASSERT_EQ(0, jstream_alloc(&js, NULL,
+				   [](struct json_object *jobj, void *arg) {
+				   }, NULL));
+	ASSERT_EQ(EPROTO, jstream_write(js, (uint8_t *)"[1,2]", 5));
+	mem_deref(js);
+}
+
+
+TEST(jstream, bad_args)
+{
+	struct jstream *js;
+
+	ASSERT_EQ(EINVAL, jstream_alloc(NULL, NULL, NULL, NULL));
+	ASSERT_EQ(EINVAL, jstream_alloc(&js, "key", NULL, NULL));
+	ASSERT_EQ(EINVAL, jstream_write(NULL, NULL, 0));
+	ASSERT_EQ(EINVAL, rest_req_set_items(NULL, NULL, NULL));
+}
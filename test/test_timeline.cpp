@@ -0,0 +1,138 @@
+/*
+* Wire
+* Copyright (C) 2020 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <re.h>
+#include <avs.h>
+#include <gtest/gtest.h>
+
+
+#define T0 1000000  /* [us] */
+
+
+TEST(icall_timeline, first_mark_wins)
+{
+	struct icall_timeline tl;
+
+	memset(&tl, 0, sizeof(tl));
+
+	icall_timeline_mark_at(&tl, ICALL_PHASE_START, T0);
+	icall_timeline_mark_at(&tl, ICALL_PHASE_CONFIG_REQ, T0 + 2000);
+	icall_timeline_mark_at(&tl, ICALL_PHASE_CONFIG_RESP, T0 + 90000);
+	icall_timeline_mark_at(&tl, ICALL_PHASE_CONFIG_RESP, T0 + 500000);
+
+	ASSERT_EQ(0, icall_timeline_elapsed(&tl, ICALL_PHASE_START));
+	ASSERT_EQ(2, icall_timeline_elapsed(&tl, ICALL_PHASE_CONFIG_REQ));
+	ASSERT_EQ(90, icall_timeline_elapsed(&tl, ICALL_PHASE_CONFIG_RESP));
+	ASSERT_EQ(-1, icall_timeline_elapsed(&tl, ICALL_PHASE_DTLS_ESTAB));
+}
+
+
+TEST(icall_timeline, reset_starts_now)
+{
+	struct icall_timeline tl;
+
+	memset(&tl, 0, sizeof(tl));
+	icall_timeline_mark_at(&tl, ICALL_PHASE_DCE_ESTAB, T0);
+
+	uint64_t before = icall_timeline_now();
+	icall_timeline_reset(&tl);
+
+	ASSERT_GE(tl.tsv[ICALL_PHASE_START], before);
+	ASSERT_EQ(0, tl.tsv[ICALL_PHASE_DCE_ESTAB]);
+
+	icall_timeline_mark(&tl, ICALL_PHASE_LOCAL_SDP);
+	ASSERT_GE(icall_timeline_elapsed(&tl, ICALL_PHASE_LOCAL_SDP), 0);
+
+	/* nothing is reached before the start */
+	icall_timeline_mark_at(&tl, ICALL_PHASE_RTP_RECV, before - 1);
+	ASSERT_EQ(0, icall_timeline_elapsed(&tl, ICALL_PHASE_RTP_RECV));
+}
+
+
+TEST(icall_timeline, json)
+{
+	struct icall_timeline tl;
+	char *json = NULL;
+
+	memset(&tl, 0, sizeof(tl));
+
+	ASSERT_EQ(0, re_sdprintf(&json, "%H", icall_timeline_json, &tl));
+	ASSERT_STREQ("{}", json);
+	json = (char *)mem_deref(json);
+
+	icall_timeline_mark_at(&tl, ICALL_PHASE_START, T0);
+	icall_timeline_mark_at(&tl, ICALL_PHASE_SFT_REQ, T0 + 10000);
+	icall_timeline_mark_at(&tl, ICALL_PHASE_FRAME_DECRYPTED, T0 + 750000);
+
+	ASSERT_EQ(0, re_sdprintf(&json, "%H", icall_timeline_json, &tl));
+	ASSERT_STREQ("{\"sft_req\":10,\"frame_decrypted\":750}", json);
+	mem_deref(json);
+}
+
+
+TEST(icall_timeline, bad_args)
+{
+	struct icall_timeline tl;
+
+	memset(&tl, 0, sizeof(tl));
+
+	icall_timeline_mark(NULL, ICALL_PHASE_START);
+	icall_timeline_mark(&tl, ICALL_PHASE_MAX);
+	icall_timeline_mark_at(&tl, ICALL_PHASE_START, 0);
+	ASSERT_EQ(0, tl.tsv[ICALL_PHASE_START]);
+
+	ASSERT_EQ(-1, icall_timeline_elapsed(NULL, ICALL_PHASE_START));
+	ASSERT_EQ(-1, icall_timeline_elapsed(&tl, ICALL_PHASE_START));
+	ASSERT_STREQ("???", icall_phase_name(ICALL_PHASE_MAX));
+}
+
+
+TEST(icall_timeline, metrics)
+{
+	struct icall_timeline tl;
+	char *json = NULL;
+
+	memset(&tl, 0, sizeof(tl));
+	icall_timeline_mark_at(&tl, ICALL_PHASE_START, T0);
+	icall_timeline_mark_at(&tl, ICALL_PHASE_DCE_ESTAB, T0 + 420000);
+
+	/* no other metrics */
+	ASSERT_EQ(0, icall_timeline_metrics(&json, NULL, &tl));
+	ASSERT_STREQ("{\"setup_timeline\":{\"dce_estab\":420}}", json);
+	json = (char *)mem_deref(json);
+
+	/* merged into the metrics object */
+	ASSERT_EQ(0, icall_timeline_metrics(&json,
+					    "{\"rtt\":30,\"loss\":{\"u\":1}}\n",
+					    &tl));
+	ASSERT_STREQ("{\"rtt\":30,\"loss\":{\"u\":1},"
+		     "\"setup_timeline\":{\"dce_estab\":420}}", json);
+	json = (char *)mem_deref(json);
+
+	ASSERT_EQ(0, icall_timeline_metrics(&json, " { } ", &tl));
+	ASSERT_STREQ("{\"setup_timeline\":{\"dce_estab\":420}}", json);
+	json = (char *)mem_deref(json);
+
+	/* not an object, passed on unchanged */
+	ASSERT_EQ(0, icall_timeline_metrics(&json, "[1,2]", &tl));
+	ASSERT_STREQ("[1,2]", json);
+	json = (char *)mem_deref(json);
+
+	ASSERT_EQ(EINVAL, icall_timeline_metrics(NULL, NULL, &tl));
+	ASSERT_EQ(EINVAL, icall_timeline_metrics(&json, NULL, NULL));
+}
@@ -16,6 +16,7 @@
 * along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <pthread.h>
 #include <time.h>
 #include <re.h>
 #include <avs.h>
@@ -714,6 +715,71 @@ TEST(wcall, create_multiple)
 }
 
 
+/*
+ * Two instances on two shards, driven from two app threads at the
+ * same time. Each instance is created, used and destroyed on its
+ * own shard.
+ */
+struct shard_client {
+	const char *userid;
+	const char *clientid;
+	WUSER_HANDLE wuser;
+	int err;
+};
+
+
+static void *shard_client_thread(void *arg)
+{
+	struct shard_client *sc = (struct shard_client *)arg;
+
+	for (int i = 0; i < 20; i++) {
+		sc->wuser = wcall_create(sc->userid, sc->clientid,
+					 NULL, NULL, NULL, NULL, NULL, NULL,
+					 NULL, NULL, NULL, NULL, NULL, NULL);
+		if (sc->wuser == WUSER_INVALID_HANDLE) {
+			sc->err = ENOMEM;
+			break;
+		}
+
+		wcall_set_mute(sc->wuser, i & 1);
+		wcall_set_relay_ranking(sc->wuser, 0);
+
+		wcall_destroy(sc->wuser);
+	}
+
+	return NULL;
+}
+
+
+TEST(wcall, shards_concurrent)
+{
+	struct shard_client scv[2] = {
+		{"abc", "123", WUSER_INVALID_HANDLE, 0},
+		{"abd", "234", WUSER_INVALID_HANDLE, 0},
+	};
+	pthread_t tidv[2];
+	int err;
+
+	err = wcall_init(0);
+	ASSERT_EQ(0, err);
+
+	ASSERT_EQ(0, wcall_run_shards(2));
+
+	for (int i = 0; i < 2; i++) {
+		ASSERT_EQ(0, pthread_create(&tidv[i], NULL,
+					    shard_client_thread, &scv[i]));
+	}
+	for (int i = 0; i < 2; i++)
+		pthread_join(tidv[i], NULL);
+
+	wcall_stop_shards();
+	wcall_close();
+
+	ASSERT_EQ(0, scv[0].err);
+	ASSERT_EQ(0, scv[1].err);
+}
+
+
 #define NUM_CLIENTS 3
 
 
@@ -0,0 +1,263 @@
+/*
+* Wire
+* Copyright (C) 2016 Wire Swiss GmbH
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+/* tracemerge -- merge binary ecall traces into one timeline
+ *
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include "avs_econn.h"
+#include "avs_econn_fmt.h"
+#include "avs_ecall.h"
+
+
+struct merged_rec {
+	uint64_t ts;     /* absolute wallclock in [ms] */
+	unsigned file;
+	size_t seq;      /* position in the input, for a stable sort */
+	struct ecall_trace_rec rec;
+};
+
+
+static struct ecall_trace_hdr *filev;  /* one per input file */
+static size_t filec;
+static struct merged_rec *recordv;
+static size_t recordc;
+
+
+static void usage(void)
+{
+	(void)re_fprintf(stderr,
+			 "usage: tracemerge [-h] [-j] <trace> [<trace> ...]\n");
+	(void)re_fprintf(stderr, "\t-j             Output NDJSON\n");
+	(void)re_fprintf(stderr, "\t-h             Show options\n");
+}
+
+
+static void *array_grow(void *arr, size_t n, size_t sz)
+{
+	return arr ? mem_realloc(arr, n * sz) : mem_alloc(n * sz, NULL);
+}
+
+
+static int load_file(const char *path)
+{
+	struct ecall_trace_hdr *tf;
+	struct mbuf *mb = NULL;
+	uint16_t i;
+	uint8_t buf[4096];
+	size_t n;
+	FILE *fp;
+	int err = 0;
+
+	fp = fopen(path, "rb");
+	if (!fp) {
+		err = errno;
+		re_fprintf(stderr, "%s: %m\n", path, err);
+		return err;
+	}
+
+	mb = mbuf_alloc(sizeof(buf));
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		err = mbuf_write_mem(mb, buf, n);
+		if (err)
+			goto out;
+	}
+	mb->pos = 0;
+
+	tf = array_grow(filev, filec + 1, sizeof(*filev));
+	if (!tf) {
+		err = ENOMEM;
+		goto out;
+	}
+	filev = tf;
+	tf = &filev[filec];
+
+	err = ecall_trace_decode_hdr(mb, tf);
+	if (err == EPROTONOSUPPORT) {
+		re_fprintf(stderr, "%s: unsupported version\n", path);
+		goto out;
+	}
+	else if (err) {
+		re_fprintf(stderr, "%s: not an ecall trace, or truncated\n",
+			   path);
+		goto out;
+	}
+
+	if (tf->count) {
+		struct merged_rec *mr;
+
+		mr = array_grow(recordv, recordc + tf->count,
+				sizeof(*recordv));
+		if (!mr) {
+			err = ENOMEM;
+			goto out;
+		}
+		recordv = mr;
+	}
+
+	for (i = 0; i < tf->count; i++) {
+		struct merged_rec *mr = &recordv[recordc];
+
+		err = ecall_trace_decode_rec(mb, &mr->rec);
+		if (err)
+			goto out;
+
+		mr->seq = recordc++;
+		mr->ts = tf->start + mr->rec.ts;
+		mr->file = (unsigned)filec;
+	}
+
+	++filec;
+
+ out:
+	mem_deref(mb);
+	fclose(fp);
+
+	return err;
+}
+
+
+static int rec_cmp(const void *a, const void *b)
+{
+	const struct merged_rec *ra = a, *rb = b;
+
+	if (ra->ts != rb->ts)
+		return ra->ts < rb->ts ? -1 : 1;
+
+	/* keep records of the same file in their original order */
+	if (ra->file != rb->file)
+		return ra->file < rb->file ? -1 : 1;
+
+	return ra->seq < rb->seq ? -1 : (ra->seq > rb->seq);
+}
+
+
+static void print_text(void)
+{
+	const uint64_t t0 = recordc ? recordv[0].ts : 0;
+	size_t i;
+
+	for (i = 0; i < filec; i++) {
+		re_printf("[%zu] %s.%s  start=%llu  dropped=%u\n",
+			  i, filev[i].userid, filev[i].clientid,
+			  filev[i].start, filev[i].dropped);
+	}
+
+	for (i = 0; i < recordc; i++) {
+		const struct merged_rec *mr = &recordv[i];
+		const struct ecall_trace_hdr *tf = &filev[mr->file];
+		const bool tx = mr->rec.flags & ECALL_TRACE_TX;
+
+		re_printf("* %8.3fs  %s.%s  %s via %7s  %10s %-8s sess=%08x",
+			  .001 * (mr->ts - t0),
+			  tf->userid, tf->clientid,
+			  tx ? "send --->" : "recv <---",
+			  econn_transp_name(mr->rec.tp),
+			  econn_msg_name(mr->rec.msg_type),
+			  (mr->rec.flags & ECALL_TRACE_RESP) ?
+			  "Response" : "Request",
+			  mr->rec.sessid);
+
+		if (!tx && mr->rec.tp == ECONN_TRANSP_BACKEND)
+			re_printf("    age=%usec", mr->rec.age);
+
+		re_printf("\n");
+	}
+}
+
+
+static void print_ndjson(void)
+{
+	size_t i;
+
+	for (i = 0; i < recordc; i++) {
+		const struct merged_rec *mr = &recordv[i];
+		const struct ecall_trace_hdr *tf = &filev[mr->file];
+
+		re_printf("{\"ts\":%llu,\"userid\":\"%s\",\"clientid\":\"%s\","
+			  "\"dir\":\"%s\",\"tp\":\"%s\",\"type\":\"%s\","
+			  "\"resp\":%s,\"age\":%u,\"sess\":\"%08x\"}\n",
+			  mr->ts, tf->userid, tf->clientid,
+			  (mr->rec.flags & ECALL_TRACE_TX) ? "send" : "recv",
+			  econn_transp_name(mr->rec.tp),
+			  econn_msg_name(mr->rec.msg_type),
+			  (mr->rec.flags & ECALL_TRACE_RESP) ?
+			  "true" : "false",
+			  mr->rec.age, mr->rec.sessid);
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	bool ndjson = false;
+	int i, err = 0;
+
+	for (;;) {
+		const int c = getopt(argc, argv, "hj");
+		if (c < 0)
+			break;
+
+		switch (c) {
+
+		case 'j':
+			ndjson = true;
+			break;
+
+		case 'h':
+		default:
+			usage();
+			return 2;
+		}
+	}
+
+	if (optind >= argc) {
+		usage();
+		return 2;
+	}
+
+	for (i = optind; i < argc; i++) {
+		err = load_file(argv[i]);
+		if (err)
+			goto out;
+	}
+
+	if (recordc)
+		qsort(recordv, recordc, sizeof(*recordv), rec_cmp);
+
+	if (ndjson)
+		print_ndjson();
+	else
+		print_text();
+
+ out:
+	mem_deref(recordv);
+	mem_deref(filev);
+
+	return err ? 1 : 0;
+}
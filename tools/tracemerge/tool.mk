@@ -0,0 +1,15 @@
+#
+# tool.mk
+#
+
+TOOL		:= tracemerge
+tracemerge_SRCS	+= main.c
+
+tracemerge_CPPFLAGS := $(AVS_CPPFLAGS)
+tracemerge_CFLAGS := $(AVS_CFLAGS)
+tracemerge_LIBS	:= $(AVS_LIBS)
+tracemerge_DEPS := $(AVS_DEPS)
+tracemerge_LIB_FILES := $(AVS_STATIC)
+
+
+include mk/tool.mk
@@ -719,6 +719,11 @@ int main(int argc, char *argv[])
 
 	re_main(signal_handler);
 
+#ifdef HAVE_CRYPTOBOX
+	/* save before anything else is torn down */
+	cryptobox_flush(g_cryptobox);
+#endif
+
  out:
 	runloop_stop();
 	view_close();